@@ -0,0 +1,28 @@
+// Heap allocations counter (see physicsbench). The whole set of (non aligned)
+// allocation functions is replaced, in their own translation unit: the compiler can't
+// inline them in the library code and match a free against the standard operator new.
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> nbAllocations(0);
+
+size_t getNbHeapAllocations() { return nbAllocations; }
+
+void *operator new(size_t n) {
+	++nbAllocations;
+	if (void *p = malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void *operator new[](size_t n) { return operator new(n); }
+void *operator new(size_t n, const std::nothrow_t &) noexcept {
+	++nbAllocations;
+	return malloc(n ? n : 1);
+}
+void *operator new[](size_t n, const std::nothrow_t &t) noexcept { return operator new(n, t); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
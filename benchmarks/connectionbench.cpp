@@ -0,0 +1,119 @@
+// Already connected check in dense packings. Compares a linear search in the connected
+// cells list, a PointerSet lookup for every cell (whatever its degree) and
+// ConnectableCell::isConnectedTo, over the collision candidates that reach this check in
+// ConnectableCell::connection.
+// - lattice: cells on a compressed face centered cubic lattice. With the default
+//   compression each of them is connected to its 12 nearest neighbours.
+// - big cells: cells 6 times bigger than the default one, each covered by a shell of
+//   default cells, so that they have a lot more neighbours.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include "../mecacell/mecacell.h"
+
+using namespace MecaCell;
+using namespace std::chrono;
+
+class BenchCell : public ConnectableCell<BenchCell> {
+public:
+	using ConnectableCell<BenchCell>::ConnectableCell;
+	double getAdhesionWith(const BenchCell *) { return 0.9; }
+	BenchCell *updateBehavior(double) { return nullptr; }
+};
+using World = BasicWorld<BenchCell, Verlet>;
+
+template <typename F> double timeIt(int nbRuns, F &&f) {
+	auto t0 = steady_clock::now();
+	for (int i = 0; i < nbRuns; ++i) f();
+	return duration<double>(steady_clock::now() - t0).count() / nbRuns;
+}
+
+int bench(const char *name, World &w, int nbRuns) {
+	w.update();
+	size_t degree = 0, maxDegree = 0;
+	for (auto &c : w.cells) {
+		degree += c->getNbConnections();
+		maxDegree = max(maxDegree, static_cast<size_t>(c->getNbConnections()));
+	}
+	printf("%s: %zu cells, %zu connections, degree mean %.2f max %zu\n", name,
+	       w.cells.size(), w.connections.size(), static_cast<double>(degree) / w.cells.size(),
+	       maxDegree);
+
+	vector<pair<BenchCell *, BenchCell *>> candidates;
+	for (auto &c : w.cells)
+		w.getCellGrid().forEachNeighbour(c, [&](BenchCell *c2) {
+			double sql = c->getRadius() + c2->getRadius();
+			if (c2 != c && (c2->getPosition() - c->getPosition()).sqlength() <= sql * sql)
+				candidates.push_back(make_pair(c, c2));
+		});
+
+	// a set of connected cells for every cell, whatever its degree
+	unordered_map<const BenchCell *, PointerSet<BenchCell>> sets;
+	for (auto &c : w.cells)
+		for (auto &o : c->getConnectedCells()) sets[c].insert(o);
+	vector<const PointerSet<BenchCell> *> candidateSets;
+	for (const auto &p : candidates) candidateSets.push_back(&sets[p.first]);
+
+	size_t found = 0, foundAllSets = 0, foundSet = 0;
+	double tFind = timeIt(nbRuns, [&]() {
+		for (const auto &p : candidates) {
+			const auto &connected = p.first->getConnectedCells();
+			found += find(connected.begin(), connected.end(), p.second) != connected.end();
+		}
+	});
+	double tAllSets = timeIt(nbRuns, [&]() {
+		for (size_t i = 0; i < candidates.size(); ++i)
+			foundAllSets += candidateSets[i]->contains(candidates[i].second);
+	});
+	double tSet = timeIt(nbRuns, [&]() {
+		for (const auto &p : candidates) foundSet += p.first->isConnectedTo(p.second);
+	});
+	if (found != foundSet || found != foundAllSets) {
+		printf("error: linear search and sets disagree (%zu vs %zu vs %zu)\n", found,
+		       foundAllSets, foundSet);
+		return 1;
+	}
+	printf("  %zu checks: linear search %.3f ms, set only %.3f ms, isConnectedTo %.3f ms\n",
+	       candidates.size(), tFind * 1e3, tAllSets * 1e3, tSet * 1e3);
+	printf("  world update: %.3f ms\n", timeIt(nbRuns, [&]() { w.update(); }) * 1e3);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int side = argc > 1 ? atoi(argv[1]) : 16; // nb of lattice cubes / big cells per side
+	int nbRuns = argc > 2 ? atoi(argv[2]) : 20;
+	// distance between nearest neighbours on the lattice, in cell radius. By default the
+	// next ones are at 2.26 radius (not connected)
+	double nn = argc > 3 ? atof(argv[3]) : 1.6;
+	const double r = DEFAULT_CELL_RADIUS;
+
+	World lattice;
+	double a = nn * r * sqrt(2.0);
+	const Vec basis[4] = {Vec(0, 0, 0), Vec(0.5, 0.5, 0), Vec(0.5, 0, 0.5), Vec(0, 0.5, 0.5)};
+	for (int i = 0; i < side; ++i)
+		for (int j = 0; j < side; ++j)
+			for (int k = 0; k < side; ++k)
+				for (const auto &b : basis) lattice.addCell(new BenchCell((Vec(i, j, k) + b) * a));
+	if (bench("lattice", lattice, nbRuns)) return 1;
+
+	World bigCells;
+	const double bigRadius = 6.0 * r;
+	const int nbShellCells = 400; // points of a fibonacci sphere
+	int nbBig = max(1, side / 4);
+	for (int i = 0; i < nbBig; ++i)
+		for (int j = 0; j < nbBig; ++j)
+			for (int k = 0; k < nbBig; ++k) {
+				Vec center = Vec(i, j, k) * (4.0 * bigRadius);
+				BenchCell *big = new BenchCell(center);
+				big->setRadius(bigRadius);
+				bigCells.addCell(big);
+				for (int s = 0; s < nbShellCells; ++s) {
+					double y = 1.0 - 2.0 * (s + 0.5) / nbShellCells;
+					double phi = s * M_PI * (3.0 - sqrt(5.0));
+					Vec dir(cos(phi) * sqrt(1.0 - y * y), y, sin(phi) * sqrt(1.0 - y * y));
+					bigCells.addCell(new BenchCell(center + dir * (bigRadius + 0.8 * r)));
+				}
+			}
+	return bench("big cells", bigCells, nbRuns);
+}
@@ -0,0 +1,54 @@
+// A DistributedWorld over the MPI ranks (a single rank when built without MPI):
+// a random packing of cells, 8 times longer along x than along y and z, created on
+// rank 0 then spread over the ranks by the first updates. Rank 0 prints one JSON line:
+// time per update, global nb of cells and ghosts, load imbalance (max / mean owned
+// cells) and migrations per frame.
+// usage: mpirun -np <nb of ranks> distributedbench [nb of cells (default 20000)]
+//        [frames (default 20)]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../mecacell/mecacell.h"
+
+using namespace MecaCell;
+using namespace std::chrono;
+
+class BenchCell : public ConnectableCell<BenchCell> {
+public:
+	using ConnectableCell<BenchCell>::ConnectableCell;
+	double getAdhesionWith(const BenchCell *) { return 0.9; }
+	BenchCell *updateBehavior(double) { return nullptr; }
+};
+
+int main(int argc, char **argv) {
+	MPICommunicator comm(&argc, &argv);
+	size_t n = argc > 1 ? atoi(argv[1]) : 20000;
+	int nbFrames = argc > 2 ? atoi(argv[2]) : 20;
+	DistributedWorld<BenchCell, Verlet> w(comm);
+	if (comm.rank() == 0) {
+		std::default_random_engine rnd(1);
+		const double r = DEFAULT_CELL_RADIUS;
+		double side = cbrt(n * (4.0 / 3.0) * M_PI * r * r * r / (0.6 * 64.0));
+		std::uniform_real_distribution<double> dist(0, side);
+		for (size_t i = 0; i < n; ++i)
+			w.addCell(new BenchCell(Vec(8.0 * dist(rnd), dist(rnd), dist(rnd))));
+	}
+	for (int f = 0; f < 5; ++f) w.update();
+	size_t migrations0 = w.getNbMigrations();
+	auto t0 = steady_clock::now();
+	for (int f = 0; f < nbFrames; ++f) w.update();
+	double t = duration<double>(steady_clock::now() - t0).count();
+	t = comm.allReduce(t, ReduceOp::max);
+	double owned = static_cast<double>(w.getNbOwnedCells());
+	double maxOwned = comm.allReduce(owned, ReduceOp::max);
+	double cells = comm.allReduce(owned, ReduceOp::sum);
+	double ghosts = comm.allReduce(static_cast<double>(w.getNbGhostCells()), ReduceOp::sum);
+	double migrations =
+	    comm.allReduce(static_cast<double>(w.getNbMigrations() - migrations0), ReduceOp::sum);
+	if (comm.rank() == 0)
+		printf("{\"ranks\": %d, \"mpi\": %s, \"cells\": %.0f, \"ghosts\": %.0f, "
+		       "\"msPerUpdate\": %.4f, \"imbalance\": %.3f, \"migrationsPerFrame\": %.1f}\n",
+		       comm.size(), mpiAvailable() ? "true" : "false", cells, ghosts,
+		       1e3 * t / nbFrames, maxOwned * comm.size() / cells, migrations / nbFrames);
+	return 0;
+}
@@ -0,0 +1,111 @@
+// Orientation representations (see MECACELL_QUATERNIONS in quaternion.h).
+// - kernels: joint direction updates and orientation integration steps, with the
+//   axis-angle Rotation path and with the quaternion path, in the same binary
+// - world: a packing of spinning cells run with the representation this binary was
+//   built with (orientationbench: Rotation, orientationbench_quat: quaternions)
+// usage: orientationbench [nb of cells (default 10000)] [frames (default 20)]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../mecacell/mecacell.h"
+
+using namespace MecaCell;
+using namespace std::chrono;
+
+class BenchCell : public ConnectableCell<BenchCell> {
+public:
+	using ConnectableCell<BenchCell>::ConnectableCell;
+	double getAdhesionWith(const BenchCell *) { return 0.9; }
+	BenchCell *updateBehavior(double) { return nullptr; }
+};
+
+template <typename F> double timeIt(F &&f) {
+	auto t0 = steady_clock::now();
+	f();
+	return duration<double>(steady_clock::now() - t0).count();
+}
+
+Vec randomUnit(std::default_random_engine &rnd) {
+	std::normal_distribution<double> d(0, 1);
+	return Vec(d(rnd), d(rnd), d(rnd)).normalized();
+}
+
+void kernels(size_t n) {
+	std::default_random_engine rnd(1);
+	std::uniform_real_distribution<double> angle(0, M_PI);
+	vector<Rotation<Vec>> rot(n), r(n);
+	vector<Basis<Vec>> basis(n);
+	vector<Quaternion> qRot(n), qR(n);
+	for (size_t i = 0; i < n; ++i) {
+		rot[i] = Rotation<Vec>(randomUnit(rnd), angle(rnd));
+		r[i] = Rotation<Vec>(randomUnit(rnd), angle(rnd));
+		basis[i].updateWithRotation(rot[i]);
+		qRot[i] = Quaternion(rot[i].teta, rot[i].n);
+		qR[i] = Quaternion(r[i].teta, r[i].n);
+	}
+	// joint direction, as Joint::updateDirection
+	vector<Vec> dirR(n), dirQ(n);
+	double tDirR = timeIt([&]() {
+		for (size_t i = 0; i < n; ++i) dirR[i] = basis[i].X.rotated(r[i].rotated(rot[i]));
+	});
+	double tDirQ = timeIt([&]() {
+		for (size_t i = 0; i < n; ++i) dirQ[i] = (qRot[i] * qR[i]) * Vec(1, 0, 0);
+	});
+	double maxDiff = 0;
+	for (size_t i = 0; i < n; ++i) maxDiff = max(maxDiff, (dirR[i] - dirQ[i]).length());
+	// orientation integration, as Orientable::addAngularDisplacement
+	const Vec d(0.01, -0.02, 0.005);
+	const int nbSteps = 10;
+	double tIntR = timeIt([&]() {
+		for (int s = 0; s < nbSteps; ++s)
+			for (size_t i = 0; i < n; ++i) {
+				rot[i] = rot[i] + d;
+				basis[i].updateWithRotation(rot[i]);
+			}
+	});
+	double tIntQ = timeIt([&]() {
+		for (int s = 0; s < nbSteps; ++s)
+			for (size_t i = 0; i < n; ++i) {
+				double a = d.length();
+				qRot[i] = (Quaternion(a, d / a) * qRot[i]).normalized();
+				basis[i] = Basis<Vec>((qRot[i] * Vec(1, 0, 0)).normalized(),
+				                      (qRot[i] * Vec(0, 1, 0)).normalized());
+			}
+	});
+	printf("{\"scenario\": \"kernels\", \"n\": %zu, \"jointDirectionNs\": {\"rotation\": %.2f, "
+	       "\"quaternion\": %.2f}, \"orientationStepNs\": {\"rotation\": %.2f, "
+	       "\"quaternion\": %.2f}, \"maxDirectionDifference\": %.3g}\n",
+	       n, 1e9 * tDirR / n, 1e9 * tDirQ / n, 1e9 * tIntR / (n * nbSteps),
+	       1e9 * tIntQ / (n * nbSteps), maxDiff);
+}
+
+void world(size_t n, int nbFrames) {
+	std::default_random_engine rnd(2);
+	BasicWorld<BenchCell, Verlet> w;
+	const double r = DEFAULT_CELL_RADIUS;
+	double side = cbrt(n * (4.0 / 3.0) * M_PI * r * r * r / 0.6);
+	std::uniform_real_distribution<double> dist(0, side);
+	for (size_t i = 0; i < n; ++i) {
+		BenchCell *c = new BenchCell(Vec(dist(rnd), dist(rnd), dist(rnd)));
+		c->setAngularVelocity(randomUnit(rnd) * 2.0);
+		w.addCell(c);
+	}
+	w.update();
+	double t = timeIt([&]() {
+		for (int f = 0; f < nbFrames; ++f) w.update();
+	});
+	double spin = 0;
+	for (auto &c : w.cells) spin += c->getOrientation().X.dot(Vec(1, 0, 0));
+	printf("{\"scenario\": \"world\", \"orientation\": \"%s\", \"cells\": %zu, "
+	       "\"connections\": %zu, \"msPerUpdate\": %.4f, \"meanX.x\": %.6f}\n",
+	       MECACELL_QUATERNIONS ? "quaternion" : "rotation", w.cells.size(),
+	       w.connections.size(), 1e3 * t / nbFrames, spin / w.cells.size());
+}
+
+int main(int argc, char **argv) {
+	size_t n = argc > 1 ? atoi(argv[1]) : 10000;
+	int nbFrames = argc > 2 ? atoi(argv[2]) : 20;
+	kernels(1000000);
+	world(n, nbFrames);
+	return 0;
+}
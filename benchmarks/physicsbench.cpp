@@ -0,0 +1,184 @@
+// Reproducible scenarios run through BasicWorld<Cell, Verlet>, one JSON object per line:
+// - packing: random packings of 1k, 10k and 100k cells relaxing (100k also with fused
+//   passes, see BasicWorld::setFusedPasses), 10k also through the host compute backend
+//   (see BasicWorld::setComputeBackend)
+// - colony: a few cells growing and dividing
+// - grown: a colony timed after many divisions, with and without the locality reordering
+//   of the cells (see BasicWorld::setLocalityReordering)
+// - mesh: cells falling and settling on a plane Model
+// - lattice: a tissue at rest (timed after a long relaxation), with and without sleeping
+//   cells (see BasicWorld::setSleeping)
+// For each scenario: time per update and per update phase, heap allocations per frame,
+// cells x steps per second, memory per cell and per connection (see
+// BasicWorld::getCellsBytes) and the world's profiling counters per frame.
+// usage: physicsbench [frames scale (default 1)] [scenario name filter]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#define MECACELL_PROFILING 1
+#include "../mecacell/mecacell.h"
+
+using namespace MecaCell;
+using namespace std::chrono;
+
+// nb of heap allocations since the start (see allocationcounter.cpp)
+size_t getNbHeapAllocations();
+
+class BenchCell : public ConnectableCell<BenchCell> {
+public:
+	using ConnectableCell<BenchCell>::ConnectableCell;
+	double growth = 0; // relative volume gained per update (colony)
+	double getAdhesionWith(const BenchCell *) { return 0.9; }
+	BenchCell *updateBehavior(double) {
+		if (growth <= 0) return nullptr;
+		grow(growth);
+		if (getRelativeVolume() < 2.0) return nullptr;
+		BenchCell *c = divide();
+		c->growth = growth;
+		return c;
+	}
+};
+
+typedef BasicWorld<BenchCell, Verlet> BenchWorld;
+
+void seedAll(unsigned int s) {
+	srand(s);
+	globalRand.seed(s);
+}
+
+// runs nbFrames timed updates (after nbWarmUps untimed ones) and prints the results
+void run(const string &scenario, BenchWorld &w, int nbFrames, int nbWarmUps = 2) {
+	for (int i = 0; i < nbWarmUps; ++i) w.update();
+	w.resetProfileStats();
+	size_t cellSteps = 0;
+	size_t allocs0 = getNbHeapAllocations();
+	auto t0 = steady_clock::now();
+	for (int i = 0; i < nbFrames; ++i) {
+		cellSteps += w.cells.size();
+		w.update();
+	}
+	double t = duration<double>(steady_clock::now() - t0).count();
+	size_t allocs = getNbHeapAllocations() - allocs0;
+	size_t nbModelConnections = 0;
+	for (auto &c : w.cells) nbModelConnections += c->getRWModelConnections().size();
+	printf("{\"scenario\": \"%s\", \"frames\": %d, \"cells\": %zu, \"connections\": %zu, "
+	       "\"modelConnections\": %zu, \"msPerUpdate\": %.4f, \"allocationsPerFrame\": %.1f, "
+	       "\"cellStepsPerSecond\": %.0f, \"bytesPerCell\": %.0f, "
+	       "\"bytesPerConnection\": %.0f, \"msPerPhase\": {",
+	       scenario.c_str(), nbFrames, w.cells.size(), w.connections.size(), nbModelConnections,
+	       1e3 * t / nbFrames, static_cast<double>(allocs) / nbFrames, cellSteps / t,
+	       static_cast<double>(w.getCellsBytes()) / max<size_t>(1, w.cells.size()),
+	       static_cast<double>(w.getConnectionsBytes()) /
+	           max<size_t>(1, w.connections.size()));
+	const auto &p = w.getProfileStats();
+	for (size_t i = 0; i < ProfileStats::NB_PHASES; ++i)
+		printf("%s\"%s\": %.4f", i ? ", " : "", profilePhaseName(static_cast<ProfilePhase>(i)),
+		       1e3 * p.seconds[i] / nbFrames);
+	printf("}, \"countersPerFrame\": {");
+	for (size_t i = 0; i < ProfileStats::NB_COUNTERS; ++i)
+		printf("%s\"%s\": %.1f", i ? ", " : "",
+		       profileCounterName(static_cast<ProfileCounter>(i)),
+		       static_cast<double>(p.counters[i]) / nbFrames);
+	printf("}}\n");
+	fflush(stdout);
+}
+
+// n cells in a cube, at a 0.6 volume fraction
+void packing(size_t n, int nbFrames, bool fused = false, bool backend = false) {
+	seedAll(1);
+	BenchWorld w;
+	w.setFusedPasses(fused);
+	if (backend) w.setComputeBackend(new HostBackend());
+	const double r = DEFAULT_CELL_RADIUS;
+	double side = cbrt(n * (4.0 / 3.0) * M_PI * r * r * r / 0.6);
+	std::uniform_real_distribution<double> dist(0, side);
+	for (size_t i = 0; i < n; ++i)
+		w.addCell(new BenchCell(Vec(dist(globalRand), dist(globalRand), dist(globalRand))));
+	string name = "packing" + std::to_string(n) + (fused ? "fused" : "");
+	run(name + (backend ? "backend" : ""), w, nbFrames);
+}
+
+void colony(int nbFrames) {
+	seedAll(2);
+	BenchWorld w;
+	for (int i = 0; i < 8; ++i) {
+		BenchCell *c = new BenchCell(Vec::randomUnit() * 60.0);
+		c->growth = 0.03 + 0.01 * (i % 3);
+		w.addCell(c);
+	}
+	run("colony", w, nbFrames);
+}
+
+void grown(int nbFrames, bool reordering) {
+	seedAll(5);
+	BenchWorld w;
+	if (reordering) w.setLocalityReordering(20);
+	for (int i = 0; i < 64; ++i) {
+		BenchCell *c = new BenchCell(Vec::randomUnit() * 200.0);
+		c->growth = 0.02 + 0.005 * (i % 3);
+		w.addCell(c);
+	}
+	run(reordering ? "grownreordered" : "grown", w, nbFrames, 220);
+}
+
+void mesh(int nbFrames) {
+	seedAll(3);
+	const char *path = "physicsbench_plane.obj";
+	{
+		const int n = 20;
+		std::ofstream obj(path);
+		obj << "vn 0 1 0\n";
+		for (int i = 0; i <= n; ++i)
+			for (int j = 0; j <= n; ++j)
+				obj << "v " << i * 100 - 1000 << " 0 " << j * 100 - 1000 << "\n";
+		for (int i = 0; i < n; ++i)
+			for (int j = 0; j < n; ++j) {
+				int a = i * (n + 1) + j + 1, b = a + n + 1;
+				obj << "f " << a << "//1 " << b << "//1 " << b + 1 << "//1\n";
+				obj << "f " << a << "//1 " << b + 1 << "//1 " << a + 1 << "//1\n";
+			}
+	}
+	BenchWorld w;
+	w.setG(Vec(0, -20, 0));
+	w.addModel("plane", path);
+	std::uniform_real_distribution<double> dist(-900, 900);
+	for (int i = 0; i < 1000; ++i)
+		w.addCell(new BenchCell(Vec(dist(globalRand), 50 + (dist(globalRand) + 900) * 0.2,
+		                            dist(globalRand))));
+	run("mesh", w, nbFrames);
+	std::remove(path);
+}
+
+// 10 x 10 x 8 cells, slightly compressed
+void lattice(int nbFrames, bool sleeping) {
+	seedAll(4);
+	BenchWorld w;
+	w.setSleeping(sleeping);
+	std::uniform_real_distribution<double> dist(-1, 1);
+	for (int i = 0; i < 800; ++i)
+		w.addCell(new BenchCell(Vec(66.0 * (i % 10) + dist(globalRand),
+		                            66.0 * (i / 10 % 10) + dist(globalRand),
+		                            66.0 * (i / 100) + dist(globalRand))));
+	run(sleeping ? "latticesleeping" : "lattice", w, nbFrames, 1500);
+}
+
+int main(int argc, char **argv) {
+	double scale = argc > 1 ? atof(argv[1]) : 1.0;
+	string filter = argc > 2 ? argv[2] : "";
+	auto frames = [&](int f) { return max(1, static_cast<int>(f * scale)); };
+	auto selected = [&](const string &s) { return s.find(filter) != string::npos; };
+	if (selected("packing1000")) packing(1000, frames(100));
+	if (selected("packing10000")) packing(10000, frames(20));
+	if (selected("packing10000backend")) packing(10000, frames(20), false, true);
+	if (selected("packing100000")) packing(100000, frames(3));
+	if (selected("packing100000fused")) packing(100000, frames(3), true);
+	if (selected("colony")) colony(frames(150));
+	if (selected("grown")) grown(frames(30), false);
+	if (selected("grownreordered")) grown(frames(30), true);
+	if (selected("mesh")) mesh(frames(100));
+	if (selected("lattice")) lattice(frames(100), false);
+	if (selected("latticesleeping")) lattice(frames(100), true);
+	return 0;
+}
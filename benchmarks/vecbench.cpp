@@ -0,0 +1,82 @@
+// Vector3D arithmetic inlined or not (see MECACELL_INLINE_VEC in vector3D.h). Built twice:
+// vecbench with the header-only operations, vecbench_outofline with the ones compiled in
+// vector3D.cpp, so that every vector operation is a call.
+// - Connection::computeForces over the connections of a compressed face centered cubic
+//   lattice (springs, flex & torsion joints).
+// - spring lengths & directions computed from an array of endpoints, gathered as
+//   Vector3D or as PaddedVector3D (4 aligned doubles).
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../mecacell/mecacell.h"
+#include "../mecacell/paddedvector.hpp"
+
+using namespace MecaCell;
+using namespace std::chrono;
+
+class BenchCell : public ConnectableCell<BenchCell> {
+public:
+	using ConnectableCell<BenchCell>::ConnectableCell;
+	double getAdhesionWith(const BenchCell *) { return 0.9; }
+	BenchCell *updateBehavior(double) { return nullptr; }
+};
+using World = BasicWorld<BenchCell, Verlet>;
+
+template <typename F> double timeIt(int nbRuns, F &&f) {
+	auto t0 = steady_clock::now();
+	for (int i = 0; i < nbRuns; ++i) f();
+	return duration<double>(steady_clock::now() - t0).count() / nbRuns;
+}
+
+// sum of the spring forces along x, for the endpoints pairs (p[2i], p[2i+1])
+template <typename V> double springs(const V *p, size_t n, double l, double k) {
+	double res = 0;
+	for (size_t i = 0; i < n; ++i) {
+		const V d = p[2 * i + 1] - p[2 * i];
+		const double len = d.length();
+		res += len > 0 ? (d / len).x * (-k * (len - l)) : 0;
+	}
+	return res;
+}
+
+int main(int argc, char **argv) {
+	int side = argc > 1 ? atoi(argv[1]) : 16; // nb of lattice cubes per side
+	int nbRuns = argc > 2 ? atoi(argv[2]) : 50;
+	const double r = DEFAULT_CELL_RADIUS;
+	printf("vector operations %s\n", MECACELL_INLINE_VEC ? "inlined" : "out of line");
+
+	World w;
+	const double a = 1.6 * r * sqrt(2.0);
+	const Vec basis[4] = {Vec(0, 0, 0), Vec(0.5, 0.5, 0), Vec(0.5, 0, 0.5), Vec(0, 0.5, 0.5)};
+	for (int i = 0; i < side; ++i)
+		for (int j = 0; j < side; ++j)
+			for (int k = 0; k < side; ++k)
+				for (const auto &b : basis) w.addCell(new BenchCell((Vec(i, j, k) + b) * a));
+	w.update();
+	const double dt = w.getDt();
+	printf("%zu cells, %zu connections\n", w.cells.size(), w.connections.size());
+	double tForces = timeIt(nbRuns, [&]() {
+		for (auto &con : w.connections) con->computeForces(dt);
+	});
+	printf("  computeForces: %.3f ms (%.1f ns per connection)\n", tForces * 1e3,
+	       tForces * 1e9 / w.connections.size());
+
+	vector<Vec> ends;
+	vector<PaddedVec, AlignedAllocator<PaddedVec>> paddedEnds;
+	for (auto &con : w.connections) {
+		ends.push_back(con->getNode0()->getPosition());
+		ends.push_back(con->getNode1()->getPosition());
+	}
+	for (const auto &e : ends) paddedEnds.push_back(e);
+	const size_t n = w.connections.size();
+	double s = 0, sPadded = 0;
+	double tVec = timeIt(nbRuns, [&]() { s += springs(ends.data(), n, 2.0 * r, 1.0); });
+	double tPadded =
+	    timeIt(nbRuns, [&]() { sPadded += springs(paddedEnds.data(), n, 2.0 * r, 1.0); });
+	if (s != sPadded) {
+		printf("error: Vec and PaddedVec springs disagree (%g vs %g)\n", s, sPadded);
+		return 1;
+	}
+	printf("  gathered springs: Vec %.3f ms, PaddedVec %.3f ms\n", tVec * 1e3, tPadded * 1e3);
+	return 0;
+}
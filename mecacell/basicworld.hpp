@@ -1,23 +1,75 @@
 #ifndef MECACELL_WORLD_H
 #define MECACELL_WORLD_H
 #include <deque>
+#include <functional>
 #include <vector>
 #include <algorithm>
 #include <map>
 #include <cstdlib>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include "checkpoint.hpp"
+#include "computebackend.hpp"
 #include "connection.h"
 #include "grid.hpp"
+#include "flatgrid.hpp"
+#include "integrators.hpp"
 #include "model.h"
 #include "modelconnection.hpp"
+#include "morton.hpp"
+#include "pointerset.hpp"
+#include "profiling.hpp"
+#include "springkernel.hpp"
+#include "sweepandprune.hpp"
+#include "threadpool.hpp"
+#include "trace.hpp"
 
 using namespace std;
 namespace MecaCell {
-template <typename Cell, typename Integrator> class BasicWorld {
+// GridType is the spatial hash used for the cells and the models broad phase, either
+// FlatGrid (contiguous, refilled each frame without allocations) or Grid
+// (unordered_map of buckets). The cells can use a sweep and prune instead (see
+// setBroadPhase)
+template <typename Cell, typename Integrator, template <typename> class GridType = FlatGrid>
+class BasicWorld {
+public:
+	using cell_type = Cell;
+	using integrator_type = Integrator;
+	using grid_type = GridType<Cell *>;
+	using modelGrid_type = GridType<std::pair<Model *, unsigned int>>;
+	using connect_type = Connection<Cell *>;
+	using model_type = Model;
+	using modelConnect_type = CellModelConnection<Cell>;
 
 protected:
 	Integrator updateCellPos;
 
 	double dt = 1.0 / 50.0;
+	double simulatedTime = 0; // sum of the updates' dt
+
+	// dt adapted after each update (see setAdaptiveDt)
+	bool adaptiveDt = false;
+	double minDt = 1.0 / 500.0, maxDt = 1.0;
+	double springSafety = 1.0; // max dt x fastest connection rate
+	double cfl = 0.05;         // max displacement of a cell per update, in cell radii
+	// per thread maxima of the adaptive dt's reductions
+	vector<pair<double, double>> adaptiveDtMaxima;
+
+	// resting cells put to sleep (see setSleeping)
+	bool sleeping = false;
+	unsigned int nbRestingFramesBeforeSleep = 20;
+	double sleepMaxSpeed = 0.05 * DEFAULT_CELL_RADIUS;
+	double sleepMaxAngularSpeed = 0.3;
+	double sleepMaxAcceleration = 0.125 * DEFAULT_CELL_RADIUS; // net force / mass
+	vector<char> sleepTransitions; // 1: falls asleep, 2: wakes up (see updateSleep)
+
+	// cells sorted along a space filling curve (see setLocalityReordering)
+	unsigned int reorderingPeriod = 0; // 0: never
+	double reorderingDegradation = 1.5;
+	double sortedIndexGap = 0; // mean connection index gap right after the last sort
+	vector<pair<uint64_t, Cell *>> mortonKeys;
+	unordered_map<const Cell *, size_t> cellIndex; // reused from one sort to another
 
 	// current update ID
 	int frame = 0;
@@ -25,12 +77,25 @@ protected:
 	// list of cells having commited apoptosis
 	vector<Cell *> cellsToDestroy;
 
-	// hashmap containing cells
-	Grid<Cell *> grid = Grid<Cell *>(5.0 * DEFAULT_CELL_RADIUS);
+	// cell - cell collisions broad phase (see setBroadPhase)
+	BroadPhase broadPhase = BroadPhase::grid;
+	// hashmap containing cells (only filled with the grid broad phase)
+	grid_type grid = grid_type(5.0 * DEFAULT_CELL_RADIUS);
+	// cells sorted along an axis (only filled with the sweep and prune broad phase)
+	SweepAndPrune<Cell *> sweep;
 
-	// model grid containting pair<model_ptr, face_id>
-	Grid<std::pair<Model *, unsigned int>> modelGrid =
-	    Grid<std::pair<Model *, unsigned int>>(100);
+	// model grid containting pair<model_ptr, face_id>. Only used for display: collisions
+	// use each model's bvh. It is rebuilt on demand (see getModelGrid)
+	modelGrid_type modelGrid = modelGrid_type(100);
+	bool modelGridDirty = true;
+
+	// cell grid updated incrementally (see setIncrementalGrid)
+	bool incrementalGrid = false;
+	// models loaded through a binary mesh cache (see setModelCache)
+	bool modelCache = false;
+	// false if cells were added or removed since the last fill (of the grid or the sweep)
+	bool cellGridFilled = false;
+	size_t cellGridSize = 0; // nb of cells in the grid
 
 	// enabled collisions
 	bool cellCellCollisions = true;
@@ -43,12 +108,68 @@ protected:
 	// threshold (dot product) above which we consider two connections to be merged
 	const double MIN_CONNECTION_SIMILARITY = 0.8;
 
+	// parallel update (see setNbThreads). nullptr means everything runs serially
+	unique_ptr<ThreadPool> pool;
+	// connections split in batches in which no two connections share a cell, so that a
+	// whole batch can compute its forces concurrently. The last one holds the leftovers
+	// that have to be computed serially.
+	static const size_t NB_FORCE_BATCHES = 64;
+	vector<vector<connect_type *>> forceBatches;
+	bool batchedForces = false; // see setBatchedForces
+	// per cell potential collisions, gathered concurrently before the connections are
+	// created serially
+	vector<vector<Cell *>> collisionCandidates;
+	// faces potentially colliding with the current cell (reused from one cell to another)
+	vector<std::pair<Model *, unsigned int>> modelCandidates;
+
+	// diagnostics, only recorded when compiled with MECACELL_TRACE
+	TraceSink traceSink;
+	// per phase timings and counters, only updated when compiled with MECACELL_PROFILING
+	ProfileStats profileStats;
+
+	// called at the end of each update (see addUpdateHook)
+	vector<std::function<void(BasicWorld &)>> updateHooks;
+
+	// background writes of the checkpoints (see saveCheckpoint)
+	AsyncFileWriter checkpointWriter;
+
+	// cells' positions at the beginning of an update made of several substeps: their
+	// prevposition is set back to it after the substeps (see update)
+	vector<Vec> updateStartPositions;
+
+	// structure of arrays copy of the cells' kinematic state (see setSoAIntegration)
+	bool soaIntegration = false;
+	KinematicState kinematics;
+
+	// behaviours updated concurrently (see setParallelBehavior)
+	bool parallelBehavior = false;
+	// cells born in the current wave of behaviour updates, one buffer per thread (see
+	// updateBehavior)
+	vector<vector<Cell *>> birthBuffers;
+	// incremented by each cell - model collision check (see checkForCellModellCollisions)
+	uint64_t contactGeneration = 0;
+
+	// where the substeps run (see setComputeBackend). nullptr: in the world
+	unique_ptr<ComputeBackend> computeBackend;
+	DeviceBuffers deviceBuffers;
+
+	// fewer passes over the cells and connections (see setFusedPasses)
+	bool fusedPasses = false;
+	// connections found too long by updateConnectionsLengthAndDirection (fused passes)
+	vector<char> connectionTooLong;
+
+	// key of the cells' random streams (see setRandomSeed). Unless set, it is drawn from
+	// globalRand at the first behaviour update: seeding globalRand before running the
+	// world still makes runs reproducible
+	uint64_t randomSeed = 0;
+	bool randomSeedSet = false;
+	uint64_t nextCellId = 0; // id of the next added cell
+	uint64_t cellIdStride = 1;
+	PointerSet<Cell> liveCells; // the content of cells (see getCell)
+
 public:
-	using cell_type = Cell;
-	using integrator_type = Integrator;
-	using connect_type = Connection<Cell *>;
-	using model_type = Model;
-	using modelConnect_type = CellModelConnection<Cell>;
+	// connections are allocated from this pool
+	ObjectPool<connect_type> connectionPool;
 
 	// OMG raw pointers! :o
 	vector<connect_type *> connections;
@@ -59,48 +180,333 @@ public:
 	// all models are stored in this map, using their name as the key
 	unordered_map<string, Model> models;
 
-	// cells to models connections are stored in a double map model* -> cell*
-	unordered_map<Model *,
-	              unordered_map<Cell *, vector<unique_ptr<CellModelConnection<Cell>>>>>
-	    cellModelConnections;
+	// cells to models connections, listed by their cells too (see CellModelContacts)
+	CellModelContacts<Cell> cellModelConnections;
 
 	/**********************************************
 	 *                 GET & SET                  *
 	 *********************************************/
 	Vec getG() const { return g; }
 	void setG(const Vec &v) { g = v; }
-	const Grid<Cell *> &getCellGrid() { return grid; }
-	const Grid<pair<Model *, unsigned int>> &getModelGrid() { return modelGrid; }
+	// empty with the sweep and prune broad phase
+	const grid_type &getCellGrid() { return grid; }
+	const SweepAndPrune<Cell *> &getCellSweep() const { return sweep; }
+	// first cell accepted by accept(cell) along the ray origin + t * dir, t in [0, maxT]:
+	// through the grid buckets the ray crosses (see Grid::rayCast), or all the cells
+	// with the sweep and prune broad phase
+	template <typename A>
+	bool rayCast(const Vec &origin, const Vec &dir, double maxT, A &&accept, Cell *&hit,
+	             double &hitT) const {
+		if (broadPhase == BroadPhase::grid)
+			return grid.rayCast(origin, dir, maxT, accept, hit, hitT);
+		bool found = false;
+		hitT = maxT;
+		for (const auto &c : cells) {
+			double t;
+			if (raySphere(origin, dir, c->getPosition(), c->getRadius(), t) && t <= hitT &&
+			    (!found || t < hitT) && accept(c)) {
+				hit = c;
+				hitT = t;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	// identifies a cell, which can then be checked for still being in the world in
+	// constant time, without holding a possibly dangling pointer to it (see getCell)
+	struct CellHandle {
+		Cell *cell = nullptr;
+		uint64_t id = 0;
+	};
+	CellHandle getHandle(Cell *c) const {
+		CellHandle h;
+		h.cell = c;
+		h.id = c ? c->getId() : 0;
+		return h;
+	}
+	// the handle's cell if it is still in the world, nullptr otherwise. The id tells
+	// apart a new cell allocated at the address of a deleted one
+	Cell *getCell(const CellHandle &h) const {
+		if (!h.cell || !liveCells.contains(h.cell) || h.cell->getId() != h.id) return nullptr;
+		return h.cell;
+	}
+	const modelGrid_type &getModelGrid() {
+		if (modelGridDirty) {
+			modelGrid.clear();
+			for (auto &m : models) insertInGrid(m.second);
+			modelGrid.build();
+			modelGridDirty = false;
+		}
+		return modelGrid;
+	}
+	TraceSink &getTraceSink() { return traceSink; }
+	// always zero unless compiled with MECACELL_PROFILING
+	const ProfileStats &getProfileStats() const { return profileStats; }
+	void resetProfileStats() { profileStats.reset(); }
 	double getViscosityCoef() const { return viscosityCoef; }
 	void setViscosityCoef(const double d) { viscosityCoef = d; }
 
+	// number of threads used by update(). With more than one thread, forces,
+	// integration, connections updates and collision detection are split across a
+	// thread pool. Results do not depend on the number of threads, but the forces are
+	// not summed in the same order as with the serial update.
+	void setNbThreads(size_t n) {
+		if (n <= 1)
+			pool.reset();
+		else if (!pool)
+			pool.reset(new ThreadPool(n));
+		else
+			pool->resize(n);
+	}
+	size_t getNbThreads() const { return pool ? pool->size() : 1; }
+
+	// when enabled, the cell grid isn't cleared and refilled at each update: only the cells
+	// covering different grid cells are moved. An update then costs one span check per
+	// cell plus the patching of the buckets the moved cells leave and enter, instead of
+	// rehashing and sorting every cell's grid cells. It is still refilled after births and
+	// deaths. With a FlatGrid, the results are the same as without the incremental mode.
+	// It pays off when few cells change grid cells per update: with 100k cells, it is
+	// about 10x faster than a refill when 1% of them move, but about 2x slower when all do.
+	void setIncrementalGrid(bool i) { incrementalGrid = i; }
+	bool getIncrementalGrid() const { return incrementalGrid; }
+	// how the cells interpenetrating each other are found:
+	// - BroadPhase::grid (default): the cells are hashed in the cell grid, whose fixed
+	//   cell size suits cells of similar radii
+	// - BroadPhase::sweepAndPrune: the cells are kept sorted along an axis from one update
+	//   to the next (see SweepAndPrune). Better for cells of very different radii (or
+	//   radii far from the grid's cell size)
+	// Both find the same interpenetrating pairs, but not in the same order: as a new
+	// connection depends on the cells' existing ones, results can differ slightly.
+	void setBroadPhase(BroadPhase b) {
+		if (b == broadPhase) return;
+		broadPhase = b;
+		grid.clear();
+		sweep.clear();
+		cellGridFilled = false;
+	}
+	BroadPhase getBroadPhase() const { return broadPhase; }
+	// when enabled, addModel saves each model's mesh in a binary file next to its OBJ file
+	// and loads it from there on later runs (see ObjModel)
+	void setModelCache(bool c) { modelCache = c; }
+	bool getModelCache() const { return modelCache; }
+
+	// when enabled, connections forces are computed by batches (as they always are with
+	// more than one thread), with the springs evaluated by packs by
+	// computeSpringForces. Results are then the same as with any number of threads.
+	void setBatchedForces(bool b) { batchedForces = b; }
+	bool getBatchedForces() const { return batchedForces || pool; }
+
+	// with a backend (owned by the world, nullptr to go back to the default), the
+	// substeps of each update run on its resident buffers (see computebackend.hpp):
+	// - once per update, in the world: the joints, cell - model contacts, friction and
+	//   gravity forces and torques, which then stay constant over the substeps
+	// - at each substep, on the backend: the springs' forces, by force batches, then
+	//   the Verlet integration of the awake cells
+	// Only for Verlet based integrators (Verlet, MultiRate<Verlet>), the others ignore
+	// the backend. Results don't depend on the nb of threads, but they differ from the
+	// default update, in which the joints are recomputed at each substep.
+	// Only HostBackend, on the cpu, is provided: the interface is there for device
+	// backends but none ships with MecaCell.
+	void setComputeBackend(ComputeBackend *b) { computeBackend.reset(b); }
+	ComputeBackend *getComputeBackend() const { return computeBackend.get(); }
+
+	// when enabled (and supported by the integrator), cells are integrated by chunks:
+	// their kinematic state is gathered in contiguous arrays, integrated with vectorized
+	// loops and written back. Results are the same as the per cell integration.
+	// No-op (stays disabled) when the integrator has no batch version (see
+	// hasBatchIntegration)
+	void setSoAIntegration(bool s) {
+		soaIntegration = s && hasBatchIntegration<Integrator>::value;
+	}
+	bool getSoAIntegration() const { return soaIntegration; }
+
+	// The cells array is kept in insertion and birth order: after many divisions,
+	// neighbouring cells are scattered in memory. When enabled, every period updates,
+	// the mean gap between the indices of connected cells is measured and, if it grew
+	// beyond degradation x its value after the last sort, the cells are sorted along a
+	// Z-order curve of their positions and the connections by their cells' indices
+	// (see reorderCells). The order of the cells, and thus the results, differ from a
+	// world without reordering.
+	void setLocalityReordering(unsigned int period, double degradation = 1.5) {
+		reorderingPeriod = period;
+		reorderingDegradation = degradation;
+		sortedIndexGap = 0;
+	}
+
+	// when enabled, the per cell and per connection work of an update is done in fewer
+	// passes: friction and gravity are applied just before each cell's integration, the
+	// connections too long to survive are spotted while their length is updated and the
+	// forces are reset along with the cells' stats. Results are the same as without it.
+	void setFusedPasses(bool f) { fusedPasses = f; }
+	bool getFusedPasses() const { return fusedPasses; }
+
+	// when enabled, dt is chosen after each update, within [min, max], from:
+	// - the connections' rates: sqrt(k / m) and c / m for each spring, with m the reduced
+	//   mass of its two nodes. dt x the fastest rate stays below the spring safety coef
+	//   (times the nb of substeps of a MultiRate integrator, see integrators.hpp)
+	// - the cells' speeds: no cell should move by more than cfl x DEFAULT_CELL_RADIUS
+	// dt shrinks at once but only grows by 25% per update. See getDt, getSimulatedTime
+	void setAdaptiveDt(bool a, double minD = 1.0 / 500.0, double maxD = 1.0) {
+		adaptiveDt = a;
+		minDt = minD;
+		maxDt = max(minD, maxD);
+	}
+	void setAdaptiveDtCoefs(double safety, double c) {
+		springSafety = safety;
+		cfl = c;
+	}
+	bool getAdaptiveDt() const { return adaptiveDt; }
+
+	// when enabled, a cell whose speed, angular speed and acceleration (net force / mass)
+	// stay below the sleep thresholds for nbFrames updates falls asleep: it isn't
+	// integrated any more, and neither the forces of its connections with other sleeping
+	// cells nor its model contacts are computed. It acts as a fixed obstacle for its
+	// awake neighbours. It wakes up when a connected awake cell moves faster than the
+	// speed threshold, when its connections change (new collision, deleted connection,
+	// growth or division) or when a model is moved (see ConnectableCell::wakeUp)
+	void setSleeping(bool s, unsigned int nbFrames = 20) {
+		sleeping = s;
+		nbRestingFramesBeforeSleep = nbFrames;
+		if (!s)
+			for (auto &c : cells) c->wakeUp();
+	}
+	void setSleepThresholds(double speed, double angularSpeed, double acceleration) {
+		sleepMaxSpeed = speed;
+		sleepMaxAngularSpeed = angularSpeed;
+		sleepMaxAcceleration = acceleration;
+	}
+	bool getSleeping() const { return sleeping; }
+	size_t getNbSleepingCells() const {
+		size_t n = 0;
+		for (auto &c : cells) n += c->isAsleep();
+		return n;
+	}
+
+	// when enabled, the cells' updateBehavior are called concurrently (with more than one
+	// thread). They must then only modify their own cell: the connections sizes updates
+	// of grow/divide are postponed and applied serially afterwards, and the newborns are
+	// collected in per thread buffers. What behaviours read from other cells should come
+	// from their published state (see ConnectableCell::publishState), copied before each
+	// wave of updates. Random draws should come from the cells' own streams (see
+	// setRandomSeed), not from globalRand. Results then don't depend on the number of
+	// threads.
+	void setParallelBehavior(bool p) { parallelBehavior = p; }
+	bool getParallelBehavior() const { return parallelBehavior; }
+
+	// Before its behaviour update, each cell's random stream (used by divide(), see
+	// ConnectableCell::getRandomStream) restarts at the draws of (seed, cell id, frame):
+	// no shared generator, and the same draws whatever the nb of threads or the order
+	// of the updates.
+	void setRandomSeed(uint64_t s) {
+		randomSeed = s;
+		randomSeedSet = true;
+	}
+	uint64_t getRandomSeed() {
+		if (!randomSeedSet)
+			setRandomSeed((static_cast<uint64_t>(globalRand()) << 32) ^ globalRand());
+		return randomSeed;
+	}
+
+	// calls f(i) for every i in [0, n), concurrently when a thread pool is available
+	template <typename F> void parallelFor(size_t n, F &&f) {
+		if (pool)
+			pool->parallelFor(n, f);
+		else
+			for (size_t i = 0; i < n; ++i) f(i);
+	}
+
 	/**********************************************
 	 *             MAIN UPDATE ROUTINE            *
 	 *********************************************/
 	void update() {
+		if (reorderingPeriod > 0 && frame % reorderingPeriod == 0 && cells.size() > 1 &&
+		    meanConnectionIndexGap() > reorderingDegradation * sortedIndexGap)
+			reorderCells();
 		if (cells.size() > 0) {
-			computeForces();
-			updatePositionsAndOrientations();
-			if (cellModelCollisions) {
+			// the connections forces and the integration run at the integrator's substeps
+			// (see MultiRate), everything else once per update
+			const unsigned int nbSubsteps = max(1u, getNbSubsteps(updateCellPos));
+			const double h = dt / nbSubsteps;
+			if (nbSubsteps > 1) {
+				updateStartPositions.resize(cells.size());
+				parallelFor(cells.size(),
+				            [&](size_t i) { updateStartPositions[i] = cells[i]->getPosition(); });
+			}
+			if (computeBackend && std::is_base_of<Verlet, Integrator>::value)
+				runBackendSubsteps(nbSubsteps, h);
+			else
+				for (unsigned int s = 0; s < nbSubsteps; ++s) {
+					if (s > 0) clearForces();
+					{
+						MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::forces);
+						computeForces(h);
+					}
+					{
+						MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::integration);
+						updatePositionsAndOrientations(h);
+					}
+				}
+			// the cell - model contacts are matched against the whole update's
+			// displacement, not the last substep's (the integrators only set the
+			// prevposition of the cells they move)
+			if (nbSubsteps > 1)
+				parallelFor(cells.size(), [&](size_t i) {
+					Cell *c = cells[i];
+					if (c->isMovementEnabled() && !c->isAsleep())
+						c->setPrevposition(updateStartPositions[i]);
+				});
+			{
+				MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::modelCollisions);
 				updateModelGrid();
-				checkForCellModellCollisions();
+				if (cellModelCollisions) checkForCellModellCollisions();
 			}
 			if (cellCellCollisions) {
-				grid.clear();
-				for (const auto &c : cells)
-					grid.insert(c);
-				updateConnectionsLengthAndDirection();
-				cellCollisions();
-				deleteImpossibleConnections();
+				{
+					MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::cellGrid);
+					updateBroadPhase();
+				}
+				{
+					MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::connectionsUpdate);
+					updateConnectionsLengthAndDirection();
+				}
+				{
+					MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::cellCollisions);
+					cellCollisions();
+				}
+				{
+					MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::connectionsDeletion);
+					deleteImpossibleConnections();
+				}
+			}
+			{
+				MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::behavior);
+				updateBehavior();
 			}
-			updateBehavior();
-			destroyCells();
-			updateStats();
-			resetForces();
+			{
+				MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::deaths);
+				destroyCells();
+			}
+			{
+				MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::stats);
+				updateStats(); // and, with fused passes, the sleep tests
+				if (sleeping) updateSleep();
+				resetForces();
+			}
+			simulatedTime += dt;
+			if (adaptiveDt) adaptDt();
 		}
+#if MECACELL_PROFILING
+		++profileStats.nbUpdates;
+#endif
 		++frame;
+		for (auto &h : updateHooks) h(*this);
 	}
 
+	// h(world) is called at the end of each update, after the frame counter is
+	// incremented (see TrajectoryWriter::attach)
+	void addUpdateHook(std::function<void(BasicWorld &)> h) { updateHooks.push_back(h); }
+
 	/**********************************************
 	 *             UPDATE SUBROUTINES             *
 	 *********************************************/
@@ -109,101 +515,368 @@ public:
 	 *           FORCES           *
 	 ******************************/
 
+	// with fused passes, the sleep tests are done here too: they need the forces, which
+	// are reset right after
 	void updateStats() {
-		for (auto &c : cells) {
-			c->updateStats();
+		if (fusedPasses) {
+			if (sleeping) sleepTransitions.assign(cells.size(), 0);
+			parallelFor(cells.size(), [&](size_t i) {
+				cells[i]->updateStats();
+				if (sleeping) sleepTest(i);
+				cells[i]->resetForce();
+				cells[i]->resetTorque();
+			});
+		} else {
+			parallelFor(cells.size(), [&](size_t i) { cells[i]->updateStats(); });
 		}
 	}
 
+	// whether the i-th cell should fall asleep or wake up, from its state before any
+	// transition (reads its forces and its neighbours' velocities)
+	void sleepTest(size_t i) {
+		const double sqSpeed = sleepMaxSpeed * sleepMaxSpeed;
+		const double sqAngularSpeed = sleepMaxAngularSpeed * sleepMaxAngularSpeed;
+		Cell *c = cells[i];
+		if (c->isAsleep()) {
+			for (auto &n : c->getConnectedCells())
+				if (!n->isAsleep() && n->getVelocity().sqlength() > sqSpeed) {
+					sleepTransitions[i] = 2;
+					break;
+				}
+		} else {
+			const double maxForce = sleepMaxAcceleration * c->getMass();
+			bool resting = c->getVelocity().sqlength() <= sqSpeed &&
+			               c->getAngularVelocity().sqlength() <= sqAngularSpeed &&
+			               c->getForce().sqlength() <= maxForce * maxForce;
+			unsigned int &f = c->getRestingFrames();
+			f = resting ? f + 1 : 0;
+			if (f >= nbRestingFramesBeforeSleep) sleepTransitions[i] = 1;
+		}
+	}
+
+	// sleep transitions, decided from the state before any of them (the result
+	// doesn't depend on the nb of threads)
+	void updateSleep() {
+		if (!fusedPasses) { // otherwise tested by updateStats, before the forces reset
+			sleepTransitions.assign(cells.size(), 0);
+			parallelFor(cells.size(), [&](size_t i) { sleepTest(i); });
+		}
+		for (size_t i = 0; i < cells.size(); ++i) {
+			if (sleepTransitions[i] == 1) cells[i]->fallAsleep();
+			if (sleepTransitions[i] == 2) cells[i]->wakeUp();
+		}
+		MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::sleepingCells,
+		                       getNbSleepingCells());
+	}
+	static bool bothAsleep(connect_type *con) {
+		return con->getNode0()->isAsleep() && con->getNode1()->isAsleep();
+	}
+
 	void setDt(double d) { dt = d; }
+	double getDt() const { return dt; }
+	double getSimulatedTime() const { return simulatedTime; }
 
-	void computeForces() {
+	// next update's dt (see setAdaptiveDt). Maxima are order independent: the result
+	// doesn't depend on the nb of threads
+	void adaptDt() {
+		adaptiveDtMaxima.assign(pool ? pool->size() : 1, make_pair(0.0, 0.0));
+		auto rate = [](Spring &s, double invMass) {
+			return max(sqrt(s.k * invMass), s.c * invMass);
+		};
+		auto kernel = [&](size_t first, size_t last, size_t t) {
+			double &r = adaptiveDtMaxima[t].first, &v = adaptiveDtMaxima[t].second;
+			for (size_t i = first; i < last; ++i) {
+				Cell *c = cells[i];
+				const double invMass = 1.0 / c->getMass();
+				// each connection is seen from both of its cells, with the same result
+				for (auto &con : c->getRWConnections())
+					r = max(r, rate(con->getSc(), 1.0 / con->getNode0()->getMass() +
+					                                  1.0 / con->getNode1()->getMass()));
+				for (auto &cmc : c->getRWModelConnections()) // models don't move
+					r = max(r, max(rate(cmc->anchor.getSc(), invMass),
+					               rate(cmc->bounce.getSc(), invMass)));
+				v = max(v, c->getVelocity().length());
+			}
+		};
+		if (pool)
+			pool->parallelForChunks(cells.size(), kernel);
+		else
+			kernel(0, cells.size(), 0);
+		double r = 0, v = 0;
+		for (const auto &m : adaptiveDtMaxima) r = max(r, m.first), v = max(v, m.second);
+		double d = min(maxDt, dt * 1.25);
+		if (r > 0) d = min(d, springSafety * getNbSubsteps(updateCellPos) / r);
+		if (v > 0) d = min(d, cfl * DEFAULT_CELL_RADIUS / v);
+		dt = max(minDt, d);
+	}
+
+	// e.g. the nb of substeps of a MultiRate integrator
+	Integrator &getIntegrator() { return updateCellPos; }
+
+	// greedy partition of the connections into batches of independent connections
+	void batchConnections() {
+		forceBatches.resize(NB_FORCE_BATCHES + 1);
+		for (auto &b : forceBatches) b.clear();
+		for (auto &c : cells) c->getForceBatches() = 0;
+		for (auto &con : connections) {
+			if (bothAsleep(con)) continue;
+			uint64_t &b0 = con->getNode0()->getForceBatches();
+			uint64_t &b1 = con->getNode1()->getForceBatches();
+			uint64_t used = b0 | b1;
+			size_t b = 0;
+			while (b < NB_FORCE_BATCHES && (used & (uint64_t(1) << b))) ++b;
+			if (b < NB_FORCE_BATCHES) {
+				b0 |= uint64_t(1) << b;
+				b1 |= uint64_t(1) << b;
+			}
+			forceBatches[b].push_back(con);
+		}
+	}
+
+	// forces for a step of length h
+	void computeForces(double h) {
 		// connections
-		for (auto &con : connections)
-			con->computeForces(dt);
-		for (auto &m : cellModelConnections) {
-			// model* -> cell* -> vec<connection>
-			for (auto &c : m.second) {
-				for (auto &cmc : c.second) {
-					cmc->computeForces(dt);
-				}
+		if (getBatchedForces()) {
+			batchConnections();
+			for (size_t b = 0; b < NB_FORCE_BATCHES; ++b) {
+				auto &batch = forceBatches[b];
+				auto kernel = [&](size_t first, size_t last, size_t) {
+					computeSpringForces(batch.data() + first, last - first, h);
+				};
+				if (pool)
+					pool->parallelForChunks(batch.size(), kernel);
+				else
+					kernel(0, batch.size(), 0);
 			}
+			for (auto &con : forceBatches[NB_FORCE_BATCHES]) con->computeForces(h);
+		} else {
+			for (auto &con : connections)
+				if (!bothAsleep(con)) con->computeForces(h);
 		}
+		for (auto &cmc : cellModelConnections)
+			if (!cmc.getCell()->isAsleep()) cmc.computeForces(h);
 
-		for (auto &c : cells) {
-			// friction
-			c->receiveForce(-6.0 * M_PI * viscosityCoef * c->getRadius() * c->getVelocity());
-			// gravity
-			c->receiveForce(g);
+		if (!fusedPasses)
+			parallelFor(cells.size(), [&](size_t i) {
+				if (!cells[i]->isAsleep()) applyFrictionAndGravity(*cells[i]);
+			});
+	}
+
+	// the substeps on the compute backend (see setComputeBackend). The connections are
+	// uploaded batch by batch
+	void runBackendSubsteps(unsigned int n, double h) {
+		DeviceBuffers &b = deviceBuffers;
+		{
+			MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::forces);
+			batchConnections();
+			b.batches.assign(1, 0);
+			for (auto &batch : forceBatches)
+				b.batches.push_back(b.batches.back() + batch.size());
+			b.resize(cells.size(), b.batches.back());
+			parallelFor(cells.size(), [&](size_t i) { cells[i]->getBufferIndex() = i; });
+			// the joints, concurrently within a batch
+			auto joints = [&](size_t k, size_t i) {
+				connect_type *con = forceBatches[k][i];
+				con->updateLengthDirection();
+				con->computeJointForces();
+				const Spring &sc = con->getSc();
+				size_t j = b.batches[k] + i;
+				b.node0[j] = static_cast<uint32_t>(con->getNode0()->getBufferIndex());
+				b.node1[j] = static_cast<uint32_t>(con->getNode1()->getBufferIndex());
+				b.k[j] = sc.k;
+				b.c[j] = sc.c;
+				b.l[j] = sc.l;
+				b.minLengthRatio[j] = sc.minLengthRatio;
+				b.prevLength[j] = sc.prevLength;
+				b.springEnabled[j] = con->scEnabled;
+			};
+			for (size_t k = 0; k < NB_FORCE_BATCHES; ++k)
+				parallelFor(forceBatches[k].size(), [&](size_t i) { joints(k, i); });
+			for (size_t i = 0; i < forceBatches[NB_FORCE_BATCHES].size(); ++i)
+				joints(NB_FORCE_BATCHES, i);
+			for (auto &cmc : cellModelConnections)
+				if (!cmc.getCell()->isAsleep()) cmc.computeForces(dt);
+			parallelFor(cells.size(), [&](size_t i) {
+				Cell *c = cells[i];
+				if (!c->isAsleep()) applyFrictionAndGravity(*c);
+				b.cells.gather(i, *c);
+				b.cells.movable[i] = c->isMovementEnabled() && !c->isAsleep();
+				b.efx[i] = b.cells.fx[i];
+				b.efy[i] = b.cells.fy[i];
+				b.efz[i] = b.cells.fz[i];
+				b.etf[i] = c->getTotalForce();
+			});
 		}
+		MECACELL_PROFILE_SCOPE(profileStats, ProfilePhase::integration);
+		computeBackend->upload(b);
+		computeBackend->runSubsteps(n, h);
+		computeBackend->download(b);
+		parallelFor(cells.size(), [&](size_t i) {
+			Cell *c = cells[i];
+			b.cells.scatter(i, *c);
+			c->setForce(Vec(b.cells.fx[i], b.cells.fy[i], b.cells.fz[i]));
+			c->setTotalForce(b.tf[i]);
+			c->markAsNotTested();
+		});
+		for (size_t k = 0; k <= NB_FORCE_BATCHES; ++k)
+			parallelFor(forceBatches[k].size(), [&](size_t i) {
+				Spring &sc = forceBatches[k][i]->getSc();
+				size_t j = b.batches[k] + i;
+				sc.length = b.length[j];
+				sc.direction = Vec(b.dx[j], b.dy[j], b.dz[j]);
+				sc.prevLength = b.prevLength[j];
+			});
 	}
 
-	void resetForces() {
-		for (auto cIt = cells.begin(); cIt < cells.end(); ++cIt) {
-			(*cIt)->resetForce();
-			(*cIt)->resetTorque();
+	void applyFrictionAndGravity(Cell &c) {
+		// friction
+		c.receiveForce(-6.0 * M_PI * viscosityCoef * c.getRadius() * c.getVelocity());
+		// gravity
+		c.receiveForce(g);
+	}
+
+	void updateBroadPhase() {
+		if (broadPhase == BroadPhase::grid) {
+			updateCellGrid();
+		} else if (!cellGridFilled || cellGridSize != cells.size()) {
+			sweep.rebuild(cells);
+			cellGridFilled = true;
+			cellGridSize = cells.size();
+		} else {
+			sweep.update();
 		}
 	}
 
+	void updateCellGrid() {
+		bool refill = !incrementalGrid || !cellGridFilled || cellGridSize != cells.size();
+		for (size_t i = 0; !refill && i < cells.size(); ++i) {
+#if MECACELL_PROFILING
+			GridSpan before = cells[i]->getGridSpan();
+#endif
+			grid.update(cells[i], cells[i]->getGridSpan());
+			MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::gridInserts,
+			                       !before.sameBounds(cells[i]->getGridSpan()));
+		}
+		if (refill) {
+			MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::gridInserts, cells.size());
+			grid.clear();
+			for (const auto &c : cells) grid.insert(c, c->getGridSpan());
+			cellGridFilled = true;
+			cellGridSize = cells.size();
+		}
+		grid.build();
+	}
+
+	void resetForces() {
+		if (fusedPasses) return; // done by updateStats
+		clearForces();
+	}
+	void clearForces() {
+		parallelFor(cells.size(), [&](size_t i) {
+			cells[i]->resetForce();
+			cells[i]->resetTorque();
+		});
+	}
+
 	void applyGravity() {
 		for (auto cIt = cells.begin(); cIt < cells.end(); ++cIt)
 			(*cIt)->receiveForce(g * (*cIt)->getMass());
 	}
 
 	void updateConnectionsLengthAndDirection() {
-		for (auto &c : connections) {
-			double contactSurface =
-			    M_PI *
-			    (pow(c->getSc().length, 2) +
-			     pow((c->getNode0()->getRadius() + c->getNode1()->getRadius()) / 2.0, 2));
+		if (fusedPasses) connectionTooLong.assign(connections.size(), 0);
+		parallelFor(connections.size(), [&](size_t i) {
+			connect_type *c = connections[i];
+			if (bothAsleep(c)) { // nothing moved
+				if (fusedPasses) connectionTooLong[i] = tooLong(c);
+				return;
+			}
+			double l = c->getSc().length;
+			double r = (c->getNode0()->getRadius() + c->getNode1()->getRadius()) / 2.0;
+			double contactSurface = M_PI * (l * l + r * r);
 			c->getFlex().first.setCurrentKCoef(contactSurface);
 			c->getFlex().second.setCurrentKCoef(contactSurface);
 			c->getTorsion().first.setCurrentKCoef(contactSurface);
 			c->getTorsion().second.setCurrentKCoef(contactSurface);
 			c->updateLengthDirection();
-		}
+			// same test as deleteImpossibleConnections (neither the lengths nor the radii
+			// change in between)
+			if (fusedPasses) connectionTooLong[i] = tooLong(c);
+		});
 	}
 
-	void updatePositionsAndOrientations() {
-		for (auto cIt = cells.begin(); cIt < cells.end(); ++cIt) {
-			Cell *c = *cIt;
-			updateCellPos(*c, dt);
-			c->markAsNotTested();
-		}
+	// integration step of length h
+	void updatePositionsAndOrientations(double h) {
+		if (soaIntegration)
+			integrateChunks(
+			    h, std::integral_constant<bool, hasBatchIntegration<Integrator>::value>());
+		else
+			parallelFor(cells.size(), [&](size_t i) {
+				Cell *c = cells[i];
+				if (!c->isAsleep()) {
+					if (fusedPasses) applyFrictionAndGravity(*c);
+					updateCellPos(*c, h);
+				}
+				c->markAsNotTested();
+			});
 	}
 
+	void integrateChunks(double h, std::true_type) {
+		// chunks small enough for their state to stay in cache between the three passes
+		const size_t CHUNK_SIZE = 256;
+		kinematics.resize(cells.size());
+		size_t nbChunks = (cells.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		parallelFor(nbChunks, [&](size_t k) {
+			size_t b = k * CHUNK_SIZE, e = min(b + CHUNK_SIZE, cells.size());
+			// only the awake cells are gathered, packed at the beginning of the chunk
+			size_t awake[CHUNK_SIZE];
+			size_t n = b;
+			for (size_t i = b; i < e; ++i) {
+				cells[i]->markAsNotTested();
+				if (cells[i]->isAsleep()) continue;
+				if (fusedPasses) applyFrictionAndGravity(*cells[i]);
+				awake[n - b] = i;
+				kinematics.gather(n++, *cells[i]);
+			}
+			updateCellPos(kinematics, h, b, n);
+			for (size_t j = b; j < n; ++j) kinematics.scatter(j, *cells[awake[j - b]]);
+		});
+	}
+	void integrateChunks(double, std::false_type) {} // never enabled, see setSoAIntegration
+
 	/******************************
 	 *           MODELS           *
 	 ******************************/
+	// the file's mesh is shared with the other models (of any world) loaded from it, see
+	// Mesh::load
 	void addModel(const string &name, const string &path) {
-		models.emplace(name, path);
+		addModel(name, Mesh::load(path, modelCache));
+	}
+	// an instance of an already loaded mesh, only its transformation is the world's own
+	void addModel(const string &name, std::shared_ptr<const Mesh> mesh) {
+		models.emplace(std::piecewise_construct, std::forward_as_tuple(name),
+		               std::forward_as_tuple(mesh));
 		models.at(name).name = name;
+		modelGridDirty = true;
 	}
 	void removeModel(const string &name) {
 		if (models.count(name)) {
+			Model *m = &models.at(name);
+			const size_t nbContacts = cellModelConnections.size();
+			cellModelConnections.removeIf([&](modelConnect_type &cmc) { return cmc.model == m; });
+			if (cellModelConnections.size() < nbContacts)
+				MECACELL_TRACE_EVENT(traceSink, TraceEvent::modelRemoved);
 			models.erase(name);
 		}
-		if (cellModelConnections.count(name)) {
-			cerr << "deleting stuff" << endl;
-			for (auto &c : cellModelConnections.at(name)) {
-				for (auto &conn : c.second) {
-					c.first->removeModelConnection(conn.second.get());
-				}
-			}
-			cerr << "ok" << endl;
-			cellModelConnections.erase(name);
-		}
-		modelGrid.clear();
-		for (auto &m : models) {
-			insertInGrid(m.second);
-		}
+		modelGridDirty = true;
 	}
 
 	void insertInGrid(Model &m) {
-		for (size_t i = 0; i < m.faces.size(); ++i) {
-			auto &f = m.faces[i];
-			modelGrid.insert({&m, i}, m.vertices[f.indices[0]], m.vertices[f.indices[1]],
-			                 m.vertices[f.indices[2]]);
+		const auto &faces = m.getFaces();
+		for (size_t i = 0; i < faces.size(); ++i) {
+			auto &f = faces[i];
+			modelGrid.insert({&m, i}, m.getVertex(f.indices[0]), m.getVertex(f.indices[1]),
+			                 m.getVertex(f.indices[2]));
 		}
 	}
 
@@ -211,202 +884,284 @@ public:
 	 *         COLLISIONS         *
 	 ******************************/
 	void updateModelGrid() {
-		bool modelChange = false;
 		for (auto &m : models) {
 			if (m.second.changedSinceLastCheck()) {
-				modelChange = true;
+				modelGridDirty = true;
+				if (sleeping)
+					for (auto &c : cells) c->wakeUp();
 			}
 		}
-		if (modelChange) {
-			modelGrid.clear();
-			for (auto &m : models) {
-				insertInGrid(m.second);
-			}
+	}
+
+	// faces of any model whose bounding box intersects c's one, sorted
+	// (bvh queries are done in the models' space, see Model::toObject)
+	void retrieveModelCandidates(const Cell *c) {
+		modelCandidates.clear();
+		for (auto &m : models) {
+			const Model &md = m.second;
+			md.getBVH().forEachFace(md.toObject(c->getPosition()),
+			                        md.toObjectRadius(c->getRadius()), [&](unsigned int f) {
+				                        modelCandidates.push_back(std::make_pair(&m.second, f));
+				                      });
 		}
+		sort(modelCandidates.begin(), modelCandidates.end());
 	}
 
 	void checkForCellModellCollisions() {
-		// first, we set all connections to dirty
-		for (auto &m : cellModelConnections) {
-			for (auto &c : m.second) {
-				for (auto &conn : c.second) {
-					conn->dirty = true;
-				}
-			}
-		}
+		// the contacts found again are marked with this generation, the others are deleted
+		// at the end (but the sleeping cells' ones)
+		const uint64_t generation = ++contactGeneration;
 		for (auto &c : cells) {
+			if (c->isAsleep()) continue;
 			// for each cell, we find if a cell - model collision is possible.
-			auto toTest = modelGrid.retrieveUnique(c->getPosition(), c->getRadius());
-			for (const auto &mf : toTest) {
-				cerr << GREY << "+----------------------------------------------------+" << NORMAL
-				     << endl;
-				cerr << " potential collision between cell " << c << " and model "
-				     << mf.first->name << endl;
+			retrieveModelCandidates(c);
+			for (const auto &mf : modelCandidates) {
 				// for each pair <model*, faceId> mf potentially colliding with c
-				const Vec &p0 = mf.first->vertices[mf.first->faces[mf.second].indices[0]];
-				const Vec &p1 = mf.first->vertices[mf.first->faces[mf.second].indices[1]];
-				const Vec &p2 = mf.first->vertices[mf.first->faces[mf.second].indices[2]];
+				const Triangle &t = mf.first->getFaces()[mf.second];
+				const Vec p0 = mf.first->getVertex(t.indices[0]);
+				const Vec p1 = mf.first->getVertex(t.indices[1]);
+				const Vec p2 = mf.first->getVertex(t.indices[2]);
 				// checking if cell c is in contact with triangle p0, p1, p2
 				pair<bool, Vec> projec = projectionIntriangle(p0, p1, p2, c->getPosition());
 				// projec = {projection inside triangle, projection coordinates}
-				// TODO: we also need to check if the connection should be on a vertice
+				// TODO: we also need to check if the connection should be on a vertice or an
+				// edge (see Mesh::vertexFaces and Mesh::faceNeighbours)
 
 				Vec currentDirection = projec.second - c->getPosition();
-				cerr << " projec = {" << projec.first << ", " << projec.second << "}" << endl;
+				MECACELL_TRACE_EVENT(traceSink, TraceEvent::potentialCollision, c, mf.first,
+				                     mf.second, projec.second, projec.first);
 				if (projec.first && currentDirection.sqlength() < pow(c->getRadius(), 2)) {
+					MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::cellModelContacts, 1);
 					// we have a potential connection. Now we consider 2 cases:
 					// 1 - brand new connection (easy)
 					// 2 - older connection	(we need to update it)
 					//  => same cell/model pair + similar bounce angle (same face or similar normal)
 					currentDirection.normalize();
 					bool alreadyExist = false;
-					cerr << CYAN << " collision !" << NORMAL << endl;
-					if (cellModelConnections.count(mf.first) &&
-					    cellModelConnections[mf.first].count(c)) {
-						cerr << " there already is a connection between this cell and this model. "
-						     << endl;
-						for (auto &otherconn : cellModelConnections[mf.first][c]) {
-							Vec prevDirection =
-							    (otherconn->bounce.getNode0().getPosition() - c->getPrevposition())
-							        .normalized();
-							cerr << " prevDir.dot(currentDir) = " << prevDirection.dot(currentDirection)
-							     << endl;
-							if (prevDirection.dot(currentDirection) > MIN_CONNECTION_SIMILARITY) {
-								alreadyExist = true;
-								cerr << GREEN << " Yep, it's an old connection (" << otherconn.get()
-								     << ")" << endl;
-								otherconn->dirty = false;
-								// case n° 2, we want to update otherconn
-								// first, the bounce spring
-								otherconn->bounce.getNode0().position = projec.second;
-								otherconn->bounce.getNode0().face = mf.second;
-								cerr << " bounce spring updated" << endl;
-								// then the anchor. It's just another simple spring that is always at the
-								// same height as the cell (orthogonal to the bounce spring)
-								// it has a restlength of 0 and follows the cell when its length is more
-								// than the cell's radius;
-								if (otherconn->anchor.getSc().length > 0) {
-									cerr << " putting anchor at cell level" << endl;
-									// first we keep the anchor at cell height
-									const Vec &anchorDirection = otherconn->anchor.getSc().direction;
-									Vec crossp =
-									    currentDirection.cross(currentDirection.cross(anchorDirection));
-									if (crossp.sqlength() > c->getRadius() * 0.02) {
-										crossp.normalize();
-										cerr << " projection axis = " << crossp << endl;
-										double projLength = min(
-										    (otherconn->anchor.getNode0().getPosition() - c->getPosition())
-										        .dot(crossp),
-										    c->getRadius());
-										otherconn->anchor.getNode0().position =
-										    c->getPosition() + projLength * crossp;
-									}
+					MECACELL_TRACE_EVENT(traceSink, TraceEvent::collision, c, mf.first, mf.second,
+					                     projec.second);
+					for (auto &otherconn : c->getRWModelConnections()) {
+						if (otherconn->model != mf.first) continue;
+						Vec prevDirection =
+						    (otherconn->bounce.getNode0().getPosition() - c->getPrevposition())
+						        .normalized();
+						MECACELL_TRACE_EVENT(traceSink, TraceEvent::connectionSimilarity, c,
+						                     mf.first, mf.second, projec.second,
+						                     prevDirection.dot(currentDirection));
+						if (prevDirection.dot(currentDirection) > MIN_CONNECTION_SIMILARITY) {
+							alreadyExist = true;
+							otherconn->generation = generation;
+							// case n° 2, we want to update otherconn
+							// first, the bounce spring
+							otherconn->bounce.getNode0().position = projec.second;
+							otherconn->bounce.getNode0().face = mf.second;
+							MECACELL_TRACE_EVENT(traceSink, TraceEvent::connectionUpdated, c,
+							                     mf.first, mf.second, projec.second);
+							// then the anchor. It's just another simple spring that is always at the
+							// same height as the cell (orthogonal to the bounce spring)
+							// it has a restlength of 0 and follows the cell when its length is more
+							// than the cell's radius;
+							if (otherconn->anchor.getSc().length > 0) {
+								// first we keep the anchor at cell height
+								const Vec &anchorDirection = otherconn->anchor.getSc().direction;
+								Vec crossp =
+								    currentDirection.cross(currentDirection.cross(anchorDirection));
+								if (crossp.sqlength() > c->getRadius() * 0.02) {
+									crossp.normalize();
+									MECACELL_TRACE_EVENT(traceSink, TraceEvent::anchorProjected, c,
+									                     mf.first, mf.second, crossp);
+									double projLength = min(
+									    (otherconn->anchor.getNode0().getPosition() - c->getPosition())
+									        .dot(crossp),
+									    c->getRadius());
+									otherconn->anchor.getNode0().position =
+									    c->getPosition() + projLength * crossp;
 								}
-								break;
 							}
+							break;
 						}
 					}
 					if (!alreadyExist) {
 						// new connection
-						cerr << BLUE << " it's a new connection" << endl;
+						MECACELL_TRACE_EVENT(traceSink, TraceEvent::newConnection, c, mf.first,
+						                     mf.second, projec.second);
 						double adh = c->getAdhesionWithModel(mf.first->name);
 						double l = mix(MAX_CELL_ADH_LENGTH * c->getRadius(),
 						               MIN_CELL_ADH_LENGTH * c->getRadius(), adh);
-						unique_ptr<CellModelConnection<Cell>> cmc(new CellModelConnection<Cell>(
-						    Connection<SpaceConnectionPoint, Cell *>(
+						modelConnect_type cmc(
+						    typename CellModelConnection<Cell>::CSConnection(
 						        {SpaceConnectionPoint(c->getPosition()), c}, // N0, N1
 						        Spring(100, dampingFromRatio(0.9, c->getMass(), 100),
 						               0)), // anchor
-						    Connection<ModelConnectionPoint, Cell *>(
+						    typename CellModelConnection<Cell>::CMConnection(
 						        {ModelConnectionPoint(mf.first, projec.second, mf.second),
 						         c}, // N0, N1
 						        Spring(c->getStiffness(),
 						               dampingFromRatio(c->getDampRatio(), c->getMass(),
 						                                c->getStiffness() * 1.0),
 						               l) // bounce
-						        )));
-						cmc->anchor.tjEnabled = false;
-						// cmc->anchor.getFlex().first.targetUpdateEnabled = false;
-						// cmc->anchor.getFlex().first.target = -currentDirection;
-						c->addModelConnection(cmc.get());
-						cellModelConnections[mf.first][c].push_back(move(cmc));
+						        ));
+						cmc.generation = generation;
+						cellModelConnections.add(cmc);
 					}
 				}
-				cerr << PURPLE << "|___________________________________________|" << NORMAL
-				     << endl
-				     << endl;
 			}
 		}
-		// clean up: dirty connections
-		for (auto &m : cellModelConnections) {
-			for (auto &c : m.second) {
-				for (auto it = c.second.begin(); it != c.second.end();) {
-					if ((*it)->dirty) {
-						cerr << " deleting dirty connection " << endl;
-						c.first->removeModelConnection(it->get());
-						it = c.second.erase(it);
-					} else {
-						++it;
+		// clean up: the contacts not found again
+		cellModelConnections.removeIf([&](modelConnect_type &cmc) {
+			if (cmc.generation == generation || cmc.getCell()->isAsleep()) return false;
+			MECACELL_TRACE_EVENT(traceSink, TraceEvent::connectionDeleted, cmc.getCell(),
+			                     cmc.model);
+			return true;
+		});
+	}
+
+	void cellCollisions() {
+#if MECACELL_PROFILING
+		size_t nbConnections = connections.size();
+#endif
+		if (broadPhase == BroadPhase::grid)
+			gridCollisions();
+		else
+			sweepCollisions();
+		MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::connectionsCreated,
+		                       connections.size() - nbConnections);
+	}
+
+	// sleeping cells don't look for collisions and are never marked as tested: only
+	// their awake neighbours test them
+	void gridCollisions() {
+		if (pool) {
+			// interpenetrating pairs are looked for concurrently (read only), connections
+			// are then created in the same order as in the serial version
+			collisionCandidates.resize(cells.size());
+			pool->parallelFor(cells.size(), [&](size_t i) {
+				Cell *c = cells[i];
+				auto &candidates = collisionCandidates[i];
+				candidates.clear();
+				if (c->isAsleep()) return;
+				grid.forEachNeighbour(c, [&](Cell *c2) {
+					double sql = c->getRadius() + c2->getRadius();
+					sql *= sql;
+					if (c2 != c && (c2->getPosition() - c->getPosition()).sqlength() <= sql)
+						candidates.push_back(c2);
+				});
+			});
+			for (size_t i = 0; i < cells.size(); ++i) {
+				if (cells[i]->isAsleep()) continue;
+				for (const auto &c2 : collisionCandidates[i]) {
+					if (!c2->alreadyTested()) {
+						MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::neighbourCandidates, 1);
+						cells[i]->connection(c2, connections, connectionPool);
 					}
 				}
+				cells[i]->markAsTested();
 			}
-		}
-		// clean up: empty entries
-		for (auto itM = cellModelConnections.begin(); itM != cellModelConnections.end();) {
-			if (itM->second.empty()) {
-				itM = cellModelConnections.erase(itM);
-			} else {
-				for (auto itC = itM->second.begin(); itC != itM->second.end();) {
-					if (itC->second.empty()) {
-						itC = itM->second.erase(itC);
-					} else {
-						++itC;
+		} else {
+			for (auto &c : cells) {
+				if (c->isAsleep()) continue;
+				grid.forEachNeighbour(c, [&](Cell *c2) {
+					if (!c2->alreadyTested()) {
+						MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::neighbourCandidates, 1);
+						c->connection(c2, connections, connectionPool);
 					}
-				}
-				++itM;
+				});
+				c->markAsTested();
 			}
 		}
 	}
 
-	void cellCollisions() {
-		for (auto &c : cells) {
-			vector<Cell *> toTest = grid.retrieve(c);
-			connect_type *s = nullptr;
-			for (const auto &c2 : toTest) {
-				if (!c2->alreadyTested()) {
-					c->connection(c2, connections);
-				}
+	// each pair of overlapping boxes is found once by the sweep, no tested flags needed.
+	// The pairs of sleeping cells are skipped, and an awake cell always looks for the
+	// connection with a sleeping one (like with the grid).
+	// The pairs come in the sweep list's order, not in the grid's: as a connection can
+	// be refused because of the ones created before it (see ConnectableCell::connection),
+	// the two broad phases can end up with different connections. With a pool, the
+	// interpenetrating pairs of each entry are found concurrently (read only), then
+	// connected entry by entry, in the order forEachPair would visit them. connection
+	// ignores the other pairs: the connections are the serial sweep's ones, whatever the
+	// nb of threads
+	void sweepCollisions() {
+		auto collide = [&](Cell *a, Cell *b) {
+			if (a->isAsleep()) {
+				if (b->isAsleep()) return;
+				std::swap(a, b);
 			}
-			c->markAsTested();
+			MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::neighbourCandidates, 1);
+			a->connection(b, connections, connectionPool);
+		};
+		if (pool) {
+			collisionCandidates.resize(sweep.size());
+			pool->parallelFor(sweep.size(), [&](size_t i) {
+				auto &candidates = collisionCandidates[i];
+				candidates.clear();
+				sweep.forEachPairFrom(i, [&](Cell *a, Cell *b) {
+					double sql = a->getRadius() + b->getRadius();
+					sql *= sql;
+					if ((b->getPosition() - a->getPosition()).sqlength() <= sql)
+						candidates.push_back(b);
+				});
+			});
+			for (size_t i = 0; i < sweep.size(); ++i)
+				for (const auto &b : collisionCandidates[i]) collide(sweep[i], b);
+		} else {
+			sweep.forEachPair(collide);
 		}
 	}
 
 	void deleteImpossibleConnections() {
-		// erase and delete connections longer than their max length
-		connections.erase(
-		    remove_if(connections.begin(), connections.end(), [&](connect_type *c) {
-			    double maxL = c->getNode0()->getRadius() + c->getNode1()->getRadius();
-			    if (c->getLength() > maxL) {
-				    c->getNode0()->removeConnection(c->getNode1(), c);
-				    delete c;
-				    return true;
-			    }
-			    return false;
-			  }), connections.end());
+		// erase and delete connections longer than their max length. With fused passes,
+		// only the ones created since updateConnectionsLengthAndDirection are tested here
+		size_t nbTested = fusedPasses ? min(connectionTooLong.size(), connections.size()) : 0;
+		for (size_t i = 0; i < connections.size(); ++i) {
+			auto &c = connections[i];
+			if (i < nbTested ? connectionTooLong[i] : tooLong(c)) {
+				c->getNode0()->removeConnection(c->getNode1(), c);
+				connectionPool.destroy(c);
+				c = nullptr;
+			}
+		}
+		connectionTooLong.clear();
 		// for (auto &c : cells) {
 		// deleteOverlapingConnections(c);
 		//}
+#if MECACELL_PROFILING
+		size_t nbConnections = connections.size();
+#endif
+		compactConnections();
+		MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::connectionsDeleted,
+		                       nbConnections - connections.size());
+	}
+
+	bool tooLong(connect_type *c) {
+		double maxL = c->getNode0()->getRadius() + c->getNode1()->getRadius();
+		return c->getLength() > maxL;
+	}
+
+	// removes the deleted (nullptr) connections from the connections list, keeping the
+	// others in the same order
+	void compactConnections() {
+		size_t n = 0;
+		for (auto &c : connections) {
+			if (c) {
+				c->worldSlot = n;
+				connections[n++] = c;
+			}
+		}
+		connections.resize(n);
 	}
 
 	// deleteOverlapingConnections
 	// deletes all connections going through cells
+	// (deleted connections are left as nullptr in connections, see compactConnections)
 	void deleteOverlapingConnections(Cell *cell) {
 		double overlapCoef = 0.9;
-		vector<connect_type *> &vec = cell->getRWConnections();
-		for (auto c0It = vec.begin(); c0It < vec.end();) {
+		auto &vec = cell->getRWConnections();
+		// erasing a connection of cell moves its last one in its slot
+		for (size_t c0Id = 0; c0Id < vec.size();) {
 			bool deleted = false; // tells if c0 was deleted inside the inner loop (so we know
-			                      // if we have to increment c0It)
-			connect_type *c0 = *c0It;
+			                      // if we have to increment c0Id)
+			connect_type *c0 = vec[c0Id];
 			if (c0->getNode1() != nullptr) { // if this is not a wall connection
 				Vec c0dir;
 				Cell *other0 = nullptr;
@@ -422,8 +1177,8 @@ public:
 				}
 				Vec c0v = c0dir * c0->getLength();
 				double c0SqLength = pow(c0->getLength(), 2);
-				for (auto c1It = c0It + 1; c1It < vec.end();) {
-					connect_type *c1 = *c1It;
+				for (size_t c1Id = c0Id + 1; c1Id < vec.size();) {
+					connect_type *c1 = vec[c1Id];
 					if (c1->getNode1() != nullptr) {
 						Vec c1dir;
 						Cell *other1 = nullptr;
@@ -443,40 +1198,71 @@ public:
 						double scal10 = c1v.dot(c0dir);
 						if (scal01 > 0 && c0SqLength < c1SqLength &&
 						    (c0SqLength - scal01 * scal01) < r0 * r0 * overlapCoef) {
-							c1It = vec.erase(c1It);
-							other1->eraseConnection(c1);
-							cell->eraseCell(other1);
-							other1->eraseCell(cell);
-							connections.erase(remove(connections.begin(), connections.end(), c1),
-							                  connections.end());
-							delete c1;
+							cell->removeConnection(other1, c1);
+							connections[c1->worldSlot] = nullptr;
+							connectionPool.destroy(c1);
 						} else if (scal10 > 0 && c1SqLength < c0SqLength &&
 						           (c1SqLength - scal10 * scal10) < r1 * r1 * overlapCoef) {
-							c0It = vec.erase(c0It);
-							other0->eraseConnection(c0);
-							cell->eraseCell(other0);
-							other0->eraseCell(cell);
-							connections.erase(remove(connections.begin(), connections.end(), c0),
-							                  connections.end());
+							cell->removeConnection(other0, c0);
+							connections[c0->worldSlot] = nullptr;
 							deleted = true;
-							delete c0;
+							connectionPool.destroy(c0);
 							break; // we need to exit the inner loop, c0 doesn't exist
 							       // anymore.
 						} else {
-							++c1It;
+							++c1Id;
 						}
 					} else {
-						++c1It;
+						++c1Id;
 					}
 				}
 			}
-			if (!deleted) ++c0It;
+			if (!deleted) ++c0Id;
 		}
 	}
 
+	// The cells born in a wave of behaviour updates are added at once, then get their
+	// own update in the next wave, in their order of birth: the same sequence as adding
+	// each newborn as soon as it is returned. Ghost cells are skipped.
 	void updateBehavior() {
-		for (size_t i = 0; i < cells.size(); ++i) {
-			addCell(cells[i]->updateBehavior(dt));
+		const uint64_t seed = getRandomSeed();
+		birthBuffers.resize(pool ? pool->size() : 1);
+		for (size_t b = 0; b < cells.size();) {
+			size_t e = cells.size();
+			for (auto &buf : birthBuffers) buf.clear();
+			if (parallelBehavior) {
+				parallelFor(cells.size(), [&](size_t i) { cells[i]->publishState(); });
+				// chunks are contiguous and in order: so are the buffers' births
+				auto kernel = [&](size_t first, size_t last, size_t t) {
+					for (size_t i = b + first; i < b + last; ++i) {
+						Cell *c = cells[i];
+						if (c->isGhost()) continue;
+						c->getRandomStream().reset(seed, c->getId(), frame);
+						c->setDeferredConnectionsUpdate(true);
+						Cell *n = c->updateBehavior(dt);
+						c->setDeferredConnectionsUpdate(false);
+						if (n) birthBuffers[t].push_back(n);
+					}
+				};
+				if (pool)
+					pool->parallelForChunks(e - b, kernel);
+				else
+					kernel(0, e - b, 0);
+				for (size_t i = b; i < e; ++i) cells[i]->applyPendingConnectionsUpdate();
+			} else {
+				for (size_t i = b; i < e; ++i) {
+					Cell *c = cells[i];
+					if (c->isGhost()) continue;
+					c->getRandomStream().reset(seed, c->getId(), frame);
+					if (Cell *n = c->updateBehavior(dt)) birthBuffers[0].push_back(n);
+				}
+			}
+			size_t nbBirths = 0;
+			for (const auto &buf : birthBuffers) nbBirths += buf.size();
+			if (cells.capacity() < e + nbBirths) cells.reserve(max(e + nbBirths, 2 * e));
+			for (const auto &buf : birthBuffers)
+				for (auto &c : buf) addCell(c);
+			b = e;
 		}
 	}
 
@@ -485,34 +1271,341 @@ public:
 		while (!cells.empty())
 			delete cells.back(), cells.pop_back();
 		while (!connections.empty())
-			delete connections.back(), connections.pop_back();
+			connectionPool.destroy(connections.back()), connections.pop_back();
 	}
 
 	void disableCellCellCollisions() { cellCellCollisions = false; }
 
+	/******************************
+	 *          LOCALITY          *
+	 ******************************/
+	// mean |i0 - i1| over the connections, for connected cells i0 and i1 in cells
+	double meanConnectionIndexGap() {
+		if (connections.empty()) return 0;
+		indexCells();
+		double gap = 0;
+		for (auto &con : connections) {
+			size_t i0 = cellIndex.at(con->getNode0()), i1 = cellIndex.at(con->getNode1());
+			gap += i0 > i1 ? i0 - i1 : i1 - i0;
+		}
+		return gap / connections.size();
+	}
+
+	// sorts the cells by Morton code of their positions (by their previous index when
+	// equal), then the connections by their cells' new indices. The grid is refilled
+	// and the connections' world slots are updated; every other per cell or per
+	// connection array is rebuilt at each update.
+	void reorderCells() {
+		if (cells.empty()) return;
+		Vec lo = cells[0]->getPosition(), hi = lo;
+		for (auto &c : cells) {
+			const Vec p = c->getPosition();
+			lo = Vec(min(lo.x, p.x), min(lo.y, p.y), min(lo.z, p.z));
+			hi = Vec(max(hi.x, p.x), max(hi.y, p.y), max(hi.z, p.z));
+		}
+		mortonKeys.resize(cells.size());
+		parallelFor(cells.size(), [&](size_t i) {
+			Cell *c = cells[i];
+			mortonKeys[i] = make_pair(Morton::encode(c->getPosition(), lo, hi), c);
+		});
+		typedef pair<uint64_t, Cell *> key_type;
+		std::stable_sort(
+		    mortonKeys.begin(), mortonKeys.end(),
+		    [](const key_type &a, const key_type &b) { return a.first < b.first; });
+		for (size_t i = 0; i < cells.size(); ++i) cells[i] = mortonKeys[i].second;
+		indexCells();
+		auto key = [&](connect_type *con) {
+			size_t i0 = cellIndex.at(con->getNode0()), i1 = cellIndex.at(con->getNode1());
+			return make_pair(min(i0, i1), max(i0, i1));
+		};
+		std::sort(connections.begin(), connections.end(),
+		          [&](connect_type *a, connect_type *b) { return key(a) < key(b); });
+		for (size_t i = 0; i < connections.size(); ++i) connections[i]->worldSlot = i;
+		cellGridFilled = false;
+		sortedIndexGap = meanConnectionIndexGap();
+	}
+
+	void indexCells() {
+		cellIndex.clear();
+		cellIndex.reserve(cells.size());
+		for (size_t i = 0; i < cells.size(); ++i) cellIndex[cells[i]] = i;
+	}
+
 	int getNbUpdates() const { return frame; }
 
+	// memory held by the cells (objects, lists, the world's list of cells) and by the
+	// connections (pool blocks, the world's list of connections), in bytes
+	size_t getCellsBytes() const {
+		size_t b = cells.capacity() * sizeof(Cell *) + cells.size() * sizeof(Cell) +
+		           liveCells.heapBytes();
+		for (const auto &c : cells) b += c->getHeapBytes();
+		return b;
+	}
+	size_t getConnectionsBytes() const {
+		return connectionPool.capacity() * sizeof(connect_type) +
+		       connections.capacity() * sizeof(connect_type *) + cellModelConnections.heapBytes();
+	}
+
 	void addCell(Cell *c) {
-		if (c != NULL) cells.push_back(c);
+		if (c != NULL) {
+			c->setId(nextCellId);
+			nextCellId += cellIdStride;
+			cells.push_back(c);
+			liveCells.insert(c);
+			cellGridFilled = false;
+		}
 	}
 
+	// added cells get the ids next, next + stride, next + 2 x stride... (e.g. so that the
+	// ranks of a DistributedWorld never give the same id)
+	void setCellIds(uint64_t next, uint64_t stride) {
+		nextCellId = next;
+		cellIdStride = max<uint64_t>(1, stride);
+	}
+
+	// a connection with default springs and joints between two cells of the world,
+	// whose state is then expected to be loaded (see Connection::loadState)
+	connect_type *createConnection(Cell *c0, Cell *c1) {
+		connect_type *con = connectionPool.create(make_pair(c0, c1), Spring());
+		con->worldSlot = connections.size();
+		connections.push_back(con);
+		c0->addConnection(c1, con);
+		return con;
+	}
+	// deletes all the connections of these cells, the connections list is compacted once
+	void deleteConnections(const vector<Cell *> &cs) {
+		for (auto &c : cs) c->eraseAndDeleteAllConnections(connections, connectionPool);
+		compactConnections();
+	}
+
+	// dead cells and their connections are removed, the cells and connections lists
+	// are compacted once at the end
 	void destroyCells() {
-		for (auto i = cells.begin(); i != cells.end();) {
-			if ((*i)->isDead()) {
-				auto c = *i;
-				c->eraseAndDeleteAllConnections(connections);
-				for (auto &m : models) {
-					if (cellModelConnections.count(&m.second) &&
-					    cellModelConnections.at(&m.second).count(c)) {
-						cellModelConnections.at(&m.second).erase(c);
-					}
-				}
-				i = cells.erase(i);
+		size_t n = 0;
+		for (auto &c : cells) {
+			if (c->isDead()) {
+				c->eraseAndDeleteAllConnections(connections, connectionPool);
+				cellModelConnections.removeCell(c);
+				liveCells.erase(c);
 				delete c;
 			} else {
-				++i;
+				cells[n++] = c;
 			}
 		}
+		if (n < cells.size()) {
+			cells.resize(n);
+			cellGridFilled = false;
+#if MECACELL_PROFILING
+			size_t nbConnections = connections.size();
+#endif
+			compactConnections();
+			MECACELL_PROFILE_COUNT(profileStats, ProfileCounter::connectionsDeleted,
+			                       nbConnections - connections.size());
+		}
+	}
+
+	// deletes all the cells and their connections
+	void removeAllCells() {
+		cellModelConnections.clear();
+		for (auto &c : connections) connectionPool.destroy(c);
+		connections.clear();
+		for (auto &c : cells) delete c;
+		cells.clear();
+		liveCells.clear();
+		cellsToDestroy.clear();
+		cellGridFilled = false;
+	}
+
+	/******************************
+	 *        CHECKPOINTS         *
+	 ******************************/
+	// A checkpoint holds the frame, dt, the simulated time, g, viscosity, globalRand's
+	// state, the random seed and next cell id, the models' transformations, the cells
+	// (see ConnectableCell::saveState), the connections and the cell - model connections,
+	// in that order (see checkpoint.hpp). Meshes are not saved: models have to be added
+	// again, with the same names, before loading.
+	// With async, the world is serialized in memory and the file is written in the
+	// background while the simulation goes on (see waitForCheckpoint).
+	bool saveCheckpoint(const string &path, bool async = false) {
+		CheckpointWriter w;
+		writeCheckpoint(w);
+		if (!async) return writeFileAtomically(path, w.release());
+		checkpointWriter.write(path, w.release());
+		return true;
+	}
+	// waits for the last asynchronous checkpoint, returns false if it couldn't be written
+	bool waitForCheckpoint() { return checkpointWriter.wait(); }
+
+	// replaces the current cells and connections. On failure (unreadable or invalid
+	// file, missing model), the world is left without cells
+	bool loadCheckpoint(const string &path) {
+		vector<char> data;
+		if (!readFile(path, data)) return false;
+		CheckpointReader r(data);
+		removeAllCells();
+		if (readCheckpoint(r)) return true;
+		removeAllCells();
+		return false;
+	}
+
+	// models sorted by name, so that checkpoints don't depend on the models' map order
+	vector<Model *> sortedModels() {
+		vector<Model *> res;
+		for (auto &m : models) res.push_back(&m.second);
+		sort(res.begin(), res.end(), [](Model *a, Model *b) { return a->name < b->name; });
+		return res;
+	}
+
+	void writeCheckpoint(CheckpointWriter &w) {
+		for (char c : CHECKPOINT_MAGIC) w.put(c);
+		w.put(CHECKPOINT_VERSION);
+		// orientations and joints are stored in their representation of this build
+		w.put(static_cast<uint8_t>(MECACELL_QUATERNIONS));
+		w.put(static_cast<int64_t>(frame));
+		w.put(dt);
+		w.put(simulatedTime);
+		w.put(g);
+		w.put(viscosityCoef);
+		std::ostringstream rng;
+		rng << globalRand;
+		w.put(rng.str());
+		w.put(getRandomSeed());
+		w.put(nextCellId);
+		// models
+		vector<Model *> sorted = sortedModels();
+		w.put(static_cast<uint64_t>(sorted.size()));
+		for (auto &m : sorted) {
+			w.put(m->name);
+			w.put(m->transformation);
+		}
+		// cells
+		unordered_map<const Cell *, uint64_t> cellIds;
+		cellIds.reserve(cells.size());
+		w.put(static_cast<uint64_t>(cells.size()));
+		for (uint64_t i = 0; i < cells.size(); ++i) {
+			Cell *c = cells[i];
+			cellIds[c] = i;
+			c->saveState(w);
+			w.put(static_cast<uint64_t>(c->getRWConnections().size()));
+			w.put(static_cast<uint64_t>(c->getRWModelConnections().size()));
+		}
+		// connections, in the world's order
+		w.put(static_cast<uint64_t>(connections.size()));
+		for (auto &con : connections) {
+			w.put(cellIds.at(con->getNode0()));
+			w.put(cellIds.at(con->getNode1()));
+			w.put(static_cast<uint64_t>(con->nodeSlots.first));
+			w.put(static_cast<uint64_t>(con->nodeSlots.second));
+			con->saveState(w);
+		}
+		// cell - model connections, in their storage order
+		unordered_map<const Model *, uint64_t> modelIds;
+		for (uint64_t m = 0; m < sorted.size(); ++m) modelIds[sorted[m]] = m;
+		w.put(static_cast<uint64_t>(cellModelConnections.size()));
+		for (auto &cmc : cellModelConnections) {
+			w.put(cellIds.at(cmc.getCell()));
+			w.put(modelIds.at(cmc.model));
+			w.put(static_cast<uint64_t>(cmc.cellSlot));
+			w.put(cmc.maxTeta);
+			w.put(cmc.anchor.getNode0().position);
+			cmc.anchor.saveState(w);
+			w.put(cmc.bounce.getNode0().position);
+			w.put(static_cast<uint64_t>(cmc.getFace()));
+			cmc.bounce.saveState(w);
+		}
+	}
+
+	bool readCheckpoint(CheckpointReader &r) {
+		for (char c : CHECKPOINT_MAGIC)
+			if (r.get<char>() != c) return false;
+		if (r.get<uint64_t>() != CHECKPOINT_VERSION) return false;
+		if (r.get<uint8_t>() != MECACELL_QUATERNIONS) return false;
+		frame = static_cast<int>(r.get<int64_t>());
+		r.get(dt);
+		r.get(simulatedTime);
+		r.get(g);
+		r.get(viscosityCoef);
+		string rng;
+		r.get(rng);
+		std::istringstream(rng) >> globalRand;
+		setRandomSeed(r.get<uint64_t>());
+		r.get(nextCellId);
+		// models
+		vector<Model *> modelIds(r.get<uint64_t>());
+		for (auto &m : modelIds) {
+			string name;
+			r.get(name);
+			if (!r.ok() || !models.count(name)) return false;
+			m = &models.at(name);
+			r.get(m->transformation);
+			m->updateFromTransformation();
+		}
+		modelGridDirty = true;
+		// cells
+		uint64_t nbCells = r.get<uint64_t>();
+		for (uint64_t i = 0; i < nbCells && r.ok(); ++i) {
+			Cell *c = new Cell(Vec::zero());
+			c->loadState(r);
+			c->resizeConnections(r.get<uint64_t>());
+			c->resizeModelConnections(r.get<uint64_t>());
+			cells.push_back(c);
+			liveCells.insert(c);
+		}
+		// connections
+		uint64_t nbConnections = r.get<uint64_t>();
+		for (uint64_t i = 0; i < nbConnections && r.ok(); ++i) {
+			uint64_t n0 = r.get<uint64_t>(), n1 = r.get<uint64_t>();
+			uint64_t s0 = r.get<uint64_t>(), s1 = r.get<uint64_t>();
+			if (!r.ok() || n0 >= cells.size() || n1 >= cells.size() || n0 == n1 ||
+			    s0 >= cells[n0]->getRWConnections().size() ||
+			    s1 >= cells[n1]->getRWConnections().size())
+				return false;
+			connect_type *con =
+			    connectionPool.create(make_pair(cells[n0], cells[n1]), Spring());
+			con->loadState(r);
+			con->nodeSlots = make_pair(s0, s1);
+			con->worldSlot = connections.size();
+			connections.push_back(con);
+			cells[n0]->restoreConnection(cells[n1], con);
+			cells[n1]->restoreConnection(cells[n0], con);
+		}
+		// cell - model connections
+		uint64_t nbContacts = r.get<uint64_t>();
+		for (uint64_t i = 0; i < nbContacts && r.ok(); ++i) {
+			uint64_t cId = r.get<uint64_t>(), mId = r.get<uint64_t>();
+			uint64_t slot = r.get<uint64_t>();
+			double maxTeta = r.get<double>();
+			if (!r.ok() || cId >= cells.size() || mId >= modelIds.size()) return false;
+			Cell *c = cells[cId];
+			Model *m = modelIds[mId];
+			Vec anchorPosition;
+			r.get(anchorPosition);
+			typename CellModelConnection<Cell>::CSConnection anchor(
+			    {SpaceConnectionPoint(anchorPosition), c}, Spring());
+			anchor.loadState(r);
+			Vec bouncePosition;
+			r.get(bouncePosition);
+			uint64_t face = r.get<uint64_t>();
+			typename CellModelConnection<Cell>::CMConnection bounce(
+			    {ModelConnectionPoint(m, bouncePosition, face), c}, Spring());
+			bounce.loadState(r);
+			if (!r.ok() || slot >= c->getRWModelConnections().size() || face >= m->getFaces().size())
+				return false;
+			modelConnect_type cmc(anchor, bounce);
+			cmc.maxTeta = maxTeta;
+			cmc.cellSlot = slot;
+			cmc.generation = contactGeneration;
+			cellModelConnections.restore(cmc);
+		}
+		if (!r.ok() || !r.atEnd()) return false;
+		// every saved slot must have been filled
+		for (auto &c : cells) {
+			for (auto &con : c->getRWConnections())
+				if (!con) return false;
+			for (auto &con : c->getRWModelConnections())
+				if (!con) return false;
+		}
+		return true;
 	}
 
 	void reset() {
@@ -0,0 +1,92 @@
+#include "bvh.h"
+#include <algorithm>
+#include <limits>
+
+using std::min;
+using std::max;
+
+namespace MecaCell {
+void FaceBVH::build(const vector<Vec> &vertices, const vector<Triangle> &faces) {
+	nodes.clear();
+	faceIds.resize(faces.size());
+	if (faces.empty()) return;
+	vector<Vec> centroids;
+	centroids.reserve(faces.size());
+	for (uint32_t i = 0; i < faces.size(); ++i) {
+		faceIds[i] = i;
+		const auto &f = faces[i].indices;
+		centroids.push_back((vertices[f[0]] + vertices[f[1]] + vertices[f[2]]) / 3.0);
+	}
+	nodes.reserve(2 * faces.size() / LEAF_SIZE + 1);
+	nodes.push_back(Node());
+	buildNode(0, 0, faceIds.size(), centroids);
+	refit(vertices, faces);
+}
+
+// splits faceIds[b, e) in two children of node n (boxes are computed by refit)
+void FaceBVH::buildNode(size_t n, uint32_t b, uint32_t e, const vector<Vec> &centroids) {
+	if (e - b <= LEAF_SIZE) {
+		nodes[n].first = b;
+		nodes[n].count = e - b;
+		return;
+	}
+	Vec cmin = centroids[faceIds[b]], cmax = cmin;
+	for (uint32_t i = b + 1; i < e; ++i) {
+		const Vec &c = centroids[faceIds[i]];
+		cmin = Vec(min(cmin.x, c.x), min(cmin.y, c.y), min(cmin.z, c.z));
+		cmax = Vec(max(cmax.x, c.x), max(cmax.y, c.y), max(cmax.z, c.z));
+	}
+	Vec extent = cmax - cmin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+	                               : (extent.y > extent.z ? 1 : 2);
+	auto coord = [&](uint32_t f) {
+		const Vec &c = centroids[f];
+		return axis == 0 ? c.x : axis == 1 ? c.y : c.z;
+	};
+	uint32_t mid = b + (e - b) / 2;
+	nth_element(faceIds.begin() + b, faceIds.begin() + mid, faceIds.begin() + e,
+	            [&](uint32_t f0, uint32_t f1) { return coord(f0) < coord(f1); });
+	uint32_t left = nodes.size();
+	nodes[n].first = left;
+	nodes[n].count = 0;
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	buildNode(left, b, mid, centroids);
+	buildNode(left + 1, mid, e, centroids);
+}
+
+void FaceBVH::fitLeaf(Node &node, const vector<Vec> &vertices,
+                      const vector<Triangle> &faces) {
+	for (int a = 0; a < 3; ++a) {
+		node.mn[a] = std::numeric_limits<double>::max();
+		node.mx[a] = -std::numeric_limits<double>::max();
+	}
+	for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+		for (auto v : faces[faceIds[i]].indices) {
+			const Vec &p = vertices[v];
+			const double c[3] = {p.x, p.y, p.z};
+			for (int a = 0; a < 3; ++a) {
+				node.mn[a] = min(node.mn[a], c[a]);
+				node.mx[a] = max(node.mx[a], c[a]);
+			}
+		}
+	}
+}
+
+void FaceBVH::refit(const vector<Vec> &vertices, const vector<Triangle> &faces) {
+	// children come after their parent: a reverse traversal is a bottom-up one
+	for (size_t n = nodes.size(); n-- > 0;) {
+		Node &node = nodes[n];
+		if (node.count) {
+			fitLeaf(node, vertices, faces);
+		} else {
+			const Node &l = nodes[node.first];
+			const Node &r = nodes[node.first + 1];
+			for (int a = 0; a < 3; ++a) {
+				node.mn[a] = min(l.mn[a], r.mn[a]);
+				node.mx[a] = max(l.mx[a], r.mx[a]);
+			}
+		}
+	}
+}
+}
@@ -0,0 +1,64 @@
+#ifndef MECACELL_BVH_H
+#define MECACELL_BVH_H
+#include <cstdint>
+#include <vector>
+#include "objmodel.h"
+#include "tools.h"
+
+using std::vector;
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                  FACES BOUNDING VOLUME HIERARCHY
+////////////////////////////////////////////////////////////////////
+// Binary tree of axis aligned bounding boxes over the faces of a triangle mesh, split
+// at the median of the faces' centroids along the largest axis.
+// When the vertices move without changing the mesh's topology (rigid transformations,
+// scaling), the tree can be refit: boxes are recomputed bottom-up, which is a lot
+// cheaper than a build and keeps the same tree.
+class FaceBVH {
+private:
+	struct Node {
+		double mn[3], mx[3];
+		uint32_t first; // leaf: first face in faceIds. Inner node: left child (right = +1)
+		uint32_t count; // nb of faces, 0 for an inner node
+	};
+	vector<Node> nodes; // nodes[0] is the root, children always come after their parent
+	vector<uint32_t> faceIds;
+
+	void buildNode(size_t n, uint32_t b, uint32_t e, const vector<Vec> &centroids);
+	void fitLeaf(Node &node, const vector<Vec> &vertices, const vector<Triangle> &faces);
+
+public:
+	static const uint32_t LEAF_SIZE = 4;
+
+	void build(const vector<Vec> &vertices, const vector<Triangle> &faces);
+	void refit(const vector<Vec> &vertices, const vector<Triangle> &faces);
+	size_t size() const { return nodes.size(); }
+	bool empty() const { return nodes.empty(); }
+
+	// calls f(faceId) once for every face of the leaves whose box intersects the sphere's
+	// box (a superset of the faces whose own box intersects it)
+	template <typename F> void forEachFace(const Vec &center, double radius, F &&f) const {
+		if (nodes.empty()) return;
+		const double mn[3] = {center.x - radius, center.y - radius, center.z - radius};
+		const double mx[3] = {center.x + radius, center.y + radius, center.z + radius};
+		uint32_t stack[64];
+		size_t top = 0;
+		stack[top++] = 0;
+		while (top) {
+			const Node &node = nodes[stack[--top]];
+			if (node.mx[0] < mn[0] || node.mn[0] > mx[0] || node.mx[1] < mn[1] ||
+			    node.mn[1] > mx[1] || node.mx[2] < mn[2] || node.mn[2] > mx[2])
+				continue;
+			if (node.count) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) f(faceIds[i]);
+			} else {
+				stack[top++] = node.first + 1;
+				stack[top++] = node.first;
+			}
+		}
+	}
+};
+}
+#endif
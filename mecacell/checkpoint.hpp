@@ -0,0 +1,247 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "basis.h"
+#include "connection.h"
+#include "matrix4x4.h"
+#include "quaternion.h"
+#include "rotation.h"
+#include "tools.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                         CHECKPOINTS
+////////////////////////////////////////////////////////////////////
+// A checkpoint is a binary snapshot of a world (see BasicWorld::saveCheckpoint):
+// a header (magic + format version) followed by the world's sections, all written in
+// the machine's native byte order. Pointers are replaced by indices.
+// CheckpointWriter serializes in memory, so that the snapshot can be written to disk
+// while the simulation goes on (see AsyncFileWriter).
+const char CHECKPOINT_MAGIC[8] = {'M', 'C', 'C', 'K', 'P', 'T', 0, 0};
+// 2: spring only cell - model connections, 3: orientation representation flag,
+// 4: cell ids and random seed, 5: simulated time, 6: sleeping cells, 7: joints' previous
+// angles, 8: cell - model connections in storage order
+const uint64_t CHECKPOINT_VERSION = 8;
+
+class CheckpointWriter {
+private:
+	std::vector<char> data;
+
+public:
+	CheckpointWriter() { data.reserve(1 << 16); }
+	template <typename T> void put(const T &v) {
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+		              "no checkpoint serialization for this type");
+		const char *p = reinterpret_cast<const char *>(&v);
+		data.insert(data.end(), p, p + sizeof(T));
+	}
+	void put(const Vec &v) {
+		put(v.x);
+		put(v.y);
+		put(v.z);
+	}
+	void put(const Rotation<Vec> &r) {
+		put(r.n);
+		put(r.teta);
+	}
+	void put(const Quaternion &q) {
+		put(q.v);
+		put(q.w);
+	}
+	void put(const Basis<Vec> &b) {
+		put(b.X);
+		put(b.Y);
+	}
+	template <typename T, size_t N> void put(const std::array<T, N> &a) {
+		for (const auto &v : a) put(v);
+	}
+	void put(const std::string &s) {
+		put(static_cast<uint64_t>(s.size()));
+		data.insert(data.end(), s.begin(), s.end());
+	}
+	void put(const Matrix4x4 &m) { put(m.m); }
+	void put(const Spring &s) {
+		put(s.k);
+		put(s.c);
+		put(s.l);
+		put(s.length);
+		put(s.prevLength);
+		put(s.minLengthRatio);
+		put(s.direction);
+	}
+	void put(const Joint &j) {
+		put(j.k);
+		put(j.currentK);
+		put(j.c);
+		put(j.maxTeta);
+		put(j.r);
+		put(j.delta);
+		put(j.prevTeta);
+		put(j.direction);
+		put(j.target);
+		put(j.maxTetaAutoCorrect);
+		put(j.targetUpdateEnabled);
+	}
+	template <typename A, typename B> void put(const std::pair<A, B> &p) {
+		put(p.first);
+		put(p.second);
+	}
+
+	size_t size() const { return data.size(); }
+	// the serialized snapshot. The writer is left empty
+	std::vector<char> release() {
+		std::vector<char> res;
+		res.swap(data);
+		return res;
+	}
+};
+
+// reads back what a CheckpointWriter wrote. Reading past the end sets ok() to false;
+// values read after that are left untouched
+class CheckpointReader {
+private:
+	const char *p;
+	const char *end;
+	bool valid = true;
+
+	bool take(void *dst, size_t n) {
+		if (!valid || static_cast<size_t>(end - p) < n) return valid = false;
+		memcpy(dst, p, n);
+		p += n;
+		return true;
+	}
+
+public:
+	CheckpointReader(const std::vector<char> &d) : p(d.data()), end(d.data() + d.size()) {}
+	bool ok() const { return valid; }
+	bool atEnd() const { return p == end; }
+	void fail() { valid = false; }
+
+	template <typename T> void get(T &v) {
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+		              "no checkpoint serialization for this type");
+		take(&v, sizeof(T));
+	}
+	template <typename T> T get() {
+		T v{};
+		get(v);
+		return v;
+	}
+	void get(Vec &v) {
+		get(v.x);
+		get(v.y);
+		get(v.z);
+	}
+	void get(Rotation<Vec> &r) {
+		get(r.n);
+		get(r.teta);
+	}
+	void get(Quaternion &q) {
+		get(q.v);
+		get(q.w);
+	}
+	void get(Basis<Vec> &b) {
+		get(b.X);
+		get(b.Y);
+	}
+	template <typename T, size_t N> void get(std::array<T, N> &a) {
+		for (auto &v : a) get(v);
+	}
+	void get(std::string &s) {
+		uint64_t n = get<uint64_t>();
+		if (!valid || static_cast<uint64_t>(end - p) < n) {
+			valid = false;
+			return;
+		}
+		s.assign(p, p + n);
+		p += n;
+	}
+	void get(Matrix4x4 &m) { get(m.m); }
+	void get(Spring &s) {
+		get(s.k);
+		get(s.c);
+		get(s.l);
+		get(s.length);
+		get(s.prevLength);
+		get(s.minLengthRatio);
+		get(s.direction);
+	}
+	void get(Joint &j) {
+		get(j.k);
+		get(j.currentK);
+		get(j.c);
+		get(j.maxTeta);
+		get(j.r);
+		get(j.delta);
+		get(j.prevTeta);
+		get(j.direction);
+		get(j.target);
+		get(j.maxTetaAutoCorrect);
+		get(j.targetUpdateEnabled);
+	}
+	template <typename A, typename B> void get(std::pair<A, B> &pr) {
+		get(pr.first);
+		get(pr.second);
+	}
+};
+
+// writes to path + ".tmp" then renames, so that a crash during the write never
+// destroys the previous file
+inline bool writeFileAtomically(const std::string &path, const std::vector<char> &data) {
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+		if (!f) return false;
+		f.write(data.data(), data.size());
+		if (!f) {
+			f.close();
+			std::remove(tmp.c_str());
+			return false;
+		}
+	}
+	return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+inline bool readFile(const std::string &path, std::vector<char> &data) {
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	if (!f) return false;
+	data.resize(static_cast<size_t>(f.tellg()));
+	f.seekg(0);
+	return f.read(data.data(), data.size()) || data.empty();
+}
+
+// writes one buffer at a time in a background thread
+class AsyncFileWriter {
+private:
+	std::thread worker;
+	bool lastResult = true;
+
+public:
+	AsyncFileWriter() {}
+	AsyncFileWriter(const AsyncFileWriter &) = delete;
+	AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+	~AsyncFileWriter() { wait(); }
+
+	// waits for the previous write first
+	void write(const std::string &path, std::vector<char> &&data) {
+		wait();
+		worker = std::thread([this, path](const std::vector<char> &d) {
+			lastResult = writeFileAtomically(path, d);
+		}, std::move(data));
+	}
+	// waits for the current write, returns false if the last write failed
+	bool wait() {
+		if (worker.joinable()) worker.join();
+		return lastResult;
+	}
+};
+}
+#endif
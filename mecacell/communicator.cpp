@@ -0,0 +1,136 @@
+#include "communicator.h"
+#include <algorithm>
+#if MECACELL_MPI
+#include <mpi.h>
+#endif
+
+namespace MecaCell {
+namespace {
+void reduce(std::vector<double> &acc, const std::vector<double> &v, ReduceOp op) {
+	for (size_t i = 0; i < acc.size() && i < v.size(); ++i) {
+		if (op == ReduceOp::sum)
+			acc[i] += v[i];
+		else if (op == ReduceOp::min)
+			acc[i] = std::min(acc[i], v[i]);
+		else
+			acc[i] = std::max(acc[i], v[i]);
+	}
+}
+}
+
+////////////////////////////////////////////////////////////////////
+//                     IN PROCESS RANKS
+////////////////////////////////////////////////////////////////////
+LocalCommunicatorGroup::LocalCommunicatorGroup(int n) {
+	for (int r = 0; r < n; ++r) comms.emplace_back(new LocalCommunicator(*this, r));
+	mailboxes.resize(n, std::vector<std::vector<char>>(n));
+	reductions.resize(n);
+}
+
+void LocalCommunicatorGroup::barrier() {
+	std::unique_lock<std::mutex> lock(mtx);
+	size_t g = generation;
+	if (++nbWaiting == comms.size()) {
+		nbWaiting = 0;
+		++generation;
+		cv.notify_all();
+	} else {
+		cv.wait(lock, [&] { return generation != g; });
+	}
+}
+
+int LocalCommunicator::size() const { return group.size(); }
+
+// each rank only writes its own row of mailboxes, and only reads after everyone wrote
+void LocalCommunicator::allToAll(const std::vector<std::vector<char>> &send,
+                                 std::vector<std::vector<char>> &recv) {
+	const int n = size();
+	for (int q = 0; q < n; ++q)
+		group.mailboxes[r][q] = q < static_cast<int>(send.size()) ? send[q]
+		                                                          : std::vector<char>();
+	group.barrier();
+	recv.resize(n);
+	for (int q = 0; q < n; ++q) recv[q] = group.mailboxes[q][r];
+	group.barrier();
+}
+
+void LocalCommunicator::allReduce(std::vector<double> &v, ReduceOp op) {
+	group.reductions[r] = v;
+	group.barrier();
+	std::vector<double> res = group.reductions[0];
+	for (int q = 1; q < size(); ++q) reduce(res, group.reductions[q], op);
+	group.barrier();
+	v.swap(res);
+}
+
+////////////////////////////////////////////////////////////////////
+//                           MPI
+////////////////////////////////////////////////////////////////////
+#if MECACELL_MPI
+bool mpiAvailable() { return true; }
+
+MPICommunicator::MPICommunicator(int *argc, char ***argv) {
+	int initialized = 0;
+	MPI_Initialized(&initialized);
+	if (!initialized) {
+		MPI_Init(argc, argv);
+		initializedHere = true;
+	}
+	MPI_Comm_rank(MPI_COMM_WORLD, &r);
+	MPI_Comm_size(MPI_COMM_WORLD, &n);
+}
+
+MPICommunicator::~MPICommunicator() {
+	int finalized = 0;
+	MPI_Finalized(&finalized);
+	if (initializedHere && !finalized) MPI_Finalize();
+}
+
+// sizes first, then the flattened buffers
+void MPICommunicator::allToAll(const std::vector<std::vector<char>> &send,
+                               std::vector<std::vector<char>> &recv) {
+	std::vector<int> sendCounts(n, 0), recvCounts(n, 0), sendDispl(n, 0), recvDispl(n, 0);
+	for (int q = 0; q < n && q < static_cast<int>(send.size()); ++q)
+		sendCounts[q] = static_cast<int>(send[q].size());
+	MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT,
+	             MPI_COMM_WORLD);
+	std::vector<char> sendBuf, recvBuf;
+	for (int q = 0; q < n; ++q) {
+		sendDispl[q] = static_cast<int>(sendBuf.size());
+		if (sendCounts[q]) sendBuf.insert(sendBuf.end(), send[q].begin(), send[q].end());
+		recvDispl[q] = q ? recvDispl[q - 1] + recvCounts[q - 1] : 0;
+	}
+	recvBuf.resize(n ? recvDispl[n - 1] + recvCounts[n - 1] : 0);
+	MPI_Alltoallv(sendBuf.data(), sendCounts.data(), sendDispl.data(), MPI_CHAR,
+	              recvBuf.data(), recvCounts.data(), recvDispl.data(), MPI_CHAR,
+	              MPI_COMM_WORLD);
+	recv.resize(n);
+	for (int q = 0; q < n; ++q)
+		recv[q].assign(recvBuf.begin() + recvDispl[q],
+		               recvBuf.begin() + recvDispl[q] + recvCounts[q]);
+}
+
+// gathered and reduced in rank order rather than with MPI_Allreduce, whose sums
+// may depend on the implementation's reduction tree
+void MPICommunicator::allReduce(std::vector<double> &v, ReduceOp op) {
+	std::vector<double> all(v.size() * n);
+	MPI_Allgather(v.data(), static_cast<int>(v.size()), MPI_DOUBLE, all.data(),
+	              static_cast<int>(v.size()), MPI_DOUBLE, MPI_COMM_WORLD);
+	std::vector<double> res(all.begin(), all.begin() + v.size());
+	for (int q = 1; q < n; ++q)
+		reduce(res, std::vector<double>(all.begin() + q * v.size(),
+		                                all.begin() + (q + 1) * v.size()),
+		       op);
+	v.swap(res);
+}
+#else
+bool mpiAvailable() { return false; }
+MPICommunicator::MPICommunicator(int *, char ***) {}
+MPICommunicator::~MPICommunicator() {}
+void MPICommunicator::allToAll(const std::vector<std::vector<char>> &send,
+                               std::vector<std::vector<char>> &recv) {
+	recv.assign(1, send.empty() ? std::vector<char>() : send[0]);
+}
+void MPICommunicator::allReduce(std::vector<double> &, ReduceOp) {}
+#endif
+}
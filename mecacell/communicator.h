@@ -0,0 +1,95 @@
+#ifndef MECACELL_COMMUNICATOR_H
+#define MECACELL_COMMUNICATOR_H
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Collective operations between the ranks of a distributed world (see
+// distributedworld.hpp). Every rank has to call them in the same order.
+// - LocalCommunicatorGroup: ranks in the same process (one thread per rank), used by
+//   the tests and to run a decomposition on a single machine
+// - MPICommunicator: one rank per MPI process. Available when the library is built
+//   with MPI (MECACELL_MPI, set by CMake when MPI is found), otherwise it is a single
+//   rank communicator and distributed worlds run serially.
+namespace MecaCell {
+enum class ReduceOp { sum, min, max };
+
+class Communicator {
+public:
+	virtual ~Communicator() {}
+	virtual int rank() const = 0;
+	virtual int size() const = 0;
+	// send[q] goes to rank q; recv[q] gets what rank q sent to this one
+	virtual void allToAll(const std::vector<std::vector<char>> &send,
+	                      std::vector<std::vector<char>> &recv) = 0;
+	// element wise reduction of v over all the ranks, in place. Sums are done in rank
+	// order: every rank gets the same result
+	virtual void allReduce(std::vector<double> &v, ReduceOp op) = 0;
+	double allReduce(double v, ReduceOp op) {
+		std::vector<double> tmp(1, v);
+		allReduce(tmp, op);
+		return tmp[0];
+	}
+};
+
+class LocalCommunicatorGroup;
+
+class LocalCommunicator : public Communicator {
+private:
+	LocalCommunicatorGroup &group;
+	int r;
+
+public:
+	LocalCommunicator(LocalCommunicatorGroup &g, int rk) : group(g), r(rk) {}
+	int rank() const { return r; }
+	int size() const;
+	void allToAll(const std::vector<std::vector<char>> &send,
+	              std::vector<std::vector<char>> &recv);
+	void allReduce(std::vector<double> &v, ReduceOp op);
+	using Communicator::allReduce;
+};
+
+// n ranks sharing mailboxes; get(r) is used by the thread running rank r
+class LocalCommunicatorGroup {
+private:
+	friend class LocalCommunicator;
+	std::vector<std::unique_ptr<LocalCommunicator>> comms;
+	std::vector<std::vector<std::vector<char>>> mailboxes; // [from][to]
+	std::vector<std::vector<double>> reductions;           // [from]
+	std::mutex mtx;
+	std::condition_variable cv;
+	size_t nbWaiting = 0;
+	size_t generation = 0;
+
+	void barrier();
+
+public:
+	explicit LocalCommunicatorGroup(int n);
+	int size() const { return static_cast<int>(comms.size()); }
+	LocalCommunicator &get(int r) { return *comms[r]; }
+};
+
+// MPI_COMM_WORLD. MPI is initialized by the first communicator if needed, and
+// finalized by its destructor
+class MPICommunicator : public Communicator {
+private:
+	int r = 0, n = 1;
+	bool initializedHere = false;
+
+public:
+	MPICommunicator(int *argc = nullptr, char ***argv = nullptr);
+	~MPICommunicator();
+	MPICommunicator(const MPICommunicator &) = delete;
+	MPICommunicator &operator=(const MPICommunicator &) = delete;
+	int rank() const { return r; }
+	int size() const { return n; }
+	void allToAll(const std::vector<std::vector<char>> &send,
+	              std::vector<std::vector<char>> &recv);
+	void allReduce(std::vector<double> &v, ReduceOp op);
+	using Communicator::allReduce;
+};
+bool mpiAvailable();
+}
+#endif
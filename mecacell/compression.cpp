@@ -0,0 +1,32 @@
+#include "compression.h"
+#if MECACELL_ZLIB
+#include <zlib.h>
+#endif
+
+namespace MecaCell {
+#if MECACELL_ZLIB
+bool compressionAvailable() { return true; }
+
+bool compressBytes(const char *in, size_t n, std::vector<char> &out) {
+	uLongf l = compressBound(n);
+	out.resize(l);
+	// fastest level: outputs are written while the simulation runs
+	if (compress2(reinterpret_cast<Bytef *>(out.data()), &l,
+	              reinterpret_cast<const Bytef *>(in), n, Z_BEST_SPEED) != Z_OK)
+		return false;
+	out.resize(l);
+	return true;
+}
+
+bool uncompressBytes(const char *in, size_t n, std::vector<char> &out) {
+	uLongf l = out.size();
+	return uncompress(reinterpret_cast<Bytef *>(out.data()), &l,
+	                  reinterpret_cast<const Bytef *>(in), n) == Z_OK &&
+	       l == out.size();
+}
+#else
+bool compressionAvailable() { return false; }
+bool compressBytes(const char *, size_t, std::vector<char> &) { return false; }
+bool uncompressBytes(const char *, size_t, std::vector<char> &) { return false; }
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef MECACELL_COMPRESSION_H
+#define MECACELL_COMPRESSION_H
+#include <cstddef>
+#include <vector>
+
+// Optional zlib compression of binary outputs. Available when the library is built
+// with zlib (MECACELL_ZLIB, set by CMake when zlib is found), otherwise every call fails
+// and the outputs stay uncompressed.
+namespace MecaCell {
+bool compressionAvailable();
+// out = compressed in
+bool compressBytes(const char *in, size_t n, std::vector<char> &out);
+// out must already have the uncompressed size
+bool uncompressBytes(const char *in, size_t n, std::vector<char> &out);
+}
+#endif
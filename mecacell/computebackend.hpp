@@ -0,0 +1,199 @@
+#ifndef COMPUTEBACKEND_HPP
+#define COMPUTEBACKEND_HPP
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "kinematicstate.hpp"
+#include "threadpool.hpp"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                      COMPUTE BACKENDS
+////////////////////////////////////////////////////////////////////
+// The substeps of an update (springs forces then Verlet integration, see
+// BasicWorld::setComputeBackend) run on flat buffers that stay resident on the backend
+// for the whole update: uploaded once, downloaded once with only what the rest of the
+// update and the behaviours read (the cells' kinematic state and forces, the springs'
+// lengths). The work is written as kernels over indices, without pointers, atomics
+// nor allocations: a backend running them on a device would have the same buffers to
+// copy and the same launches to make. Forces are accumulated without atomics thanks to
+// the world's force batches: no two connections of a batch share a cell.
+// Only the interface and its host implementation (HostBackend) are provided: there is
+// no device backend, MecaCell doesn't depend on any gpu compute toolkit.
+struct DeviceBuffers {
+	// cells. cells.f* is the current substep's force, cells.da* the angular displacement
+	// of the whole update once the substeps are done
+	KinematicState cells;
+	// forces and torques that aren't from the springs (joints, model contacts, friction,
+	// gravity): computed by the world once per update, constant over the substeps
+	std::vector<double> efx, efy, efz, etf;
+	std::vector<double> tf;              // total force (see Movable::receiveForce)
+	std::vector<double> adx, ady, adz;   // angular displacement of the previous substeps
+	// connections' springs (see Spring and BasicConnection::computeSpringForce)
+	std::vector<uint32_t> node0, node1;
+	std::vector<double> k, c, l, minLengthRatio, prevLength, length, dx, dy, dz;
+	std::vector<char> springEnabled;
+	// batch b is the connections [batches[b], batches[b + 1]). The last batch holds the
+	// ones that have to be computed one after the other
+	std::vector<size_t> batches;
+
+	size_t nbCells() const { return cells.size(); }
+	size_t nbConnections() const { return node0.size(); }
+	void resize(size_t nbCells, size_t nbConnections) {
+		cells.resize(nbCells);
+		for (auto *v : {&efx, &efy, &efz, &etf, &tf, &adx, &ady, &adz})
+			v->resize(nbCells);
+		node0.resize(nbConnections);
+		node1.resize(nbConnections);
+		for (auto *v : {&k, &c, &l, &minLengthRatio, &prevLength, &length, &dx, &dy, &dz})
+			v->resize(nbConnections);
+		springEnabled.resize(nbConnections);
+	}
+};
+
+// the kernels, one work item per index
+namespace DeviceKernels {
+// substep start: the constant forces only
+inline void resetForces(DeviceBuffers &b, size_t i) {
+	b.cells.fx[i] = b.efx[i];
+	b.cells.fy[i] = b.efy[i];
+	b.cells.fz[i] = b.efz[i];
+	b.tf[i] = b.etf[i];
+}
+
+// connection j, as Spring::updateLengthDirection then BasicConnection::computeSpringForce
+inline void spring(DeviceBuffers &b, size_t j, double h) {
+	KinematicState &s = b.cells;
+	const uint32_t n0 = b.node0[j], n1 = b.node1[j];
+	double dx = s.px[n1] - s.px[n0], dy = s.py[n1] - s.py[n0], dz = s.pz[n1] - s.pz[n0];
+	double len = sqrt(dx * dx + dy * dy + dz * dz);
+	if (len > 0) {
+		dx /= len;
+		dy /= len;
+		dz /= len;
+	}
+	if (b.springEnabled[j]) {
+		double x = len - b.l[j];
+		double minLength = b.minLengthRatio[j] * b.l[j];
+		if (len < minLength) {
+			// nodes pushed apart, normal velocities exchanged
+			double d = minLength - len;
+			double v0 = s.vx[n0] * dx + s.vy[n0] * dy + s.vz[n0] * dz;
+			double v1 = s.vx[n1] * dx + s.vy[n1] * dy + s.vz[n1] * dz;
+			s.px[n0] -= dx * d / 2.0;
+			s.py[n0] -= dy * d / 2.0;
+			s.pz[n0] -= dz * d / 2.0;
+			s.px[n1] += dx * d / 2.0;
+			s.py[n1] += dy * d / 2.0;
+			s.pz[n1] += dz * d / 2.0;
+			s.vx[n0] += (v1 - v0) * dx;
+			s.vy[n0] += (v1 - v0) * dy;
+			s.vz[n0] += (v1 - v0) * dz;
+			s.vx[n1] += (v0 - v1) * dx;
+			s.vy[n1] += (v0 - v1) * dy;
+			s.vz[n1] += (v0 - v1) * dz;
+			len = minLength;
+		}
+		double f = (-b.k[j] * x - b.c[j] * (len - b.prevLength[j]) / h) / 2.0;
+		s.fx[n0] -= dx * f;
+		s.fy[n0] -= dy * f;
+		s.fz[n0] -= dz * f;
+		s.fx[n1] += dx * f;
+		s.fy[n1] += dy * f;
+		s.fz[n1] += dz * f;
+		double tf = x < 0 ? f : -f;
+		b.tf[n0] += tf;
+		b.tf[n1] += tf;
+		b.prevLength[j] = len;
+	}
+	b.length[j] = len;
+	b.dx[j] = dx;
+	b.dy[j] = dy;
+	b.dz[j] = dz;
+}
+
+// cell i, as Verlet (see integrators.hpp). The angular displacement is summed over the
+// substeps, and left in cells.da* after the last one
+inline void verlet(DeviceBuffers &b, size_t i, double h, bool last) {
+	KinematicState &s = b.cells;
+	if (!s.movable[i]) return;
+	auto position = [&](std::vector<double> &p, std::vector<double> &pp,
+	                    std::vector<double> &v, const std::vector<double> &f) {
+		double oldVel = v[i];
+		v[i] = v[i] + f[i] * h / s.mass[i];
+		pp[i] = p[i];
+		p[i] = p[i] + (v[i] + oldVel) * h * 0.5;
+	};
+	position(s.px, s.ppx, s.vx, s.fx);
+	position(s.py, s.ppy, s.vy, s.fy);
+	position(s.pz, s.ppz, s.vz, s.fz);
+	auto orientation = [&](std::vector<double> &d, std::vector<double> &ad,
+	                       std::vector<double> &v, const std::vector<double> &t) {
+		double oldVel = v[i];
+		v[i] = v[i] + t[i] * h / s.inertia[i];
+		ad[i] += (v[i] + oldVel) * h * 0.5;
+		if (last) d[i] = ad[i];
+	};
+	orientation(s.dax, b.adx, s.avx, s.tx);
+	orientation(s.day, b.ady, s.avy, s.ty);
+	orientation(s.daz, b.adz, s.avz, s.tz);
+}
+}
+
+// what a device backend has to implement
+class ComputeBackend {
+public:
+	virtual ~ComputeBackend() {}
+	virtual void upload(DeviceBuffers &b) = 0;
+	// n substeps of h: forces reset to the constant ones, springs batch by batch, then
+	// Verlet integration of the movable cells
+	virtual void runSubsteps(unsigned int n, double h) = 0;
+	virtual void download(DeviceBuffers &b) = 0;
+};
+
+// The reference backend: runs the kernels on the cpu, on its own threads. The buffers
+// are used in place: upload and download copy nothing. Results don't depend on the nb
+// of threads.
+class HostBackend : public ComputeBackend {
+private:
+	DeviceBuffers *buffers = nullptr;
+	std::unique_ptr<ThreadPool> pool;
+
+	template <typename F> void launch(size_t n, F &&kernel) {
+		if (pool)
+			pool->parallelForChunks(n, [&](size_t first, size_t last, size_t) {
+				for (size_t i = first; i < last; ++i) kernel(i);
+			});
+		else
+			for (size_t i = 0; i < n; ++i) kernel(i);
+	}
+
+public:
+	explicit HostBackend(size_t nbThreads = 1) {
+		if (nbThreads > 1) pool.reset(new ThreadPool(nbThreads));
+	}
+
+	void upload(DeviceBuffers &b) { buffers = &b; }
+	void download(DeviceBuffers &) { buffers = nullptr; }
+
+	void runSubsteps(unsigned int n, double h) {
+		DeviceBuffers &b = *buffers;
+		const size_t nbBatches = b.batches.size() - 1;
+		launch(b.nbCells(), [&](size_t i) { b.adx[i] = b.ady[i] = b.adz[i] = 0; });
+		for (unsigned int s = 0; s < n; ++s) {
+			launch(b.nbCells(), [&](size_t i) { DeviceKernels::resetForces(b, i); });
+			for (size_t k = 0; k + 1 < nbBatches; ++k) {
+				const size_t first = b.batches[k];
+				launch(b.batches[k + 1] - first,
+				       [&](size_t j) { DeviceKernels::spring(b, first + j, h); });
+			}
+			for (size_t j = b.batches[nbBatches - 1]; j < b.batches[nbBatches]; ++j)
+				DeviceKernels::spring(b, j, h);
+			const bool last = s + 1 == n;
+			launch(b.nbCells(), [&](size_t i) { DeviceKernels::verlet(b, i, h, last); });
+		}
+	}
+};
+}
+#endif
@@ -9,12 +9,18 @@
 #include <iostream>
 #include <memory>
 #include <functional>
+#include <cstdint>
 #include "rotation.h"
 #include "movable.h"
 #include "orientable.h"
 #include "connection.h"
 #include "modelconnection.hpp"
 #include "model.h"
+#include "objectpool.hpp"
+#include "pointerset.hpp"
+#include "smallvector.hpp"
+#include "gridspan.hpp"
+#include "random.hpp"
 
 #define CUBICROOT2 1.25992104989
 #define VOLUMEPI 0.23873241463 // 1/(4/3*pi)
@@ -25,21 +31,61 @@ namespace MecaCell {
 template <typename Derived> class ConnectableCell : public Movable, public Orientable {
 protected:
 	using ConnectionType = Connection<Derived *>;
+	using ConnectionPool = ObjectPool<ConnectionType>;
 	using ModelConnectionType = CellModelConnection<Derived>;
-	bool dead = false; // is the cell dead or alive ?
-	array<double, 3> color = {{0.75, 0.12, 0.07}};
+	// nb of connections stored inline, beyond it they move to the heap
+	static const size_t NB_INLINE_CONNECTIONS = 8;
+	// beyond this nb of connected cells, isConnectedTo uses connectedCellsSet. Measured
+	// with benchmarks/connectionbench: both are on par for the 12 neighbours of a dense
+	// packing, the set is twice as fast when degrees reach hundreds, and cells with fewer
+	// connections don't pay for its memory
+	static const size_t LINEAR_SEARCH_MAX = NB_INLINE_CONNECTIONS;
+	// flags grouped together, away from the doubles
+	bool dead = false;   // is the cell dead or alive ?
+	bool tested = false; // has already been tested for collision
+	bool visible = true;
+	// connections sizes updates postponed while behaviours run concurrently (see
+	// BasicWorld::setParallelBehavior)
+	bool deferConnectionsUpdate = false;
+	bool connectionsUpdatePending = false;
+	// resting cells are put to sleep by the world (see BasicWorld::setSleeping)
+	bool asleep = false;
+	// copy of a cell owned by another rank (see DistributedWorld)
+	bool ghost = false;
+	array<float, 3> color = {{0.75f, 0.12f, 0.07f}}; // only drawn: float is enough
 	double radius = DEFAULT_CELL_RADIUS;
 	double baseRadius = DEFAULT_CELL_RADIUS;
 	double stiffness = DEFAULT_CELL_STIFFNESS;
 	double dampRatio = DEFAULT_CELL_DAMP_RATIO;
 	double angularStiffness = DEFAULT_CELL_ANG_STIFFNESS;
-	bool tested = false; // has already been tested for collision
-	vector<ConnectionType *> connections;
+	SmallVector<ConnectionType *, NB_INLINE_CONNECTIONS> connections;
 	vector<ModelConnectionType *> modelConnections;
-	vector<Derived *> connectedCells; // TODO: try with an unordered_set (easier check for
-	                                  // already connected)
+	// connectedCells[i] is the cell at the other end of connections[i]
+	SmallVector<Derived *, NB_INLINE_CONNECTIONS> connectedCells;
+	// same content, for the already connected check. Only filled while there are more
+	// than LINEAR_SEARCH_MAX connected cells
+	PointerSet<Derived> connectedCellsSet;
 	double pressure = 1.0;
-	bool visible = true;
+	uint64_t forceBatches = 0; // batches already used by this cell's connections (see
+	                           // BasicWorld::batchConnections)
+	GridSpan gridSpan;         // grid cells covered in the world's grid
+	size_t bufferIndex = 0;    // in the world's device buffers (see ComputeBackend)
+	uint64_t id = 0; // set by the world when the cell is added (see BasicWorld::addCell)
+	unsigned int restingFrames = 0; // consecutive updates spent at rest
+	RandomStream rng; // rekeyed on (world seed, id, frame) before each behaviour update
+
+public:
+	// what other cells' behaviours can read while behaviours run concurrently, as it was
+	// before the current wave of updates (see BasicWorld::setParallelBehavior)
+	struct PublishedState {
+		Vec position;
+		double radius = DEFAULT_CELL_RADIUS;
+		double pressure = 1.0;
+		bool dead = false;
+	};
+
+protected:
+	PublishedState published;
 
 public:
 	ConnectableCell(Vec pos) : Movable(pos) { randomColor(); }
@@ -47,13 +93,13 @@ public:
 	ConnectableCell(const Derived &c, const Vec &translation)
 	    : Movable(c.getPosition() + translation, c.mass),
 	      dead(false),
+	      tested(false),
 	      color(c.color),
 	      radius(c.radius),
 	      baseRadius(c.baseRadius),
 	      stiffness(c.stiffness),
 	      dampRatio(c.dampRatio),
-	      angularStiffness(c.angularStiffness),
-	      tested(false) {}
+	      angularStiffness(c.angularStiffness) {}
 
 	double getRadius() const { return radius; }
 	double getBaseRadius() const { return baseRadius; }
@@ -62,7 +108,41 @@ public:
 		if (i < 3) return color[i];
 		return 0;
 	}
-	const std::vector<Derived *> &getConnectedCells() const { return connectedCells; }
+	const SmallVector<Derived *, NB_INLINE_CONNECTIONS> &getConnectedCells() const {
+		return connectedCells;
+	}
+	// a linear search up to LINEAR_SEARCH_MAX connected cells, a lookup in a hash set
+	// (constant time) beyond
+	bool isConnectedTo(const Derived *c) const {
+		if (connectedCells.size() <= LINEAR_SEARCH_MAX)
+			return find(connectedCells.begin(), connectedCells.end(), c) != connectedCells.end();
+		return connectedCellsSet.contains(c);
+	}
+
+	uint64_t getId() const { return id; }
+	void setId(uint64_t i) { id = i; }
+	// this cell's draws of the current frame: the same whatever the thread that updates
+	// it and the order of the updates (see BasicWorld::setRandomSeed)
+	RandomStream &getRandomStream() { return rng; }
+
+	// a sleeping cell is neither integrated nor gets its forces computed. Changes of its
+	// connections wake it up; cells moved by hand should be woken up too
+	bool isAsleep() const { return asleep; }
+	void wakeUp() {
+		asleep = false;
+		restingFrames = 0;
+	}
+	void fallAsleep() {
+		asleep = true;
+		velocity = Vec::zero();
+		angularVelocity = Vec::zero();
+	}
+	unsigned int &getRestingFrames() { return restingFrames; }
+
+	// a ghost only mirrors a cell of another rank: the world doesn't update its
+	// behaviour. It isn't part of the cell's saved state
+	bool isGhost() const { return ghost; }
+	void setGhost(bool g) { ghost = g; }
 
 	double getPressure() const { return pressure; }
 
@@ -78,10 +158,19 @@ public:
 
 	double getSqradius() const { return radius * radius; }
 	bool alreadyTested() const { return tested; }
+	uint64_t &getForceBatches() { return forceBatches; }
+	GridSpan &getGridSpan() { return gridSpan; }
+	size_t &getBufferIndex() { return bufferIndex; }
 	int getNbConnections() const { return connections.size(); }
+	// memory used by the cell outside of its own object (its lists' heap blocks)
+	size_t getHeapBytes() const {
+		return connections.heapBytes() + connectedCells.heapBytes() +
+		       modelConnections.capacity() * sizeof(ModelConnectionType *) +
+		       connectedCellsSet.heapBytes();
+	}
 
 	void setVisible(bool v) { visible = v; }
-	bool getVisible() { return visible; }
+	bool getVisible() const { return visible; }
 	string toString() {
 		stringstream s;
 		s << "Cell " << this << " :" << endl;
@@ -135,20 +224,29 @@ public:
 	double getAdhesionWith(const Derived *d) { return self().getAdhesionWith(d); }
 	double getAdhesionWithModel(const string &) { return 0.7; }
 
-	vector<ConnectionType *> &getRWConnections() { return connections; }
+	SmallVector<ConnectionType *, NB_INLINE_CONNECTIONS> &getRWConnections() {
+		return connections;
+	}
 	vector<ModelConnectionType *> &getRWModelConnections() { return modelConnections; }
 
-	// TODO : try using set instead of vectors for connections (faster random deletion)
-	void addModelConnection(ModelConnectionType *con) { modelConnections.push_back(con); }
+	void addModelConnection(ModelConnectionType *con) {
+		con->cellSlot = modelConnections.size();
+		modelConnections.push_back(con);
+	}
+	// swaps con with the last model connection
 	void removeModelConnection(ModelConnectionType *con) {
-		modelConnections.erase(remove(modelConnections.begin(), modelConnections.end(), con),
-		                       modelConnections.end());
+		assert(modelConnections[con->cellSlot] == con);
+		modelConnections[con->cellSlot] = modelConnections.back();
+		modelConnections[con->cellSlot]->cellSlot = con->cellSlot;
+		modelConnections.pop_back();
 	}
 
 	/******************************
 	 * connections
 	 *****************************/
-	void connection(Derived *c, vector<ConnectionType *> &worldConnexions) {
+	// new connections are allocated from pool
+	void connection(Derived *c, vector<ConnectionType *> &worldConnexions,
+	                ConnectionPool &pool) {
 		if (c != this) {
 			Vec AB = c->position - position;
 			double sqdist = AB.sqlength();
@@ -156,8 +254,7 @@ public:
 			sql *= sql;
 			// interpenetration
 			if (sqdist <= sql) {
-				if (find(connectedCells.begin(), connectedCells.end(), c) ==
-				    connectedCells.end()) {
+				if (!isConnectedTo(c)) {
 					// if those cells aren't already connected
 					// we check if this connection would not go through an already connected cell
 					bool ok = true;
@@ -192,7 +289,7 @@ public:
 						    (dampRatio * radius + c->dampRatio * c->radius) / (radius + c->radius);
 						// double maxTeta = mix(0.0, M_PI / 2.0, minAdh);
 						double maxTeta = M_PI / 12.0;
-						ConnectionType *s = new ConnectionType(
+						ConnectionType *s = pool.create(
 						    pair<Derived *, Derived *>(selfptr(), c),
 						    Spring(k, dampingFromRatio(dr, mass + c->mass, k), l),
 						    make_pair(Joint(getAngularStiffness(),
@@ -218,6 +315,7 @@ public:
 						s->getTorsion().second.setCurrentKCoef(contactSurface);
 						addConnection(c, s);
 
+						s->worldSlot = worldConnexions.size();
 						worldConnexions.push_back(s);
 					}
 				}
@@ -233,6 +331,11 @@ public:
 	// area
 	//  (maybe directly from World?)
 	void updateAllConnections() {
+		if (deferConnectionsUpdate) {
+			connectionsUpdatePending = true;
+			return;
+		}
+		wakeUp();
 		for (auto &con : connections) {
 			Derived *otherCell =
 			    con->getNode0() == selfptr() ? con->getNode1() : con->getNode0();
@@ -242,7 +345,28 @@ public:
 		}
 	}
 
-	template <typename C = Derived> C *divide() { return divide<C>(Vec::randomUnit()); }
+	// copies the cell's readable state. Derived cells can publish their own fields by
+	// hiding this method (and calling it)
+	void publishState() {
+		published.position = position;
+		published.radius = radius;
+		published.pressure = pressure;
+		published.dead = dead;
+	}
+	const PublishedState &getPublishedState() const { return published; }
+
+	// the connections are shared with the other cells: while deferred, updateAllConnections
+	// only records that it has to be done
+	void setDeferredConnectionsUpdate(bool d) { deferConnectionsUpdate = d; }
+	void applyPendingConnectionsUpdate() {
+		if (connectionsUpdatePending) {
+			connectionsUpdatePending = false;
+			updateAllConnections();
+		}
+	}
+
+	// along a direction drawn from the cell's random stream
+	template <typename C = Derived> C *divide() { return divide<C>(rng.unitVector()); }
 
 	template <typename C = Derived> C *divide(const Vec &direction) {
 		setRadius(getBaseRadius());
@@ -259,19 +383,26 @@ public:
 		updateAllConnections();
 	}
 
+	// position of s in connections
+	size_t &getSlot(ConnectionType *s) {
+		return s->getNode0() == selfptr() ? s->nodeSlots.first : s->nodeSlots.second;
+	}
+
 	void addConnection(Derived *c, ConnectionType *s) {
-		connections.push_back(s);
-		c->connections.push_back(s);
-		connectedCells.push_back(c);
-		c->connectedCells.push_back(selfptr());
+		wakeUp();
+		c->wakeUp();
+		pushConnection(c, s);
+		c->pushConnection(selfptr(), s);
 	}
 
-	// erase cell from the connectedCells container
-	void eraseCell(Derived *cell) {
-		unsigned int prevC = connectedCells.size();
-		connectedCells.erase(remove(connectedCells.begin(), connectedCells.end(), cell),
-		                     connectedCells.end());
-		assert(connectedCells.size() == prevC - 1 || prevC == 0);
+	void pushConnection(Derived *c, ConnectionType *s) {
+		getSlot(s) = connections.size();
+		connections.push_back(s);
+		connectedCells.push_back(c);
+		if (connectedCells.size() == LINEAR_SEARCH_MAX + 1)
+			for (auto &o : connectedCells) connectedCellsSet.insert(o);
+		else if (connectedCells.size() > LINEAR_SEARCH_MAX + 1)
+			connectedCellsSet.insert(c);
 	}
 
 	// erase connection with a cell (calls deleteConnection(c,s))
@@ -292,39 +423,101 @@ public:
 	// destructors are not called
 	void removeConnection(Derived *c, ConnectionType *s) {
 		assert(c);
-		eraseCell(c);
-		c->eraseCell(selfptr());
 		eraseConnection(s);
 		c->eraseConnection(s);
 	}
 
-	// erase connection s f the connections container
+	// erase connection s (and the corresponding connected cell) in constant time: the last
+	// connection takes its place
 	void eraseConnection(ConnectionType *s) {
-		connections.erase(remove(connections.begin(), connections.end(), s),
-		                  connections.end());
+		wakeUp();
+		size_t i = getSlot(s);
+		assert(connections[i] == s);
+		if (connectedCells.size() == LINEAR_SEARCH_MAX + 1)
+			connectedCellsSet = PointerSet<Derived>();
+		else if (connectedCells.size() > LINEAR_SEARCH_MAX + 1)
+			connectedCellsSet.erase(connectedCells[i]);
+		connections[i] = connections.back();
+		connectedCells[i] = connectedCells.back();
+		getSlot(connections[i]) = i;
+		connections.pop_back();
+		connectedCells.pop_back();
 	}
 
-	void eraseAndDeleteAllConnections(std::vector<ConnectionType *> &aux) {
-		for (auto cIt = connections.begin(); cIt != connections.end();) {
-			ConnectionType *sp = *cIt;
-			auto otherCell = sp->getNode0() == this ? sp->getNode1() : sp->getNode0();
+	// the world's list of connections (aux) is not compacted: the deleted connections are
+	// replaced by nullptr (see BasicWorld::compactConnections)
+	void eraseAndDeleteAllConnections(std::vector<ConnectionType *> &aux,
+	                                  ConnectionPool &pool) {
+		for (size_t i = 0; i < connections.size();) {
+			ConnectionType *sp = connections[i];
+			Derived *otherCell = connectedCells[i];
 			if (otherCell != nullptr) {
-				aux.erase(remove(aux.begin(), aux.end(), sp), aux.end());
-				connectedCells.erase(
-				    remove(connectedCells.begin(), connectedCells.end(), otherCell),
-				    connectedCells.end());
-				otherCell->connectedCells.erase(remove(otherCell->connectedCells.begin(),
-				                                       otherCell->connectedCells.end(), this),
-				                                otherCell->connectedCells.end());
+				aux[sp->worldSlot] = nullptr;
 				otherCell->eraseConnection(sp);
-				cIt = connections.erase(cIt);
-				delete sp;
+				eraseConnection(sp); // connections[i] is now another connection
+				pool.destroy(sp);
 			} else {
-				++cIt;
+				++i;
 			}
 		}
 	}
 
+	/******************************
+	 * checkpoints
+	 *****************************/
+	// cells with more state can hide these two methods, calling them first. Connections
+	// are restored by the world (see BasicWorld::loadCheckpoint)
+	template <typename W> void saveState(W &w) const {
+		Movable::saveState(w);
+		Orientable::saveState(w);
+		w.put(id);
+		w.put(dead);
+		w.put(color);
+		w.put(radius);
+		w.put(baseRadius);
+		w.put(stiffness);
+		w.put(dampRatio);
+		w.put(angularStiffness);
+		w.put(pressure);
+		w.put(visible);
+		w.put(asleep);
+		w.put(restingFrames);
+	}
+	template <typename R> void loadState(R &r) {
+		Movable::loadState(r);
+		Orientable::loadState(r);
+		r.get(id);
+		r.get(dead);
+		r.get(color);
+		r.get(radius);
+		r.get(baseRadius);
+		r.get(stiffness);
+		r.get(dampRatio);
+		r.get(angularStiffness);
+		r.get(pressure);
+		r.get(visible);
+		r.get(asleep);
+		r.get(restingFrames);
+	}
+
+	// puts connection s at its saved slot (see Connection::nodeSlots), for cells whose
+	// connections lists have been resized to their saved sizes
+	void restoreConnection(Derived *c, ConnectionType *s) {
+		size_t i = getSlot(s);
+		connections[i] = s;
+		connectedCells[i] = c;
+		if (connectedCells.size() > LINEAR_SEARCH_MAX) connectedCellsSet.insert(c);
+	}
+	void resizeConnections(size_t n) {
+		connections.assign(n, nullptr);
+		connectedCells.assign(n, nullptr);
+		connectedCellsSet = PointerSet<Derived>();
+	}
+	void resizeModelConnections(size_t n) { modelConnections.assign(n, nullptr); }
+	void restoreModelConnection(ModelConnectionType *con) {
+		modelConnections[con->cellSlot] = con;
+	}
+
 	/******************************
 	 * division and control
 	 *****************************/
@@ -1,5 +1,6 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
+#include "quaternion.h"
 #include "tools.h"
 
 #define MAX_TS_INCL                                                                      \
@@ -39,9 +40,13 @@ struct Joint {
 	double currentK = 1.0;
 	double c = 1.0;               // damp
 	double maxTeta = M_PI / 20.0; // maximum angle
-	Rotation<Vec> r;              // rotation from node to joint
+#if MECACELL_QUATERNIONS
+	Quaternion r = Quaternion::identity(); // rotation from node to joint
+#else
+	Rotation<Vec> r; // rotation from node to joint
+#endif
 	Rotation<Vec> delta;          // current rotation
-	Rotation<Vec> prevDelta;
+	double prevTeta = 0;          // delta's angle at the previous update
 	Vec direction;                  // current direction
 	Vec target;                     // targeted direction
 	bool maxTetaAutoCorrect = true; // do we need to handle maxTeta?
@@ -51,10 +56,32 @@ struct Joint {
 	Joint(const double &K, const double &C, const double &MTETA, bool handleMteta = true)
 	    : k(K), c(C), maxTeta(MTETA), maxTetaAutoCorrect(handleMteta) {}
 
+#if MECACELL_QUATERNIONS
+	// joint's frame: basis b (world coordinates) attached to node
+	template <typename N> void setFrame(N *node, const Basis<Vec> &b) {
+		r = node->getOrientationQuaternion().conjugated() *
+		    Quaternion::betweenBases(Vec(1, 0, 0), Vec(0, 1, 0), b.X, b.Y);
+	}
+	// current direction: the node's X (flexure) or Y (torsion) axis, rotated with r
+	template <typename N> void updateDirection(N *node, bool torsion) {
+		Vec axis = torsion ? Vec(0, 1, 0) : Vec(1, 0, 0);
+		direction = (node->getOrientationQuaternion() * r) * axis;
+	}
+#else
+	// joint's frame: basis b (world coordinates) attached to node
+	template <typename N> void setFrame(N *node, const Basis<Vec> &b) {
+		r = node->getOrientationRotation().inverted() + Vec::getRotation(Basis<Vec>(), b);
+	}
 	// current direction is computed using a reference Vector v rotated with rotation rot
 	void updateDirection(const Vec &v, const Rotation<Vec> &rot) {
 		direction = v.rotated(r.rotated(rot));
 	}
+	// current direction: the node's X (flexure) or Y (torsion) axis, rotated with r
+	template <typename N> void updateDirection(N *node, bool torsion) {
+		const Basis<Vec> o = node->getOrientation();
+		updateDirection(torsion ? o.Y : o.X, node->getOrientationRotation());
+	}
+#endif
 	void updateDelta() { delta = Vec::getRotation(direction, target); }
 	void setCurrentKCoef(double kc) { currentK = k * kc; }
 };
@@ -62,6 +89,77 @@ struct Joint {
 ////////////////////////////////////////////////////////////////////
 //                      CONNECTION CLASS
 ////////////////////////////////////////////////////////////////////
+// Joint policies of a Connection, chosen at compile time:
+struct SpringAndJoints {}; // 1 spring + 1 flexure and 1 torsion joint per node
+struct SpringOnly {};      // 1 spring, no joint state at all (cell - model contacts)
+
+// the two nodes and the spring, common to all the Connection variants
+template <typename N0, typename N1> class BasicConnection {
+protected:
+	pair<N0, N1> connected; // the two connected nodes
+	Spring sc;              // basic spring
+
+public:
+	BasicConnection(const pair<N0, N1> &n, const Spring &S) : connected{n}, sc(S) {
+		initS();
+	}
+
+	void initS() {
+		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
+		                         ptr(connected.second)->getPosition());
+		sc.prevLength = sc.length;
+	}
+	/**********************************************
+	 *                GET & SET
+	 **********************************************/
+	Spring &getSc() { return sc; }
+	N0 &getNode0() { return connected.first; }
+	N1 &getNode1() { return connected.second; }
+	float getLength() { return sc.length; }
+	void setBaseLength(const double d) { sc.l = d; }
+	Vec getDirection() { return sc.direction; }
+	template <typename R, typename T> R &getOtherNode(const T &n) {
+		return n == connected.first ? connected.second : connected.first;
+	}
+
+	/**********************************************
+	 *              UPDATES
+	 **********************************************/
+	void updateLengthDirection() {
+		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
+		                         ptr(connected.second)->getPosition());
+	}
+
+	// spring force, sc's length & direction must be up to date
+	void computeSpringForce(double dt) {
+		double x = sc.length - sc.l; // actual compression / elongation
+		double minlength = sc.minLengthRatio * sc.l;
+		if (sc.length < minlength) {
+			double d = minlength - sc.length;
+			Vec component0 =
+			    ptr(connected.first)->getVelocity().dot(sc.direction) * sc.direction;
+			Vec tangent0 = ptr(connected.first)->getVelocity() - component0;
+			Vec component1 =
+			    ptr(connected.second)->getVelocity().dot(sc.direction) * sc.direction;
+			Vec tangent1 = ptr(connected.second)->getVelocity() - component1;
+			ptr(connected.first)
+			    ->setPosition(ptr(connected.first)->getPosition() - sc.direction * d / 2.0);
+			ptr(connected.second)
+			    ->setPosition(ptr(connected.second)->getPosition() + sc.direction * d / 2.0);
+			ptr(connected.first)->setVelocity(tangent0 + component1);
+			ptr(connected.second)->setVelocity(tangent1 + component0);
+			sc.length = minlength;
+		}
+		bool compression = x < 0;
+		double v = sc.length - sc.prevLength;
+		double k = sc.k; // compression ? sc.k : sc.k * 0.2;
+		double f = (-k * x - sc.c * v / dt) / 2.0;
+		ptr(connected.first)->receiveForce(f, -sc.direction, compression);
+		ptr(connected.second)->receiveForce(f, sc.direction, compression);
+		sc.prevLength = sc.length;
+	}
+};
+
 // Connects 2 "connectable" nodes with 1 "classic" spring,
 // 1 flexure and 1 torsion joint per node. By default those 3 types of
 // connections are enabled but one can easily choose to use only a subset
@@ -77,125 +175,96 @@ struct Joint {
 // - double getInertia()
 // - void receiveForce(double intensity, Vec direction, bool compressive)
 // - void receiveTorque(Vec acc)
-template <typename N0, typename N1 = N0> class Connection {
+template <typename N0, typename N1 = N0, typename Joints = SpringAndJoints>
+class Connection : public BasicConnection<N0, N1> {
 private:
-	pair<N0, N1> connected;    // the two connected nodes
-	Spring sc;                 // basic spring
+	using BasicConnection<N0, N1>::connected;
+	using BasicConnection<N0, N1>::sc;
 	pair<Joint, Joint> fj, tj; // flexure and torsion joints (1 per node)
 
 public:
 	bool scEnabled = true, fjEnabled = true, tjEnabled = false;
+	// positions of this connection in the containers holding it, so that it can be
+	// removed in constant time (see ConnectableCell::eraseConnection)
+	size_t worldSlot = 0;           // in the world's list
+	pair<size_t, size_t> nodeSlots; // in each node's list
 	/**********************************************
 	 *               CONSTRUCTOR
 	 **********************************************/
 	Connection(const pair<N0, N1> &n, const Spring &S)
-	    : connected{n}, sc(S), fjEnabled(false), tjEnabled(false) {
-		initS();
-	}
+	    : BasicConnection<N0, N1>(n, S), fjEnabled(false), tjEnabled(false) {}
 	Connection(const pair<N0, N1> &n, const pair<Joint, Joint> &FJ,
 	           const pair<Joint, Joint> &TJ)
-	    : connected{n}, fj(FJ), tj(TJ), scEnabled(false) {
-		initS();
+	    : BasicConnection<N0, N1>(n, Spring()), fj(FJ), tj(TJ), scEnabled(false) {
 		initFJ();
 	}
 	Connection(const pair<N0, N1> &n, const Spring &SC, const pair<Joint, Joint> &FJ,
 	           const pair<Joint, Joint> &TJ)
-	    : connected{n}, sc(SC), fj(FJ), tj(TJ) {
-		initS();
+	    : BasicConnection<N0, N1>(n, SC), fj(FJ), tj(TJ) {
 		initFJ();
 	}
 
-	void initS() {
-		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
-		                         ptr(connected.second)->getPosition());
-		sc.prevLength = sc.length;
-	}
 	void initFJ() {
 		Vec ortho = sc.direction.ortho();
 		// rotations for joints (cell base to connection) =
 		// cellBasis -> worldBasis + worldBasis -> connectionBasis
-		fj.first.r = ptr(connected.first)->getOrientationRotation().inverted() +
-		             Vec::getRotation(Basis<Vec>(), Basis<Vec>(sc.direction, ortho));
-		fj.second.r = ptr(connected.second)->getOrientationRotation().inverted() +
-		              Vec::getRotation(Basis<Vec>(), Basis<Vec>(-sc.direction, ortho));
+		fj.first.setFrame(ptr(connected.first), Basis<Vec>(sc.direction, ortho));
+		fj.second.setFrame(ptr(connected.second), Basis<Vec>(-sc.direction, ortho));
 		tj.first.r = fj.first.r;
 		tj.second.r = fj.second.r;
 
 		// joint's current direction
-		fj.first.updateDirection(ptr(connected.first)->getOrientation().X,
-		                         ptr(connected.first)->getOrientationRotation());
-		fj.second.updateDirection(ptr(connected.second)->getOrientation().X,
-		                          ptr(connected.second)->getOrientationRotation());
-		tj.first.updateDirection(ptr(connected.first)->getOrientation().Y,
-		                         ptr(connected.first)->getOrientationRotation());
-		tj.second.updateDirection(ptr(connected.second)->getOrientation().Y,
-		                          ptr(connected.second)->getOrientationRotation());
+		fj.first.updateDirection(ptr(connected.first), false);
+		fj.second.updateDirection(ptr(connected.second), false);
+		tj.first.updateDirection(ptr(connected.first), true);
+		tj.second.updateDirection(ptr(connected.second), true);
 	}
 	/**********************************************
 	 *                GET & SET
 	 **********************************************/
-	Spring &getSc() { return sc; }
 	pair<Joint, Joint> &getFlex() { return fj; }
 	pair<Joint, Joint> &getTorsion() { return tj; }
-	N0 &getNode0() { return connected.first; }
-	N1 &getNode1() { return connected.second; }
-	float getLength() { return sc.length; }
-	void setBaseLength(const double d) { sc.l = d; }
-	Vec getDirection() { return sc.direction; }
-	template <typename R, typename T> R &getOtherNode(const T &n) {
-		return n == connected.first ? connected.second : connected.first;
+
+	/**********************************************
+	 *              CHECKPOINTS
+	 **********************************************/
+	// springs, joints and flags. The nodes are saved by their owner
+	template <typename W> void saveState(W &w) const {
+		w.put(sc);
+		w.put(fj);
+		w.put(tj);
+		w.put(scEnabled);
+		w.put(fjEnabled);
+		w.put(tjEnabled);
+	}
+	template <typename R> void loadState(R &r) {
+		r.get(sc);
+		r.get(fj);
+		r.get(tj);
+		r.get(scEnabled);
+		r.get(fjEnabled);
+		r.get(tjEnabled);
 	}
 
 	/**********************************************
 	 *              UPDATES
 	 **********************************************/
-	void updateLengthDirection() {
-		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
-		                         ptr(connected.second)->getPosition());
-	}
 	void computeForces(double dt) {
 		// BASIC SPRING
-		sc.updateLengthDirection(ptr(connected.first)->getPosition(),
-		                         ptr(connected.second)->getPosition());
-		if (scEnabled) {
-			double x = sc.length - sc.l; // actual compression / elongation
-			double minlength = sc.minLengthRatio * sc.l;
-			if (sc.length < minlength) {
-				double d = minlength - sc.length;
-				Vec component0 =
-				    ptr(connected.first)->getVelocity().dot(sc.direction) * sc.direction;
-				Vec tangent0 = ptr(connected.first)->getVelocity() - component0;
-				Vec component1 =
-				    ptr(connected.second)->getVelocity().dot(sc.direction) * sc.direction;
-				Vec tangent1 = ptr(connected.second)->getVelocity() - component1;
-				ptr(connected.first)
-				    ->setPosition(ptr(connected.first)->getPosition() - sc.direction * d / 2.0);
-				ptr(connected.second)
-				    ->setPosition(ptr(connected.second)->getPosition() + sc.direction * d / 2.0);
-				ptr(connected.first)->setVelocity(tangent0 + component1);
-				ptr(connected.second)->setVelocity(tangent1 + component0);
-				sc.length = minlength;
-			}
-			bool compression = x < 0;
-			double v = sc.length - sc.prevLength;
-			double k = sc.k; // compression ? sc.k : sc.k * 0.2;
-			double f = (-k * x - sc.c * v / dt) / 2.0;
-			ptr(connected.first)->receiveForce(f, -sc.direction, compression);
-			ptr(connected.second)->receiveForce(f, sc.direction, compression);
-			sc.prevLength = sc.length;
-		}
+		this->updateLengthDirection();
+		if (scEnabled) this->computeSpringForce(dt);
+		computeJointForces();
+	}
+
+	void computeJointForces() {
 		// update directions of both flex and tosion springs
 		if (fjEnabled) {
-			fj.first.updateDirection(ptr(connected.first)->getOrientation().X,
-			                         ptr(connected.first)->getOrientationRotation());
-			fj.second.updateDirection(ptr(connected.second)->getOrientation().X,
-			                          ptr(connected.second)->getOrientationRotation());
+			fj.first.updateDirection(ptr(connected.first), false);
+			fj.second.updateDirection(ptr(connected.second), false);
 		}
 		if (tjEnabled) {
-			tj.first.updateDirection(ptr(connected.first)->getOrientation().Y,
-			                         ptr(connected.first)->getOrientationRotation());
-			tj.second.updateDirection(ptr(connected.second)->getOrientation().Y,
-			                          ptr(connected.second)->getOrientationRotation());
+			tj.first.updateDirection(ptr(connected.first), true);
+			tj.second.updateDirection(ptr(connected.second), true);
 		}
 		if (tjEnabled || fjEnabled) {
 			updateFT<0>();
@@ -217,11 +286,8 @@ public:
 			if (fjNode.maxTetaAutoCorrect &&
 			    fjNode.delta.teta > fjNode.maxTeta) { // if we passed flex break angle
 				float dif = fjNode.delta.teta - fjNode.maxTeta;
-				fjNode.r = fjNode.r + Rotation<Vec>(fjNode.delta.n, dif);
 				fjNode.direction = fjNode.direction.rotated(Rotation<Vec>(fjNode.delta.n, dif));
-				fjNode.r = node->getOrientationRotation().inverted() +
-				           Vec::getRotation(Basis<Vec>(), Basis<Vec>(fjNode.direction,
-				                                                     fjNode.direction.ortho()));
+				fjNode.setFrame(node, Basis<Vec>(fjNode.direction, fjNode.direction.ortho()));
 			}
 			// flex torque and force
 			fjNode.delta.n.normalize();
@@ -229,7 +295,7 @@ public:
 			                                    ptr(connected.second)->getPosition())
 			                                       .length();
 			double torque = fjNode.currentK * fjNode.delta.teta +
-			                fjNode.c * (fjNode.delta.teta - fjNode.prevDelta.teta); // -kx - cv
+			                fjNode.c * (fjNode.delta.teta - fjNode.prevTeta); // -kx - cv
 			Vec vFlex = fjNode.delta.n * torque;                                    // torque
 			Vec ortho = sc.direction.ortho(fjNode.delta.n).normalized(); // force direction
 			Vec force = sign * ortho * torque / d;
@@ -238,7 +304,7 @@ public:
 			other->receiveForce(force);
 
 			node->receiveTorque(vFlex);
-			fjNode.prevDelta = fjNode.delta;
+			fjNode.prevTeta = fjNode.delta.teta;
 		}
 		if (tjEnabled) {
 			// updating torsion joint (needs to stay perp to sc.direction)
@@ -246,9 +312,7 @@ public:
 			// if the angle between our torsion spring and sc.direction is too far from 90°,
 			// we reproject & recompute it
 			if (abs(scalar) > MAX_TS_INCL) {
-				tjNode.r = node->getOrientationRotation().inverted() +
-				           Vec::getRotation(Basis<Vec>(Vec(1, 0, 0), Vec(0, 1, 0)),
-				                            Basis<Vec>(sc.direction, tjNode.direction));
+				tjNode.setFrame(node, Basis<Vec>(sc.direction, tjNode.direction));
 			} else {
 				tjNode.direction = tjNode.direction.normalized() - scalar * sc.direction;
 			}
@@ -267,5 +331,27 @@ public:
 		}
 	}
 };
+
+// spring only variant: same spring as above, always enabled, without any joint state
+// nor flag to test
+template <typename N0, typename N1>
+class Connection<N0, N1, SpringOnly> : public BasicConnection<N0, N1> {
+private:
+	using BasicConnection<N0, N1>::sc;
+
+public:
+	static const bool scEnabled = true, fjEnabled = false, tjEnabled = false;
+
+	Connection(const pair<N0, N1> &n, const Spring &S) : BasicConnection<N0, N1>(n, S) {}
+
+	template <typename W> void saveState(W &w) const { w.put(sc); }
+	template <typename R> void loadState(R &r) { r.get(sc); }
+
+	void computeForces(double dt) {
+		this->updateLengthDirection();
+		this->computeSpringForce(dt);
+	}
+	void computeJointForces() {}
+};
 }
 #endif
@@ -0,0 +1,315 @@
+#ifndef MECACELL_DISTRIBUTEDWORLD_HPP
+#define MECACELL_DISTRIBUTEDWORLD_HPP
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "basicworld.hpp"
+#include "checkpoint.hpp"
+#include "communicator.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                     DISTRIBUTED WORLD
+////////////////////////////////////////////////////////////////////
+// A world split over the ranks of a Communicator. Space is cut in slabs along x, one
+// per rank, and each rank runs a BasicWorld (with its grid broad phase) holding:
+// - the cells it owns: those in its slab
+// - ghosts: copies of the other ranks' cells within the halo width of its slab. They
+//   take part in the collisions and connections of the owned cells, but they are
+//   neither integrated nor updated (see ConnectableCell::isGhost)
+// Each update:
+// 1. every balancing period, the slabs' boundaries are moved to the quantiles of the
+//    cells' x: every rank gets about the same number of cells
+// 2. ghosts exchange: owned cells within the halo of another slab are sent to its
+//    rank, which refreshes or creates their ghosts and deletes the ones it didn't get
+// 3. migration: owned cells out of their slab are sent to their new owner with their
+//    connections. There, they replace their ghost and the connections it had; the
+//    sender keeps them as ghosts.
+// 4. the local update, then the smallest dt of all the ranks (with adaptive dt)
+// With a halo wider than the longest connection (the sum of two radii), an owned cell
+// and its ghosts have the same neighbours. Ghosts are only refreshed before the local
+// update though: during its collisions, they are an integration step behind, and the
+// two sides of a boundary can disagree on a new connection for an update.
+// Cell ids are unique over all the ranks (rank + k x nb of ranks), so the cells'
+// random streams don't depend on which rank owns them.
+// Cells with more state hide saveState and loadState, as for checkpoints. Cell - model
+// contacts aren't migrated, the new owner finds them again: models have to be added
+// to each rank's local world.
+template <typename Cell, typename Integrator, template <typename> class GridType = FlatGrid>
+class DistributedWorld {
+public:
+	using world_type = BasicWorld<Cell, Integrator, GridType>;
+	using connect_type = typename world_type::connect_type;
+
+protected:
+	Communicator &comm;
+	world_type local;
+	// boundaries[q] is the upper x of rank q's slab and the lower x of rank q + 1's
+	vector<double> boundaries;
+	unsigned int balancingPeriod = 50;
+	bool balanced = false;
+	double halo = 3.0 * DEFAULT_CELL_RADIUS;
+	bool seedShared = false;
+	size_t nbMigrations = 0; // cells sent to other ranks
+	unordered_map<uint64_t, Cell *> cellsById; // owned and ghost cells
+	// messages to and from every rank
+	vector<CheckpointWriter> cellsOut, connectionsOut;
+	vector<vector<char>> sendBuffers, recvBuffers;
+	static const size_t NB_BALANCING_BINS = 1024;
+	static double inf() { return std::numeric_limits<double>::infinity(); }
+
+public:
+	explicit DistributedWorld(Communicator &c)
+	    : comm(c), boundaries(max(0, c.size() - 1), inf()) {
+		local.setCellIds(comm.rank(), comm.size());
+	}
+
+	/**********************************************
+	 *                 GET & SET                  *
+	 *********************************************/
+	// the rank's BasicWorld, to set its options, add models or read its cells (owned
+	// and ghosts)
+	world_type &getLocalWorld() { return local; }
+	Communicator &getCommunicator() { return comm; }
+	// ghosts are the cells closer than the halo width to the slab
+	void setHaloWidth(double h) { halo = h; }
+	double getHaloWidth() const { return halo; }
+	// the slabs are balanced at the first update, then every period updates (never
+	// again with 0)
+	void setLoadBalancingPeriod(unsigned int p) { balancingPeriod = p; }
+	double getSlabLow(int q) const {
+		return q > 0 ? boundaries[q - 1] : -inf();
+	}
+	double getSlabHigh(int q) const {
+		return q < comm.size() - 1 ? boundaries[q] : inf();
+	}
+	int ownerOf(const Vec &p) const {
+		return static_cast<int>(upper_bound(boundaries.begin(), boundaries.end(), p.x) -
+		                        boundaries.begin());
+	}
+	vector<Cell *> getOwnedCells() const {
+		vector<Cell *> res;
+		for (auto &c : local.cells)
+			if (!c->isGhost()) res.push_back(c);
+		return res;
+	}
+	size_t getNbOwnedCells() const {
+		size_t n = 0;
+		for (auto &c : local.cells) n += !c->isGhost();
+		return n;
+	}
+	size_t getNbGhostCells() const { return local.cells.size() - getNbOwnedCells(); }
+	// collective: every rank has to call it
+	size_t getGlobalNbCells() {
+		return static_cast<size_t>(
+		    comm.allReduce(static_cast<double>(getNbOwnedCells()), ReduceOp::sum));
+	}
+	size_t getNbMigrations() const { return nbMigrations; }
+	int getNbUpdates() const { return local.getNbUpdates(); }
+
+	// cells can be added on any rank: they are sent to their owner at the next update
+	void addCell(Cell *c) { local.addCell(c); }
+
+	/**********************************************
+	 *             MAIN UPDATE ROUTINE            *
+	 *********************************************/
+	// collective: every rank has to call it
+	void update() {
+		if (!seedShared) shareRandomSeed();
+		const int frame = local.getNbUpdates();
+		if (!balanced || (balancingPeriod > 0 && frame % balancingPeriod == 0)) balance();
+		exchangeGhosts();
+		migrate();
+		local.update();
+		if (local.getAdaptiveDt())
+			local.setDt(comm.allReduce(local.getDt(), ReduceOp::min));
+	}
+
+protected:
+	/**********************************************
+	 *             UPDATE SUBROUTINES             *
+	 *********************************************/
+	void indexCells() {
+		cellsById.clear();
+		cellsById.reserve(local.cells.size());
+		for (auto &c : local.cells) cellsById[c->getId()] = c;
+	}
+
+	void resetOutboxes() {
+		cellsOut.assign(comm.size(), CheckpointWriter());
+		connectionsOut.assign(comm.size(), CheckpointWriter());
+	}
+
+	// every rank uses rank 0's random seed
+	void shareRandomSeed() {
+		sendBuffers.assign(comm.size(), vector<char>());
+		if (comm.rank() == 0) {
+			CheckpointWriter w;
+			w.put(local.getRandomSeed());
+			sendBuffers.assign(comm.size(), w.release());
+		}
+		comm.allToAll(sendBuffers, recvBuffers);
+		CheckpointReader r(recvBuffers[0]);
+		local.setRandomSeed(r.get<uint64_t>());
+		seedShared = true;
+	}
+
+	// boundaries at the quantiles of a histogram of the owned cells' x
+	void balance() {
+		balanced = true;
+		const int n = comm.size();
+		if (n == 1) return;
+		vector<double> range = {inf(), inf()}; // min x, -max x
+		for (auto &c : local.cells)
+			if (!c->isGhost()) {
+				range[0] = min(range[0], c->getPosition().x);
+				range[1] = min(range[1], -c->getPosition().x);
+			}
+		comm.allReduce(range, ReduceOp::min);
+		if (range[0] > -range[1]) return; // no cells
+		const double lo = range[0];
+		const double w = max(-range[1] - lo, 1e-9) / NB_BALANCING_BINS;
+		vector<double> histogram(NB_BALANCING_BINS, 0.0);
+		for (auto &c : local.cells)
+			if (!c->isGhost()) {
+				size_t b = static_cast<size_t>((c->getPosition().x - lo) / w);
+				histogram[min(b, NB_BALANCING_BINS - 1)] += 1.0;
+			}
+		comm.allReduce(histogram, ReduceOp::sum);
+		double total = 0;
+		for (auto &h : histogram) total += h;
+		size_t b = 0;
+		double cumul = 0;
+		for (int q = 0; q < n - 1; ++q) {
+			double target = total * (q + 1) / n;
+			while (b < NB_BALANCING_BINS - 1 && cumul + histogram[b] < target)
+				cumul += histogram[b++];
+			double f = histogram[b] > 0 ? min(1.0, (target - cumul) / histogram[b]) : 0.0;
+			boundaries[q] = lo + (b + f) * w;
+		}
+	}
+
+	// cells: id then state (see ConnectableCell::saveState)
+	void exchangeGhosts() {
+		const int n = comm.size(), me = comm.rank();
+		resetOutboxes();
+		for (auto &c : local.cells) {
+			if (c->isGhost()) continue;
+			double x = c->getPosition().x;
+			for (int q = 0; q < n; ++q)
+				if (q != me && x >= getSlabLow(q) - halo && x < getSlabHigh(q) + halo) {
+					cellsOut[q].put(c->getId());
+					c->saveState(cellsOut[q]);
+				}
+		}
+		sendBuffers.resize(n);
+		for (int q = 0; q < n; ++q) sendBuffers[q] = cellsOut[q].release();
+		comm.allToAll(sendBuffers, recvBuffers);
+		indexCells();
+		// ghosts that aren't received stay dead (the state of the others is alive)
+		for (auto &c : local.cells)
+			if (c->isGhost()) c->die();
+		for (int q = 0; q < n; ++q) {
+			CheckpointReader r(recvBuffers[q]);
+			while (r.ok() && !r.atEnd()) {
+				uint64_t id = r.get<uint64_t>();
+				Cell *c = cellsById.count(id) ? cellsById[id] : nullptr;
+				if (!c) {
+					c = new Cell(Vec::zero());
+					c->setGhost(true);
+					local.addCell(c);
+					cellsById[id] = c;
+				}
+				double radius = c->getRadius();
+				c->loadState(r);
+				c->disableMovement();
+				if (c->getRadius() != radius) c->updateAllConnections();
+			}
+		}
+		local.destroyCells();
+	}
+
+	// a message holds its nb of cells, the cells (id then state) and their connections
+	// (cell id, other cell id, is the cell the node 0, Connection::saveState)
+	void migrate() {
+		const int n = comm.size(), me = comm.rank();
+		resetOutboxes();
+		vector<uint64_t> nbCellsOut(n, 0);
+		vector<Cell *> leaving;
+		for (auto &c : local.cells) {
+			if (c->isGhost()) continue;
+			int q = ownerOf(c->getPosition());
+			if (q == me) continue;
+			++nbCellsOut[q];
+			cellsOut[q].put(c->getId());
+			c->saveState(cellsOut[q]);
+			const auto &cons = c->getRWConnections();
+			const auto &others = c->getConnectedCells();
+			for (size_t i = 0; i < cons.size(); ++i) {
+				connectionsOut[q].put(c->getId());
+				connectionsOut[q].put(others[i]->getId());
+				connectionsOut[q].put(cons[i]->getNode0() == c);
+				cons[i]->saveState(connectionsOut[q]);
+			}
+			leaving.push_back(c);
+		}
+		for (auto &c : leaving) {
+			c->setGhost(true);
+			c->disableMovement();
+		}
+		nbMigrations += leaving.size();
+		sendBuffers.resize(n);
+		for (int q = 0; q < n; ++q) {
+			CheckpointWriter w;
+			w.put(nbCellsOut[q]);
+			sendBuffers[q] = w.release();
+			for (auto *part : {&cellsOut[q], &connectionsOut[q]}) {
+				vector<char> d = part->release();
+				sendBuffers[q].insert(sendBuffers[q].end(), d.begin(), d.end());
+			}
+		}
+		comm.allToAll(sendBuffers, recvBuffers);
+		indexCells();
+		// the cells first: they can be connected to each other
+		vector<CheckpointReader> readers;
+		vector<Cell *> arrived;
+		for (int q = 0; q < n; ++q) {
+			readers.emplace_back(recvBuffers[q]);
+			CheckpointReader &r = readers.back();
+			uint64_t nbCells = r.get<uint64_t>();
+			for (uint64_t i = 0; i < nbCells && r.ok(); ++i) {
+				uint64_t id = r.get<uint64_t>();
+				Cell *c = cellsById.count(id) ? cellsById[id] : nullptr;
+				if (!c) {
+					c = new Cell(Vec::zero());
+					local.addCell(c);
+					cellsById[id] = c;
+				}
+				c->loadState(r);
+				c->setGhost(false);
+				arrived.push_back(c);
+			}
+		}
+		// the connections they had as ghosts are replaced by the sender's ones
+		local.deleteConnections(arrived);
+		for (auto &r : readers) {
+			while (r.ok() && !r.atEnd()) {
+				Cell *c = cellsById[r.get<uint64_t>()];
+				uint64_t otherId = r.get<uint64_t>();
+				bool node0 = r.get<bool>();
+				Cell *o = cellsById.count(otherId) ? cellsById[otherId] : nullptr;
+				if (o && !c->isConnectedTo(o)) {
+					(node0 ? local.createConnection(c, o) : local.createConnection(o, c))
+					    ->loadState(r);
+				} else {
+					// already restored from the other cell, or too far from this slab
+					connect_type skipped(make_pair(c, c), Spring());
+					skipped.loadState(r);
+				}
+			}
+		}
+	}
+};
+}
+#endif
@@ -0,0 +1,162 @@
+#ifndef MECACELL_ENSEMBLE_HPP
+#define MECACELL_ENSEMBLE_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "model.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                          ENSEMBLE
+////////////////////////////////////////////////////////////////////
+// Many independent worlds (parameter sweeps, evolutionary searches...) updated in
+// parallel, each one by a single thread at a time: for small worlds, running several of
+// them at once scales much better than parallelizing each update.
+// Worlds are updated by slices of a few updates. Each thread has its own queue of worlds,
+// takes the last one it ran first (its cells are still in cache) and, once its queue is
+// empty, steals the oldest world of another thread's queue.
+// Each world gets its own random seed (see BasicWorld::setRandomSeed): as long as the
+// cells draw from their own streams (not from globalRand), a world's results don't
+// depend on the number of threads nor on the scheduling.
+// Models added to the ensemble are loaded once, their meshes are shared by all the worlds
+// (each world keeps its own transformation of them) and stay loaded as long as the
+// ensemble lives.
+template <typename World> class Ensemble {
+public:
+	// called after each update of a world, with the world's index: true stops that world.
+	// It is called concurrently for different worlds
+	using StopCondition = std::function<bool(World &, size_t)>;
+
+private:
+	struct Queue {
+		std::mutex mtx;
+		std::deque<size_t> worlds;
+	};
+	std::vector<std::unique_ptr<World>> worlds;
+	std::vector<uint64_t> seeds;
+	std::vector<char> stopped; // by the stop condition
+	std::vector<std::pair<std::string, std::shared_ptr<const Mesh>>> sharedModels;
+	size_t nbThreads;
+	uint64_t baseSeed;
+	int sliceSize = 8;
+	StopCondition stopCondition;
+
+	// splitmix64 finalizer: well spread seeds from consecutive indices
+	static uint64_t mixSeed(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+	bool pop(Queue &q, size_t &w, bool steal) {
+		std::lock_guard<std::mutex> lock(q.mtx);
+		if (q.worlds.empty()) return false;
+		if (steal) {
+			w = q.worlds.front();
+			q.worlds.pop_front();
+		} else {
+			w = q.worlds.back();
+			q.worlds.pop_back();
+		}
+		return true;
+	}
+
+	void workerLoop(size_t t, std::vector<Queue> &queues, std::atomic<size_t> &remaining,
+	                int nbUpdates) {
+		while (remaining.load() > 0) {
+			size_t w = 0;
+			bool found = pop(queues[t], w, false);
+			for (size_t k = 1; !found && k < queues.size(); ++k)
+				found = pop(queues[(t + k) % queues.size()], w, true);
+			if (!found) { // the remaining worlds are being updated by other threads
+				std::this_thread::yield();
+				continue;
+			}
+			World &world = *worlds[w];
+			for (int s = 0; s < sliceSize && world.getNbUpdates() < nbUpdates; ++s) {
+				world.update();
+				if (stopCondition && stopCondition(world, w)) {
+					stopped[w] = true;
+					break;
+				}
+			}
+			if (stopped[w] || world.getNbUpdates() >= nbUpdates) {
+				--remaining;
+			} else {
+				std::lock_guard<std::mutex> lock(queues[t].mtx);
+				queues[t].worlds.push_back(w);
+			}
+		}
+	}
+
+public:
+	// nbThreads = 0: as many as the hardware supports
+	explicit Ensemble(size_t nbT = 0, uint64_t seed = 0) : nbThreads(nbT), baseSeed(seed) {
+		if (nbThreads == 0) nbThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	Ensemble(const Ensemble &) = delete;
+	Ensemble &operator=(const Ensemble &) = delete;
+
+	size_t size() const { return worlds.size(); }
+	World &operator[](size_t i) { return *worlds[i]; }
+	uint64_t getSeed(size_t i) const { return seeds[i]; }
+	// whether the stop condition stopped world i during the last run
+	bool isStopped(size_t i) const { return stopped[i]; }
+
+	size_t getNbThreads() const { return nbThreads; }
+	void setNbThreads(size_t n) { nbThreads = n > 0 ? n : 1; }
+	// nb of updates a world runs before going back to its thread's queue
+	void setSliceSize(int s) { sliceSize = s > 0 ? s : 1; }
+	void setStopCondition(StopCondition s) { stopCondition = s; }
+
+	// a new world, seeded with seed, with the ensemble's models. Its parameters and cells
+	// are then up to the caller
+	World &addWorld(uint64_t seed) {
+		worlds.emplace_back(new World());
+		World &w = *worlds.back();
+		w.setRandomSeed(seed);
+		for (const auto &m : sharedModels) w.addModel(m.first, m.second);
+		seeds.push_back(seed);
+		stopped.push_back(false);
+		return w;
+	}
+	// same, with a seed derived from the ensemble's seed and the world's index
+	World &addWorld() { return addWorld(mixSeed(baseSeed + worlds.size())); }
+
+	// loads a mesh once and adds it to all the worlds, present and future
+	void addModel(const std::string &name, const std::string &path, bool useMeshCache = false) {
+		sharedModels.push_back(std::make_pair(name, Mesh::load(path, useMeshCache)));
+		for (auto &w : worlds) w->addModel(name, sharedModels.back().second);
+	}
+
+	// updates every world until it has been updated nbUpdates times in total (the count
+	// of World::getNbUpdates) or until the stop condition stops it
+	void run(int nbUpdates) {
+		std::vector<Queue> queues(std::min(nbThreads, std::max<size_t>(worlds.size(), 1)));
+		size_t n = 0;
+		for (size_t i = 0; i < worlds.size(); ++i) {
+			stopped[i] = false;
+			if (worlds[i]->getNbUpdates() < nbUpdates) {
+				queues[n % queues.size()].worlds.push_front(i); // the first ones run first
+				++n;
+			}
+		}
+		std::atomic<size_t> remaining(n);
+		std::vector<std::thread> threads;
+		for (size_t t = 1; t < queues.size(); ++t)
+			threads.emplace_back([&, t]() { workerLoop(t, queues, remaining, nbUpdates); });
+		workerLoop(0, queues, remaining, nbUpdates);
+		for (auto &t : threads) t.join();
+	}
+};
+}
+#endif
@@ -0,0 +1,457 @@
+#ifndef FLATGRID_HPP
+#define FLATGRID_HPP
+
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+#include "tools.h"
+#include "gridspan.hpp"
+#include "raycast.hpp"
+using namespace std;
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                         FLAT GRID
+////////////////////////////////////////////////////////////////////
+// Same interface as Grid, but buckets are identified by their integer coordinates
+// and all their content is stored in one contiguous array, each bucket in its own range
+// (found through an open addressing table). Within a bucket, objects are kept in their
+// insertion order.
+// clear() keeps every buffer allocated, so refilling the grid each frame doesn't hit
+// the allocator. Inserting invalidates the layout: the new objects are placed by build(),
+// or lazily by the first retrieve (build() has to be called explicitly before retrieving
+// from several threads at once).
+// update() moves an object in place: only the buckets it leaves and enters are patched.
+// Once objects have been updated, buckets are laid out with some slack; a bucket that
+// outgrows its range moves to the end of the array, which is laid out again when half
+// of it is made of the holes left behind (or when most buckets are empty).
+template <typename O> class FlatGrid {
+private:
+	struct Key {
+		int x, y, z;
+		Key() {}
+		Key(int X, int Y, int Z) : x(X), y(Y), z(Z) {}
+		bool operator==(const Key &k) const { return x == k.x && y == k.y && z == k.z; }
+	};
+	struct Slot {
+		Key key;
+		uint32_t bucket; // EMPTY if the slot is free
+	};
+	// content[start, start + size) are the bucket's objects, sorted by rank. The range
+	// can hold capacity objects
+	struct Bucket {
+		Key key;
+		uint32_t start, size, capacity;
+	};
+	// inserted, not placed yet (see build)
+	struct Entry {
+		Key key;
+		uint32_t rank;
+		O obj;
+	};
+	static const uint32_t EMPTY = 0xFFFFFFFF;
+
+	double cellSize;                    // actually it's 1/cellSize, just so we can multiply
+	mutable vector<Entry> pending;      // in insertion order
+	mutable vector<O> content;          // bucket ranges, with holes
+	mutable vector<uint32_t> contentRank; // insertion rank of each content's object
+	mutable vector<Bucket> buckets;     // bucket id -> coordinates and range
+	mutable vector<Slot> table;         // open addressing table: coordinates -> bucket
+	mutable vector<uint32_t> entryBucket; // bucket of each pending entry (temporary)
+	// previous layout's buffers, reused by the next one
+	mutable vector<O> spareContent;
+	mutable vector<uint32_t> spareRank;
+	mutable vector<Bucket> spareBuckets;
+	mutable bool upToDate = false;
+	mutable bool slack = false; // objects have been updated: buckets get spare room
+	uint32_t nextRank = 0;      // next inserted object's rank
+	size_t nbEntries = 0;       // objects x buckets, placed or pending
+	mutable size_t nbOccupied = 0; // non empty buckets
+	mutable size_t nbHoles = 0;    // content left behind by the buckets that moved
+
+	static size_t hash(const Key &k) {
+		return (static_cast<uint32_t>(k.x) * 73856093u) ^ (static_cast<uint32_t>(k.y) * 19349663u) ^
+		       (static_cast<uint32_t>(k.z) * 83492791u);
+	}
+
+	// bucket id of the cell k, EMPTY if it has never been occupied since the last layout
+	uint32_t find(const Key &k) const {
+		if (table.empty()) return EMPTY;
+		size_t mask = table.size() - 1;
+		for (size_t s = hash(k) & mask;; s = (s + 1) & mask) {
+			const Slot &slot = table[s];
+			if (slot.bucket == EMPTY || slot.key == k) return slot.bucket;
+		}
+	}
+
+	void rehash(size_t nbSlots) const {
+		Slot emptySlot;
+		emptySlot.bucket = EMPTY;
+		table.assign(nbSlots, emptySlot);
+		size_t mask = nbSlots - 1;
+		for (uint32_t b = 0; b < buckets.size(); ++b) {
+			size_t s = hash(buckets[b].key) & mask;
+			while (table[s].bucket != EMPTY) s = (s + 1) & mask;
+			table[s].key = buckets[b].key;
+			table[s].bucket = b;
+		}
+	}
+
+	// bucket id of the cell k, creating it (empty, without any range) if needed
+	uint32_t findOrAdd(const Key &k) const {
+		if (2 * (buckets.size() + 1) > table.size())
+			rehash(table.empty() ? 64 : table.size() * 2);
+		size_t mask = table.size() - 1;
+		size_t s = hash(k) & mask;
+		for (; table[s].bucket != EMPTY; s = (s + 1) & mask)
+			if (table[s].key == k) return table[s].bucket;
+		table[s].key = k;
+		table[s].bucket = static_cast<uint32_t>(buckets.size());
+		Bucket b;
+		b.key = k;
+		b.start = b.size = b.capacity = 0;
+		buckets.push_back(b);
+		return table[s].bucket;
+	}
+
+	uint32_t rangeCapacity(uint32_t size) const { return slack ? size + size / 2 + 1 : size; }
+
+	// lays out the non empty buckets and the pending entries again, in new contiguous
+	// ranges. Pending entries have the highest ranks: they go at the end of their bucket
+	void layout() const {
+		spareBuckets.swap(buckets);
+		buckets.clear();
+		Slot emptySlot;
+		emptySlot.bucket = EMPTY;
+		std::fill(table.begin(), table.end(), emptySlot);
+		for (const auto &b : spareBuckets)
+			if (b.size) buckets[findOrAdd(b.key)].size = b.size;
+		entryBucket.resize(pending.size());
+		for (size_t i = 0; i < pending.size(); ++i) {
+			entryBucket[i] = findOrAdd(pending[i].key);
+			++buckets[entryBucket[i]].size;
+		}
+		uint32_t start = 0;
+		for (auto &b : buckets) {
+			b.start = start;
+			b.capacity = rangeCapacity(b.size);
+			start += b.capacity;
+			b.size = 0; // used as a cursor below
+		}
+		spareContent.resize(start);
+		spareRank.resize(start);
+		for (const auto &ob : spareBuckets) {
+			if (!ob.size) continue;
+			Bucket &b = buckets[find(ob.key)];
+			std::copy(content.begin() + ob.start, content.begin() + ob.start + ob.size,
+			          spareContent.begin() + b.start);
+			std::copy(contentRank.begin() + ob.start, contentRank.begin() + ob.start + ob.size,
+			          spareRank.begin() + b.start);
+			b.size = ob.size;
+		}
+		for (size_t i = 0; i < pending.size(); ++i) {
+			Bucket &b = buckets[entryBucket[i]];
+			spareContent[b.start + b.size] = pending[i].obj;
+			spareRank[b.start + b.size++] = pending[i].rank;
+		}
+		content.swap(spareContent);
+		contentRank.swap(spareRank);
+		pending.clear();
+		nbOccupied = buckets.size();
+		nbHoles = 0;
+	}
+
+	// adds obj (of rank r) to bucket b, at its rank's place
+	void add(uint32_t b, const O &obj, uint32_t r) {
+		Bucket *bk = &buckets[b];
+		if (bk->size == bk->capacity) { // moved to a larger range at the end
+			uint32_t start = static_cast<uint32_t>(content.size());
+			uint32_t capacity = max(4u, 2 * bk->capacity);
+			content.resize(start + capacity);
+			contentRank.resize(start + capacity);
+			std::copy(content.begin() + bk->start, content.begin() + bk->start + bk->size,
+			          content.begin() + start);
+			std::copy(contentRank.begin() + bk->start,
+			          contentRank.begin() + bk->start + bk->size, contentRank.begin() + start);
+			nbHoles += bk->capacity;
+			bk->start = start;
+			bk->capacity = capacity;
+		}
+		if (bk->size == 0) ++nbOccupied;
+		size_t i = bk->start + bk->size;
+		for (; i > bk->start && contentRank[i - 1] > r; --i) {
+			content[i] = content[i - 1];
+			contentRank[i] = contentRank[i - 1];
+		}
+		content[i] = obj;
+		contentRank[i] = r;
+		++bk->size;
+	}
+
+	// removes the object of rank r from bucket b
+	void remove(uint32_t b, uint32_t r) {
+		Bucket &bk = buckets[b];
+		size_t end = bk.start + bk.size;
+		size_t i = bk.start;
+		while (contentRank[i] != r) ++i;
+		for (; i + 1 < end; ++i) {
+			content[i] = content[i + 1];
+			contentRank[i] = contentRank[i + 1];
+		}
+		if (--bk.size == 0) --nbOccupied;
+	}
+
+	// calls f(begin, end) on the content of every bucket intersecting the
+	// (center - radius, center + radius) box, i.e. the grid cells of GridSpan(coord, r, cellSize)
+	template <typename F> void forEachInBox(const Vec &coord, double r, F &&f) const {
+		if (!upToDate) build();
+		if (buckets.empty()) return;
+		GridSpan(coord, r, cellSize).forEach([&](int i, int j, int k) {
+			uint32_t b = find(Key(i, j, k));
+			if (b != EMPTY)
+				f(content.begin() + buckets[b].start,
+				  content.begin() + buckets[b].start + buckets[b].size);
+		});
+	}
+
+	bool isOccupied(const Vec &cell) const {
+		uint32_t b = find(Key(double2int(cell.x), double2int(cell.y), double2int(cell.z)));
+		return b != EMPTY && buckets[b].size > 0;
+	}
+
+public:
+	FlatGrid(double cs) : cellSize(1.0 / cs) {}
+
+	double getCellSize() const { return 1.0 / cellSize; }
+
+	// places the objects inserted since the last build
+	void build() const {
+		if (upToDate) return;
+		layout();
+		upToDate = true;
+	}
+
+	// calls f(i, j, k, n) for every occupied grid cell (i, j, k), n being its number of
+	// objects. Doesn't copy anything, unlike getContent
+	template <typename F> void forEachBucket(F &&f) const {
+		if (!upToDate) build();
+		for (const auto &b : buckets)
+			if (b.size) f(b.key.x, b.key.y, b.key.z, static_cast<size_t>(b.size));
+	}
+
+	// same layout as Grid::getContent (built on demand, for display and debug purposes)
+	unordered_map<Vec, vector<O>> getContent() const {
+		if (!upToDate) build();
+		unordered_map<Vec, vector<O>> res;
+		for (const auto &b : buckets)
+			if (b.size)
+				res[Vec(b.key.x, b.key.y, b.key.z)].assign(content.begin() + b.start,
+				                                          content.begin() + b.start + b.size);
+		return res;
+	}
+
+	void insert(const O &obj) {
+		GridSpan span;
+		insert(obj, span);
+	}
+
+	// same as insert(obj), also stores the grid cells covered by obj in span
+	void insert(const O &obj, GridSpan &span) {
+		span = GridSpan(ptr(obj)->getPosition(), ptr(obj)->getRadius(), cellSize);
+		span.first = nextRank;
+		span.forEach([&](int i, int j, int k) {
+			Entry e;
+			e.key = Key(i, j, k);
+			e.rank = nextRank;
+			e.obj = obj;
+			pending.push_back(e);
+		});
+		++nextRank;
+		nbEntries += span.size();
+		upToDate = false;
+	}
+
+	// moves obj (inserted with span) to the grid cells it covers now. Only the buckets it
+	// leaves or enters are modified, and obj keeps its insertion rank in them: the layout
+	// is the one a clear and reinsertion of every object would give. Costs O(grid cells
+	// left and entered), plus an amortized share of the occasional new layout
+	void update(const O &obj, GridSpan &span) {
+		GridSpan s(ptr(obj)->getPosition(), ptr(obj)->getRadius(), cellSize);
+		if (s.sameBounds(span)) return;
+		if (!upToDate) build();
+		slack = true;
+		const uint32_t r = static_cast<uint32_t>(span.first);
+		span.forEach([&](int i, int j, int k) {
+			if (!s.contains(i, j, k)) remove(find(Key(i, j, k)), r);
+		});
+		s.forEach([&](int i, int j, int k) {
+			if (!span.contains(i, j, k)) add(findOrAdd(Key(i, j, k)), obj, r);
+		});
+		nbEntries += s.size();
+		nbEntries -= span.size();
+		s.first = r;
+		span = s;
+		if (2 * nbHoles > content.size() + 1024 || buckets.size() > 2 * nbOccupied + 64) layout();
+	}
+
+	void insert(const O &obj, const Vec &p0, const Vec &p1,
+	            const Vec &p2) { // insert triangles
+		Vec blf(min(p0.x, min(p1.x, p2.x)), min(p0.y, min(p1.y, p2.y)),
+		        min(p0.z, min(p1.z, p2.z)));
+		Vec trb(max(p0.x, max(p1.x, p2.x)), max(p0.y, max(p1.y, p2.y)),
+		        max(p0.z, max(p1.z, p2.z)));
+		double cs = 1.0 / cellSize;
+		GridSpan box(getIndexFromPosition(blf), getIndexFromPosition(trb) + 1);
+		box.forEach([&](int i, int j, int k) {
+			Vec center = cs * Vec(i, j, k);
+			std::pair<bool, Vec> projec = projectionIntriangle(p0, p1, p2, center);
+			if ((center - projec.second).sqlength() < 0.8 * cs * cs) {
+				if (projec.first || closestDistToTriangleEdge(p0, p1, p2, center) < 0.87 * cs) {
+					Entry e;
+					e.key = Key(i, j, k);
+					e.rank = nextRank;
+					e.obj = obj;
+					pending.push_back(e);
+					++nbEntries;
+				}
+			}
+		});
+		++nextRank;
+		upToDate = false;
+	}
+
+	Vec getIndexFromPosition(const Vec &v) {
+		Vec res = v * cellSize;
+		return Vec(floor(res.x), floor(res.y), floor(res.z));
+	}
+
+	set<O> retrieveUnique(const Vec &coord, double r) const {
+		set<O> res;
+		forEachInBox(coord, r, [&](typename vector<O>::const_iterator b,
+		                           typename vector<O>::const_iterator e) { res.insert(b, e); });
+		return res;
+	}
+
+	vector<O> retrieve(const Vec &coord, double r) const {
+		vector<O> res;
+		forEachInBox(coord, r, [&](typename vector<O>::const_iterator b,
+		                           typename vector<O>::const_iterator e) {
+			res.insert(res.end(), b, e);
+		});
+		return res;
+	}
+
+	vector<O> retrieve(const O &obj) const {
+		return retrieve(ptr(obj)->getPosition(), ptr(obj)->getRadius());
+	}
+
+	// visits the same objects, in the same order, as retrieve(coord, r), without
+	// building any container
+	template <typename F> void forEachNeighbour(const Vec &coord, double r, F &&f) const {
+		forEachInBox(coord, r, [&](typename vector<O>::const_iterator b,
+		                           typename vector<O>::const_iterator e) {
+			for (; b != e; ++b) f(*b);
+		});
+	}
+
+	template <typename F> void forEachNeighbour(const O &obj, F &&f) const {
+		forEachNeighbour(ptr(obj)->getPosition(), ptr(obj)->getRadius(), f);
+	}
+
+	// see Grid::rayCast
+	template <typename A>
+	bool rayCast(const Vec &origin, const Vec &dir, double maxT, A &&accept, O &hit,
+	             double &hitT) const {
+		if (!upToDate) build();
+		bool found = false;
+		hitT = maxT;
+		if (buckets.empty()) return false;
+		walkRay(origin, dir, maxT, cellSize, [&](int i, int j, int k, double tEnter) {
+			if (found && tEnter > hitT) return false;
+			uint32_t b = find(Key(i, j, k));
+			if (b != EMPTY) {
+				const Bucket &bk = buckets[b];
+				for (uint32_t e = bk.start; e < bk.start + bk.size; ++e) {
+					const O &o = content[e];
+					double t;
+					if (raySphere(origin, dir, ptr(o)->getPosition(), ptr(o)->getRadius(), t) &&
+					    t <= hitT && (!found || t < hitT) && accept(o)) {
+						hit = o;
+						hitT = t;
+						found = true;
+					}
+				}
+			}
+			return true;
+		});
+		return found;
+	}
+
+	// same content as retrieveUnique, sorted in a reusable vector
+	void retrieveUnique(const Vec &coord, double r, vector<O> &res) const {
+		res.clear();
+		forEachNeighbour(coord, r, [&](const O &o) { res.push_back(o); });
+		sort(res.begin(), res.end());
+		res.erase(unique(res.begin(), res.end()), res.end());
+	}
+
+	double computeSurface() const {
+		if (!upToDate) build();
+		if (Vec::dimension == 3) {
+			double res = 0.0;
+			double faceArea = pow(1.0 / cellSize, 2);
+			for (auto &b : buckets) {
+				if (!b.size) continue;
+				res += (6.0 - static_cast<double>(getNbNeighbours(Vec(b.key.x, b.key.y, b.key.z)))) *
+				       faceArea;
+			}
+			return res;
+		}
+		return pow(1.0 / cellSize, 2) * static_cast<double>(nbOccupied);
+	}
+
+	double getVolume() const {
+		if (!upToDate) build();
+		if (Vec::dimension == 3)
+			return pow(1.0 / cellSize, 3) * static_cast<double>(nbOccupied);
+		return 0.0;
+	}
+
+	double computeSphericity() const {
+		return (cbrt(M_PI) * (pow(6.0 * getVolume(), (2.0 / 3.0)))) / computeSurface();
+	}
+
+	// nb of occupied neighbour grid cells
+	int getNbNeighbours(const Vec &cell) const {
+		if (!upToDate) build();
+		int res = 0;
+		if (isOccupied(cell - Vec(0, 0, 1))) ++res;
+		if (isOccupied(cell - Vec(0, 1, 0))) ++res;
+		if (isOccupied(cell - Vec(1, 0, 0))) ++res;
+		if (isOccupied(cell + Vec(0, 0, 1))) ++res;
+		if (isOccupied(cell + Vec(0, 1, 0))) ++res;
+		if (isOccupied(cell + Vec(1, 0, 0))) ++res;
+		return res;
+	}
+
+	size_t size() const { return nbEntries; }
+
+	void clear() {
+		pending.clear();
+		buckets.clear();
+		content.clear();
+		contentRank.clear();
+		Slot emptySlot;
+		emptySlot.bucket = EMPTY;
+		std::fill(table.begin(), table.end(), emptySlot);
+		nextRank = 0;
+		nbEntries = 0;
+		nbOccupied = 0;
+		nbHoles = 0;
+		upToDate = false;
+	}
+};
+}
+#endif
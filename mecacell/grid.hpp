@@ -5,7 +5,10 @@
 #include <set>
 #include <iostream>
 #include <unordered_map>
+#include <algorithm>
 #include "tools.h"
+#include "gridspan.hpp"
+#include "raycast.hpp"
 using namespace std;
 
 namespace MecaCell {
@@ -20,12 +23,42 @@ public:
 	double getCellSize() const { return 1.0 / cellSize; }
 	const unordered_map<Vec, vector<O>> &getContent() const { return um; }
 
+	// calls f(i, j, k, n) for every occupied grid cell (i, j, k), n being its number of
+	// objects (see FlatGrid::forEachBucket)
+	template <typename F> void forEachBucket(F &&f) const {
+		for (const auto &b : um)
+			f(double2int(b.first.x), double2int(b.first.y), double2int(b.first.z),
+			  b.second.size());
+	}
+
 	void insert(const O &obj) {
-		Vec center = ptr(obj)->getPosition() * cellSize;
-		double radius = ptr(obj)->getRadius() * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		minCorner.iterateTo(maxCorner, [&](Vec v) { um[v].push_back(obj); });
+		GridSpan(ptr(obj)->getPosition(), ptr(obj)->getRadius(), cellSize)
+		    .forEach([&](int i, int j, int k) { um[Vec(i, j, k)].push_back(obj); });
+	}
+
+	// same as insert(obj), also stores the grid cells covered by obj in span
+	void insert(const O &obj, GridSpan &span) {
+		span = GridSpan(ptr(obj)->getPosition(), ptr(obj)->getRadius(), cellSize);
+		span.forEach([&](int i, int j, int k) { um[Vec(i, j, k)].push_back(obj); });
+	}
+
+	// moves obj (inserted with span) to the grid cells it covers now. Only the grid cells
+	// it enters or leaves are modified, obj is added at the end of the ones it enters
+	void update(const O &obj, GridSpan &span) {
+		GridSpan s(ptr(obj)->getPosition(), ptr(obj)->getRadius(), cellSize);
+		if (s.sameBounds(span)) return;
+		span.forEach([&](int i, int j, int k) {
+			if (!s.contains(i, j, k)) {
+				auto it = um.find(Vec(i, j, k));
+				auto &bucket = it->second;
+				bucket.erase(find(bucket.begin(), bucket.end(), obj));
+				if (bucket.empty()) um.erase(it);
+			}
+		});
+		s.forEach([&](int i, int j, int k) {
+			if (!span.contains(i, j, k)) um[Vec(i, j, k)].push_back(obj);
+		});
+		span = s;
 	}
 
 	void insert(const O &obj, const Vec &p0, const Vec &p1,
@@ -35,7 +68,9 @@ public:
 		Vec trb(max(p0.x, max(p1.x, p2.x)), max(p0.y, max(p1.y, p2.y)),
 		        max(p0.z, max(p1.z, p2.z)));
 		double cs = 1.0 / cellSize;
-		getIndexFromPosition(blf).iterateTo(getIndexFromPosition(trb) + 1, [&](const Vec &v) {
+		GridSpan box(getIndexFromPosition(blf), getIndexFromPosition(trb) + 1);
+		box.forEach([&](int i, int j, int k) {
+			const Vec v(i, j, k);
 			Vec center = cs * v;
 			std::pair<bool, Vec> projec = projectionIntriangle(p0, p1, p2, center);
 			if ((center - projec.second).sqlength() < 0.8 * cs * cs) {
@@ -46,6 +81,36 @@ public:
 		});
 	}
 
+	// the object (seen as a sphere) the ray origin + t * dir hits first, for t in
+	// [0, maxT], among the ones accept(obj) is true for. Only the buckets along the ray are
+	// visited, up to the first hit. Returns false if nothing is hit
+	template <typename A>
+	bool rayCast(const Vec &origin, const Vec &dir, double maxT, A &&accept, O &hit,
+	             double &hitT) const {
+		bool found = false;
+		hitT = maxT;
+		walkRay(origin, dir, maxT, cellSize, [&](int i, int j, int k, double tEnter) {
+			if (found && tEnter > hitT) return false;
+			auto it = um.find(Vec(i, j, k));
+			if (it != um.end()) {
+				for (const auto &o : it->second) {
+					double t;
+					if (raySphere(origin, dir, ptr(o)->getPosition(), ptr(o)->getRadius(), t) &&
+					    t <= hitT && (!found || t < hitT) && accept(o)) {
+						hit = o;
+						hitT = t;
+						found = true;
+					}
+				}
+			}
+			return true;
+		});
+		return found;
+	}
+
+	// buckets are always up to date, nothing to do (see FlatGrid::build)
+	void build() const {}
+
 	Vec getIndexFromPosition(const Vec &v) {
 		Vec res = v * cellSize;
 		return Vec(floor(res.x), floor(res.y), floor(res.z));
@@ -53,44 +118,40 @@ public:
 
 	set<O> retrieveUnique(const Vec &coord, double r) const {
 		set<O> res;
-		Vec center = coord * cellSize;
-		double radius = r * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		// TODO check if faster with a set (uniques...) and by removing  selfcollision
-		minCorner.iterateTo(maxCorner, [&](const Vec &v) {
-			if (um.count(v)) {
-				for (auto &e : um.at(v)) {
-					res.insert(e);
-				}
-			}
-		});
+		forEachNeighbour(coord, r, [&](const O &o) { res.insert(o); });
 		return res;
 	}
 
 	vector<O> retrieve(const Vec &coord, double r) const {
 		vector<O> res;
-		Vec center = coord * cellSize;
-		double radius = r * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		// TODO check if faster with a set (uniques...) and by removing  selfcollision
-		minCorner.iterateTo(maxCorner, [&](const Vec &v) {
-			if (um.count(v)) res.insert(res.end(), um.at(v).begin(), um.at(v).end());
-		});
+		forEachNeighbour(coord, r, [&](const O &o) { res.push_back(o); });
 		return res;
 	}
 
 	vector<O> retrieve(const O &obj) const {
-		vector<O> res;
-		Vec center = ptr(obj)->getPosition() * cellSize;
-		double radius = ptr(obj)->getRadius() * cellSize;
-		Vec minCorner = center - radius;
-		Vec maxCorner = center + radius;
-		minCorner.iterateTo(maxCorner, [this, &res](const Vec &v) {
-			if (um.count(v)) res.insert(res.end(), um.at(v).begin(), um.at(v).end());
+		return retrieve(ptr(obj)->getPosition(), ptr(obj)->getRadius());
+	}
+
+	// visits the same objects, in the same order, as retrieve(coord, r), without
+	// building any container
+	template <typename F> void forEachNeighbour(const Vec &coord, double r, F &&f) const {
+		GridSpan(coord, r, cellSize).forEach([&](int i, int j, int k) {
+			auto it = um.find(Vec(i, j, k));
+			if (it != um.end())
+				for (const auto &o : it->second) f(o);
 		});
-		return res;
+	}
+
+	template <typename F> void forEachNeighbour(const O &obj, F &&f) const {
+		forEachNeighbour(ptr(obj)->getPosition(), ptr(obj)->getRadius(), f);
+	}
+
+	// same content as retrieveUnique, sorted in a reusable vector
+	void retrieveUnique(const Vec &coord, double r, vector<O> &res) const {
+		res.clear();
+		forEachNeighbour(coord, r, [&](const O &o) { res.push_back(o); });
+		sort(res.begin(), res.end());
+		res.erase(unique(res.begin(), res.end()), res.end());
 	}
 
 	double computeSurface() const {
@@ -0,0 +1,61 @@
+#ifndef GRIDSPAN_HPP
+#define GRIDSPAN_HPP
+#include <cstddef>
+#include "tools.h"
+
+namespace MecaCell {
+// Grid cells covered by an object (inclusive integer bounds), as computed by the grids'
+// insert. Objects keep their span so that the grids can update them incrementally
+// (see Grid::update and FlatGrid::update).
+struct GridSpan {
+	int minCorner[3] = {0, 0, 0};
+	int maxCorner[3] = {-1, -1, -1}; // empty
+	size_t first = 0;                // used by FlatGrid: the object's insertion rank
+
+	GridSpan() {}
+	// span of a sphere, invCellSize = 1 / grid cell size
+	GridSpan(const Vec &position, double radius, double invCellSize) {
+		Vec center = position * invCellSize;
+		double r = radius * invCellSize;
+		setBox(center - r, center + r);
+	}
+	// grid cells of the box [mn, mx], given in grid coordinates (position * invCellSize)
+	GridSpan(const Vec &mn, const Vec &mx) { setBox(mn, mx); }
+
+	void setBox(const Vec &mn, const Vec &mx) {
+		minCorner[0] = double2int(mn.x);
+		minCorner[1] = double2int(mn.y);
+		minCorner[2] = double2int(mn.z);
+		maxCorner[0] = double2int(mx.x);
+		maxCorner[1] = double2int(mx.y);
+		maxCorner[2] = double2int(mx.z);
+	}
+
+	bool sameBounds(const GridSpan &s) const {
+		for (int i = 0; i < 3; ++i)
+			if (minCorner[i] != s.minCorner[i] || maxCorner[i] != s.maxCorner[i]) return false;
+		return true;
+	}
+
+	bool contains(int i, int j, int k) const {
+		return minCorner[0] <= i && i <= maxCorner[0] && minCorner[1] <= j &&
+		       j <= maxCorner[1] && minCorner[2] <= k && k <= maxCorner[2];
+	}
+
+	// nb of grid cells covered
+	size_t size() const {
+		size_t s = 1;
+		for (int i = 0; i < 3; ++i)
+			s *= maxCorner[i] < minCorner[i] ? 0 : maxCorner[i] - minCorner[i] + 1;
+		return s;
+	}
+
+	// calls f(i, j, k) on every covered grid cell, in the grids' insertion order
+	template <typename F> void forEach(F &&f) const {
+		for (int i = minCorner[0]; i <= maxCorner[0]; ++i)
+			for (int j = minCorner[1]; j <= maxCorner[1]; ++j)
+				for (int k = minCorner[2]; k <= maxCorner[2]; ++k) f(i, j, k);
+	}
+};
+}
+#endif
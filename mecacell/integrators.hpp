@@ -1,8 +1,15 @@
 #ifndef INTEGRATORS_HPP
 #define INTEGRATORS_HPP
+#include <type_traits>
+#include <utility>
+#include "kinematicstate.hpp"
 
 // Integration schemes
 // using structs instead of lambda templates (c++14 feature :-/ )
+// Each scheme can also integrate a range [b, e) of a KinematicState (structure of arrays)
+// with plain per axis loops. They do exactly the same floating point operations as the
+// per cell version; the angular displacement is left in s.da* (the rotation itself
+// can't be vectorized and is applied by KinematicState::scatter).
 namespace MecaCell {
 
 struct Verlet {
@@ -19,11 +26,38 @@ struct Verlet {
 			oldVel = c.getAngularVelocity();
 			c.setAngularVelocity(c.getAngularVelocity() +
 			                     c.getTorque() * dt / c.getMomentOfInertia());
-			c.setOrientationRotation(c.getOrientationRotation() +
-			                         (c.getAngularVelocity() + oldVel) * dt * 0.5);
-			c.updateCurrentOrientation();
+			c.addAngularDisplacement((c.getAngularVelocity() + oldVel) * dt * 0.5);
 		}
 	}
+
+	void operator()(KinematicState &s, const double &dt, size_t b, size_t e) {
+		// position
+		auto position = [&](double *p, double *pp, double *v, const double *f) {
+			const double *m = s.mass.data();
+			for (size_t i = b; i < e; ++i) {
+				double oldVel = v[i];
+				v[i] = v[i] + f[i] * dt / m[i];
+				pp[i] = p[i];
+				p[i] = p[i] + (v[i] + oldVel) * dt * 0.5;
+			}
+		};
+		position(s.px.data(), s.ppx.data(), s.vx.data(), s.fx.data());
+		position(s.py.data(), s.ppy.data(), s.vy.data(), s.fy.data());
+		position(s.pz.data(), s.ppz.data(), s.vz.data(), s.fz.data());
+
+		// orientation
+		auto orientation = [&](double *d, double *v, const double *t) {
+			const double *in = s.inertia.data();
+			for (size_t i = b; i < e; ++i) {
+				double oldVel = v[i];
+				v[i] = v[i] + t[i] * dt / in[i];
+				d[i] = (v[i] + oldVel) * dt * 0.5;
+			}
+		};
+		orientation(s.dax.data(), s.avx.data(), s.tx.data());
+		orientation(s.day.data(), s.avy.data(), s.ty.data());
+		orientation(s.daz.data(), s.avz.data(), s.tz.data());
+	}
 };
 struct Euler {
 	template <typename C> void operator()(C &c, const double &dt) {
@@ -37,10 +71,63 @@ struct Euler {
 			// orientation
 			c.setAngularVelocity(c.getAngularVelocity() +
 			                     c.getTorque() * dt / c.getMomentOfInertia());
-			c.setOrientationRotation(c.getOrientationRotation() + c.getAngularVelocity() * dt);
-			c.updateCurrentOrientation();
+			c.addAngularDisplacement(c.getAngularVelocity() * dt);
 		}
 	}
+
+	void operator()(KinematicState &s, const double &dt, size_t b, size_t e) {
+		// position
+		auto position = [&](double *p, double *pp, double *v, const double *f) {
+			const double *m = s.mass.data();
+			for (size_t i = b; i < e; ++i) {
+				v[i] = v[i] + f[i] * dt / m[i];
+				pp[i] = p[i];
+				p[i] = p[i] + v[i] * dt;
+			}
+		};
+		position(s.px.data(), s.ppx.data(), s.vx.data(), s.fx.data());
+		position(s.py.data(), s.ppy.data(), s.vy.data(), s.fy.data());
+		position(s.pz.data(), s.ppz.data(), s.vz.data(), s.fz.data());
+
+		// orientation
+		auto orientation = [&](double *d, double *v, const double *t) {
+			const double *in = s.inertia.data();
+			for (size_t i = b; i < e; ++i) {
+				v[i] = v[i] + t[i] * dt / in[i];
+				d[i] = v[i] * dt;
+			}
+		};
+		orientation(s.dax.data(), s.avx.data(), s.tx.data());
+		orientation(s.day.data(), s.avy.data(), s.ty.data());
+		orientation(s.daz.data(), s.avz.data(), s.tz.data());
+	}
+};
+
+// Multi rate integration: each world update is made of nbSubsteps steps of I, of
+// dt / nbSubsteps, each with its own connections forces (stiff springs stay stable at a
+// larger dt), while the collision detection and the behaviours still run once per update
+// (see BasicWorld::update). After an update, the cells' prevposition is their position
+// before the update, not before its last substep.
+template <typename I> struct MultiRate : public I {
+	unsigned int nbSubsteps;
+	MultiRate(unsigned int n = 4) : nbSubsteps(n) {}
+	using I::operator();
+};
+
+// nb of integration steps per world update
+template <typename I> unsigned int getNbSubsteps(const I &) { return 1; }
+template <typename I> unsigned int getNbSubsteps(const MultiRate<I> &i) {
+	return i.nbSubsteps;
+}
+
+// true if the integrator I can integrate a KinematicState range
+template <typename I> struct hasBatchIntegration {
+	template <typename T>
+	static auto test(int) -> decltype(std::declval<T &>()(std::declval<KinematicState &>(),
+	                                                       0.0, size_t(0), size_t(0)),
+	                                  std::true_type());
+	template <typename> static std::false_type test(...);
+	static const bool value = decltype(test<I>(0))::value;
 };
 }
 #endif
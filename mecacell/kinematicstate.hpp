@@ -0,0 +1,68 @@
+#ifndef KINEMATICSTATE_HPP
+#define KINEMATICSTATE_HPP
+#include <vector>
+#include "tools.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                      KINEMATIC STATE
+////////////////////////////////////////////////////////////////////
+// Structure of arrays holding the hot fields of Movable and Orientable for a range of
+// cells (index i <=> i-th cell). Integrators can run plain loops over these arrays,
+// which the compiler can vectorize, instead of going through each cell's getters and
+// setters. Cells stay the owners of their state: gather() copies it in, scatter()
+// copies the integrated state back (see BasicWorld::setSoAIntegration).
+struct KinematicState {
+	// position, previous position, velocity, force
+	std::vector<double> px, py, pz, ppx, ppy, ppz, vx, vy, vz, fx, fy, fz;
+	// angular velocity, torque, and angular displacement computed by the integrator
+	std::vector<double> avx, avy, avz, tx, ty, tz, dax, day, daz;
+	std::vector<double> mass, inertia;
+	std::vector<char> movable;
+
+	size_t size() const { return px.size(); }
+
+	void resize(size_t n) {
+		for (auto *v : {&px, &py, &pz, &ppx, &ppy, &ppz, &vx, &vy, &vz, &fx, &fy, &fz, &avx,
+		                &avy, &avz, &tx, &ty, &tz, &dax, &day, &daz, &mass, &inertia})
+			v->resize(n);
+		movable.resize(n);
+	}
+
+	template <typename C> void gather(size_t i, C &c) {
+		const Vec p = c.getPosition(), v = c.getVelocity(), f = c.getForce();
+		const Vec av = c.getAngularVelocity(), t = c.getTorque();
+		px[i] = p.x;
+		py[i] = p.y;
+		pz[i] = p.z;
+		vx[i] = v.x;
+		vy[i] = v.y;
+		vz[i] = v.z;
+		fx[i] = f.x;
+		fy[i] = f.y;
+		fz[i] = f.z;
+		avx[i] = av.x;
+		avy[i] = av.y;
+		avz[i] = av.z;
+		tx[i] = t.x;
+		ty[i] = t.y;
+		tz[i] = t.z;
+		mass[i] = c.getMass();
+		inertia[i] = c.getMomentOfInertia();
+		movable[i] = c.isMovementEnabled();
+	}
+
+	// writes back what an integrator can modify. The angular displacement is added to the
+	// cell's orientation.
+	template <typename C> void scatter(size_t i, C &c) const {
+		if (movable[i]) {
+			c.setPrevposition(Vec(ppx[i], ppy[i], ppz[i]));
+			c.setPosition(Vec(px[i], py[i], pz[i]));
+			c.setVelocity(Vec(vx[i], vy[i], vz[i]));
+			c.setAngularVelocity(Vec(avx[i], avy[i], avz[i]));
+			c.addAngularDisplacement(Vec(dax[i], day[i], daz[i]));
+		}
+	}
+};
+}
+#endif
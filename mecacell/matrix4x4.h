@@ -14,8 +14,10 @@ struct Matrix4x4 {
 	void scale(const Vec &s);
 	void translate(const Vec &t);
 	void rotate(const Rotation<Vec> &r);
-	Matrix4x4 operator*(const Matrix4x4 &mm);
-	Vec operator*(const Vec &);
+	Matrix4x4 operator*(const Matrix4x4 &mm) const;
+	Vec operator*(const Vec &) const;
+	// inverse of an affine transformation (last row = 0 0 0 1)
+	Matrix4x4 inverted() const;
 	friend ostream &operator<<(ostream &, const Matrix4x4 &);
 };
 }
@@ -1,17 +1,107 @@
 #include "model.h"
+#include <limits>
+#include <mutex>
+#include <sys/stat.h>
 
 using std::string;
 using std::vector;
 using std::unordered_map;
-using std::unordered_set;
 
 namespace MecaCell {
-Model::Model(const string &filepath) : obj(filepath) {
-	updateFacesFromObj();
-	// computeAdjacency();
-	updateFromTransformation();
+Mesh::Mesh(const ObjModel &obj) : vertices(obj.vertices) {
+	normals.reserve(obj.normals.size());
+	for (auto &n : obj.normals) normals.push_back(n.normalized());
+	faces.reserve(obj.faces.size());
+	bool allNormals = true;
+	for (auto &f : obj.faces) {
+		faces.push_back(f.v);
+		allNormals = allNormals && f.hasNormals;
+	}
+	if (allNormals)
+		for (auto &f : obj.faces) faceNormals.push_back(f.n);
+	bvh.build(vertices, faces);
+	computeAdjacency();
+}
+
+// O(F) for bounded vertex valences: faces are bucketed by vertex (counting sort), then
+// each face's neighbours are gathered from its 3 vertices' buckets
+void Mesh::computeAdjacency() {
+	const size_t nbFaces = faces.size();
+	vertexFaces.offsets.assign(vertices.size() + 1, 0);
+	for (auto &f : faces)
+		for (auto v : f.indices) ++vertexFaces.offsets[v + 1];
+	for (size_t v = 0; v < vertices.size(); ++v)
+		vertexFaces.offsets[v + 1] += vertexFaces.offsets[v];
+	vertexFaces.ids.resize(vertexFaces.offsets.back());
+	vector<uint32_t> next(vertexFaces.offsets.begin(), vertexFaces.offsets.end() - 1);
+	for (size_t i = 0; i < nbFaces; ++i)
+		for (auto v : faces[i].indices) vertexFaces.ids[next[v]++] = i; // rows stay sorted
+
+	// mark[g] == f once g is already a neighbour of f
+	vector<uint32_t> mark(nbFaces, std::numeric_limits<uint32_t>::max());
+	faceNeighbours.offsets.assign(1, 0);
+	faceNeighbours.offsets.reserve(nbFaces + 1);
+	faceNeighbours.ids.clear();
+	for (size_t i = 0; i < nbFaces; ++i) {
+		mark[i] = i;
+		for (auto v : faces[i].indices)
+			vertexFaces.forEach(v, [&](uint32_t g) {
+				if (mark[g] != i) {
+					mark[g] = i;
+					faceNeighbours.ids.push_back(g);
+				}
+			});
+		std::sort(faceNeighbours.ids.begin() + faceNeighbours.offsets.back(),
+		          faceNeighbours.ids.end());
+		faceNeighbours.offsets.push_back(faceNeighbours.ids.size());
+	}
+}
+
+namespace {
+struct RegistryEntry {
+	std::weak_ptr<const Mesh> mesh;
+	uint64_t size;
+	int64_t time;
+};
+bool fileStamp(const string &path, uint64_t &size, int64_t &time) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+	size = st.st_size;
+	time = st.st_mtime;
+	return true;
+}
+}
+
+std::shared_ptr<const Mesh> Mesh::load(const string &filepath, bool useMeshCache) {
+	static std::mutex mtx;
+	static unordered_map<string, RegistryEntry> registry;
+	uint64_t size = 0;
+	int64_t time = 0;
+	const bool stamped = fileStamp(filepath, size, time);
+	std::lock_guard<std::mutex> lock(mtx);
+	// expired entries are dropped on the way, the registry only holds the meshes in use
+	for (auto it = registry.begin(); it != registry.end();) {
+		if (it->second.mesh.expired())
+			it = registry.erase(it);
+		else
+			++it;
+	}
+	auto it = registry.find(filepath);
+	if (stamped && it != registry.end() && it->second.size == size && it->second.time == time) {
+		auto m = it->second.mesh.lock();
+		if (m) return m;
+	}
+	// the ObjModel only lives during the conversion
+	auto m = std::make_shared<const Mesh>(ObjModel(filepath, useMeshCache));
+	if (stamped) registry[filepath] = RegistryEntry{m, size, time};
+	return m;
 }
 
+Model::Model(const string &filepath, bool useMeshCache)
+    : Model(Mesh::load(filepath, useMeshCache)) {}
+
+Model::Model(std::shared_ptr<const Mesh> m) : mesh(m) { updateFromTransformation(); }
+
 void Model::scale(const Vec &s) {
 	transformation.scale(s);
 	updateFromTransformation();
@@ -31,37 +121,56 @@ bool Model::changedSinceLastCheck() {
 	return c;
 }
 
+void Model::setLazyTransformation(bool l) {
+	lazyTransformation = l;
+	if (l) {
+		// the mesh's object space geometry is used directly
+		vector<Vec>().swap(vertices);
+		vector<Vec>().swap(normals);
+		bvh = FaceBVH();
+		updateInverse();
+		changed = true;
+	} else {
+		updateFromTransformation();
+	}
+}
+
+void Model::updateInverse() {
+	inverse = transformation.inverted();
+	// the largest singular value of the linear part A is bounded by the square root of
+	// the largest absolute row sum of transpose(A) * A (exact for similarity transforms)
+	double maxRowSum = 0;
+	for (int i = 0; i < 3; ++i) {
+		double rowSum = 0;
+		for (int j = 0; j < 3; ++j) {
+			double ata = 0;
+			for (int k = 0; k < 3; ++k) ata += inverse.m[k][i] * inverse.m[k][j];
+			rowSum += fabs(ata);
+		}
+		maxRowSum = max(maxRowSum, rowSum);
+	}
+	inverseScale = sqrt(maxRowSum);
+}
+
 void Model::updateFromTransformation() {
+	if (lazyTransformation) {
+		updateInverse();
+		changed = true;
+		return;
+	}
 	vertices.clear();
 	normals.clear();
-	for (auto &v : obj.vertices) {
+	for (auto &v : mesh->vertices) {
 		vertices.push_back(transformation * v);
 	}
-	for (auto &n : obj.normals) {
+	for (auto &n : mesh->normals) {
 		normals.push_back((transformation * n).normalized());
 	}
+	// transformations don't change the topology, the tree only needs to be refit
+	if (bvh.empty())
+		bvh.build(vertices, mesh->faces);
+	else
+		bvh.refit(vertices, mesh->faces);
 	changed = true;
 }
-void Model::updateFacesFromObj() {
-	for (auto &f : obj.faces) {
-		faces.push_back(f.at("v"));
-	}
-	changed = true;
-}
-void Model::computeAdjacency() {
-	for (size_t i = 0; i < faces.size(); ++i) {
-		Triangle &ti = faces[i];
-		for (size_t j = i + 1; j < faces.size(); ++j) {
-			Triangle &tj = faces[j];
-			if (ti.indices[0] == tj.indices[0] || ti.indices[0] == tj.indices[1] ||
-			    ti.indices[0] == tj.indices[2] || ti.indices[1] == tj.indices[0] ||
-			    ti.indices[1] == tj.indices[1] || ti.indices[1] == tj.indices[2] ||
-			    ti.indices[2] == tj.indices[0] || ti.indices[2] == tj.indices[1] ||
-			    ti.indices[2] == tj.indices[2]) {
-				adjacency[i].insert(j);
-				adjacency[j].insert(i);
-			}
-		}
-	}
-}
 }
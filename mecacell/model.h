@@ -2,42 +2,104 @@
 #define MECACELL_MODEL_H
 #include "matrix4x4.h"
 #include "objmodel.h"
+#include "bvh.h"
 #include "tools.h"
+#include <memory>
 #include <vector>
 #include <string>
-#include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <unordered_map>
-#include <unordered_set>
 
 using std::string;
 using std::vector;
 using std::unordered_map;
-using std::unordered_set;
 using std::pair;
 
 namespace MecaCell {
 
-struct Model;
+// compressed sparse rows: row i is ids[offsets[i]] to ids[offsets[i + 1] - 1], sorted
+struct CSRIndex {
+	vector<uint32_t> offsets; // nb of rows + 1
+	vector<uint32_t> ids;
+
+	size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t rowSize(size_t i) const { return offsets[i + 1] - offsets[i]; }
+	const uint32_t *rowBegin(size_t i) const { return ids.data() + offsets[i]; }
+	const uint32_t *rowEnd(size_t i) const { return ids.data() + offsets[i + 1]; }
+	bool contains(size_t i, uint32_t id) const {
+		return std::binary_search(rowBegin(i), rowEnd(i), id);
+	}
+	template <typename F> void forEach(size_t i, F &&f) const {
+		for (const uint32_t *p = rowBegin(i); p != rowEnd(i); ++p) f(*p);
+	}
+};
+
+// Immutable object space geometry of an OBJ file, shared by all the models (of any
+// world) loaded from it: load keeps a registry of the meshes in use, a file is only
+// parsed again once none of its models is left, or when it changed on disk. Only what
+// the simulation and the viewer need is kept, the ObjModel is dropped after loading.
+struct Mesh {
+	vector<Vec> vertices;
+	vector<Vec> normals;         // normalized
+	vector<Triangle> faces;      // vertices indices
+	vector<Triangle> faceNormals; // normals indices of each face, empty if some have none
+	FaceBVH bvh;                 // over faces
+	CSRIndex vertexFaces;        // faces using each vertex
+	CSRIndex faceNeighbours;     // faces sharing at least one vertex with each face
+
+	explicit Mesh(const ObjModel &obj);
+	// the mesh of filepath, shared with the models already using it (thread safe)
+	static std::shared_ptr<const Mesh> load(const string &filepath, bool useMeshCache = false);
+
+private:
+	void computeAdjacency();
+};
 
 struct Model {
-	Model(const string &filepath);
+	Model(const string &filepath, bool useMeshCache = false); // see Mesh::load
+	// an instance of an already loaded mesh
+	explicit Model(std::shared_ptr<const Mesh> m);
 
 	void scale(const Vec &s);
 	void translate(const Vec &t);
 	void rotate(const Rotation<Vec> &r);
 	void updateFromTransformation();
-	void computeAdjacency();
-	void updateFacesFromObj();
+	void setLazyTransformation(bool l);
+	bool isLazyTransformation() const { return lazyTransformation; }
 	bool changedSinceLastCheck();
 
 	string name;
-	ObjModel obj;
+	std::shared_ptr<const Mesh> mesh; // never modified, shared between models
 	Matrix4x4 transformation;
+	// world space copies of the mesh's vertices & normals, and bvh over them refit after
+	// each transformation. All empty in lazy mode (the mesh's ones are used instead)
 	vector<Vec> vertices;
 	vector<Vec> normals;
-	vector<Triangle> faces;
-	unordered_map<size_t, unordered_set<size_t>> adjacency; // adjacent faces share at least one vertex
+	FaceBVH bvh;
 	bool changed = true;
+
+	const vector<Triangle> &getFaces() const { return mesh->faces; }
+	// Lazy transformation mode: the instance keeps no geometry of its own, queries use the
+	// mesh's object space bvh and a transformation only updates the inverse matrix.
+	// Queries go through toObject, getBVH and getVertex, which work in both modes.
+	const FaceBVH &getBVH() const { return lazyTransformation ? mesh->bvh : bvh; }
+	Vec toObject(const Vec &p) const { return lazyTransformation ? inverse * p : p; }
+	Vec toWorld(const Vec &p) const { return lazyTransformation ? transformation * p : p; }
+	// world space position of the i-th vertex
+	Vec getVertex(size_t i) const {
+		return lazyTransformation ? transformation * mesh->vertices[i] : vertices[i];
+	}
+	// radius of a sphere containing the object space image of a world space sphere
+	double toObjectRadius(double r) const {
+		return lazyTransformation ? r * inverseScale : r;
+	}
+
+private:
+	bool lazyTransformation = false;
+	Matrix4x4 inverse;
+	double inverseScale = 1.0; // upper bound of the inverse's scaling factor
+	void updateInverse();
 };
 }
 #endif
@@ -5,9 +5,9 @@
 #include "matrix4x4.h"
 #include "objmodel.h"
 #include "tools.h"
+#include <cstdint>
 #include <vector>
 #include <string>
-#include <vector>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -30,6 +30,7 @@ struct SpaceConnectionPoint { // just a connection point with anything anywhere
 	Vec getAngularVelocity() { return Vec::zero(); }
 	Basis<Vec> getOrientation() { return Basis<Vec>(); }
 	Rotation<Vec> getOrientationRotation() { return Rotation<Vec>(); }
+	Quaternion getOrientationQuaternion() { return Quaternion::identity(); }
 	double getInertia() { return 1; }
 	void receiveForce(double, const Vec &, bool) {}
 	void receiveForce(const Vec &) {}
@@ -49,6 +50,7 @@ struct ModelConnectionPoint {
 	Vec getAngularVelocity() { return Vec::zero(); }
 	Basis<Vec> getOrientation() { return Basis<Vec>(); }
 	Rotation<Vec> getOrientationRotation() { return Rotation<Vec>(); }
+	Quaternion getOrientationQuaternion() { return Quaternion::identity(); }
 	double getInertia() { return 1; }
 	void receiveForce(double, const Vec &, bool) {}
 	void receiveForce(const Vec &) {}
@@ -56,8 +58,9 @@ struct ModelConnectionPoint {
 };
 
 template <typename Cell> struct CellModelConnection {
-	using CMConnection = Connection<ModelConnectionPoint, Cell *>;
-	using CSConnection = Connection<SpaceConnectionPoint, Cell *>;
+	// both are plain springs: no joint state is stored
+	using CMConnection = Connection<ModelConnectionPoint, Cell *, SpringOnly>;
+	using CSConnection = Connection<SpaceConnectionPoint, Cell *, SpringOnly>;
 	Model *model;
 	CSConnection anchor;  // slide and anchor, only angular
 	CMConnection bounce;  // always perpendicular, only classic spring
@@ -70,8 +73,86 @@ template <typename Cell> struct CellModelConnection {
 	}
 
 	CellModelConnection() {}
-	CellModelConnection(CSConnection a, CMConnection b) : anchor(a), bounce(b) {}
-	bool dirty = false; // does this connection need to be deleted?
+	CellModelConnection(CSConnection a, CMConnection b)
+	    : model(b.getNode0().model), anchor(a), bounce(b) {}
+	Cell *getCell() { return bounce.getNode1(); }
+	size_t getFace() { return bounce.getNode0().face; }
+	uint64_t generation = 0; // last collision check that found this contact
+	size_t cellSlot = 0;     // position in the cell's modelConnections
+};
+
+////////////////////////////////////////////////////////////////////
+//                    CELL - MODEL CONTACTS
+////////////////////////////////////////////////////////////////////
+// All the cell - model connections of a world, stored contiguously. A contact is
+// identified by its cell, its model and its face (see CellModelConnection), the cells
+// list their contacts (getRWModelConnections), so that no map is needed.
+// Contacts are removed by swapping them with the last one: the cells' pointers to the
+// contacts that move (or to all of them when the storage grows) are updated.
+template <typename Cell> class CellModelContacts {
+public:
+	using Contact = CellModelConnection<Cell>;
+
+private:
+	vector<Contact> contacts;
+
+	void relink(size_t i) { contacts[i].getCell()->restoreModelConnection(&contacts[i]); }
+	Contact *push(const Contact &cmc) {
+		const Contact *old = contacts.data();
+		contacts.push_back(cmc);
+		if (contacts.data() != old)
+			for (size_t i = 0; i + 1 < contacts.size(); ++i) relink(i);
+		return &contacts.back();
+	}
+
+public:
+	size_t size() const { return contacts.size(); }
+	bool empty() const { return contacts.empty(); }
+	Contact &operator[](size_t i) { return contacts[i]; }
+	typename vector<Contact>::iterator begin() { return contacts.begin(); }
+	typename vector<Contact>::iterator end() { return contacts.end(); }
+	size_t heapBytes() const { return contacts.capacity() * sizeof(Contact); }
+
+	// adds a contact at the end of its cell's list
+	Contact *add(const Contact &cmc) {
+		Contact *res = push(cmc);
+		res->getCell()->addModelConnection(res);
+		return res;
+	}
+	// adds a contact at its cellSlot in its cell's list (see resizeModelConnections)
+	Contact *restore(const Contact &cmc) {
+		Contact *res = push(cmc);
+		relink(contacts.size() - 1);
+		return res;
+	}
+
+	// removes the contact from its cell's list and from the store
+	void remove(Contact *cmc) {
+		cmc->getCell()->removeModelConnection(cmc);
+		const size_t i = static_cast<size_t>(cmc - contacts.data());
+		if (i + 1 < contacts.size()) {
+			contacts[i] = contacts.back();
+			relink(i);
+		}
+		contacts.pop_back();
+	}
+	// removes, in one pass, every contact pred(contact) is true for
+	template <typename P> void removeIf(P &&pred) {
+		for (size_t i = 0; i < contacts.size();) {
+			if (pred(contacts[i]))
+				remove(&contacts[i]); // the last contact is now at i
+			else
+				++i;
+		}
+	}
+	// removes the contacts of a cell
+	void removeCell(Cell *c) {
+		auto &cmcs = c->getRWModelConnections();
+		while (!cmcs.empty()) remove(cmcs.back());
+	}
+
+	// the cells' lists are left as they are
+	void clear() { contacts.clear(); }
 };
 }
 #endif
@@ -0,0 +1,40 @@
+#ifndef MORTON_HPP
+#define MORTON_HPP
+#include <algorithm>
+#include <cstdint>
+#include "vector3D.h"
+
+namespace MecaCell {
+// Z-order (Morton) codes: points close in space mostly get close codes, so sorting
+// objects by the code of their position gives them a good memory locality
+namespace Morton {
+// the 21 lowest bits of x, spread every 3 bits
+inline uint64_t spreadBits(uint64_t x) {
+	x &= 0x1FFFFF;
+	x = (x | x << 32) & 0x1F00000000FFFFULL;
+	x = (x | x << 16) & 0x1F0000FF0000FFULL;
+	x = (x | x << 8) & 0x100F00F00F00F00FULL;
+	x = (x | x << 4) & 0x10C30C30C30C30C3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+inline uint64_t encode(uint32_t x, uint32_t y, uint32_t z) {
+	return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+}
+
+// code of p, quantized on 21 bits per axis in the box [minCorner, maxCorner]
+inline uint64_t encode(const Vector3D &p, const Vector3D &minCorner,
+                       const Vector3D &maxCorner) {
+	const double MAX_COORD = 0x1FFFFF;
+	auto quantize = [&](double v, double a, double b) {
+		double q = b > a ? (v - a) / (b - a) * MAX_COORD : 0.0;
+		return static_cast<uint32_t>(std::min(MAX_COORD, std::max(0.0, q)));
+	};
+	return encode(quantize(p.x, minCorner.x, maxCorner.x),
+	              quantize(p.y, minCorner.y, maxCorner.y),
+	              quantize(p.z, minCorner.z, maxCorner.z));
+}
+}
+}
+#endif
@@ -31,12 +31,14 @@ public:
 	Vec getPrevposition() const { return prevposition; }
 	Vec getVelocity() const { return velocity; }
 	Vec getForce() const { return force; }
+	double getTotalForce() const { return totalForce; }
 	double getMass() const { return mass; }
 	double getBaseMass() const { return baseMass; }
 	void setPosition(const Vec &p) { position = p; }
 	void setPrevposition(const Vec &p) { prevposition = p; }
 	void setVelocity(const Vec &v) { velocity = v; }
 	void setForce(const Vec &f) { force = f; }
+	void setTotalForce(double f) { totalForce = f; }
 	void setMass(const double m) { mass = m; }
 	void setBaseMass(const double m) { baseMass = m; }
 	/**********************************************
@@ -52,6 +54,29 @@ public:
 		totalForce = 0;
 		force = Vec::zero();
 	}
+	/**********************************************
+	 *               CHECKPOINTS
+	 **********************************************/
+	template <typename W> void saveState(W &w) const {
+		w.put(position);
+		w.put(prevposition);
+		w.put(velocity);
+		w.put(force);
+		w.put(movementEnabled);
+		w.put(mass);
+		w.put(baseMass);
+		w.put(totalForce);
+	}
+	template <typename R> void loadState(R &r) {
+		r.get(position);
+		r.get(prevposition);
+		r.get(velocity);
+		r.get(force);
+		r.get(movementEnabled);
+		r.get(mass);
+		r.get(baseMass);
+		r.get(totalForce);
+	}
 };
 }
 #endif
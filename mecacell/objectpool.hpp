@@ -0,0 +1,61 @@
+#ifndef OBJECTPOOL_HPP
+#define OBJECTPOOL_HPP
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                        OBJECT POOL
+////////////////////////////////////////////////////////////////////
+// Allocates objects of type T in contiguous blocks of BLOCK_SIZE slots. Destroyed
+// objects' slots go into a free list and are reused first, so creating and destroying
+// objects at the same rate never hits the global allocator.
+// Addresses are stable: a block is never moved or freed before the pool is.
+// Objects still alive when the pool is destroyed are not destroyed.
+template <typename T, size_t BLOCK_SIZE = 1024> class ObjectPool {
+private:
+	using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+	std::vector<std::unique_ptr<Storage[]>> blocks;
+	std::vector<T *> freeList;
+	size_t nextInBlock = BLOCK_SIZE; // first slot of the last block never used yet
+	size_t nbAlive = 0;
+
+public:
+	ObjectPool() {}
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool &operator=(const ObjectPool &) = delete;
+
+	template <typename... Args> T *create(Args &&... args) {
+		void *slot;
+		if (!freeList.empty()) {
+			slot = freeList.back();
+			freeList.pop_back();
+		} else {
+			if (nextInBlock == BLOCK_SIZE) {
+				blocks.emplace_back(new Storage[BLOCK_SIZE]);
+				nextInBlock = 0;
+			}
+			slot = &blocks.back()[nextInBlock++];
+		}
+		T *o = new (slot) T(std::forward<Args>(args)...);
+		++nbAlive;
+		return o;
+	}
+
+	void destroy(T *o) {
+		o->~T();
+		freeList.push_back(o);
+		--nbAlive;
+	}
+
+	// nb of objects alive
+	size_t size() const { return nbAlive; }
+	// nb of slots allocated
+	size_t capacity() const { return blocks.size() * BLOCK_SIZE; }
+};
+}
+#endif
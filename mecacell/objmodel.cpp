@@ -0,0 +1,254 @@
+#include "objmodel.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#define MECACELL_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace MecaCell {
+namespace {
+// read only view of a whole file: memory mapped when possible, read in a buffer otherwise
+class FileView {
+private:
+	const char *b = nullptr;
+	size_t s = 0;
+	vector<char> buffer;
+#if MECACELL_MMAP
+	void *map = nullptr;
+#endif
+
+public:
+	FileView(const string &path) {
+#if MECACELL_MMAP
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m != MAP_FAILED) {
+				map = m;
+				b = static_cast<const char *>(m);
+				s = st.st_size;
+			}
+		}
+		close(fd);
+#else
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) return;
+		buffer.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		if (!buffer.empty() && file.read(buffer.data(), buffer.size())) {
+			b = buffer.data();
+			s = buffer.size();
+		}
+#endif
+	}
+	~FileView() {
+#if MECACELL_MMAP
+		if (map) munmap(map, s);
+#endif
+	}
+	FileView(const FileView &) = delete;
+	FileView &operator=(const FileView &) = delete;
+	const char *data() const { return b; }
+	size_t size() const { return s; }
+};
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline const char *skipBlanks(const char *p, const char *e) {
+	while (p < e && isBlank(*p)) ++p;
+	return p;
+}
+inline const char *tokenEnd(const char *p, const char *e) {
+	while (p < e && !isBlank(*p)) ++p;
+	return p;
+}
+
+// same result as stod: the token is copied in a null terminated buffer for strtod
+bool parseDouble(const char *&p, const char *e, double &d) {
+	p = skipBlanks(p, e);
+	const char *te = tokenEnd(p, e);
+	char buf[64];
+	size_t l = te - p;
+	if (l == 0 || l >= sizeof(buf)) return false;
+	memcpy(buf, p, l);
+	buf[l] = 0;
+	char *end;
+	d = strtod(buf, &end);
+	p = te;
+	return end != buf;
+}
+
+// 1 based, or negative = relative to the end of the n elements read so far
+bool parseIndex(const char *&p, const char *e, size_t n, unsigned int &id) {
+	bool neg = p < e && *p == '-';
+	if (neg) ++p;
+	if (p == e || *p < '0' || *p > '9') return false;
+	long long i = 0;
+	while (p < e && *p >= '0' && *p <= '9') i = i * 10 + (*p++ - '0');
+	i = neg ? static_cast<long long>(n) - i : i - 1;
+	if (i < 0) return false;
+	id = static_cast<unsigned int>(i);
+	return true;
+}
+
+bool isKeyword(const char *p, const char *e, const char *k) {
+	size_t l = strlen(k);
+	return static_cast<size_t>(e - p) == l && memcmp(p, k, l) == 0;
+}
+
+// binary cache: header followed by the raw vertices, uv, normals and faces arrays
+struct CacheHeader {
+	char magic[8];
+	uint64_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t nbVertices, nbUV, nbNormals, nbFaces;
+};
+const char CACHE_MAGIC[8] = {'M', 'C', 'M', 'E', 'S', 'H', 0, 0};
+const uint64_t CACHE_VERSION = 1;
+static_assert(sizeof(Vec) == 3 * sizeof(double) && std::is_standard_layout<Vec>::value,
+              "Vec is stored as 3 raw doubles in the mesh cache");
+static_assert(sizeof(UV) == 2 * sizeof(double) && std::is_trivially_copyable<UV>::value,
+              "UV is stored as 2 raw doubles in the mesh cache");
+static_assert(sizeof(ObjFace) == 11 * sizeof(unsigned int) &&
+                  std::is_trivially_copyable<ObjFace>::value,
+              "ObjFace is stored as 11 raw unsigned ints in the mesh cache");
+
+bool sourceStats(const string &path, uint64_t &size, int64_t &time) {
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+	size = st.st_size;
+	time = st.st_mtime;
+	return true;
+}
+
+template <typename T> void readArray(vector<T> &v, size_t n, const char *&p) {
+	v.resize(n);
+	if (n) memcpy(static_cast<void *>(v.data()), p, n * sizeof(T));
+	p += n * sizeof(T);
+}
+template <typename T> void writeArray(const vector<T> &v, std::ofstream &f) {
+	if (!v.empty()) f.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+}
+}
+
+ObjModel::ObjModel(const string &filepath, bool useCache) {
+	if (useCache && readCache(filepath)) return;
+	{
+		FileView file(filepath);
+		if (file.data()) parse(file.data(), file.data() + file.size());
+	}
+	if (useCache) writeCache(filepath);
+}
+
+void ObjModel::parse(const char *b, const char *e) {
+	for (const char *p = b; p < e;) {
+		const char *le = static_cast<const char *>(memchr(p, '\n', e - p));
+		if (!le) le = e;
+		p = skipBlanks(p, le);
+		const char *ke = tokenEnd(p, le);
+		if (isKeyword(p, ke, "v") || isKeyword(p, ke, "vn")) {
+			bool isNormal = ke - p == 2;
+			Vec v;
+			p = ke;
+			if (parseDouble(p, le, v.x) && parseDouble(p, le, v.y) && parseDouble(p, le, v.z))
+				(isNormal ? normals : vertices).push_back(v);
+		} else if (isKeyword(p, ke, "vt")) {
+			UV t;
+			p = ke;
+			if (parseDouble(p, le, t.u) && parseDouble(p, le, t.v)) uv.push_back(t);
+		} else if (isKeyword(p, ke, "f")) {
+			// v, v/t, v//n or v/t/n. Only triangles are kept
+			ObjFace f;
+			f.hasUV = f.hasNormals = 1;
+			int nbCorners = 0;
+			bool valid = true;
+			p = skipBlanks(ke, le);
+			while (valid && p < le) {
+				unsigned int vid = 0, tid = 0, nid = 0;
+				bool hasT = false, hasN = false;
+				valid = parseIndex(p, le, vertices.size(), vid);
+				if (valid && p < le && *p == '/') {
+					++p;
+					if (p < le && *p != '/') valid = hasT = parseIndex(p, le, uv.size(), tid);
+					if (valid && p < le && *p == '/') {
+						++p;
+						valid = hasN = parseIndex(p, le, normals.size(), nid);
+					}
+				}
+				valid = valid && (p == le || isBlank(*p));
+				if (valid && nbCorners < 3) {
+					f.v.indices[nbCorners] = vid;
+					f.t.indices[nbCorners] = tid;
+					f.n.indices[nbCorners] = nid;
+					f.hasUV &= hasT;
+					f.hasNormals &= hasN;
+				}
+				++nbCorners;
+				p = skipBlanks(p, le);
+			}
+			if (valid && nbCorners == 3) faces.push_back(f);
+		}
+		p = le + 1;
+	}
+}
+
+bool ObjModel::readCache(const string &filepath) {
+	CacheHeader h;
+	uint64_t size;
+	int64_t time;
+	if (!sourceStats(filepath, size, time)) return false;
+	FileView file(cachePath(filepath));
+	if (file.size() < sizeof(h)) return false;
+	memcpy(&h, file.data(), sizeof(h));
+	if (memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) != 0 || h.version != CACHE_VERSION ||
+	    h.sourceSize != size || h.sourceTime != time)
+		return false;
+	uint64_t expected = sizeof(h) + h.nbVertices * sizeof(Vec) + h.nbUV * sizeof(UV) +
+	                    h.nbNormals * sizeof(Vec) + h.nbFaces * sizeof(ObjFace);
+	if (file.size() != expected) return false;
+	const char *p = file.data() + sizeof(h);
+	readArray(vertices, h.nbVertices, p);
+	readArray(uv, h.nbUV, p);
+	readArray(normals, h.nbNormals, p);
+	readArray(faces, h.nbFaces, p);
+	return true;
+}
+
+bool ObjModel::writeCache(const string &filepath) const {
+	CacheHeader h;
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.version = CACHE_VERSION;
+	if (!sourceStats(filepath, h.sourceSize, h.sourceTime)) return false;
+	h.nbVertices = vertices.size();
+	h.nbUV = uv.size();
+	h.nbNormals = normals.size();
+	h.nbFaces = faces.size();
+	// written aside then renamed, so that a concurrent run never reads a partial cache
+	string path = cachePath(filepath), tmp = path + ".tmp";
+	{
+		std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+		if (!f) return false;
+		f.write(reinterpret_cast<const char *>(&h), sizeof(h));
+		writeArray(vertices, f);
+		writeArray(uv, f);
+		writeArray(normals, f);
+		writeArray(faces, f);
+		if (!f) {
+			f.close();
+			std::remove(tmp.c_str());
+			return false;
+		}
+	}
+	return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+}
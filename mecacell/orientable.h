@@ -1,5 +1,6 @@
 #ifndef ORIENTABLE_H
 #define ORIENTABLE_H
+#include "quaternion.h"
 #include "tools.h"
 namespace MecaCell {
 class Orientable {
@@ -7,7 +8,11 @@ class Orientable {
 	Vec angularVelocity = Vec::zero();
 	Vec torque = Vec::zero();
 	Basis<Vec> orientation;
+#if MECACELL_QUATERNIONS
+	Quaternion orientationQuaternion = Quaternion::identity();
+#else
 	Rotation<Vec> orientationRotation;
+#endif
 
  public:
 	/**********************************************
@@ -21,18 +26,73 @@ class Orientable {
 	Vec getAngularVelocity() const { return angularVelocity; }
 	Vec getTorque() const { return torque; }
 	Basis<Vec> getOrientation() const { return orientation; }
-	Rotation<Vec> getOrientationRotation() const { return orientationRotation; }
 	void setAngularVelocity(const Vec& v) { angularVelocity = v; }
 	void setTorque(const Vec& t) { torque = t; }
+#if MECACELL_QUATERNIONS
+	Rotation<Vec> getOrientationRotation() const {
+		return Quaternion(orientationQuaternion).toAxisAngle();
+	}
+	Quaternion getOrientationQuaternion() const { return orientationQuaternion; }
+	void setOrientationRotation(const Rotation<Vec>& r) {
+		orientationQuaternion = Quaternion(r.teta, r.n.normalized()).normalized();
+	}
+#else
+	Rotation<Vec> getOrientationRotation() const { return orientationRotation; }
+	Quaternion getOrientationQuaternion() const {
+		return Quaternion(orientationRotation.teta, orientationRotation.n);
+	}
 	void setOrientationRotation(const Rotation<Vec>& r) { orientationRotation = r; }
+#endif
 
 	/**********************************************
 	 *                  UPDATES
 	 **********************************************/
 	void receiveTorque(const Vec& t) { torque += t; }
+#if MECACELL_QUATERNIONS
+	void updateCurrentOrientation() {
+		orientation = Basis<Vec>((orientationQuaternion * Vec(1, 0, 0)).normalized(),
+		                         (orientationQuaternion * Vec(0, 1, 0)).normalized());
+	}
+	// rotates the orientation by d (axis * angle), as integrators do at each step
+	void addAngularDisplacement(const Vec& d) {
+		double a = d.length();
+		if (a > 0) orientationQuaternion = (Quaternion(a, d / a) * orientationQuaternion).normalized();
+		updateCurrentOrientation();
+	}
+#else
 	void updateCurrentOrientation() { orientation.updateWithRotation(orientationRotation); }
+	// rotates the orientation by d (axis * angle), as integrators do at each step
+	void addAngularDisplacement(const Vec& d) {
+		orientationRotation = orientationRotation + d;
+		updateCurrentOrientation();
+	}
+#endif
 	void resetTorque() { torque = Vec::zero(); }
 	void resetAngularVelocity() { angularVelocity = Vec::zero(); }
+
+	/**********************************************
+	 *                CHECKPOINTS
+	 **********************************************/
+	template <typename W> void saveState(W& w) const {
+		w.put(angularVelocity);
+		w.put(torque);
+		w.put(orientation);
+#if MECACELL_QUATERNIONS
+		w.put(orientationQuaternion);
+#else
+		w.put(orientationRotation);
+#endif
+	}
+	template <typename R> void loadState(R& r) {
+		r.get(angularVelocity);
+		r.get(torque);
+		r.get(orientation);
+#if MECACELL_QUATERNIONS
+		r.get(orientationQuaternion);
+#else
+		r.get(orientationRotation);
+#endif
+	}
 };
 }
 #endif
@@ -0,0 +1,68 @@
+#ifndef PADDEDVECTOR_HPP
+#define PADDEDVECTOR_HPP
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include "vector3D.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                      PADDED VECTOR
+////////////////////////////////////////////////////////////////////
+// Vector3D padded to 4 doubles and aligned on 32 bytes, so that each one fills exactly an
+// AVX register (2 SSE registers) and never straddles a cache line. Meant for arrays
+// gathered for a vectorized loop, Vector3D stays the type of the cells' state (it is
+// serialized and mapped as 3 doubles). w is padding, kept at 0 by the operations.
+// It is over-aligned: before c++17, containers of PaddedVector3D need AlignedAllocator.
+struct alignas(32) PaddedVector3D {
+	double x, y, z, w;
+	constexpr PaddedVector3D() : x(0), y(0), z(0), w(0) {}
+	constexpr PaddedVector3D(double a, double b, double c) : x(a), y(b), z(c), w(0) {}
+	constexpr PaddedVector3D(const Vector3D &v) : x(v.x), y(v.y), z(v.z), w(0) {}
+	constexpr Vector3D toVec() const { return Vector3D(x, y, z); }
+
+	constexpr PaddedVector3D operator+(const PaddedVector3D &v) const {
+		return PaddedVector3D(x + v.x, y + v.y, z + v.z);
+	}
+	constexpr PaddedVector3D operator-(const PaddedVector3D &v) const {
+		return PaddedVector3D(x - v.x, y - v.y, z - v.z);
+	}
+	constexpr PaddedVector3D operator*(double s) const {
+		return PaddedVector3D(x * s, y * s, z * s);
+	}
+	constexpr PaddedVector3D operator/(double s) const {
+		return PaddedVector3D(x / s, y / s, z / s);
+	}
+	inline void operator+=(const PaddedVector3D &v) {
+		x += v.x;
+		y += v.y;
+		z += v.z;
+	}
+	constexpr double dot(const PaddedVector3D &v) const { return x * v.x + y * v.y + z * v.z; }
+	constexpr double sqlength() const { return x * x + y * y + z * z; }
+	inline double length() const { return sqrt(sqlength()); }
+};
+static_assert(sizeof(PaddedVector3D) == 32 && alignof(PaddedVector3D) == 32,
+              "PaddedVector3D should be exactly 4 aligned doubles");
+typedef PaddedVector3D PaddedVec;
+
+// allocator honoring alignof(T) (std::allocator only guarantees alignof(max_align_t)
+// before c++17), e.g. std::vector<PaddedVec, AlignedAllocator<PaddedVec>>
+template <typename T> struct AlignedAllocator {
+	typedef T value_type;
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+	T *allocate(size_t n) {
+		void *p = nullptr;
+		if (posix_memalign(&p, alignof(T) < sizeof(void *) ? sizeof(void *) : alignof(T),
+		                   n * sizeof(T)))
+			throw std::bad_alloc();
+		return static_cast<T *>(p);
+	}
+	void deallocate(T *p, size_t) { free(p); }
+	template <typename U> bool operator==(const AlignedAllocator<U> &) const { return true; }
+	template <typename U> bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+}
+#endif
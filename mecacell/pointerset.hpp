@@ -0,0 +1,82 @@
+#ifndef POINTERSET_HPP
+#define POINTERSET_HPP
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                        POINTER SET
+////////////////////////////////////////////////////////////////////
+// Small set of pointers stored in one flat open addressing table (linear probing),
+// kept at most half full. Used by cells to know in constant time which cells they are
+// connected to.
+template <typename T> class PointerSet {
+private:
+	std::vector<T *> slots; // nullptr = free slot
+	size_t nbElements = 0;
+
+	size_t home(const T *p) const {
+		uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)) *
+		             0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(h >> 32) & (slots.size() - 1);
+	}
+
+	void grow() {
+		std::vector<T *> old(slots.empty() ? 16 : slots.size() * 2, nullptr);
+		old.swap(slots);
+		for (auto p : old)
+			if (p) place(p);
+	}
+
+	void place(T *p) {
+		size_t mask = slots.size() - 1;
+		size_t s = home(p);
+		while (slots[s]) s = (s + 1) & mask;
+		slots[s] = p;
+	}
+
+public:
+	size_t size() const { return nbElements; }
+	size_t heapBytes() const { return slots.capacity() * sizeof(T *); }
+
+	bool contains(const T *p) const {
+		if (slots.empty()) return false;
+		size_t mask = slots.size() - 1;
+		for (size_t s = home(p); slots[s]; s = (s + 1) & mask)
+			if (slots[s] == p) return true;
+		return false;
+	}
+
+	// p must not be in the set already
+	void insert(T *p) {
+		if (2 * (nbElements + 1) > slots.size()) grow();
+		place(p);
+		++nbElements;
+	}
+
+	void erase(const T *p) {
+		if (slots.empty()) return;
+		size_t mask = slots.size() - 1;
+		size_t s = home(p);
+		for (; slots[s] != p; s = (s + 1) & mask)
+			if (!slots[s]) return;
+		// backward shift: moves back the following elements that can't be reached anymore
+		for (size_t next = (s + 1) & mask; slots[next]; next = (next + 1) & mask) {
+			size_t h = home(slots[next]);
+			// can slots[next] stay where it is, i.e. is h cyclically in (s, next]?
+			if (s <= next ? (s < h && h <= next) : (s < h || h <= next)) continue;
+			slots[s] = slots[next];
+			s = next;
+		}
+		slots[s] = nullptr;
+		--nbElements;
+	}
+
+	void clear() {
+		for (auto &p : slots) p = nullptr;
+		nbElements = 0;
+	}
+};
+}
+#endif
@@ -0,0 +1,108 @@
+#ifndef PROFILING_HPP
+#define PROFILING_HPP
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Per phase timings and counters of BasicWorld::update
+// MECACELL_PROFILING = 0 (default): compiled out, the stats stay at zero
+// MECACELL_PROFILING = 1: the world's ProfileStats are updated at each update
+#ifndef MECACELL_PROFILING
+#define MECACELL_PROFILING 0
+#endif
+
+#define MECACELL_PROFILE_CONCAT_(a, b) a##b
+#define MECACELL_PROFILE_CONCAT(a, b) MECACELL_PROFILE_CONCAT_(a, b)
+#if MECACELL_PROFILING
+// times the rest of the enclosing scope
+#define MECACELL_PROFILE_SCOPE(stats, phase)                                            \
+	MecaCell::ProfileScope MECACELL_PROFILE_CONCAT(mecacellProfileScope, __LINE__)(stats, \
+	                                                                               phase)
+#define MECACELL_PROFILE_COUNT(stats, counter, n) (stats).add(counter, n)
+#else
+#define MECACELL_PROFILE_SCOPE(stats, phase) ((void)0)
+#define MECACELL_PROFILE_COUNT(stats, counter, n) ((void)0)
+#endif
+
+namespace MecaCell {
+// in BasicWorld::update's order
+enum class ProfilePhase {
+	forces,
+	integration,
+	modelCollisions,
+	cellGrid,
+	connectionsUpdate,
+	cellCollisions,
+	connectionsDeletion,
+	behavior,
+	deaths,
+	stats,
+	count
+};
+
+enum class ProfileCounter {
+	gridInserts,          // cells inserted or moved in the cell grid
+	neighbourCandidates,  // cell pairs tested by ConnectableCell::connection
+	connectionsCreated,   // cell - cell connections
+	connectionsDeleted,   // cell - cell connections, too long or with a dead cell
+	cellModelContacts,    // cell - model face contacts found by the narrow phase
+	sleepingCells,        // see BasicWorld::setSleeping
+	count
+};
+
+inline const char *profilePhaseName(ProfilePhase p) {
+	static const char *names[] = {"forces",         "integration",         "modelCollisions",
+	                              "cellGrid",       "connectionsUpdate",   "cellCollisions",
+	                              "connectionsDeletion", "behavior",        "deaths",
+	                              "stats"};
+	return names[static_cast<int>(p)];
+}
+
+inline const char *profileCounterName(ProfileCounter c) {
+	static const char *names[] = {"gridInserts",        "neighbourCandidates",
+	                              "connectionsCreated", "connectionsDeleted",
+	                              "cellModelContacts",  "sleepingCells"};
+	return names[static_cast<int>(c)];
+}
+
+// totals since the last reset
+struct ProfileStats {
+	static const size_t NB_PHASES = static_cast<size_t>(ProfilePhase::count);
+	static const size_t NB_COUNTERS = static_cast<size_t>(ProfileCounter::count);
+	std::array<double, NB_PHASES> seconds;
+	std::array<uint64_t, NB_COUNTERS> counters;
+	uint64_t nbUpdates = 0;
+
+	ProfileStats() { reset(); }
+	void reset() {
+		seconds.fill(0);
+		counters.fill(0);
+		nbUpdates = 0;
+	}
+	void add(ProfilePhase p, double s) { seconds[static_cast<size_t>(p)] += s; }
+	void add(ProfileCounter c, uint64_t n) { counters[static_cast<size_t>(c)] += n; }
+	double getSeconds(ProfilePhase p) const { return seconds[static_cast<size_t>(p)]; }
+	uint64_t getCount(ProfileCounter c) const { return counters[static_cast<size_t>(c)]; }
+	double getTotalSeconds() const {
+		double t = 0;
+		for (auto s : seconds) t += s;
+		return t;
+	}
+};
+
+class ProfileScope {
+private:
+	ProfileStats &stats;
+	ProfilePhase phase;
+	std::chrono::steady_clock::time_point t0;
+
+public:
+	ProfileScope(ProfileStats &s, ProfilePhase p)
+	    : stats(s), phase(p), t0(std::chrono::steady_clock::now()) {}
+	~ProfileScope() {
+		stats.add(phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+		                     .count());
+	}
+};
+}
+#endif
@@ -32,6 +32,16 @@ Quaternion::Quaternion(const Vector3D &v0, const Vector3D &v1) {
 	}
 }
 
+Quaternion Quaternion::betweenBases(const Vector3D &X0, const Vector3D &Y0,
+                                    const Vector3D &X1, const Vector3D &Y1) {
+	Quaternion q0(X0.normalized(), X1.normalized());
+	Vector3D Ytmp = q0 * Y0;
+	Ytmp.normalize();
+	Quaternion qres = Quaternion(Ytmp, Y1.normalized()) * q0;
+	qres.normalize();
+	return qres;
+}
+
 Rotation<Vector3D> Quaternion::toAxisAngle() {
 	normalize();
 	double s = sqrt(1.0 - w * w);
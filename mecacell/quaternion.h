@@ -4,6 +4,14 @@
 #include "vector3D.h"
 #include "tools.h"
 
+// Orientation representation of Orientable and Joint
+// MECACELL_QUATERNIONS = 0 (default): axis-angle Rotation, composed through quaternions
+// MECACELL_QUATERNIONS = 1: unit quaternions all along, converted to a Rotation only when
+// one is asked for (getOrientationRotation)
+#ifndef MECACELL_QUATERNIONS
+#define MECACELL_QUATERNIONS 0
+#endif
+
 namespace MecaCell {
 struct Quaternion {
    public:
@@ -11,7 +19,6 @@ struct Quaternion {
       double w;
       Quaternion(const double&, const Vector3D& );
       Quaternion(const Vector3D&, const Vector3D&);
-      Quaternion(const Quaternion& q):v(q.v),w(q.w){}
       Quaternion(const double& x, const double& y, const double& z, const double& ww):v(x,y,z),w(ww){}
       Quaternion():v(0,1,0),w(0){}
       Quaternion operator*(const Quaternion&) const ;
@@ -20,7 +27,12 @@ struct Quaternion {
       double getAngle() const;
       Quaternion normalized() const;
       void normalize();
+      Quaternion conjugated() const { return Quaternion(-v.x, -v.y, -v.z, w); }
       Rotation<Vector3D> toAxisAngle();
+      static Quaternion identity() { return Quaternion(0, 0, 0, 1); }
+      // rotation from basis (X0, Y0) to basis (X1, Y1), normalized
+      static Quaternion betweenBases(const Vector3D &X0, const Vector3D &Y0, const Vector3D &X1,
+                                     const Vector3D &Y1);
 };
 }
 #endif
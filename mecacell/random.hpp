@@ -0,0 +1,95 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "vector3D.h"
+
+namespace MecaCell {
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"): the
+// block of 4 random words for a 4 words counter and a 2 words key
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> ctr,
+                                          std::array<uint32_t, 2> key) {
+	const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57, W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+	for (int i = 0; i < 10; ++i) {
+		uint64_t p0 = static_cast<uint64_t>(M0) * ctr[0];
+		uint64_t p1 = static_cast<uint64_t>(M1) * ctr[2];
+		ctr = {{static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(p1),
+		        static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(p0)}};
+		key[0] += W0;
+		key[1] += W1;
+	}
+	return ctr;
+}
+
+// A stream of random numbers entirely defined by (seed, stream, substream): no shared
+// state, so streams can be used concurrently, and the same draws are obtained whatever
+// the thread that makes them. Draw n of a stream is word n % 4 of the Philox block
+// of counter (stream, substream, n / 4), keyed with the seed.
+// Also a UniformRandomBitGenerator (for std distributions, whose results can differ
+// from one standard library to the other).
+class RandomStream {
+private:
+	std::array<uint32_t, 2> key = {{0, 0}};
+	std::array<uint32_t, 4> ctr = {{0, 0, 0, 0}};
+	std::array<uint32_t, 4> block;
+	unsigned int nbUsed = 4; // words of block already drawn
+
+public:
+	typedef uint32_t result_type;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return 0xFFFFFFFF; }
+
+	RandomStream() {}
+	RandomStream(uint64_t seed, uint64_t stream, uint32_t substream = 0) {
+		reset(seed, stream, substream);
+	}
+
+	// restarts at the first draw of (seed, stream, substream)
+	void reset(uint64_t seed, uint64_t stream, uint32_t substream = 0) {
+		key = {{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}};
+		ctr = {{static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32), substream,
+		        0}};
+		nbUsed = 4;
+	}
+
+	result_type operator()() {
+		if (nbUsed == 4) {
+			block = philox4x32(ctr, key);
+			++ctr[3];
+			nbUsed = 0;
+		}
+		return block[nbUsed++];
+	}
+
+	// in [0, 1), with 53 random bits
+	double uniform() {
+		uint64_t a = (*this)() >> 5, b = (*this)() >> 6;
+		return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+	}
+	double uniform(double a, double b) { return a + (b - a) * uniform(); }
+
+	// gaussian (Box - Muller)
+	double normal(double mean = 0.0, double stdDev = 1.0) {
+		double u = 1.0 - uniform(); // in (0, 1]
+		double v = uniform();
+		return mean + stdDev * sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+	}
+
+	// uniformly distributed on the unit sphere
+	Vector3D unitVector() {
+		double z = 2.0 * uniform() - 1.0;
+		double phi = 2.0 * M_PI * uniform();
+		double r = sqrt(std::max(0.0, 1.0 - z * z));
+		return Vector3D(r * cos(phi), r * sin(phi), z);
+	}
+
+	// d slightly deviated, as Vector3D::deltaDirection
+	Vector3D deltaDirection(const Vector3D &d, double amount) {
+		double x = normal(0, amount), y = normal(0, amount), z = normal(0, amount);
+		return Vector3D(d.x + x, d.y + y, d.z + z).normalized();
+	}
+};
+}
+#endif
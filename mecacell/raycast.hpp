@@ -0,0 +1,72 @@
+#ifndef MECACELL_RAYCAST_HPP
+#define MECACELL_RAYCAST_HPP
+#include <cmath>
+#include <limits>
+#include "tools.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                         RAY CASTING
+////////////////////////////////////////////////////////////////////
+// Helpers for the grids' rayCast. A ray is origin + t * dir, t >= 0 (dir doesn't need to
+// be normalized, t is in dir lengths).
+
+// first t at which the ray enters the sphere (0 if origin is inside), false if it misses it
+inline bool raySphere(const Vec &origin, const Vec &dir, const Vec &center, double radius,
+                      double &t) {
+	const Vec oc = origin - center;
+	const double a = dir.sqlength();
+	const double b = oc.dot(dir);
+	const double c = oc.sqlength() - radius * radius;
+	if (c <= 0) {
+		t = 0;
+		return true;
+	}
+	if (b >= 0 || a == 0) return false; // going away
+	const double delta = b * b - a * c;
+	if (delta < 0) return false;
+	t = (-b - sqrt(delta)) / a;
+	return true;
+}
+
+// calls visit(i, j, k, tEnter) on every grid cell the ray crosses for t in [0, maxT], in
+// order (Amanatides & Woo's walk), until visit returns false. invCellSize is 1 / the size
+// of the grid cells, as the grids store it. As the grids round coordinates (double2int),
+// the grid cell i spans [i - 0.5, i + 0.5] grid cell sizes
+template <typename F>
+void walkRay(const Vec &origin, const Vec &dir, double maxT, double invCellSize, F &&visit) {
+	const Vec p = origin * invCellSize + Vec(0.5, 0.5, 0.5);
+	const Vec d = dir * invCellSize;
+	int cell[3] = {static_cast<int>(floor(p.x)), static_cast<int>(floor(p.y)),
+	               static_cast<int>(floor(p.z))};
+	const double pc[3] = {p.x, p.y, p.z}, dc[3] = {d.x, d.y, d.z};
+	const double inf = std::numeric_limits<double>::infinity();
+	int step[3];
+	double tMax[3], tDelta[3];
+	for (int a = 0; a < 3; ++a) {
+		if (dc[a] > 0) {
+			step[a] = 1;
+			tMax[a] = (cell[a] + 1 - pc[a]) / dc[a];
+			tDelta[a] = 1.0 / dc[a];
+		} else if (dc[a] < 0) {
+			step[a] = -1;
+			tMax[a] = (cell[a] - pc[a]) / dc[a];
+			tDelta[a] = -1.0 / dc[a];
+		} else {
+			step[a] = 0;
+			tMax[a] = inf;
+			tDelta[a] = inf;
+		}
+	}
+	double tEnter = 0;
+	while (tEnter <= maxT) {
+		if (!visit(cell[0], cell[1], cell[2], tEnter)) return;
+		const int a = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+		if (tMax[a] == inf) return;
+		tEnter = tMax[a];
+		tMax[a] += tDelta[a];
+		cell[a] += step[a];
+	}
+}
+}
+#endif
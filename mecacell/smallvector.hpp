@@ -0,0 +1,92 @@
+#ifndef SMALLVECTOR_HPP
+#define SMALLVECTOR_HPP
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                        SMALL VECTOR
+////////////////////////////////////////////////////////////////////
+// Vector of trivially copyable elements whose first N elements are stored inline:
+// lists that usually stay short (a cell's connections) live in their owner's memory,
+// without any heap allocation nor its bookkeeping. Beyond N, the elements move to the
+// heap and capacity doubles, as with std::vector.
+template <typename T, size_t N> class SmallVector {
+	static_assert(std::is_trivially_copyable<T>::value,
+	              "SmallVector elements are moved with memcpy");
+
+private:
+	T *first;          // local or a heap block
+	uint32_t n = 0;
+	uint32_t cap = N;
+	T local[N];
+
+	bool onHeap() const { return first != local; }
+
+	void reserveMore() {
+		uint32_t c = cap * 2;
+		T *p = static_cast<T *>(malloc(c * sizeof(T)));
+		if (!p) throw std::bad_alloc();
+		memcpy(p, first, n * sizeof(T));
+		if (onHeap()) free(first);
+		first = p;
+		cap = c;
+	}
+
+	void copyFrom(const SmallVector &v) {
+		while (cap < v.n) reserveMore();
+		memcpy(first, v.first, v.n * sizeof(T));
+		n = v.n;
+	}
+
+public:
+	SmallVector() : first(local) {}
+	SmallVector(const SmallVector &v) : first(local) { copyFrom(v); }
+	SmallVector &operator=(const SmallVector &v) {
+		if (this != &v) copyFrom(v);
+		return *this;
+	}
+	~SmallVector() {
+		if (onHeap()) free(first);
+	}
+
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	size_t capacity() const { return cap; }
+	// memory used outside of the vector itself
+	size_t heapBytes() const { return onHeap() ? cap * sizeof(T) : 0; }
+
+	T *data() { return first; }
+	const T *data() const { return first; }
+	T *begin() { return first; }
+	T *end() { return first + n; }
+	const T *begin() const { return first; }
+	const T *end() const { return first + n; }
+	T &operator[](size_t i) { return first[i]; }
+	const T &operator[](size_t i) const { return first[i]; }
+	T &back() { return first[n - 1]; }
+	const T &back() const { return first[n - 1]; }
+
+	void push_back(const T &e) {
+		if (n == cap) {
+			T copy = e; // e may be one of our elements
+			reserveMore();
+			first[n++] = copy;
+		} else {
+			first[n++] = e;
+		}
+	}
+	void pop_back() { --n; }
+	void clear() { n = 0; }
+	void assign(size_t s, const T &e) {
+		while (cap < s) reserveMore();
+		for (size_t i = 0; i < s; ++i) first[i] = e;
+		n = static_cast<uint32_t>(s);
+	}
+};
+}
+#endif
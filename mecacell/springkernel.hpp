@@ -0,0 +1,78 @@
+#ifndef SPRINGKERNEL_HPP
+#define SPRINGKERNEL_HPP
+#include <cmath>
+#include <cstddef>
+#include "tools.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                      SPRING KERNEL
+////////////////////////////////////////////////////////////////////
+// Computes the forces of n connections (Connection<N*> pointers) by packs of W.
+// Endpoint positions and spring parameters of a pack are gathered in lane arrays and
+// the spring is evaluated with fixed size loops, which the compiler turns into SIMD
+// code (W = 4 fits an AVX register of doubles, use W = 8 for AVX-512).
+// The resulting forces are then scattered to the nodes, and the joints are computed
+// per connection. A pack is processed as n separate computeForces calls would be:
+// results are identical as long as no two connections of the range share a node
+// (which is what BasicWorld's force batches guarantee).
+// Connections reaching their max compression have their nodes moved and their
+// velocities exchanged: they go through the scalar Connection::computeSpringForce.
+template <size_t W = 4, typename C>
+void computeSpringForces(C *const *conns, size_t n, const double dt) {
+	size_t p = 0;
+	for (; p + W <= n; p += W) {
+		double dx[W], dy[W], dz[W], len[W], x[W], f[W];
+		double l[W], k[W], c[W], prevLength[W], minLengthRatio[W];
+		bool clamped[W];
+
+		// gather
+		for (size_t i = 0; i < W; ++i) {
+			C *con = conns[p + i];
+			const auto &sc = con->getSc();
+			const Vec p0 = ptr(con->getNode0())->getPosition();
+			const Vec p1 = ptr(con->getNode1())->getPosition();
+			dx[i] = p1.x - p0.x;
+			dy[i] = p1.y - p0.y;
+			dz[i] = p1.z - p0.z;
+			l[i] = sc.l;
+			k[i] = sc.k;
+			c[i] = sc.c;
+			prevLength[i] = sc.prevLength;
+			minLengthRatio[i] = sc.minLengthRatio;
+		}
+
+		// same operations as Spring::updateLengthDirection & Connection::computeSpringForce
+		for (size_t i = 0; i < W; ++i) {
+			len[i] = sqrt(dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]);
+			double d = len[i] > 0 ? len[i] : 1.0;
+			dx[i] = len[i] > 0 ? dx[i] / d : dx[i];
+			dy[i] = len[i] > 0 ? dy[i] / d : dy[i];
+			dz[i] = len[i] > 0 ? dz[i] / d : dz[i];
+			x[i] = len[i] - l[i];
+			clamped[i] = len[i] < minLengthRatio[i] * l[i];
+			f[i] = (-k[i] * x[i] - c[i] * (len[i] - prevLength[i]) / dt) / 2.0;
+		}
+
+		// scatter
+		for (size_t i = 0; i < W; ++i) {
+			C *con = conns[p + i];
+			auto &sc = con->getSc();
+			sc.direction = Vec(dx[i], dy[i], dz[i]);
+			sc.length = len[i];
+			if (con->scEnabled) {
+				if (clamped[i]) {
+					con->computeSpringForce(dt);
+				} else {
+					ptr(con->getNode0())->receiveForce(f[i], -sc.direction, x[i] < 0);
+					ptr(con->getNode1())->receiveForce(f[i], sc.direction, x[i] < 0);
+					sc.prevLength = len[i];
+				}
+			}
+			con->computeJointForces();
+		}
+	}
+	for (; p < n; ++p) conns[p]->computeForces(dt);
+}
+}
+#endif
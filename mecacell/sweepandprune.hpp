@@ -0,0 +1,131 @@
+#ifndef MECACELL_SWEEPANDPRUNE_HPP
+#define MECACELL_SWEEPANDPRUNE_HPP
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "tools.h"
+
+namespace MecaCell {
+// broad phase of the cell - cell collisions (see BasicWorld::setBroadPhase)
+enum class BroadPhase { grid, sweepAndPrune };
+
+////////////////////////////////////////////////////////////////////
+//                     SWEEP AND PRUNE
+////////////////////////////////////////////////////////////////////
+// Persistent sort and sweep broad phase: the objects' bounding boxes are kept sorted by
+// their lower bound along one axis, and a sweep along that list finds every pair of
+// overlapping boxes once. There is no cell size to tune, so it copes with any mix of
+// radii. From one update to the next the objects barely move: the list is nearly sorted
+// and an insertion sort restores it in about linear time.
+// The sweep axis is the one along which the boxes' centers are the most spread out. It
+// is chosen again at each rebuild, and during updates when another axis becomes twice
+// as spread out (the list is then fully sorted again).
+// O is a pointer like type (see ptr in tools.h) to an object with getPosition and
+// getRadius.
+template <typename O> class SweepAndPrune {
+private:
+	struct Entry {
+		double mn[3], mx[3];
+		O obj;
+	};
+	std::vector<Entry> entries;
+	int axis = 0;
+
+	static void setBox(Entry &e) {
+		const Vec &p = ptr(e.obj)->getPosition();
+		const double r = ptr(e.obj)->getRadius();
+		e.mn[0] = p.x - r;
+		e.mn[1] = p.y - r;
+		e.mn[2] = p.z - r;
+		e.mx[0] = p.x + r;
+		e.mx[1] = p.y + r;
+		e.mx[2] = p.z + r;
+	}
+
+	// variance of the boxes' centers along each axis
+	void spread(double var[3]) const {
+		double sum[3] = {0, 0, 0}, sqSum[3] = {0, 0, 0};
+		for (const auto &e : entries)
+			for (int a = 0; a < 3; ++a) {
+				const double c = 0.5 * (e.mn[a] + e.mx[a]);
+				sum[a] += c;
+				sqSum[a] += c * c;
+			}
+		const double n = entries.empty() ? 1.0 : static_cast<double>(entries.size());
+		for (int a = 0; a < 3; ++a) var[a] = sqSum[a] / n - (sum[a] / n) * (sum[a] / n);
+	}
+
+	void fullSort() {
+		const int ax = axis;
+		std::stable_sort(entries.begin(), entries.end(),
+		                 [ax](const Entry &a, const Entry &b) { return a.mn[ax] < b.mn[ax]; });
+	}
+
+	void insertionSort() {
+		for (size_t i = 1; i < entries.size(); ++i) {
+			if (!(entries[i].mn[axis] < entries[i - 1].mn[axis])) continue;
+			Entry e = entries[i];
+			size_t j = i;
+			for (; j > 0 && e.mn[axis] < entries[j - 1].mn[axis]; --j)
+				entries[j] = entries[j - 1];
+			entries[j] = e;
+		}
+	}
+
+public:
+	size_t size() const { return entries.size(); }
+	int getAxis() const { return axis; }
+	const O &operator[](size_t i) const { return entries[i].obj; }
+
+	void clear() { entries.clear(); }
+
+	// replaces the content by objs, fully sorted along the most spread out axis
+	template <typename C> void rebuild(const C &objs) {
+		entries.resize(objs.size());
+		size_t i = 0;
+		for (const auto &o : objs) {
+			entries[i].obj = o;
+			setBox(entries[i++]);
+		}
+		double var[3];
+		spread(var);
+		axis = 0;
+		for (int a = 1; a < 3; ++a) axis = var[a] > var[axis] ? a : axis;
+		fullSort();
+	}
+
+	// the objects moved (or grew): boxes are refreshed and the list sorted again
+	void update() {
+		for (auto &e : entries) setBox(e);
+		double var[3];
+		spread(var);
+		int best = axis;
+		for (int a = 0; a < 3; ++a) best = var[a] > var[best] ? a : best;
+		if (var[best] > 2.0 * var[axis]) {
+			axis = best;
+			fullSort();
+		} else {
+			insertionSort();
+		}
+	}
+
+	// calls f(a, b) for the objects after the i-th one (b) whose box overlaps the i-th
+	// object's box (a). Only reads the list: different i can be swept concurrently
+	template <typename F> void forEachPairFrom(size_t i, F &&f) const {
+		const Entry &a = entries[i];
+		const int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+		for (size_t j = i + 1; j < entries.size() && entries[j].mn[axis] <= a.mx[axis]; ++j) {
+			const Entry &b = entries[j];
+			if (b.mn[a1] <= a.mx[a1] && a.mn[a1] <= b.mx[a1] && b.mn[a2] <= a.mx[a2] &&
+			    a.mn[a2] <= b.mx[a2])
+				f(a.obj, b.obj);
+		}
+	}
+
+	// calls f(a, b) once for every pair of overlapping boxes, a before b in the list
+	template <typename F> void forEachPair(F &&f) const {
+		for (size_t i = 0; i < entries.size(); ++i) forEachPairFrom(i, f);
+	}
+};
+}
+#endif
@@ -0,0 +1,124 @@
+#ifndef MECACELL_THREADPOOL_HPP
+#define MECACELL_THREADPOOL_HPP
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                       THREAD POOL
+////////////////////////////////////////////////////////////////////
+// Minimal fork/join pool used by the parallel update mode of the world.
+// The calling thread takes part in the work as thread 0.
+// A range is always split in the same contiguous chunks for a given number of threads,
+// so what each thread computes does not depend on scheduling.
+class ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable startCV, doneCV;
+	std::function<void(size_t)> job;
+	size_t generation = 0; // incremented each time a new job is submitted
+	size_t pending = 0;    // nb of workers still running the current job
+	bool stopping = false;
+
+	// seenGeneration: the generation when the worker was created, whose job (if any) is
+	// already done and must not be run again
+	void workerLoop(size_t id, size_t seenGeneration) {
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				startCV.wait(lock, [&] { return stopping || generation != seenGeneration; });
+				if (stopping) return;
+				seenGeneration = generation;
+			}
+			job(id);
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if (--pending == 0) doneCV.notify_one();
+			}
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		startCV.notify_all();
+		for (auto &w : workers) w.join();
+		workers.clear();
+		stopping = false;
+	}
+
+public:
+	explicit ThreadPool(size_t n = 1) { resize(n); }
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	~ThreadPool() { stop(); }
+
+	// total number of threads, including the calling one
+	size_t size() const { return workers.size() + 1; }
+
+	void resize(size_t n) {
+		stop();
+		size_t g;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			g = generation;
+		}
+		for (size_t i = 1; i < n; ++i) workers.emplace_back(&ThreadPool::workerLoop, this, i, g);
+	}
+
+	// runs f(threadId) once on every thread and waits for all of them to finish
+	void run(const std::function<void(size_t)> &f) {
+		if (workers.empty()) {
+			f(0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			job = f;
+			pending = workers.size();
+			++generation;
+		}
+		startCV.notify_all();
+		f(0);
+		std::unique_lock<std::mutex> lock(mtx);
+		doneCV.wait(lock, [&] { return pending == 0; });
+	}
+
+	// [begin, end) bounds of the chunk of a range of size n handled by thread t
+	static std::pair<size_t, size_t> chunk(size_t n, size_t t, size_t nbThreads) {
+		size_t q = n / nbThreads, r = n % nbThreads;
+		size_t b = t * q + (t < r ? t : r);
+		return {b, b + q + (t < r ? 1 : 0)};
+	}
+
+	// calls f(begin, end, threadId) on contiguous chunks covering [0, n)
+	template <typename F> void parallelForChunks(size_t n, F &&f) {
+		if (n == 0) return;
+		size_t nt = size() < n ? size() : n;
+		if (nt == 1) {
+			f(0, n, 0);
+			return;
+		}
+		run([&](size_t t) {
+			if (t < nt) {
+				auto c = chunk(n, t, nt);
+				f(c.first, c.second, t);
+			}
+		});
+	}
+
+	// calls f(i) for every i in [0, n)
+	template <typename F> void parallelFor(size_t n, F &&f) {
+		parallelForChunks(n, [&](size_t b, size_t e, size_t) {
+			for (size_t i = b; i < e; ++i) f(i);
+		});
+	}
+};
+}
+#endif
@@ -0,0 +1,78 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include <iostream>
+#include <vector>
+#include "tools.h"
+
+// Diagnostics of the world's inner loops (cell - model collisions, ...)
+// MECACELL_TRACE = 0 (default): compiled out, the events' arguments aren't even evaluated
+// MECACELL_TRACE = 1: events are recorded by the world's TraceSink
+#ifndef MECACELL_TRACE
+#define MECACELL_TRACE 0
+#endif
+
+#if MECACELL_TRACE
+#define MECACELL_TRACE_EVENT(sink, ...) (sink).record(MecaCell::TraceRecord(__VA_ARGS__))
+#else
+#define MECACELL_TRACE_EVENT(sink, ...) ((void)0)
+#endif
+
+namespace MecaCell {
+struct Model;
+
+enum class TraceEvent {
+	potentialCollision,   // a face is close to a cell. value = projection in the face
+	collision,            // the cell touches the face
+	connectionSimilarity, // value = dot product with an existing connection's direction
+	connectionUpdated,    // an existing cell - model connection is kept and updated
+	anchorProjected,      // position = projection axis of the anchor
+	newConnection,        // a new cell - model connection is created
+	connectionDeleted,    // a cell - model connection isn't in contact anymore
+	modelRemoved
+};
+
+inline const char *traceEventName(TraceEvent e) {
+	static const char *names[] = {"potential collision", "collision",
+	                              "connection similarity", "connection updated",
+	                              "anchor projected", "new connection",
+	                              "connection deleted", "model removed"};
+	return names[static_cast<int>(e)];
+}
+
+struct TraceRecord {
+	TraceEvent event;
+	const void *cell = nullptr;
+	const Model *model = nullptr;
+	size_t face = 0;
+	Vec position = Vec::zero();
+	double value = 0;
+	TraceRecord(TraceEvent e, const void *c = nullptr, const Model *m = nullptr,
+	            size_t f = 0, const Vec &p = Vec::zero(), double v = 0)
+	    : event(e), cell(c), model(m), face(f), position(p), value(v) {}
+};
+
+// collects the trace records in memory. With echo enabled, they are also printed to cerr
+class TraceSink {
+private:
+	std::vector<TraceRecord> records;
+	bool echo = false;
+
+public:
+	void record(const TraceRecord &r) {
+		records.push_back(r);
+		if (echo)
+			std::cerr << traceEventName(r.event) << ": cell " << r.cell << ", model "
+			          << r.model << ", face " << r.face << ", position " << r.position
+			          << ", value " << r.value << std::endl;
+	}
+	void setEcho(bool e) { echo = e; }
+	const std::vector<TraceRecord> &getRecords() const { return records; }
+	size_t count(TraceEvent e) const {
+		size_t n = 0;
+		for (const auto &r : records) n += r.event == e;
+		return n;
+	}
+	void clear() { records.clear(); }
+};
+}
+#endif
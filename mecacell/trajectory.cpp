@@ -0,0 +1,131 @@
+#include "trajectory.h"
+
+namespace MecaCell {
+namespace {
+template <typename T> void writeRaw(std::ofstream &f, const T &v) {
+	f.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+template <typename T> bool readRaw(std::ifstream &f, T &v) {
+	return static_cast<bool>(f.read(reinterpret_cast<char *>(&v), sizeof(T)));
+}
+template <typename T> void column(std::vector<T> &c, const char *&p, size_t n) {
+	c.resize(n);
+	if (n) memcpy(c.data(), p, n * sizeof(T));
+	p += n * sizeof(T);
+}
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string &path, size_t s, bool compress,
+                                   size_t maxQueued)
+    : file(path, std::ios::binary | std::ios::trunc),
+      stride(s ? s : 1),
+      compressed(compress && compressionAvailable()),
+      maxQueuedFrames(maxQueued ? maxQueued : 1) {
+	if (!file) return;
+	file.write(TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	writeRaw(file, TRAJECTORY_VERSION);
+	writeRaw(file, static_cast<uint64_t>(compressed ? 1 : 0));
+	worker = std::thread([this]() { workerLoop(); });
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	notEmpty.notify_all();
+	if (worker.joinable()) worker.join();
+}
+
+void TrajectoryWriter::push(Chunk &&c) {
+	if (!isOpen()) return;
+	std::unique_lock<std::mutex> lock(mtx);
+	notFull.wait(lock, [&] { return queue.size() < maxQueuedFrames; });
+	queue.push_back(std::move(c));
+	notEmpty.notify_one();
+}
+
+void TrajectoryWriter::workerLoop() {
+	std::vector<char> packed;
+	while (true) {
+		Chunk c;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			notEmpty.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (queue.empty()) return; // stopping, everything was written
+			c = std::move(queue.front());
+			queue.pop_front();
+			writing = true;
+		}
+		notFull.notify_all();
+		// a payload that doesn't shrink is stored as is (stored size == raw size)
+		const std::vector<char> *out = &c.payload;
+		if (compressed && compressBytes(c.payload.data(), c.payload.size(), packed) &&
+		    packed.size() < c.payload.size())
+			out = &packed;
+		writeRaw(file, c.frame);
+		writeRaw(file, c.nbCells);
+		writeRaw(file, c.nbConnections);
+		writeRaw(file, static_cast<uint64_t>(c.payload.size()));
+		writeRaw(file, static_cast<uint64_t>(out->size()));
+		file.write(out->data(), out->size());
+		bool ok = file.good();
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			writing = false;
+			failed = failed || !ok;
+			++nbWritten;
+		}
+		notFull.notify_all();
+	}
+}
+
+bool TrajectoryWriter::flush() {
+	if (!isOpen()) return false;
+	std::unique_lock<std::mutex> lock(mtx);
+	notFull.wait(lock, [&] { return queue.empty() && !writing; });
+	file.flush();
+	return !failed && file.good();
+}
+
+size_t TrajectoryWriter::getNbFramesWritten() {
+	std::lock_guard<std::mutex> lock(mtx);
+	return nbWritten;
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &path)
+    : file(path, std::ios::binary) {
+	char magic[sizeof(TRAJECTORY_MAGIC)];
+	uint64_t version, codec;
+	valid = file.read(magic, sizeof(magic)) &&
+	        memcmp(magic, TRAJECTORY_MAGIC, sizeof(magic)) == 0 && readRaw(file, version) &&
+	        version == TRAJECTORY_VERSION && readRaw(file, codec) && codec <= 1;
+	compressed = valid && codec == 1;
+}
+
+bool TrajectoryReader::next(TrajectoryFrame &f) {
+	uint64_t n, m, rawSize, storedSize;
+	if (!valid || !readRaw(file, f.frame) || !readRaw(file, n) || !readRaw(file, m) ||
+	    !readRaw(file, rawSize) || !readRaw(file, storedSize))
+		return false;
+	if (rawSize != 5 * n * sizeof(double) + 2 * m * sizeof(uint32_t) ||
+	    storedSize > rawSize || (storedSize < rawSize && !compressed))
+		return valid = false;
+	stored.resize(storedSize);
+	if (!file.read(stored.data(), storedSize)) return valid = false;
+	const char *p = stored.data();
+	if (storedSize < rawSize) {
+		raw.resize(rawSize);
+		if (!uncompressBytes(stored.data(), storedSize, raw)) return valid = false;
+		p = raw.data();
+	}
+	column(f.x, p, n);
+	column(f.y, p, n);
+	column(f.z, p, n);
+	column(f.radius, p, n);
+	column(f.pressure, p, n);
+	column(f.node0, p, m);
+	column(f.node1, p, m);
+	return true;
+}
+}
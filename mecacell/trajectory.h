@@ -0,0 +1,138 @@
+#ifndef MECACELL_TRAJECTORY_H
+#define MECACELL_TRAJECTORY_H
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "compression.h"
+
+namespace MecaCell {
+////////////////////////////////////////////////////////////////////
+//                        TRAJECTORIES
+////////////////////////////////////////////////////////////////////
+// Per frame output of headless runs. The file is a header (magic, version, codec)
+// followed by one chunk per recorded frame:
+//   frame (int64), nb cells n (uint64), nb connections m (uint64),
+//   raw payload size (uint64), stored payload size (uint64), stored payload
+// The payload is columnar: x[n], y[n], z[n], radius[n], pressure[n] (doubles), then
+// node0[m], node1[m] (uint32 indices in this frame's cells, which are in the world's
+// order). With compression (and zlib available, see compression.h), each payload is
+// compressed on its own.
+const char TRAJECTORY_MAGIC[8] = {'M', 'C', 'T', 'R', 'A', 'J', 0, 0};
+const uint64_t TRAJECTORY_VERSION = 1;
+
+struct TrajectoryFrame {
+	int64_t frame = 0;
+	std::vector<double> x, y, z, radius, pressure;
+	std::vector<uint32_t> node0, node1;
+	size_t nbCells() const { return x.size(); }
+	size_t nbConnections() const { return node0.size(); }
+};
+
+// Frames are copied in columns by the simulation thread, then compressed and written
+// by a background thread. At most maxQueuedFrames frames wait for it: beyond that, the
+// simulation waits, which bounds the memory used when the disk is too slow.
+class TrajectoryWriter {
+private:
+	struct Chunk {
+		int64_t frame;
+		uint64_t nbCells, nbConnections;
+		std::vector<char> payload;
+	};
+	std::ofstream file;
+	size_t stride;
+	bool compressed;
+	size_t maxQueuedFrames;
+	std::deque<Chunk> queue;
+	std::mutex mtx;
+	std::condition_variable notEmpty, notFull;
+	bool stopping = false;
+	bool writing = false; // the worker is writing a chunk popped from the queue
+	bool failed = false;
+	size_t nbWritten = 0;
+	std::thread worker;
+	std::unordered_map<const void *, uint32_t> cellIndex; // reused from frame to frame
+
+	void workerLoop();
+	void push(Chunk &&c);
+
+public:
+	// stride: one frame out of stride is recorded by record()
+	TrajectoryWriter(const std::string &path, size_t stride = 1, bool compress = false,
+	                 size_t maxQueuedFrames = 8);
+	TrajectoryWriter(const TrajectoryWriter &) = delete;
+	TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+	// writes the remaining frames
+	~TrajectoryWriter();
+
+	bool isOpen() const { return file.is_open(); }
+	bool isCompressed() const { return compressed; }
+	size_t getStride() const { return stride; }
+	// waits until all the recorded frames are written. Returns false after a write error
+	bool flush();
+	size_t getNbFramesWritten();
+
+	// records the world's current frame if it is a multiple of the stride
+	template <typename World> void record(World &w) {
+		if (w.getNbUpdates() % stride == 0) write(w);
+	}
+
+	// records the world's current frame
+	template <typename World> void write(World &w) {
+		Chunk c;
+		c.frame = w.getNbUpdates();
+		c.nbCells = w.cells.size();
+		c.nbConnections = w.connections.size();
+		const size_t n = c.nbCells, m = c.nbConnections;
+		c.payload.resize(5 * n * sizeof(double) + 2 * m * sizeof(uint32_t));
+		double *d = reinterpret_cast<double *>(c.payload.data());
+		cellIndex.clear();
+		cellIndex.reserve(n);
+		for (size_t i = 0; i < n; ++i) {
+			const auto &cell = w.cells[i];
+			auto p = cell->getPosition();
+			d[i] = p.x;
+			d[n + i] = p.y;
+			d[2 * n + i] = p.z;
+			d[3 * n + i] = cell->getRadius();
+			d[4 * n + i] = cell->getPressure();
+			cellIndex[cell] = static_cast<uint32_t>(i);
+		}
+		uint32_t *nodes = reinterpret_cast<uint32_t *>(d + 5 * n);
+		for (size_t i = 0; i < m; ++i) {
+			nodes[i] = cellIndex.at(w.connections[i]->getNode0());
+			nodes[m + i] = cellIndex.at(w.connections[i]->getNode1());
+		}
+		push(std::move(c));
+	}
+
+	// records the frames of w according to the stride. The writer must outlive w's
+	// updates
+	template <typename World> void attach(World &w) {
+		w.addUpdateHook([this](World &world) { record(world); });
+	}
+};
+
+// reads back the frames of a trajectory file
+class TrajectoryReader {
+private:
+	std::ifstream file;
+	bool compressed = false;
+	bool valid = false;
+	std::vector<char> stored, raw;
+
+public:
+	TrajectoryReader(const std::string &path);
+	bool isValid() const { return valid; }
+	bool isCompressed() const { return compressed; }
+	// false at the end of the file or on a truncated / invalid chunk
+	bool next(TrajectoryFrame &f);
+};
+}
+#endif
@@ -9,16 +9,13 @@
 #include "rotation.h"
 #include "quaternion.h"
 #include "tools.h"
+#if !MECACELL_INLINE_VEC
+#include "vector3Dops.hpp"
+#endif
 
 using namespace std;
 namespace MecaCell {
 
-double Vector3D::dot(const Vector3D &v) const { return x * v.x + y * v.y + z * v.z; }
-
-Vector3D Vector3D::cross(const Vector3D &v) const {
-	return Vector3D((y * v.z - z * v.y), (z * v.x - x * v.z), (x * v.y - y * v.x));
-}
-
 void Vector3D::random() {
 	std::normal_distribution<double> nDist(0.0, 1.0);
 	x = nDist(globalRand);
@@ -38,55 +35,6 @@ Vector3D Vector3D::deltaDirection(double amount) {
 	return Vector3D(x + nDist(globalRand), y + nDist(globalRand), z + nDist(globalRand)).normalized();
 }
 
-Vector3D Vector3D::zero() { return Vector3D(0, 0, 0); }
-
-bool Vector3D::isZero() const { return (x == 0 && y == 0 && z == 0); }
-
-void Vector3D::operator/=(const double &d) {
-	x /= d;
-	y /= d;
-	z /= d;
-}
-
-void Vector3D::operator*=(const double &d) {
-	x *= d;
-	y *= d;
-	z *= d;
-}
-
-void Vector3D::operator+=(const Vector3D &v) {
-	x += v.x;
-	y += v.y;
-	z += v.z;
-}
-
-Vector3D Vector3D::operator+(const Vector3D &v) const { return Vector3D(x + v.x, y + v.y, z + v.z); }
-Vector3D Vector3D::operator-(const Vector3D &v) const { return Vector3D(x - v.x, y - v.y, z - v.z); }
-Vector3D Vector3D::operator-(const double &v) const { return Vector3D(x - v, y - v, z - v); }
-Vector3D Vector3D::operator+(const double &v) const { return Vector3D(x + v, y + v, z + v); }
-Vector3D Vector3D::operator/(const double &s) const { return Vector3D(x / s, y / s, z / s); }
-Vector3D Vector3D::operator/(const Vector3D &v) const { return Vector3D(x / v.x, y / v.y, z / v.z); }
-Vector3D Vector3D::operator-() const { return Vector3D(-x, -y, -z); }
-
-bool Vector3D::operator>=(const double &v) const { return (x >= v && y >= v && z >= v); }
-bool Vector3D::operator<=(const double &v) const { return (x <= v && y <= v && z <= v); }
-bool Vector3D::operator>(const double &v) const { return (x > v && y > v && z > v); }
-bool Vector3D::operator<(const double &v) const { return (x < v && y < v && z < v); }
-
-double Vector3D::length() const { return sqrt(x * x + y * y + z * z); }
-double Vector3D::sqlength() const { return (x * x + y * y + z * z); }
-
-double Vector3D::getX() const { return x; }
-double Vector3D::getY() const { return y; }
-double Vector3D::getZ() const { return z; }
-
-void Vector3D::normalize() { *this = *this / length(); }
-
-Vector3D Vector3D::normalized() const {
-	double l = length();
-	return Vector3D(x / l, y / l, z / l);
-}
-
 std::string Vector3D::toString() {
 	std::stringstream s;
 	s.precision(500);
@@ -221,20 +169,9 @@ Rotation<Vector3D> Vector3D::getRotation(const Basis<Vector3D> &b0, const Basis<
 
 Rotation<Vector3D> Vector3D::getRotation(const Vector3D &X0, const Vector3D &Y0, const Vector3D &X1,
                                          const Vector3D &Y1) {
-	Quaternion q0(X0.normalized(), X1.normalized());
-	Vector3D Ytmp = q0 * Y0;
-	Ytmp.normalize();
-	Quaternion qres = Quaternion(Ytmp, Y1.normalized()) * q0;
-	qres.normalize();
-	return qres.toAxisAngle();
+	return Quaternion::betweenBases(X0, Y0, X1, Y1).toAxisAngle();
 }
 
-Vector3D operator*(const Vector3D &v, const double &s) { return Vector3D(v.x * s, v.y * s, v.z * s); }
-Vector3D operator*(const double &s, const Vector3D &v) { return Vector3D(v.x * s, v.y * s, v.z * s); }
-
-bool operator==(const Vector3D &a, const Vector3D &b) { return (a.x == b.x && a.y == b.y && a.z == b.z); }
-bool operator!=(const Vector3D &a, const Vector3D &b) { return !operator==(a, b); }
-
 ostream &operator<<(ostream &out, const Vector3D &v) {
 	out << "(" << v.x << ", " << v.y << ", " << v.z << ")";
 	return out;
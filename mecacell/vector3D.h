@@ -6,43 +6,60 @@
 #include "rotation.h"
 #include "basis.h"
 
+// MECACELL_INLINE_VEC = 1 (default): Vector3D's arithmetic is defined in vector3Dops.hpp,
+// included below, so that it is inlined in the templated loops of the worlds and usable in
+// constant expressions.
+// MECACELL_INLINE_VEC = 0: it is compiled once in vector3D.cpp instead (each operation is
+// then a call, see benchmarks/vecbench.cpp)
+#ifndef MECACELL_INLINE_VEC
+#define MECACELL_INLINE_VEC 1
+#endif
+#if MECACELL_INLINE_VEC
+#define MECACELL_VEC_CONSTEXPR constexpr
+#define MECACELL_VEC_INLINE inline
+#else
+#define MECACELL_VEC_CONSTEXPR
+#define MECACELL_VEC_INLINE
+#endif
+
 namespace MecaCell {
 class Vector3D {
 public:
 	double x, y, z;
 	static const int dimension = 3;
-	Vector3D(double a, double b, double c) : x(a), y(b), z(c) {}
-	Vector3D() : x(0), y(0), z(0) {}
-	explicit Vector3D(double a) : x(a), y(a), z(a) {}
-	Vector3D(const Vector3D &v) : x(v.x), y(v.y), z(v.z) {}
+	constexpr Vector3D(double a, double b, double c) : x(a), y(b), z(c) {}
+	constexpr Vector3D() : x(0), y(0), z(0) {}
+	constexpr explicit Vector3D(double a) : x(a), y(a), z(a) {}
+	Vector3D(const Vector3D &v) = default;
+	Vector3D &operator=(const Vector3D &v) = default;
 
-	double dot(const Vector3D &v) const;
-	Vector3D cross(const Vector3D &v) const;
+	MECACELL_VEC_CONSTEXPR double dot(const Vector3D &v) const;
+	MECACELL_VEC_CONSTEXPR Vector3D cross(const Vector3D &v) const;
 
 	void random();
 	Vector3D deltaDirection(double amount);
 	static Vector3D randomUnit();
-	static Vector3D zero();
-	bool isZero() const;
+	static MECACELL_VEC_CONSTEXPR Vector3D zero();
+	MECACELL_VEC_CONSTEXPR bool isZero() const;
 
-	void operator*=(const double &d);
-	void operator/=(const double &d);
-	void operator+=(const Vector3D &v);
-	Vector3D operator+(const Vector3D &v) const;
-	Vector3D operator-(const Vector3D &v) const;
-	Vector3D operator-(const double &v) const;
-	Vector3D operator+(const double &v) const;
-	Vector3D operator/(const double &s) const;
-	Vector3D operator/(const Vector3D &v) const;
-	Vector3D operator-() const;
+	MECACELL_VEC_INLINE void operator*=(const double &d);
+	MECACELL_VEC_INLINE void operator/=(const double &d);
+	MECACELL_VEC_INLINE void operator+=(const Vector3D &v);
+	MECACELL_VEC_CONSTEXPR Vector3D operator+(const Vector3D &v) const;
+	MECACELL_VEC_CONSTEXPR Vector3D operator-(const Vector3D &v) const;
+	MECACELL_VEC_CONSTEXPR Vector3D operator-(const double &v) const;
+	MECACELL_VEC_CONSTEXPR Vector3D operator+(const double &v) const;
+	MECACELL_VEC_CONSTEXPR Vector3D operator/(const double &s) const;
+	MECACELL_VEC_CONSTEXPR Vector3D operator/(const Vector3D &v) const;
+	MECACELL_VEC_CONSTEXPR Vector3D operator-() const;
 
-	bool operator>=(const double &v) const;
-	bool operator<=(const double &v) const;
-	bool operator>(const double &v) const;
-	bool operator<(const double &v) const;
+	MECACELL_VEC_CONSTEXPR bool operator>=(const double &v) const;
+	MECACELL_VEC_CONSTEXPR bool operator<=(const double &v) const;
+	MECACELL_VEC_CONSTEXPR bool operator>(const double &v) const;
+	MECACELL_VEC_CONSTEXPR bool operator<(const double &v) const;
 
-	double length() const;
-	double sqlength() const;
+	MECACELL_VEC_INLINE double length() const;
+	MECACELL_VEC_CONSTEXPR double sqlength() const;
 
 	Vector3D rotated(const double &, const Vector3D &) const;
 	Vector3D rotated(const Rotation<Vector3D> &) const;
@@ -57,28 +74,33 @@ public:
 	static Vector3D getProjectionOnPlane(const Vector3D &o, const Vector3D &n, const Vector3D &p);
 	static double rayCast(const Vector3D &o, const Vector3D &n, const Vector3D &p, const Vector3D &r);
 
-	double getX() const;
-	double getY() const;
-	double getZ() const;
+	MECACELL_VEC_CONSTEXPR double getX() const;
+	MECACELL_VEC_CONSTEXPR double getY() const;
+	MECACELL_VEC_CONSTEXPR double getZ() const;
 
-	void normalize();
-	Vector3D normalized() const;
+	MECACELL_VEC_INLINE void normalize();
+	MECACELL_VEC_INLINE Vector3D normalized() const;
 
 	std::string toString();
 	static int getHash(int a, int b);
 	std::size_t getHash() const;
 
+	// calls fun on the integer coordinates of the box [this, v]. The grids use the templated
+	// GridSpan(min, max).forEach(f(i, j, k)) instead, which inlines f
 	void iterateTo(Vector3D const &v, const std::function<void(const Vector3D &)> &fun, int inc = 1);
 
 	Vector3D ortho() const;
 	Vector3D ortho(Vector3D v) const;
 	friend ostream &operator<<(ostream &out, const Vector3D &v);
 };
-Vector3D operator*(const Vector3D &v, const double &s);
-Vector3D operator*(const double &s, const Vector3D &v);
-bool operator==(const Vector3D &a, const Vector3D &b);
-bool operator!=(const Vector3D &a, const Vector3D &b);
+MECACELL_VEC_CONSTEXPR Vector3D operator*(const Vector3D &v, const double &s);
+MECACELL_VEC_CONSTEXPR Vector3D operator*(const double &s, const Vector3D &v);
+MECACELL_VEC_CONSTEXPR bool operator==(const Vector3D &a, const Vector3D &b);
+MECACELL_VEC_CONSTEXPR bool operator!=(const Vector3D &a, const Vector3D &b);
 }
+#if MECACELL_INLINE_VEC
+#include "vector3Dops.hpp"
+#endif
 namespace std {
 template <> struct hash<MecaCell::Vector3D> {
 	std::size_t operator()(const MecaCell::Vector3D &v) const { return v.getHash(); }
@@ -0,0 +1,100 @@
+#ifndef VECTOR3DOPS_HPP
+#define VECTOR3DOPS_HPP
+#include <cmath>
+#include "vector3D.h"
+
+// Vector3D's arithmetic. Included at the end of vector3D.h (inline & constexpr), or by
+// vector3D.cpp only when MECACELL_INLINE_VEC = 0 (see vector3D.h)
+namespace MecaCell {
+MECACELL_VEC_CONSTEXPR double Vector3D::dot(const Vector3D &v) const {
+	return x * v.x + y * v.y + z * v.z;
+}
+
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::cross(const Vector3D &v) const {
+	return Vector3D((y * v.z - z * v.y), (z * v.x - x * v.z), (x * v.y - y * v.x));
+}
+
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::zero() { return Vector3D(0, 0, 0); }
+
+MECACELL_VEC_CONSTEXPR bool Vector3D::isZero() const { return (x == 0 && y == 0 && z == 0); }
+
+MECACELL_VEC_INLINE void Vector3D::operator/=(const double &d) {
+	x /= d;
+	y /= d;
+	z /= d;
+}
+
+MECACELL_VEC_INLINE void Vector3D::operator*=(const double &d) {
+	x *= d;
+	y *= d;
+	z *= d;
+}
+
+MECACELL_VEC_INLINE void Vector3D::operator+=(const Vector3D &v) {
+	x += v.x;
+	y += v.y;
+	z += v.z;
+}
+
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator+(const Vector3D &v) const {
+	return Vector3D(x + v.x, y + v.y, z + v.z);
+}
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator-(const Vector3D &v) const {
+	return Vector3D(x - v.x, y - v.y, z - v.z);
+}
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator-(const double &v) const {
+	return Vector3D(x - v, y - v, z - v);
+}
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator+(const double &v) const {
+	return Vector3D(x + v, y + v, z + v);
+}
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator/(const double &s) const {
+	return Vector3D(x / s, y / s, z / s);
+}
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator/(const Vector3D &v) const {
+	return Vector3D(x / v.x, y / v.y, z / v.z);
+}
+MECACELL_VEC_CONSTEXPR Vector3D Vector3D::operator-() const { return Vector3D(-x, -y, -z); }
+
+MECACELL_VEC_CONSTEXPR bool Vector3D::operator>=(const double &v) const {
+	return (x >= v && y >= v && z >= v);
+}
+MECACELL_VEC_CONSTEXPR bool Vector3D::operator<=(const double &v) const {
+	return (x <= v && y <= v && z <= v);
+}
+MECACELL_VEC_CONSTEXPR bool Vector3D::operator>(const double &v) const {
+	return (x > v && y > v && z > v);
+}
+MECACELL_VEC_CONSTEXPR bool Vector3D::operator<(const double &v) const {
+	return (x < v && y < v && z < v);
+}
+
+MECACELL_VEC_INLINE double Vector3D::length() const { return sqrt(x * x + y * y + z * z); }
+MECACELL_VEC_CONSTEXPR double Vector3D::sqlength() const { return (x * x + y * y + z * z); }
+
+MECACELL_VEC_CONSTEXPR double Vector3D::getX() const { return x; }
+MECACELL_VEC_CONSTEXPR double Vector3D::getY() const { return y; }
+MECACELL_VEC_CONSTEXPR double Vector3D::getZ() const { return z; }
+
+MECACELL_VEC_INLINE void Vector3D::normalize() { *this = *this / length(); }
+
+MECACELL_VEC_INLINE Vector3D Vector3D::normalized() const {
+	double l = length();
+	return Vector3D(x / l, y / l, z / l);
+}
+
+MECACELL_VEC_CONSTEXPR Vector3D operator*(const Vector3D &v, const double &s) {
+	return Vector3D(v.x * s, v.y * s, v.z * s);
+}
+MECACELL_VEC_CONSTEXPR Vector3D operator*(const double &s, const Vector3D &v) {
+	return Vector3D(v.x * s, v.y * s, v.z * s);
+}
+
+MECACELL_VEC_CONSTEXPR bool operator==(const Vector3D &a, const Vector3D &b) {
+	return (a.x == b.x && a.y == b.y && a.z == b.z);
+}
+MECACELL_VEC_CONSTEXPR bool operator!=(const Vector3D &a, const Vector3D &b) {
+	return !operator==(a, b);
+}
+}
+#endif
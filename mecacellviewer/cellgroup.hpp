@@ -1,17 +1,66 @@
 #ifndef CELLGROUP_HPP
 #define CELLGROUP_HPP
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+#include <cstdint>
+#include <unordered_map>
 #include "viewtools.h"
+#include "frustum.hpp"
 #include "primitives/sphere.hpp"
+#include "primitives/particlesprite.hpp"
 
 namespace MecacellViewer {
 enum cellMode { plain, centers };
-template <typename C> class CellGroup {
+// draws a container of cells, or of pointers to cells: the world's cells or a
+// snapshot's (see WorldSnapshot)
+template <typename C> const C &cellRef(C *c) { return *c; }
+template <typename C> const C &cellRef(const C &c) { return c; }
+
+class CellGroup {
 	QOpenGLShaderProgram shader;
 	unique_ptr<QOpenGLTexture> normalMap = nullptr;
 	IcoSphere sphere;
+	// instanced path: cell.vert & cell.frag with INSTANCED defined, one sphere per level of
+	// detail, each in a vao of its own with a buffer of per cell attributes (see
+	// INSTANCE_SIZE). Below the last level, cells are drawn as impostors
+	struct Lod {
+		unique_ptr<IcoSphere> sphere;
+		QOpenGLBuffer buf;
+		vector<float> data;
+	};
+	QOpenGLShaderProgram instancedShader;
+	vector<Lod> lods;
+	QOpenGLShaderProgram impostorShader;
+	Particlesprite impostors{impostorShader};
+	vector<pair<QVector4D, QVector4D>> impostorData;
+	// position, radius, rotation axis, rotation angle, color
+	static const int INSTANCE_SIZE = 11;
+
+	// culling: the cells are bucketed by center, each bucket is tested against the
+	// frustum, then only the cells of the buckets crossing it are tested individually
+	struct Bucket {
+		QVector3D lo, hi;
+		Frustum::Side side;
+	};
+	vector<Bucket> buckets;
+	vector<int> cellBuckets; // bucket of each cell, -1 if not drawn
+	unordered_map<uint64_t, int> bucketIds;
+	Frustum frustum;
 
 public:
 	bool cut = false;
+	// one draw call for all the cells, with the model and normal matrices computed on the
+	// gpu. Otherwise, one draw call (and its uniforms) per cell
+	bool instanced = true;
+	// culls the cells outside of the view frustum
+	bool frustumCulling = true;
+	double cullingBucketSize = 400.0; // in world units, about 10 default cell radii
+	// instanced path only: the sphere's subdivisions at each level of detail, and the
+	// projected radius (in half viewport heights) down to which each one is used. The
+	// subdivisions are read by load
+	bool levelsOfDetail = true;
+	vector<int> lodSubdivisions = {3, 2, 1};
+	vector<double> lodMinSizes = {0.04, 0.015, 0.005};
 	cellMode drawMode;
 	CellGroup() {}
 
@@ -25,12 +74,195 @@ public:
 		normalMap->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
 		normalMap->setMagnificationFilter(QOpenGLTexture::Linear);
 		sphere.load(shader);
+		loadInstanced();
+	}
+
+	void loadInstanced() {
+		const QString define = "#define INSTANCED\n";
+		instancedShader.addShaderFromSourceCode(
+		    QOpenGLShader::Vertex, shaderWithHeader(":/shaders/cell.vert", define));
+		instancedShader.addShaderFromSourceCode(
+		    QOpenGLShader::Fragment, shaderWithHeader(":/shaders/cell.frag", define));
+		instancedShader.link();
+		QOpenGLFunctions_3_3_Core *GLf =
+		    QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_3_Core>();
+		GLf->initializeOpenGLFunctions();
+		lods.clear();
+		for (int subdivisions : lodSubdivisions) {
+			lods.emplace_back();
+			Lod &l = lods.back();
+			l.sphere = unique_ptr<IcoSphere>(new IcoSphere(subdivisions));
+			l.sphere->load(instancedShader);
+			instancedShader.bind();
+			l.sphere->vao.bind();
+			l.buf.create();
+			l.buf.setUsagePattern(QOpenGLBuffer::StreamDraw);
+			l.buf.bind();
+			const int stride = INSTANCE_SIZE * sizeof(float);
+			auto attribute = [&](const char *name, int offset, int size) {
+				int loc = instancedShader.attributeLocation(name);
+				instancedShader.enableAttributeArray(loc);
+				instancedShader.setAttributeBuffer(loc, GL_FLOAT, offset * sizeof(float), size,
+				                                   stride);
+				GLf->glVertexAttribDivisor(loc, 1);
+			};
+			attribute("instancePositionRadius", 0, 4);
+			attribute("instanceRotation", 4, 4);
+			attribute("instanceColor", 8, 3);
+			l.sphere->vao.release();
+			instancedShader.release();
+		}
+		impostorShader.addShaderFromSourceCode(QOpenGLShader::Vertex,
+		                                       shaderWithHeader(":/shaders/particle.vert"));
+		impostorShader.addShaderFromSourceCode(QOpenGLShader::Fragment,
+		                                       shaderWithHeader(":/shaders/particle.frag"));
+		impostorShader.link();
+		impostors.load();
+	}
+
+	static uint64_t bucketKey(const QVector3D &p, double bucketSize) {
+		// 21 bits per axis
+		auto k = [&](float x) {
+			return static_cast<uint64_t>(static_cast<int64_t>(std::floor(x / bucketSize)) +
+			                             (1 << 20)) &
+			       0x1fffff;
+		};
+		return k(p.x()) | (k(p.y()) << 21) | (k(p.z()) << 42);
+	}
+
+	// fills cellBuckets, and classifies the buckets against the frustum
+	template <typename Cells> void cull(const Cells &cells) {
+		buckets.clear();
+		bucketIds.clear();
+		cellBuckets.resize(cells.size());
+		size_t i = 0;
+		for (auto &cell : cells) {
+			const auto &c = cellRef(cell);
+			int &b = cellBuckets[i++];
+			if (!isDrawn(c)) {
+				b = -1;
+				continue;
+			}
+			const QVector3D p = toQV3D(c.getPosition());
+			const float r = c.getRadius();
+			const QVector3D rv(r, r, r);
+			auto it = bucketIds.find(bucketKey(p, cullingBucketSize));
+			if (it == bucketIds.end()) {
+				b = buckets.size();
+				bucketIds[bucketKey(p, cullingBucketSize)] = b;
+				buckets.push_back(Bucket{p - rv, p + rv, Frustum::intersecting});
+			} else {
+				b = it->second;
+				Bucket &bu = buckets[b];
+				bu.lo = QVector3D(std::min(bu.lo.x(), p.x() - r), std::min(bu.lo.y(), p.y() - r),
+				                  std::min(bu.lo.z(), p.z() - r));
+				bu.hi = QVector3D(std::max(bu.hi.x(), p.x() + r), std::max(bu.hi.y(), p.y() + r),
+				                  std::max(bu.hi.z(), p.z() + r));
+			}
+		}
+		for (auto &b : buckets) b.side = frustum.classify(b.lo, b.hi);
+	}
+
+	// whether the cell of index i (see cull) is visible
+	template <typename C> bool inFrustum(const C &c, size_t i) const {
+		if (!frustumCulling) return true;
+		const int b = cellBuckets[i];
+		if (b < 0 || buckets[b].side == Frustum::outside) return false;
+		return buckets[b].side == Frustum::inside ||
+		       frustum.sphereVisible(toQV3D(c.getPosition()), c.getRadius());
+	}
+
+	template <typename C> bool isDrawn(const C &c) const {
+		if (!c.getVisible()) return false;
+		return !cut || QVector3D::dotProduct(toQV3D(c.getPosition()), QVector3D(1, 0, 0)) > 0;
+	}
+
+	template <typename C>
+	QVector3D cellColor(const C &c, const colorMode &cm, const void *selected) const {
+		if (&c == selected) return QVector3D(1.0, 1.0, 1.0);
+		if (cm == pressure) {
+			QColor co;
+			co.setHsvF(mix(0.0, 0.7, 1.0 - c.getNormalizedPressure()), 0.8, 0.8);
+			return QVector3D(co.redF(), co.greenF(), co.blueF());
+		}
+		return QVector3D(c.getColor(0), c.getColor(1), c.getColor(2));
+	}
+
+	// level of detail of a sphere of radius r at depth d: its index in lods, or
+	// lods.size() for an impostor
+	size_t lodOf(double r, double d, const QMatrix4x4 &proj) const {
+		if (!levelsOfDetail) return 0;
+		const double size = d > 0 ? proj(1, 1) * r / d : 1.0;
+		size_t l = 0;
+		while (l < lods.size() && l < lodMinSizes.size() && size < lodMinSizes[l]) ++l;
+		return l;
+	}
+
+	// fills the instance buffers then draws the cells of each level of detail at once
+	template <typename Cells>
+	void drawInstanced(const Cells &cells, const QMatrix4x4 &view, const QMatrix4x4 &proj,
+	                   const QVector3D &viewV, const QVector3D &camPos, const colorMode &cm,
+	                   const void *selected) {
+		for (auto &l : lods) l.data.clear();
+		impostorData.clear();
+		const QVector3D forward = viewV.normalized();
+		size_t i = 0;
+		for (auto &cell : cells) {
+			const auto &c = cellRef(cell);
+			const size_t ci = i++;
+			if (!isDrawn(c) || !inFrustum(c, ci)) continue;
+			const auto p = c.getPosition();
+			const double radius = drawMode == plain ? c.getRadius() : 2.0;
+			const QVector3D color = cellColor(c, cm, selected);
+			const size_t l =
+			    lodOf(radius, QVector3D::dotProduct(toQV3D(p) - camPos, forward), proj);
+			if (l == lods.size()) {
+				impostorData.push_back(make_pair(QVector4D(p.x, p.y, p.z, radius),
+				                                 QVector4D(color, 1.0)));
+				continue;
+			}
+			const auto r = c.getOrientationRotation();
+			const double data[INSTANCE_SIZE] = {p.x,   p.y,    p.z,       radius,    r.n.x, r.n.y,
+			                                    r.n.z, r.teta, color.x(), color.y(), color.z()};
+			for (double d : data) lods[l].data.push_back(static_cast<float>(d));
+		}
+		QOpenGLFunctions_3_3_Core *GLf =
+		    QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_3_Core>();
+		instancedShader.bind();
+		GL->glActiveTexture(GL_TEXTURE0);
+		GL->glBindTexture(GL_TEXTURE_2D, normalMap->textureId());
+		instancedShader.setUniformValue("nmap", 0);
+		instancedShader.setUniformValue("projection", proj);
+		instancedShader.setUniformValue("view", view);
+		for (auto &l : lods) {
+			const int nbInstances = l.data.size() / INSTANCE_SIZE;
+			if (nbInstances == 0) continue;
+			l.sphere->vao.bind();
+			l.buf.bind();
+			l.buf.allocate(l.data.data(), l.data.size() * sizeof(float));
+			GLf->glDrawElementsInstanced(GL_TRIANGLES, l.sphere->indices.size(),
+			                             GL_UNSIGNED_INT, 0, nbInstances);
+			l.sphere->vao.release();
+		}
+		instancedShader.release();
+		if (!impostorData.empty()) {
+			impostors.update(impostorData);
+			QVector3D right = view.row(0).toVector3D(), up = view.row(1).toVector3D();
+			QMatrix4x4 vp = proj * view;
+			impostors.draw(QVector2D(1.0, 1.0), up, right, vp);
+		}
 	}
 
-	void draw(const vector<C *> &cells, const QMatrix4x4 &view, const QMatrix4x4 &projection,
+	// selected: the cell drawn in white, if any
+	template <typename Cells>
+	void draw(const Cells &cells, const QMatrix4x4 &view, const QMatrix4x4 &projection,
 	          const QVector3D &viewV, const QVector3D &camPos, const colorMode &cm,
-	          const C *selected = nullptr) {
-		if (cells.size() > 0) {
+	          const void *selected = nullptr) {
+		frustum = Frustum(projection * view);
+		if (frustumCulling) cull(cells);
+		if (cells.size() > 0 && instanced) {
+			drawInstanced(cells, view, projection, viewV, camPos, cm, selected);
+		} else if (cells.size() > 0) {
 			shader.bind();
 			sphere.vao.bind();
 			normalMap->bind(0);
@@ -39,39 +271,26 @@ public:
 			shader.setUniformValue(shader.uniformLocation("nmap"), 0);
 			shader.setUniformValue(shader.uniformLocation("projection"), projection);
 			shader.setUniformValue(shader.uniformLocation("view"), view);
-			vector<C *> sortedCells = cells;
-			decltype((*cells.begin())->getPosition()) viewVec(viewV.x(), viewV.y(), viewV.z());
-			decltype((*cells.begin())->getPosition()) camVec(camPos.x(), camPos.y(), camPos.z());
-			// std::sort(sortedCells.begin(), sortedCells.end(), [&](C *a, C *b) {
-			// return (a->getPosition() - camVec).sqlength() > (b->getPosition() - camVec).sqlength();
-			//});
-			for (auto &c : sortedCells) {
-				if (c->getVisible()) {
-					QMatrix4x4 model;
-					double radius = c->getRadius();
-					QVector3D center = toQV3D(c->getPosition());
-					if ((cut && QVector3D::dotProduct(center, QVector3D(1, 0, 0)) > 0) || !cut) {
-						model.translate(center);
-						model.rotate(radToDeg(c->getOrientationRotation().teta), toQV3D(c->getOrientationRotation().n));
-						if (drawMode == plain) {
-							model.scale(QVector3D(radius, radius, radius));
-						} else {
-							model.scale(QVector3D(2.0, 2.0, 2.0));
-						}
-						QVector3D color(c->getColor(0), c->getColor(1), c->getColor(2));
-						if (cm == pressure) {
-							QColor co;
-							co.setHsvF(mix(0.0, 0.7, 1.0 - c->getNormalizedPressure()), 0.8, 0.8);
-							color = QVector3D(co.redF(), co.greenF(), co.blueF());
-						}
-						if (c == selected) color = QVector3D(1.0, 1.0, 1.0);
-						QMatrix4x4 nmatrix = (model).inverted().transposed();
-						shader.setUniformValue(shader.uniformLocation("model"), model);
-						shader.setUniformValue(shader.uniformLocation("normalMatrix"), nmatrix);
-						shader.setUniformValue(shader.uniformLocation("color"), color);
-						GL->glDrawElements(GL_TRIANGLES, sphere.indices.size(), GL_UNSIGNED_INT, 0);
-					}
+			size_t i = 0;
+			for (auto &cell : cells) {
+				const auto &c = cellRef(cell);
+				const size_t ci = i++;
+				if (!isDrawn(c) || !inFrustum(c, ci)) continue;
+				QMatrix4x4 model;
+				double radius = c.getRadius();
+				model.translate(toQV3D(c.getPosition()));
+				model.rotate(radToDeg(c.getOrientationRotation().teta),
+				             toQV3D(c.getOrientationRotation().n));
+				if (drawMode == plain) {
+					model.scale(QVector3D(radius, radius, radius));
+				} else {
+					model.scale(QVector3D(2.0, 2.0, 2.0));
 				}
+				QMatrix4x4 nmatrix = (model).inverted().transposed();
+				shader.setUniformValue(shader.uniformLocation("model"), model);
+				shader.setUniformValue(shader.uniformLocation("normalMatrix"), nmatrix);
+				shader.setUniformValue(shader.uniformLocation("color"), cellColor(c, cm, selected));
+				GL->glDrawElements(GL_TRIANGLES, sphere.indices.size(), GL_UNSIGNED_INT, 0);
 			}
 			sphere.vao.release();
 			shader.release();
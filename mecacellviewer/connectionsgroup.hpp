@@ -2,11 +2,38 @@
 #define CONNECTIONSGROUP_HPP
 #include "viewtools.h"
 #include "primitives/lines.hpp"
+#include <cstring>
 #include <vector>
 class ConnectionsGroup {
 	QOpenGLShaderProgram shader;
 	Lines lines;
 
+	template <typename V> static float *writeSegment(float *p, const V &a, const V &b) {
+		*p++ = a.x;
+		*p++ = a.y;
+		*p++ = a.z;
+		*p++ = b.x;
+		*p++ = b.y;
+		*p++ = b.z;
+		return p;
+	}
+
+	void bind(const QMatrix4x4 &view, const QMatrix4x4 &projection) {
+		shader.bind();
+		lines.vao.bind();
+		lines.vbuf.bind();
+		shader.setUniformValue(shader.uniformLocation("viewProjection"), projection * view);
+	}
+	void drawLines(int first, int nbVertices, const QVector4D &color) {
+		if (nbVertices == 0) return;
+		shader.setUniformValue(shader.uniformLocation("color"), color);
+		GL->glDrawArrays(GL_LINES, first, nbVertices);
+	}
+	void release() {
+		lines.vao.release();
+		shader.release();
+	}
+
 public:
 	ConnectionsGroup() {}
 
@@ -21,82 +48,56 @@ public:
 		lines.load(shader);
 	}
 
+	// the bounce and anchor segments of every cell - model contact, written straight into
+	// the mapped buffer, then drawn in two calls
 	template <typename Cell>
 	void drawModelConnections(const vector<Cell *> &cells, const QMatrix4x4 &view,
 	                          const QMatrix4x4 &projection) {
-		lines.vertices = std::vector<float>();
-		shader.bind();
-		lines.vao.bind();
-		lines.vbuf.bind();
-		lines.vbuf.allocate(&lines.vertices[0], lines.vertices.size() * sizeof(float));
-		QVector4D color(0.9, 0.2, 0.1, 1.0);
-		shader.setUniformValue(shader.uniformLocation("viewProjection"), projection * view);
-		shader.setUniformValue(shader.uniformLocation("color"), color);
-		GL->glDrawArrays(GL_LINES, 0, lines.vertices.size() / 3.0);
-		lines.vertices = std::vector<float>();
-		for (auto &c : cells) {
-			for (auto &conne : c->getRWModelConnections()) {
-				QVector3D center0 = toQV3D(conne->bounce.getNode0().getPosition());
-				QVector3D center1 = toQV3D(conne->bounce.getNode1()->getPosition());
-				lines.vertices.push_back(center0.x());
-				lines.vertices.push_back(center0.y());
-				lines.vertices.push_back(center0.z());
-				lines.vertices.push_back(center1.x());
-				lines.vertices.push_back(center1.y());
-				lines.vertices.push_back(center1.z());
-			}
-		}
-		lines.vbuf.allocate(&lines.vertices[0], lines.vertices.size() * sizeof(float));
-		shader.setUniformValue(shader.uniformLocation("viewProjection"), projection * view);
-		shader.setUniformValue(shader.uniformLocation("color"), color);
-		GL->glDrawArrays(GL_LINES, 0, lines.vertices.size() / 3.0);
-		lines.vertices = std::vector<float>();
+		size_t n = 0;
+		for (auto &c : cells) n += c->getRWModelConnections().size();
+		if (n == 0) return;
+		bind(view, projection);
+		int first;
+		float *bounces = lines.map(n * 12, first);
+		float *anchors = bounces + n * 6;
 		for (auto &c : cells) {
 			for (auto &conne : c->getRWModelConnections()) {
-				QVector3D center0 = toQV3D(conne->anchor.getNode0().getPosition());
-				QVector3D center1 = toQV3D(conne->anchor.getNode1()->getPosition());
-				lines.vertices.push_back(center0.x());
-				lines.vertices.push_back(center0.y());
-				lines.vertices.push_back(center0.z());
-				lines.vertices.push_back(center1.x());
-				lines.vertices.push_back(center1.y());
-				lines.vertices.push_back(center1.z());
+				bounces = writeSegment(bounces, conne->bounce.getNode0().getPosition(),
+				                       conne->bounce.getNode1()->getPosition());
+				anchors = writeSegment(anchors, conne->anchor.getNode0().getPosition(),
+				                       conne->anchor.getNode1()->getPosition());
 			}
 		}
-		lines.vbuf.allocate(&lines.vertices[0], lines.vertices.size() * sizeof(float));
-		color = QVector4D(0.0, 0.4, 0.8, 1.0);
-		shader.setUniformValue(shader.uniformLocation("viewProjection"), projection * view);
-		shader.setUniformValue(shader.uniformLocation("color"), color);
-		GL->glDrawArrays(GL_LINES, 0, lines.vertices.size() / 3.0);
-		lines.vao.release();
-		shader.release();
+		lines.unmap();
+		drawLines(first, n * 2, QVector4D(0.9, 0.2, 0.1, 1.0));
+		drawLines(first + n * 2, n * 2, QVector4D(0.0, 0.4, 0.8, 1.0));
+		release();
+	}
+
+	// segments as captured in a WorldSnapshot: 2 x 3 floats each
+	void drawSegments(const vector<float> &segments, const QMatrix4x4 &view,
+	                  const QMatrix4x4 &projection, const QVector4D &color) {
+		if (segments.empty()) return;
+		bind(view, projection);
+		int first;
+		memcpy(lines.map(segments.size(), first), &segments[0],
+		       segments.size() * sizeof(float));
+		lines.unmap();
+		drawLines(first, segments.size() / 3, color);
+		release();
 	}
 
 	template <typename C>
 	void draw(const vector<C *> &co, const QMatrix4x4 &view, const QMatrix4x4 &projection) {
-		lines.vertices = std::vector<float>();
-		for (auto &c : co) {
-			auto cell0 = c->getNode0();
-			auto cell1 = c->getNode1();
-			QVector3D center0 = toQV3D(cell0->getPosition());
-			QVector3D center1 = toQV3D(cell1->getPosition());
-			lines.vertices.push_back(center0.x());
-			lines.vertices.push_back(center0.y());
-			lines.vertices.push_back(center0.z());
-			lines.vertices.push_back(center1.x());
-			lines.vertices.push_back(center1.y());
-			lines.vertices.push_back(center1.z());
-		}
-		shader.bind();
-		lines.vao.bind();
-		lines.vbuf.bind();
-		lines.vbuf.allocate(&lines.vertices[0], lines.vertices.size() * sizeof(float));
-		QVector4D color(0.95, 0.8, 0.1, 1.0);
-		shader.setUniformValue(shader.uniformLocation("viewProjection"), projection * view);
-		shader.setUniformValue(shader.uniformLocation("color"), color);
-		GL->glDrawArrays(GL_LINES, 0, lines.vertices.size() / 3.0);
-		lines.vao.release();
-		shader.release();
+		if (co.empty()) return;
+		bind(view, projection);
+		int first;
+		float *p = lines.map(co.size() * 6, first);
+		for (auto &c : co)
+			p = writeSegment(p, c->getNode0()->getPosition(), c->getNode1()->getPosition());
+		lines.unmap();
+		drawLines(first, co.size() * 2, QVector4D(0.95, 0.8, 0.1, 1.0));
+		release();
 	}
 };
 #endif
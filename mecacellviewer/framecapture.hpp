@@ -0,0 +1,188 @@
+#ifndef FRAMECAPTURE_HPP
+#define FRAMECAPTURE_HPP
+#include <QImage>
+#include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
+#include <QString>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "viewtools.h"
+
+namespace MecacellViewer {
+// runs jobs in submission order on a few threads. With a single thread, jobs also finish
+// in that order. push waits while maxQueued jobs are already waiting, so that a slow
+// consumer doesn't pile up frames in memory
+class WorkQueue {
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mtx;
+	std::condition_variable jobCV, roomCV;
+	size_t maxQueued;
+	bool stopping = false;
+
+	void workerLoop() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				jobCV.wait(lock, [&] { return stopping || !jobs.empty(); });
+				if (jobs.empty()) return; // stopping, and nothing left to do
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			roomCV.notify_one();
+			job();
+		}
+	}
+
+public:
+	explicit WorkQueue(size_t nbThreads, size_t maxQ = 8) : maxQueued(maxQ) {
+		for (size_t i = 0; i < nbThreads; ++i) workers.emplace_back(&WorkQueue::workerLoop, this);
+	}
+	WorkQueue(const WorkQueue &) = delete;
+	WorkQueue &operator=(const WorkQueue &) = delete;
+	// finishes every queued job
+	~WorkQueue() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		jobCV.notify_all();
+		for (auto &w : workers) w.join();
+	}
+
+	void push(std::function<void()> job) {
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			roomCV.wait(lock, [&] { return jobs.size() < maxQueued; });
+			jobs.push_back(std::move(job));
+		}
+		jobCV.notify_one();
+	}
+};
+
+// Saves frames from a framebuffer object without stalling the render thread: the pixels
+// are read into a pixel buffer object, which is only mapped one frame later (when the gpu
+// is done with it), then the images are encoded and saved by worker threads. Frames can
+// also be piped to an external video encoder (see startVideo).
+class FrameCapture {
+	static const size_t NB_READBACKS = 2;
+	struct Readback {
+		QOpenGLBuffer pbo = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+		QSize size;
+		std::string name; // empty for a video frame
+		int frame = 0;
+		bool pending = false;
+	};
+	Readback readbacks[NB_READBACKS];
+	size_t next = 0;
+	int frame = 0;
+
+	WorkQueue encoders;
+	WorkQueue videoWriter{1}; // keeps the frames in order
+	FILE *video = nullptr;
+	QSize videoSize;
+
+	// copies the pixels out of r's buffer, then hands them to the encoders
+	void collect(Readback &r) {
+		r.pending = false;
+		QImage img(r.size, QImage::Format_RGBA8888);
+		r.pbo.bind();
+		const void *pixels = r.pbo.map(QOpenGLBuffer::ReadOnly);
+		if (pixels) {
+			memcpy(img.bits(), pixels, img.byteCount());
+			r.pbo.unmap();
+		}
+		r.pbo.release();
+		if (!pixels) return;
+		const std::string name = r.name;
+		if (!name.empty()) {
+			const int q = quality;
+			// opengl's rows go bottom up
+			encoders.push([img, name, q]() {
+				img.mirrored().save(QString::fromStdString(name), 0, q);
+			});
+		} else if (video && r.size == videoSize) {
+			FILE *v = video;
+			videoWriter.push([img, v]() {
+				QImage m = img.mirrored();
+				fwrite(m.constBits(), 1, m.byteCount(), v);
+			});
+		}
+	}
+
+public:
+	int quality = 97; // jpeg quality, as in QImage::save
+
+	explicit FrameCapture(size_t nbEncoders = 2) : encoders(nbEncoders) {}
+	FrameCapture(const FrameCapture &) = delete;
+	FrameCapture &operator=(const FrameCapture &) = delete;
+	~FrameCapture() { stopVideo(); }
+
+	// reads fbo's color attachment now, saves it to name (or sends it to the video encoder
+	// if name is empty) later. The fbo doesn't need to be bound
+	void capture(QOpenGLFramebufferObject *fbo, const std::string &name) {
+		Readback &r = readbacks[next];
+		next = (next + 1) % NB_READBACKS;
+		if (r.pending) collect(r); // only waits with more than NB_READBACKS captures per frame
+		if (!r.pbo.isCreated()) {
+			r.pbo.create();
+			r.pbo.setUsagePattern(QOpenGLBuffer::StreamRead);
+		}
+		r.size = fbo->size();
+		r.pbo.bind();
+		const int bytes = r.size.width() * r.size.height() * 4;
+		if (r.pbo.size() != bytes) r.pbo.allocate(bytes);
+		fbo->bind();
+		GL->glReadPixels(0, 0, r.size.width(), r.size.height(), GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		fbo->release();
+		r.pbo.release();
+		r.name = name;
+		r.frame = frame;
+		r.pending = true;
+	}
+
+	// to be called once per frame, after the captures: hands the frames read during the
+	// previous frames to the encoders
+	void endFrame() {
+		for (auto &r : readbacks)
+			if (r.pending && r.frame < frame) collect(r);
+		++frame;
+	}
+
+	// hands every pending frame to the encoders (needs the openGL context)
+	void finish() {
+		for (auto &r : readbacks)
+			if (r.pending) collect(r);
+	}
+
+	// starts piping raw frames (RGBA, top row first) of the given size to command's
+	// standard input, e.g.:
+	// ffmpeg -y -f rawvideo -pix_fmt rgba -s 1280x720 -r 30 -i - -pix_fmt yuv420p out.mp4
+	// Frames of another size are dropped
+	bool startVideo(const std::string &command, const QSize &size) {
+		stopVideo();
+		video = popen(command.c_str(), "w");
+		if (!video) std::cerr << "couldn't start the video encoder: " << command << std::endl;
+		videoSize = size;
+		return video != nullptr;
+	}
+	void stopVideo() {
+		if (!video) return;
+		FILE *v = video;
+		video = nullptr;
+		// once the frames already queued are written
+		videoWriter.push([v]() { pclose(v); });
+	}
+	bool isRecording() const { return video != nullptr; }
+};
+}
+#endif
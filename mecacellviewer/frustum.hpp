@@ -0,0 +1,58 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include <cmath>
+
+namespace MecacellViewer {
+// the 6 planes of a view frustum, extracted from a viewProjection matrix. A plane
+// (n, d) keeps the points p with dot(n, p) + d >= 0 (n is normalized)
+class Frustum {
+	QVector4D planes[6];
+
+public:
+	enum Side { outside, intersecting, inside };
+
+	Frustum() {}
+	explicit Frustum(const QMatrix4x4 &viewProjection) {
+		const QVector4D r0 = viewProjection.row(0), r1 = viewProjection.row(1),
+		                r2 = viewProjection.row(2), r3 = viewProjection.row(3);
+		planes[0] = r3 + r0; // left
+		planes[1] = r3 - r0; // right
+		planes[2] = r3 + r1; // bottom
+		planes[3] = r3 - r1; // top
+		planes[4] = r3 + r2; // near
+		planes[5] = r3 - r2; // far
+		for (auto &p : planes) p /= p.toVector3D().length();
+	}
+
+	double distance(int i, const QVector3D &p) const {
+		return QVector3D::dotProduct(planes[i].toVector3D(), p) + planes[i].w();
+	}
+
+	bool sphereVisible(const QVector3D &c, double r) const {
+		for (int i = 0; i < 6; ++i)
+			if (distance(i, c) < -r) return false;
+		return true;
+	}
+
+	// where the box [lo, hi] is. Conservative: a box outside of the frustum but not of any
+	// of its planes is said to be intersecting
+	Side classify(const QVector3D &lo, const QVector3D &hi) const {
+		Side res = inside;
+		for (int i = 0; i < 6; ++i) {
+			const QVector3D n = planes[i].toVector3D();
+			// the box's corners the furthest along and against n
+			const QVector3D pos(n.x() >= 0 ? hi.x() : lo.x(), n.y() >= 0 ? hi.y() : lo.y(),
+			                    n.z() >= 0 ? hi.z() : lo.z());
+			const QVector3D neg(n.x() >= 0 ? lo.x() : hi.x(), n.y() >= 0 ? lo.y() : hi.y(),
+			                    n.z() >= 0 ? lo.z() : hi.z());
+			if (distance(i, pos) < 0) return outside;
+			if (distance(i, neg) < 0) res = intersecting;
+		}
+		return res;
+	}
+};
+}
+#endif
@@ -1,23 +1,97 @@
 #ifndef GRIDVIEWER_HPP
 #define GRIDVIEWER_HPP
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+#include <algorithm>
+#include <vector>
 #include "viewtools.h"
 #include "primitives/cube.hpp"
 
 class GridViewer {
 	QOpenGLShaderProgram shader;
 	Cube cube;
+	// instanced path: the same shaders with INSTANCED defined, the cube in a vao of its
+	// own, and one buffer of occupied grid cells (coordinates, number of objects)
+	QOpenGLShaderProgram instancedShader;
+	Cube instancedCube;
+	QOpenGLBuffer instanceBuf;
+	std::vector<float> instanceData;
 
 public:
+	// one draw call for the whole grid. Otherwise, one draw call per occupied grid cell
+	bool instanced = true;
+	// instanced path only: colors the grid cells by number of objects (blue to red, on a
+	// log scale), instead of the given color
+	bool heatmap = false;
+
 	GridViewer(){};
 	void load(const QString &vs, const QString &fs) {
 		shader.addShaderFromSourceCode(QOpenGLShader::Vertex, shaderWithHeader(vs));
 		shader.addShaderFromSourceCode(QOpenGLShader::Fragment, shaderWithHeader(fs));
 		shader.link();
 		cube.load(shader);
+
+		const QString define = "#define INSTANCED\n";
+		instancedShader.addShaderFromSourceCode(QOpenGLShader::Vertex,
+		                                        shaderWithHeader(vs, define));
+		instancedShader.addShaderFromSourceCode(QOpenGLShader::Fragment,
+		                                        shaderWithHeader(fs, define));
+		instancedShader.link();
+		instancedCube.load(instancedShader);
+		QOpenGLFunctions_3_3_Core *GLf =
+		    QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_3_Core>();
+		GLf->initializeOpenGLFunctions();
+		instancedShader.bind();
+		instancedCube.vao.bind();
+		instanceBuf.create();
+		instanceBuf.setUsagePattern(QOpenGLBuffer::StreamDraw);
+		instanceBuf.bind();
+		int loc = instancedShader.attributeLocation("instanceCell");
+		instancedShader.enableAttributeArray(loc);
+		instancedShader.setAttributeBuffer(loc, GL_FLOAT, 0, 4);
+		GLf->glVertexAttribDivisor(loc, 1);
+		instancedCube.vao.release();
+		instancedShader.release();
+	}
+
+	template <typename G>
+	void drawInstanced(const G &g, const QMatrix4x4 &view, const QMatrix4x4 &projection,
+	                   const QVector4D &color) {
+		instanceData.clear();
+		size_t maxOccupancy = 0;
+		g.forEachBucket([&](int i, int j, int k, size_t n) {
+			instanceData.push_back(i);
+			instanceData.push_back(j);
+			instanceData.push_back(k);
+			instanceData.push_back(n);
+			maxOccupancy = std::max(maxOccupancy, n);
+		});
+		const int nbInstances = instanceData.size() / 4;
+		if (nbInstances == 0) return;
+		QOpenGLFunctions_3_3_Core *GLf =
+		    QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_3_3_Core>();
+		instancedShader.bind();
+		instancedCube.vao.bind();
+		instanceBuf.bind();
+		instanceBuf.allocate(instanceData.data(), instanceData.size() * sizeof(float));
+		instancedShader.setUniformValue("projection", projection);
+		instancedShader.setUniformValue("view", view);
+		instancedShader.setUniformValue("color", color);
+		instancedShader.setUniformValue("cellSize", static_cast<float>(g.getCellSize()));
+		instancedShader.setUniformValue("maxOccupancy",
+		                                heatmap ? static_cast<float>(maxOccupancy) : 0.0f);
+		GLf->glDrawElementsInstanced(GL_TRIANGLES, instancedCube.indices.size(),
+		                             GL_UNSIGNED_INT, 0, nbInstances);
+		instancedCube.vao.release();
+		instancedShader.release();
 	}
 
 	template <typename G>
 	void draw(const G &g, const QMatrix4x4 &view, const QMatrix4x4 &projection, const QVector4D &color) {
+		if (instanced) {
+			drawInstanced(g, view, projection, color);
+			return;
+		}
 		shader.bind();
 		cube.vao.bind();
 		shader.setUniformValue(shader.uniformLocation("projection"), projection);
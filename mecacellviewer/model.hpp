@@ -5,6 +5,13 @@
 
 using std::vector;
 
+// the matrix a model's vertices are drawn with (they are the mesh's, in object space)
+template <typename Model> QMatrix4x4 modelMatrix(const Model &m) {
+	const auto &t = m.transformation.m;
+	return QMatrix4x4(t[0][0], t[0][1], t[0][2], t[0][3], t[1][0], t[1][1], t[1][2], t[1][3],
+	                  t[2][0], t[2][1], t[2][2], t[2][3], t[3][0], t[3][1], t[3][2], t[3][3]);
+}
+
 template <typename Model> struct ModelViewer {
 	QOpenGLShaderProgram shader;
 	QOpenGLVertexArrayObject vao;
@@ -17,33 +24,34 @@ template <typename Model> struct ModelViewer {
 	void load(const Model &m) {
 
 		// extracting vertices, normals and uv (if available)
-		for (auto &v : m.vertices) {
+		const auto &mesh = *m.mesh;
+		for (auto &v : mesh.vertices) {
 			vertices.push_back(v.x);
 			vertices.push_back(v.y);
 			vertices.push_back(v.z);
 		}
 		normals.resize(vertices.size());
-		for (auto &f : m.obj.faces) {
-
-			assert(f.count("v") && f.count("n"));
-			for (auto &vid : f.at("v").indices) {
-				assert(vid < m.obj.vertices.size());
+		assert(!mesh.faceNormals.empty());
+		for (size_t i = 0; i < mesh.faces.size(); ++i) {
+			const auto &f = mesh.faces[i];
+			for (auto &vid : f.indices) {
+				assert(vid < mesh.vertices.size());
 				indices.push_back(vid);
 			}
 
+			if (mesh.faceNormals.empty()) continue;
 			for (int id = 0; id < 3; ++id) {
-				size_t vid = f.at("v").indices[id];
-				size_t nid = f.at("n").indices[id];
-				normals[vid * 3 + 0] = m.normals[nid].x;
-				normals[vid * 3 + 1] = m.normals[nid].y;
-				normals[vid * 3 + 2] = m.normals[nid].z;
+				size_t vid = f.indices[id];
+				size_t nid = mesh.faceNormals[i].indices[id];
+				normals[vid * 3 + 0] = mesh.normals[nid].x;
+				normals[vid * 3 + 1] = mesh.normals[nid].y;
+				normals[vid * 3 + 2] = mesh.normals[nid].z;
 			}
 		}
 
 		cerr << vertices.size() << " vertices, " << normals.size() << "normals, " << uv.size() << " uv" << endl;
 
 		// creating and binding shaders/vao/vbos
-		// TODO : directly use model's transformed vertices and normals
 
 		shader.addShaderFromSourceCode(QOpenGLShader::Vertex, shaderWithHeader(":/shaders/mvp.vert"));
 		shader.addShaderFromSourceCode(QOpenGLShader::Fragment, shaderWithHeader(":/shaders/model.frag"));
@@ -80,9 +88,12 @@ template <typename Model> struct ModelViewer {
 	}
 
 	void draw(const QMatrix4x4 &view, const QMatrix4x4 &projection, const Model &m) {
+		draw(view, projection, modelMatrix(m));
+	}
+
+	void draw(const QMatrix4x4 &view, const QMatrix4x4 &projection, const QMatrix4x4 &model) {
 		shader.bind();
 		vao.bind();
-		QMatrix4x4 model;
 		shader.setUniformValue(shader.uniformLocation("projection"), projection);
 		shader.setUniformValue(shader.uniformLocation("view"), view);
 		shader.setUniformValue(shader.uniformLocation("model"), model);
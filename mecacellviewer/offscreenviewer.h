@@ -0,0 +1,81 @@
+#ifndef OFFSCREENVIEWER_H
+#define OFFSCREENVIEWER_H
+#include "viewtools.h"
+#include "renderer.hpp"
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#define MECACELL_VIEWER
+#include "macros.h"
+
+using namespace std;
+namespace MecacellViewer {
+// Runs a scenario without any display (e.g. on cluster nodes) and renders it to an image
+// sequence with the same Renderer as the Viewer, in an offscreen surface.
+// Qt's "offscreen" platform is used unless QT_QPA_PLATFORM says otherwise. Its openGL
+// contexts go through GLX: without an X server, use QT_QPA_PLATFORM=minimalegl to render
+// through EGL (on a gpu, or on Mesa's software renderer).
+template <typename Scenario> class OffscreenViewer {
+	QSize size = QSize(1280, 720);
+	int stride = 1;
+	string framePrefix = "frame";
+	QStringList visibleElements = QStringList() << "cells";
+
+public:
+	OffscreenViewer() { initResources(); }
+
+	void setSize(const QSize &s) { size = s; }
+	// one frame is rendered every stride world updates
+	void setStride(int s) { stride = s > 0 ? s : 1; }
+	// frames are saved to <prefix><frame number>.jpg
+	void setFramePrefix(const string &p) { framePrefix = p; }
+	// same names as the viewer's display menu: cells, centers, connections, cellGrid...
+	void setVisibleElements(const QStringList &v) { visibleElements = v; }
+
+	// runs nbUpdates world updates. f, if given, is called with the renderer after its
+	// initialization (e.g. to place the camera). The world is always updated on this thread,
+	// between frames: the renderer's async mode doesn't apply here
+	int exec(int argc, char **argv, int nbUpdates,
+	         std::function<void(Renderer<Scenario> &)> f = nullptr) {
+		if (qgetenv("QT_QPA_PLATFORM").isEmpty()) qputenv("QT_QPA_PLATFORM", "offscreen");
+		QGuiApplication app(argc, argv);
+		QSurfaceFormat format;
+		format.setProfile(QSurfaceFormat::CoreProfile);
+		format.setVersion(3, 3);
+		QOpenGLContext context;
+		context.setFormat(format);
+		if (!context.create()) {
+			cerr << "couldn't create an openGL context" << endl;
+			return 1;
+		}
+		QOffscreenSurface surface;
+		surface.setFormat(context.format());
+		surface.create();
+		if (!context.makeCurrent(&surface)) {
+			cerr << "couldn't make the openGL context current" << endl;
+			return 1;
+		}
+		{
+			Renderer<Scenario> renderer(argc, argv);
+			renderer.initializeOffscreen(size, visibleElements);
+			if (f) f(renderer);
+			for (int u = 0, frame = 0; u < nbUpdates; u += stride, ++frame) {
+				for (int i = 1; i < stride; ++i) renderer.getScenario().loop();
+				stringstream name;
+				name << framePrefix << frame << ".jpg";
+				renderer.screenCapture(name.str());
+				renderer.renderFrame(); // the last update of the stride, then the frame
+			}
+			renderer.finishCaptures();
+		} // the renderer's gl objects are released while the context is current
+		context.doneCurrent();
+		return 0;
+	}
+};
+}
+#endif
@@ -11,20 +11,41 @@ struct Lines {
 	Lines() {}
 	QOpenGLBuffer vbuf;
 	QOpenGLVertexArrayObject vao;
-	std::vector<float> vertices;
+	// vbuf is used as a ring: each map writes after the previous one, without waiting for
+	// the gpu to be done with it. When the ring is full the storage is orphaned (the driver
+	// gives us a fresh one while the gpu finishes with the old), and grown if needed
+	size_t capacity = 0, head = 0; // in bytes
+
 	void load(QOpenGLShaderProgram &shader) {
 		shader.bind();
 		vao.create();
 		vao.bind();
 		vbuf.create();
 		vbuf.bind();
-		vbuf.setUsagePattern(QOpenGLBuffer::StreamDraw);
-		vbuf.allocate(&vertices[0], vertices.size() * sizeof(float));
+		vbuf.setUsagePattern(QOpenGLBuffer::StreamDraw); // allocated by the first map
 		shader.enableAttributeArray(0);
 		shader.setAttributeBuffer(0, GL_FLOAT, 0, 3);
 		vao.release();
 		shader.release();
 	}
+
+	// room for nbFloats floats in vbuf (which must be bound), to be unmapped before drawing.
+	// first is set to the index of its first vertex
+	float *map(size_t nbFloats, int &first) {
+		const size_t bytes = nbFloats * sizeof(float);
+		if (head + bytes > capacity) {
+			if (bytes * 2 > capacity) capacity = bytes * 3;
+			vbuf.allocate(static_cast<int>(capacity));
+			head = 0;
+		}
+		first = head / (3 * sizeof(float));
+		void *p = vbuf.mapRange(static_cast<int>(head), static_cast<int>(bytes),
+		                        QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidate |
+		                            QOpenGLBuffer::RangeUnsynchronized);
+		head += bytes;
+		return static_cast<float *>(p);
+	}
+	void unmap() { vbuf.unmap(); }
 };
 
 #endif
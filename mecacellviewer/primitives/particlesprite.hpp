@@ -15,7 +15,7 @@ class Particlesprite{
 	protected:
 		QOpenGLShaderProgram& shader;
 		QOpenGLBuffer vbuf, pbuf, cbuf;
-		QOpenGLVertexArrayObject* vao;
+		QOpenGLVertexArrayObject* vao = nullptr;
 		std::vector<float> vertices  = {-1,-1,0,1,-1,0,-1,1,0,1,1,0};
 		std::vector<float> positions = {};
 		std::vector<float> colors = {};
@@ -39,14 +39,12 @@ class Particlesprite{
 
 			pbuf.create();
 			pbuf.bind();
-			pbuf.allocate( &positions[0], positions.size()*sizeof(float));
-			pbuf.setUsagePattern(QOpenGLBuffer::StreamDraw);
+			pbuf.setUsagePattern(QOpenGLBuffer::StreamDraw); // allocated by update
 			shader.enableAttributeArray(1);
-			shader.setAttributeBuffer(1, GL_FLOAT, 0, 3 );
+			shader.setAttributeBuffer(1, GL_FLOAT, 0, 4 );
 
 			cbuf.create();
 			cbuf.bind();
-			cbuf.allocate( &colors[0], colors.size()*sizeof(float));
 			cbuf.setUsagePattern(QOpenGLBuffer::StreamDraw);
 			shader.enableAttributeArray(2);
 			shader.setAttributeBuffer(2, GL_FLOAT, 0, 4 );
@@ -55,13 +53,15 @@ class Particlesprite{
 			shader.release();
 		}
 
-		void update (vector<pair<QVector3D,QVector4D>>& p){
+		// position & scale (multiplies size), color
+		void update (const vector<pair<QVector4D,QVector4D>>& p){
 			positions.clear();
 			colors.clear();
 			for(size_t i = 0 ; i < p.size() ; ++i){
 				positions.push_back(p[i].first.x());
 				positions.push_back(p[i].first.y());
 				positions.push_back(p[i].first.z());
+				positions.push_back(p[i].first.w());
 				colors.push_back(p[i].second.x());
 				colors.push_back(p[i].second.y());
 				colors.push_back(p[i].second.z());
@@ -70,9 +70,9 @@ class Particlesprite{
 			shader.bind();
 			vao->bind();
 			pbuf.bind();
-			pbuf.allocate(&positions[0], positions.size()*sizeof(float));
+			pbuf.allocate(positions.data(), positions.size()*sizeof(float));
 			cbuf.bind();
-			cbuf.allocate(&colors[0], colors.size()*sizeof(float));
+			cbuf.allocate(colors.data(), colors.size()*sizeof(float));
 			vao->release();
 			shader.release();
 		}
@@ -89,7 +89,7 @@ class Particlesprite{
 			GLf->glVertexAttribDivisor(0, 0);
 			GLf->glVertexAttribDivisor(1, 1);
 			GLf->glVertexAttribDivisor(2, 1);
-			GLf->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, positions.size()/3);
+			GLf->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, positions.size()/4);
 			vao->release();
 			shader.release();
 
@@ -108,7 +108,7 @@ class Particlesprite{
 			glVertexAttribDivisor(0, 0);
 			glVertexAttribDivisor(1, 1);
 			glVertexAttribDivisor(2, 1);
-			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, positions.size()/3);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, positions.size()/4);
 			vao->release();
 			shader.release();
 
@@ -77,6 +77,15 @@ Item {
 						else removeOptionInCtrl("visibleElements", "modelGrid");
 					}
 				}
+				CheckableButton {
+					checked: false
+					id: viewGridOccupancy
+					legend: "Grid occupancy"
+					onToggled: {
+						if (checked) pushUniqueOptionInCtrl("visibleElements", "gridOccupancy");
+						else removeOptionInCtrl("visibleElements", "gridOccupancy");
+					}
+				}
 			}
 			VerticalSpacer {}
 			SubTitle {
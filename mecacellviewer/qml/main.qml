@@ -296,6 +296,32 @@ Item {
 					label: "UPDATE"
 					value: getStat("nbUpdates")
 				}
+				RowSpacer {
+					color: "#20FFFFFF"
+					coef: 1
+				}
+				ValueWatcher {
+					label: "TIME"
+					value: getStat("simulatedTime").toFixed(2)
+				}
+				RowSpacer {
+					color: "#20FFFFFF"
+					coef: 1
+				}
+				ValueWatcher {
+					label: "DT"
+					value: getStat("dt").toFixed(4)
+				}
+				RowSpacer {
+					color: "#20FFFFFF"
+					coef: 1
+					visible: statAvail("updateMs")
+				}
+				ValueWatcher {
+					label: "MS / UPDATE"
+					value: getStat("updateMs").toFixed(2)
+					visible: statAvail("updateMs")
+				}
 			}
 		}
 	}
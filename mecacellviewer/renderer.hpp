@@ -9,9 +9,15 @@
 #include "renderquad.hpp"
 #include "blurquad.hpp"
 #include "gridviewer.hpp"
+#include "framecapture.hpp"
 #include "macros.h"
+#include "worldsnapshot.hpp"
+#include "../mecacell/profiling.hpp"
 #include <type_traits>
 #include <QThread>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <cmath>
 #include <QOpenGLContext>
 #include <QOpenGLFramebufferObject>
@@ -36,6 +42,7 @@ private:
 	using ConnectType = typename World::connect_type;
 	using ModelType = typename World::model_type;
 	using modelConn_ptr = unique_ptr<typename World::modelConnect_type>;
+	using Snapshot = WorldSnapshot<Cell>;
 
 	template <typename T = Scenario>
 	void initInterface(const typename std::enable_if<HAS_MEMBER(Scenario, MCV_buttonMap),
@@ -55,12 +62,12 @@ private:
 
 	// Visual elements
 	Camera camera;
-	CellGroup<Cell> cells;
+	CellGroup cells;
 	ConnectionsGroup connections;
 	Skybox skybox;
 	unique_ptr<QOpenGLFramebufferObject> ssaoFBO, msaaFBO, finalFBO, fsaaFBO;
 	QOpenGLFramebufferObjectFormat ssaoFormat, msaaFormat, finalFormat;
-	GLuint depthTex;
+	GLuint depthTex = 0;
 	RenderQuad ssaoTarget;
 	BlurQuad blurTarget;
 	GridViewer gridViewer;
@@ -85,7 +92,20 @@ private:
 	int nbFramesSinceLastTick = 0;
 	QVariantMap stats, guiCtrl;
 	const int fpsRefreshRate = 400;
+	MecaCell::ProfileStats lastProfile; // world's stats at the last fps tick
 	Cell *selectedCell = nullptr;
+	typename World::CellHandle selectedHandle; // checks selectedCell is still alive
+	size_t selectedHint = 0; // selectedCell's last index in the snapshot
+
+	// Asynchronous world (see setAsyncWorld): the world thread updates the world and
+	// publishes a snapshot of it, the render thread draws the latest one
+	bool asyncWorld = false;
+	bool initialized = false; // the world mode can't change anymore
+	std::thread worldThread;
+	std::mutex worldMutex; // held by the world thread during an update
+	std::atomic<bool> worldRunning{false}, asyncUpdate{true}, asyncStep{false};
+	TripleBuffer<Snapshot> snapshots;
+	const Snapshot *snapshot = nullptr; // acquired at sync, drawn until the next one
 
 	// options
 	double BLUR_COEF = 1.0, MSAA_COEF = 4, FSAA_COEF = 20.0;
@@ -96,6 +116,9 @@ private:
 	bool cut = false;
 	bool takeScreen = false;
 	string screenName;
+	FrameCapture frameCapture;
+	string videoCommand; // to start recording with, at the next frame
+	bool stopVideo = false;
 	colorMode cMode;
 
 	void clear() {
@@ -105,7 +128,8 @@ private:
 		GL->glEnable(GL_DEPTH_TEST);
 	}
 
-	// depth texture initialisation
+	// depth texture initialisation. 24 bits, as the fbos' depth renderbuffers: the msaa
+	// fbo's depth is blitted into it, which fails (with the color) on mismatched formats
 	void genDepthTexture(QSize s, GLuint &t) {
 		GL->glGenTextures(1, &t);
 		GL->glBindTexture(GL_TEXTURE_2D, t);
@@ -113,7 +137,7 @@ private:
 		GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		GL->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		GL->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, s.width(), s.height(), 0,
+		GL->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, s.width(), s.height(), 0,
 		                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
 	}
 
@@ -122,9 +146,11 @@ private:
 	 ***********************************/
 	// main paint method, called every frame
 	virtual void paint() {
-		if (loopStep || worldUpdate) {
+		if (asyncWorld) {
+			if (selectedCell && !selectedState()) selectedCell = nullptr;
+		} else if (loopStep || worldUpdate) {
 			scenario.loop();
-			if (!selectedCellStillExists()) selectedCell = nullptr;
+			selectedCell = scenario.getWorld().getCell(selectedHandle);
 			loopStep = false;
 		}
 
@@ -150,9 +176,12 @@ private:
 		}
 		if (gc.contains("cells")) {
 			cells.drawMode = plain;
-			cells.draw(scenario.getWorld().cells, view, projection, camera.getViewVector(),
-			           camera.getPosition(), cMode, selectedCell);
+			drawCells(view, projection);
 		}
+		// the grids aren't part of the snapshot: these debug views wait for the world thread
+		std::unique_lock<std::mutex> gridLock;
+		if (gc.contains("cellGrid") || gc.contains("modelGrid")) gridLock = lockWorld();
+		gridViewer.heatmap = gc.contains("gridOccupancy");
 		if (gc.contains("cellGrid")) {
 			gridViewer.draw(scenario.getWorld().getCellGrid(), view, projection,
 			                QVector4D(0.99, 0.9, 0.4, 1.0));
@@ -162,17 +191,8 @@ private:
 			                QVector4D(0.6, 0.1, 0.1, 1.0));
 		}
 
-		for (auto &m : scenario.getWorld().models) {
-			if (!modelViewers.count(m.first)) {
-				modelViewers[m.first];
-				modelViewers[m.first].load(m.second);
-			}
-		}
-		for (auto &m : modelViewers) {
-			if (scenario.getWorld().models.count(m.first)) {
-				m.second.draw(view, projection, scenario.getWorld().models.at(m.first));
-			}
-		}
+		if (gridLock.owns_lock()) gridLock.unlock();
+		drawModels(view, projection);
 
 		msaaFBO->release();
 		QOpenGLFramebufferObject::blitFramebuffer(ssaoFBO.get(), msaaFBO.get(),
@@ -184,13 +204,21 @@ private:
 		// no ssao from here
 		if (gc.contains("centers")) {
 			cells.drawMode = centers;
-			cells.draw(scenario.getWorld().cells, view, projection, camera.getViewVector(),
-			           camera.getPosition(), cMode, selectedCell);
+			drawCells(view, projection);
 		}
 		if (gc.contains("connections")) {
-			connections.draw<ConnectType>(scenario.getWorld().connections, view, projection);
-			connections.drawModelConnections<Cell>(
-			    scenario.getWorld().cells, view, projection);
+			if (asyncWorld) {
+				connections.drawSegments(snapshot->connections, view, projection,
+				                         QVector4D(0.95, 0.8, 0.1, 1.0));
+				connections.drawSegments(snapshot->modelBounces, view, projection,
+				                         QVector4D(0.9, 0.2, 0.1, 1.0));
+				connections.drawSegments(snapshot->modelAnchors, view, projection,
+				                         QVector4D(0.0, 0.4, 0.8, 1.0));
+			} else {
+				connections.draw<ConnectType>(scenario.getWorld().connections, view, projection);
+				connections.drawModelConnections<Cell>(scenario.getWorld().cells, view,
+				                                       projection);
+			}
 		}
 
 		QOpenGLFramebufferObject::blitFramebuffer(
@@ -201,12 +229,22 @@ private:
 		if (guiCtrl.count("takeScreen")) {
 			stringstream screenshotName;
 			screenshotName << "screen" << frame << ".jpg";
-			fsaaFBO->toImage().save(QString::fromStdString(screenshotName.str()), 0, 97);
+			frameCapture.capture(fsaaFBO.get(), screenshotName.str());
 		}
 		if (takeScreen) {
-			fsaaFBO->toImage().save(QString::fromStdString(screenName), 0, 97);
+			frameCapture.capture(fsaaFBO.get(), screenName);
 			takeScreen = false;
 		}
+		if (stopVideo) {
+			frameCapture.stopVideo();
+			stopVideo = false;
+		}
+		if (!videoCommand.empty()) {
+			frameCapture.startVideo(videoCommand, fsaaFBO->size());
+			videoCommand.clear();
+		}
+		if (frameCapture.isRecording()) frameCapture.capture(fsaaFBO.get(), "");
+		frameCapture.endFrame();
 		GL->glViewport(0, 0, viewportSize.width() * screenCoef,
 		               viewportSize.height() * screenCoef);
 		blurTarget.draw(fsaaFBO->texture(), 5, viewportSize * screenCoef,
@@ -221,9 +259,20 @@ private:
 			stats["fps"] = 1000.0 * (double)nbFramesSinceLastTick / (double)fpsDt.count();
 			nbFramesSinceLastTick = 0;
 			tfps = chrono::high_resolution_clock::now();
+			refreshProfilingStats(asyncWorld ? snapshot->profile :
+			                                   scenario.getWorld().getProfileStats());
+		}
+		if (asyncWorld) {
+			stats["nbCells"] = QVariant((int)snapshot->cells.size());
+			stats["nbUpdates"] = snapshot->nbUpdates;
+			stats["dt"] = snapshot->dt;
+			stats["simulatedTime"] = snapshot->simulatedTime;
+		} else {
+			stats["nbCells"] = QVariant((int)scenario.getWorld().cells.size());
+			stats["nbUpdates"] = scenario.getWorld().getNbUpdates();
+			stats["dt"] = scenario.getWorld().getDt();
+			stats["simulatedTime"] = scenario.getWorld().getSimulatedTime();
 		}
-		stats["nbCells"] = QVariant((int)scenario.getWorld().cells.size());
-		stats["nbUpdates"] = scenario.getWorld().getNbUpdates();
 		if (window) {
 			window->resetOpenGLState();
 		}
@@ -235,14 +284,103 @@ private:
 		if (window) window->update();
 	}
 
+	void drawCells(const QMatrix4x4 &view, const QMatrix4x4 &projection) {
+		if (asyncWorld)
+			cells.draw(snapshot->cells, view, projection, camera.getViewVector(),
+			           camera.getPosition(), cMode, selectedState());
+		else
+			cells.draw(scenario.getWorld().cells, view, projection, camera.getViewVector(),
+			           camera.getPosition(), cMode, selectedCell);
+	}
+
+	void drawModels(const QMatrix4x4 &view, const QMatrix4x4 &projection) {
+		if (asyncWorld) {
+			for (auto &m : snapshot->models) {
+				if (!modelViewers.count(m.first)) {
+					std::lock_guard<std::mutex> lock(worldMutex);
+					if (!scenario.getWorld().models.count(m.first)) continue;
+					modelViewers[m.first].load(scenario.getWorld().models.at(m.first));
+				}
+				modelViewers[m.first].draw(view, projection, m.second);
+			}
+			return;
+		}
+		for (auto &m : scenario.getWorld().models) {
+			if (!modelViewers.count(m.first)) {
+				modelViewers[m.first];
+				modelViewers[m.first].load(m.second);
+			}
+		}
+		for (auto &m : modelViewers) {
+			if (scenario.getWorld().models.count(m.first)) {
+				m.second.draw(view, projection, scenario.getWorld().models.at(m.first));
+			}
+		}
+	}
+
+	// averages per update since the last tick, only when the world is compiled with
+	// MECACELL_PROFILING (its stats stay at zero otherwise)
+	void refreshProfilingStats(const MecaCell::ProfileStats &p) {
+		if (p.nbUpdates < lastProfile.nbUpdates) lastProfile.reset(); // stats were reset
+		double n = static_cast<double>(p.nbUpdates - lastProfile.nbUpdates);
+		if (n == 0) return;
+		QVariantMap phases, counters;
+		for (size_t i = 0; i < MecaCell::ProfileStats::NB_PHASES; ++i)
+			phases[MecaCell::profilePhaseName(static_cast<MecaCell::ProfilePhase>(i))] =
+			    1000.0 * (p.seconds[i] - lastProfile.seconds[i]) / n;
+		for (size_t i = 0; i < MecaCell::ProfileStats::NB_COUNTERS; ++i)
+			counters[MecaCell::profileCounterName(static_cast<MecaCell::ProfileCounter>(i))] =
+			    static_cast<double>(p.counters[i] - lastProfile.counters[i]) / n;
+		stats["updateMs"] = 1000.0 * (p.getTotalSeconds() - lastProfile.getTotalSeconds()) / n;
+		stats["phasesMs"] = phases;
+		stats["counters"] = counters;
+		lastProfile = p;
+	}
+
 	colorMode strToColorMode(const QString &cm) {
 		if (cm == "pressure") return pressure;
 		if (cm == "owncolor") return owncolor;
 	}
 
-	bool selectedCellStillExists() {
-		return (std::find(scenario.getWorld().cells.begin(), scenario.getWorld().cells.end(),
-		                  selectedCell) != scenario.getWorld().cells.end());
+	// locked only in async mode, where the world thread might be updating the world
+	std::unique_lock<std::mutex> lockWorld() {
+		std::unique_lock<std::mutex> lock(worldMutex, std::defer_lock);
+		if (asyncWorld) lock.lock();
+		return lock;
+	}
+
+	// world thread: updates as fast as it can while the world is running (or once per
+	// step request) and publishes a snapshot after each update
+	void worldLoop() {
+		while (worldRunning) {
+			if (asyncUpdate || asyncStep.exchange(false)) {
+				std::lock_guard<std::mutex> lock(worldMutex);
+				scenario.loop();
+				snapshots.getBack().capture(scenario.getWorld());
+				snapshots.publish();
+			} else {
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			}
+		}
+	}
+
+	void startWorldThread() {
+		snapshots.getBack().capture(scenario.getWorld());
+		snapshots.publish();
+		snapshot = &snapshots.acquire();
+		worldRunning = true;
+		worldThread = std::thread(&Renderer<Scenario>::worldLoop, this);
+	}
+
+	void stopWorldThread() {
+		worldRunning = false;
+		if (worldThread.joinable()) worldThread.join();
+	}
+
+	// selectedCell in the snapshot (async mode), matched by selectedHandle's id
+	const typename Snapshot::CellState *selectedState() {
+		if (!selectedCell) return nullptr;
+		return snapshot->find(selectedHandle, selectedHint);
 	}
 
 	/***********************************
@@ -252,6 +390,7 @@ private:
 	virtual void initialize() {
 		scenario.init(argc, argv);
 		initInterface();
+		if (asyncWorld) startWorldThread();
 		// gl functions
 		GL = QOpenGLContext::currentContext()->functions();
 		GL->initializeOpenGLFunctions();
@@ -290,17 +429,22 @@ private:
 		ssaoFBO->release();
 
 		// scenario
+		initialized = true;
 	}
 
 	/***********************************
 	 *           UTILS & SYNC          *
 	 ***********************************/
 	// called when the openGL context is invalidated
-	virtual void cleanupSlot() {}
+	virtual void cleanupSlot() { frameCapture.finish(); }
 
 	// useful for creating a new instance from QSGRenderThread
 	// ugly trick... but hey, it works!
-	virtual SignalSlotRenderer *clone() { return new Renderer<Scenario>(argc, argv); }
+	virtual SignalSlotRenderer *clone() {
+		auto r = new Renderer<Scenario>(argc, argv);
+		r->setAsyncWorld(asyncWorld);
+		return r;
+	}
 
 	// called after every frame, thread safe
 	virtual void sync(SignalSlotBase *b) {
@@ -313,11 +457,20 @@ private:
 		worldUpdate = b->worldUpdate;
 		loopStep = b->loopStep;
 		b->loopStep = false;
+		if (asyncWorld) {
+			asyncUpdate = worldUpdate;
+			if (loopStep) asyncStep = true;
+			loopStep = false;
+			snapshot = &snapshots.acquire();
+		}
 		clickedButtons = b->clickedButtons;
 		b->clickedButtons.clear();
 		// stats
-		if (selectedCell)
-			stats["selectedCell"] = cellToQVMap(selectedCell);
+		const typename Snapshot::CellState *selState = asyncWorld ? selectedState() : nullptr;
+		if (selState)
+			stats["selectedCell"] = cellToQVMap(*selState);
+		else if (selectedCell && !asyncWorld)
+			stats["selectedCell"] = cellToQVMap(*selectedCell);
 		else
 			stats.remove("selectedCell");
 		b->setStats(stats);
@@ -370,15 +523,22 @@ private:
 				QVector4D ray = camera.getViewMatrix().inverted() * rayEye;
 				QVector3D l(ray.x(), ray.y(), ray.z());
 				QVector3D l0 = camera.getPosition();
-				QVector3D p0 = toQV3D(selectedCell->getPosition());
+				const typename Snapshot::CellState *selState =
+				    asyncWorld ? selectedState() : nullptr;
+				QVector3D p0 = toQV3D(selState ? selState->getPosition() :
+				                                 selectedCell->getPosition());
 				QVector3D n = camera.getOrientation();
 				if (QVector3D::dotProduct(l, n) != 0) {
 					float d = (QVector3D::dotProduct((p0 - l0), n)) / QVector3D::dotProduct(l, n);
 					QVector3D projectedPos = l0 + d * l;
 					decltype(selectedCell->getPosition()) newPos(projectedPos.x(), projectedPos.y(),
 					                                             projectedPos.z());
-					selectedCell->setPosition(newPos);
-					selectedCell->resetVelocity();
+					std::unique_lock<std::mutex> lock = lockWorld();
+					// the world thread might have deleted it since the snapshot
+					if (Cell *c = scenario.getWorld().getCell(selectedHandle)) {
+						c->setPosition(newPos);
+						c->resetVelocity();
+					}
 				}
 			}
 		}
@@ -409,6 +569,7 @@ private:
 		for (auto &menu : clickedButtons) {
 			for (auto &label : menu.second) {
 				if (buttonMap.count(menu.first) && buttonMap.at(menu.first).count(label)) {
+					std::unique_lock<std::mutex> lock = lockWorld();
 					buttonMap[menu.first][label](this);
 				}
 			}
@@ -438,18 +599,18 @@ private:
 		ssaoFBO->release();
 	}
 
-	QVariantMap cellToQVMap(Cell *c) {
+	// c: a cell or its snapshot
+	template <typename C> QVariantMap cellToQVMap(const C &c) {
 		QVariantMap res;
-		if (c) {
-			res["Radius"] = c->getRadius();
-			res["Stiffness"] = c->getStiffness();
-			res["Volume"] = c->getVolume();
-			res["Pressure"] = c->getPressure();
-			res["Mass"] = c->getMass();
-			res["Connections"] = c->getNbConnections();
-		}
+		res["Radius"] = c.getRadius();
+		res["Stiffness"] = c.getStiffness();
+		res["Volume"] = c.getVolume();
+		res["Pressure"] = c.getPressure();
+		res["Mass"] = c.getMass();
+		res["Connections"] = c.getNbConnections();
 		return res;
 	}
+
 	void addCuttingPlane() {}
 	void pickCell() {
 		QVector2D mouseNDC(
@@ -463,22 +624,16 @@ private:
 		QVector4D ray = camera.getViewMatrix().inverted() * rayEye;
 		QVector3D vray(ray.x(), ray.y(), ray.z());
 		vray.normalize();
-		Cell *res = nullptr;
-		double minEyeDist = 1e20;
-		for (auto &c : scenario.getWorld().cells) {
-			if (c->getVisible()) {
-				double sqRad = pow(c->getRadius(), 2);
-				QVector3D EC = toQV3D(c->getPosition()) - camera.getPosition();
-				QVector3D EV = vray * QVector3D::dotProduct(EC, vray);
-				double eyeDist = EC.lengthSquared();
-				double rayDist = eyeDist - EV.lengthSquared();
-				if (rayDist <= sqRad && eyeDist < minEyeDist) {
-					minEyeDist = eyeDist;
-					res = c;
-				}
-			}
-		}
-		selectedCell = res;
+		// the first visible cell along the ray (see BasicWorld::rayCast)
+		std::unique_lock<std::mutex> lock = lockWorld();
+		Cell *hit = nullptr;
+		double t;
+		if (!scenario.getWorld().rayCast(
+		        QV3D2Vec(camera.getPosition()), QV3D2Vec(vray), camera.getFarPlane(),
+		        [](Cell *c) { return c->getVisible(); }, hit, t))
+			hit = nullptr;
+		selectedCell = hit;
+		selectedHandle = scenario.getWorld().getHandle(hit);
 	}
 
 	void applyInterfaceAdditions(SignalSlotBase *b) {
@@ -495,12 +650,41 @@ public:
 	explicit Renderer(int c, char **v) : SignalSlotRenderer(), argc(c), argv(v) {
 		clickMethods["select"] = bind(&Renderer<Scenario>::pickCell, this);
 	}
+	~Renderer() { stopWorldThread(); }
+	// runs the world on its own thread, as fast as it can, instead of one update per
+	// frame on the render thread. The renderer then draws the latest snapshot of the world
+	// (see WorldSnapshot). Must be set before the renderer is initialized, ignored after
+	void setAsyncWorld(bool a) {
+		if (!initialized) asyncWorld = a;
+	}
 	Cell *getSelectedCell() { return selectedCell; }
 	Camera &getCameraRef() { return camera; }
+	// the next frame is saved to name, by a worker thread (see FrameCapture)
 	void screenCapture(std::string name) {
 		takeScreen = true;
 		screenName = name;
 	}
+	// from the next frame on, every frame is piped to command, which reads raw RGBA frames
+	// of the viewport's size (in pixels) on its standard input (see
+	// FrameCapture::startVideo)
+	void startVideoCapture(const std::string &command) { videoCommand = command; }
+	void stopVideoCapture() { stopVideo = true; }
+
+	// headless use, without qml nor window (see OffscreenViewer). An openGL context must be
+	// current
+	void initializeOffscreen(const QSize &s, const QStringList &visibleElements) {
+		asyncWorld = false; // there's no sync to publish snapshots at
+		viewportSize = s;
+		initialize();
+		FSAA_COEF = 1.0; // as set by paint without a window, before the fbos are sized
+		setViewportSize(s);
+		guiCtrl["visibleElements"] = visibleElements;
+	}
+	// updates the world once then draws it
+	void renderFrame() { paint(); }
+	// waits for the frames being read back to be handed to the encoders
+	void finishCaptures() { frameCapture.finish(); }
+	Scenario &getScenario() { return scenario; }
 };
 }
 #endif
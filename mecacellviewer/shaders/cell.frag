@@ -1,7 +1,15 @@
 
 uniform sampler2D nmap;
+#ifdef INSTANCED
+in vec3 colorVar;
+in mat3 normalMatrixVar;
+#define color colorVar
+#define NORMAL_MATRIX normalMatrixVar
+#else
 uniform vec3 color;
 uniform mat4 normalMatrix;
+#define NORMAL_MATRIX mat3(normalMatrix)
+#endif
 
 in vec2 texCoordVar;
 in  vec3 objectSpaceNormal;
@@ -38,8 +46,8 @@ void main(){
 
 	mat3 basis = mat3(t,b,n );
 	vec3 eyespaceNormal1 = basis * tangentSpaceNormal; // world -> object space
-	eyespaceNormal1 = normalize( mat3(normalMatrix)*eyespaceNormal1); // object -> eye
-	vec3 eyespaceNormal0 = normalize(mat3(normalMatrix) * objectSpaceNormal);
+	eyespaceNormal1 = normalize( NORMAL_MATRIX*eyespaceNormal1); // object -> eye
+	vec3 eyespaceNormal0 = normalize(NORMAL_MATRIX * objectSpaceNormal);
 
 	float diffuseCoef = min(1.0,max(0.0, abs(dot(eyespaceNormal0, surfaceToCamera)))); //bords noirds, centre blanc
 	float diffuseCoefMap =  min(1.0,max(0.0, abs(dot(eyespaceNormal1, surfaceToCamera)))); //bords noirds, centre blanc, normales perturbées (éclairage caméra)
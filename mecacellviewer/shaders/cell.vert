@@ -1,7 +1,15 @@
-
 uniform mat4 view;
-uniform mat4 model;
 uniform mat4 projection;
+#ifdef INSTANCED
+// per cell: position and radius, rotation (axis, angle) and color
+in vec4 instancePositionRadius;
+in vec4 instanceRotation;
+in vec3 instanceColor;
+out vec3 colorVar;
+out mat3 normalMatrixVar;
+#else
+uniform mat4 model;
+#endif
 
 in vec3 position;
 in vec3 normal;
@@ -16,8 +24,27 @@ out vec3 objectSpaceBitangent;
 out vec3 cameraPosition;
 out highp vec3 surfacePosition;
 
+#ifdef INSTANCED
+// rotation of angle a around the unit axis n
+mat3 rotationMatrix(vec3 n, float a){
+    float c = cos(a), s = sin(a), t = 1.0 - c;
+    return mat3(t * n.x * n.x + c, t * n.x * n.y + s * n.z, t * n.x * n.z - s * n.y,
+                t * n.x * n.y - s * n.z, t * n.y * n.y + c, t * n.y * n.z + s * n.x,
+                t * n.x * n.z + s * n.y, t * n.y * n.z - s * n.x, t * n.z * n.z + c);
+}
+#endif
 
 void main(){
+#ifdef INSTANCED
+    mat3 r = rotationMatrix(normalize(instanceRotation.xyz), instanceRotation.w);
+    // rotation and uniform scale: the normal matrix is the rotation
+    mat4 model = mat4(vec4(r[0] * instancePositionRadius.w, 0.0),
+                      vec4(r[1] * instancePositionRadius.w, 0.0),
+                      vec4(r[2] * instancePositionRadius.w, 0.0),
+                      vec4(instancePositionRadius.xyz, 1.0));
+    normalMatrixVar = r;
+    colorVar = instanceColor;
+#endif
     gl_Position = projection * view * model * vec4(position, 1);
     texCoordVar = texCoord;
     /*eyespaceNormal = normalize(mat3(normalMatrix) * normal);*/
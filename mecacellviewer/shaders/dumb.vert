@@ -5,6 +5,6 @@ out highp vec2 UV;
 
 void main(void){
 	gl_Position = vec4(vertex,1.0);
-	UV = (vertex.xy+highp vec2(1.0,1.0))*0.5;
+	UV = (vertex.xy + vec2(1.0, 1.0)) * 0.5;
 }
 
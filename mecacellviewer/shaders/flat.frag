@@ -1,4 +1,9 @@
+#ifdef INSTANCED
+in vec4 colorVar;
+#define color colorVar
+#else
 uniform vec4 color;
+#endif
 
 in vec2 UV;
 in vec3 surfacePosition;
@@ -37,7 +42,7 @@ void main(){
 	vec3 normal=normalize(cross(X,Y));
 
 
-	vec4 colorLinear;
+	vec4 colorLinear = vec4(0.0);
 
 	for(int i = 0 ; i< nbLights ; ++i){
 
@@ -36,7 +36,7 @@ void main(){
 	vec3 normal = normalize(normalInterp);
 
 
-	vec4 colorLinear;
+	vec4 colorLinear = vec4(0.0);
 
 	for(int i = 0 ; i< nbLights ; ++i){
 
@@ -1,7 +1,16 @@
 uniform mat4 view;
-uniform mat4 model;
 uniform mat4 projection;
+#ifdef INSTANCED
+// per grid cell: integer coordinates and number of objects
+in vec4 instanceCell;
+uniform float cellSize;
+uniform float maxOccupancy; // colors by occupancy when > 0
+uniform vec4 color;
+out vec4 colorVar;
+#else
+uniform mat4 model;
 uniform mat4 normalMatrix;
+#endif
 
 in vec3 position;
 in vec3 normal;
@@ -12,6 +21,18 @@ out vec3 surfacePosition;
 out vec3 normalInterp;
 
 void main(){
+#ifdef INSTANCED
+	// translation and uniform scale: the normals are unchanged
+	float h = 0.5 * cellSize;
+	mat4 model = mat4(vec4(h, 0.0, 0.0, 0.0), vec4(0.0, h, 0.0, 0.0), vec4(0.0, 0.0, h, 0.0),
+	                  vec4(instanceCell.xyz * cellSize, 1.0));
+	mat4 normalMatrix = mat4(1.0);
+	colorVar = color;
+	if (maxOccupancy > 0.0) {
+		float t = clamp(log(1.0 + instanceCell.w) / log(1.0 + maxOccupancy), 0.0, 1.0);
+		colorVar = vec4(mix(vec3(0.1, 0.3, 0.9), vec3(0.95, 0.1, 0.05), t), color.a);
+	}
+#endif
 	UV = texCoord;
 	mat4 mv = view*model;
 	vec4 vertPos4 = mv * vec4(position, 1.0);
@@ -12,6 +12,7 @@ void main(){
 	/*finalColor = texture(tex,UV)*fColor;*/
 	vec2 uv = UV-0.5f;
    float sql = uv.x*uv.x + uv.y*uv.y;
+	if (sql >= 0.25f) discard; // no depth outside of the disc
 	finalColor = sql < 0.25f ? mix(vec4(fColor.rgb*fColor.rgb,fColor.a),fColor,sql*4.0f) : vec4(0.0);
 }
 
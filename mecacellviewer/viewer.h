@@ -18,6 +18,7 @@
 using namespace std;
 namespace MecacellViewer {
 template <typename Scenario> class Viewer {
+	bool asyncWorld = false;
 
 public:
 	Viewer() {
@@ -35,6 +36,10 @@ public:
 #endif
 	};
 
+	// updates the world on its own thread instead of once per frame (see
+	// Renderer::setAsyncWorld)
+	void setAsyncWorld(bool a) { asyncWorld = a; }
+
 	int exec(int argc, char **argv) {
 		QGuiApplication app(argc, argv);
 		app.setQuitOnLastWindowClosed(true);
@@ -44,7 +49,9 @@ public:
 		view.setResizeMode(QQuickView::SizeRootObjectToView);
 		QObject *root = view.rootObject();
 		SignalSlotBase *ssb = root->findChild<SignalSlotBase *>("renderer");
-		unique_ptr<SignalSlotRenderer> r = unique_ptr<Renderer<Scenario>>(new Renderer<Scenario>(argc, argv));
+		Renderer<Scenario> *renderer = new Renderer<Scenario>(argc, argv);
+		renderer->setAsyncWorld(asyncWorld);
+		unique_ptr<SignalSlotRenderer> r = unique_ptr<Renderer<Scenario>>(renderer);
 		view.rootContext()->setContextProperty("glview", ssb);
 		ssb->init(r);
 		view.show();
@@ -6,7 +6,7 @@
 #include "viewtools.h"
 bool culling = false;
 QOpenGLFunctions *GL = nullptr;
-QString shaderWithHeader(QString filename) {
+QString shaderWithHeader(QString filename, QString defines) {
 	int majorV = QOpenGLContext::currentContext()->format().majorVersion();
 	int minorV = QOpenGLContext::currentContext()->format().minorVersion();
 	bool needCore = true;
@@ -36,7 +36,8 @@ QString shaderWithHeader(QString filename) {
 	QFile f(filename);
 	if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) qDebug() << "unable to open " << filename << endl;
 	QTextStream in(&f);
-	QString res = QString("#version ") + version + core + QString("\n") + in.readAll();
+	QString res = QString("#version ") + version + core + QString("\n") + defines;
+	res += in.readAll();
 	return res;
 }
 void initResources() { Q_INIT_RESOURCE(resourcesLibMecacellViewer); }
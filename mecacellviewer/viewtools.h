@@ -9,7 +9,8 @@
 extern bool culling;
 extern QOpenGLFunctions *GL;
 template <typename V> QVector3D toQV3D(const V &v) { return QVector3D(v.x, v.y, v.z); }
-QString shaderWithHeader(QString filename);
+// the shader's source after the #version line and the given #defines
+QString shaderWithHeader(QString filename, QString defines = "");
 void initResources();
 inline double radToDeg(double x) { return x / M_PI * 180; }
 template <typename T> T mix(T m, T M, double v) { return (1.0 - v) * m + v * M; }
@@ -0,0 +1,146 @@
+#ifndef WORLDSNAPSHOT_HPP
+#define WORLDSNAPSHOT_HPP
+#include <QMatrix4x4>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../mecacell/profiling.hpp"
+#include "model.hpp"
+#include "viewtools.h"
+
+namespace MecacellViewer {
+// What the renderer reads of the world when the world runs on its own thread (see
+// Renderer::setAsyncWorld): copied by the simulation thread after an update, then drawn
+// by the render thread without touching the world.
+template <typename Cell> struct WorldSnapshot {
+	using Vec = decltype(((Cell *)nullptr)->getPosition());
+	using Rotation = decltype(((Cell *)nullptr)->getOrientationRotation());
+
+	// a cell as drawn and as shown in the selected cell's stats. Its getters mirror the
+	// cell's, so that the same drawing code works for both
+	struct CellState {
+		Vec position;
+		Rotation rotation;
+		double radius, stiffness, pressure, normalizedPressure, mass;
+		float color[3];
+		int nbConnections;
+		bool visible;
+		uint64_t id; // the cell's id: identifies it (e.g. for the selection) even when a
+		             // new cell is allocated at a dead one's address
+
+		Vec getPosition() const { return position; }
+		Rotation getOrientationRotation() const { return rotation; }
+		double getRadius() const { return radius; }
+		double getStiffness() const { return stiffness; }
+		double getVolume() const { return (4.0 / 3.0) * M_PI * radius * radius * radius; }
+		double getPressure() const { return pressure; }
+		double getNormalizedPressure() const { return normalizedPressure; }
+		double getMass() const { return mass; }
+		double getColor(unsigned int i) const { return i < 3 ? color[i] : 0; }
+		int getNbConnections() const { return nbConnections; }
+		bool getVisible() const { return visible; }
+	};
+
+	std::vector<CellState> cells;
+	// segments (2 x 3 floats each): connections, and the cell - model contacts
+	std::vector<float> connections, modelBounces, modelAnchors;
+	std::vector<std::pair<std::string, QMatrix4x4>> models; // name, model matrix
+	int nbUpdates = 0;
+	double dt = 0, simulatedTime = 0;
+	MecaCell::ProfileStats profile;
+
+	static void addSegment(std::vector<float> &v, const Vec &a, const Vec &b) {
+		const float s[6] = {static_cast<float>(a.x), static_cast<float>(a.y),
+		                    static_cast<float>(a.z), static_cast<float>(b.x),
+		                    static_cast<float>(b.y), static_cast<float>(b.z)};
+		v.insert(v.end(), s, s + 6);
+	}
+
+	// the buffers are reused from one capture to the next
+	template <typename World> void capture(World &w) {
+		cells.resize(w.cells.size());
+		for (size_t i = 0; i < w.cells.size(); ++i) {
+			Cell *c = w.cells[i];
+			CellState &s = cells[i];
+			s.position = c->getPosition();
+			s.rotation = c->getOrientationRotation();
+			s.radius = c->getRadius();
+			s.stiffness = c->getStiffness();
+			s.pressure = c->getPressure();
+			s.normalizedPressure = c->getNormalizedPressure();
+			s.mass = c->getMass();
+			for (unsigned int k = 0; k < 3; ++k) s.color[k] = c->getColor(k);
+			s.nbConnections = c->getNbConnections();
+			s.visible = c->getVisible();
+			s.id = c->getId();
+		}
+		connections.clear();
+		for (auto &con : w.connections)
+			addSegment(connections, con->getNode0()->getPosition(),
+			           con->getNode1()->getPosition());
+		modelBounces.clear();
+		modelAnchors.clear();
+		for (auto &c : w.cells)
+			for (auto &con : c->getRWModelConnections()) {
+				addSegment(modelBounces, con->bounce.getNode0().getPosition(),
+				           con->bounce.getNode1()->getPosition());
+				addSegment(modelAnchors, con->anchor.getNode0().getPosition(),
+				           con->anchor.getNode1()->getPosition());
+			}
+		models.clear();
+		for (auto &m : w.models) models.emplace_back(m.first, modelMatrix(m.second));
+		nbUpdates = w.getNbUpdates();
+		dt = w.getDt();
+		simulatedTime = w.getSimulatedTime();
+		profile = w.getProfileStats();
+	}
+
+	// the handle's cell (see BasicWorld::CellHandle), matched by id.
+	// hint: its index in the last snapshot it was found in. The order of the cells rarely
+	// changes from one update to the next, so it is usually found right away
+	template <typename Handle> const CellState *find(const Handle &h, size_t &hint) const {
+		if (!h.cell) return nullptr;
+		if (hint < cells.size() && cells[hint].id == h.id) return &cells[hint];
+		for (size_t i = 0; i < cells.size(); ++i)
+			if (cells[i].id == h.id) {
+				hint = i;
+				return &cells[i];
+			}
+		return nullptr;
+	}
+};
+
+// Lets a writer thread publish complete values that a reader thread takes whenever it
+// wants: the writer fills the back buffer then publishes it, the reader acquires the
+// latest published one. Neither waits for the other beyond the swap of two indexes.
+template <typename T> class TripleBuffer {
+private:
+	T buffers[3];
+	size_t front = 0, ready = 1, back = 2;
+	bool fresh = false; // ready holds a value the reader hasn't taken yet
+	std::mutex mtx;
+
+public:
+	// writer side
+	T &getBack() { return buffers[back]; }
+	void publish() {
+		std::lock_guard<std::mutex> lock(mtx);
+		std::swap(back, ready);
+		fresh = true;
+	}
+
+	// reader side: the latest published value, the same one until a newer is published
+	const T &acquire() {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (fresh) {
+			std::swap(front, ready);
+			fresh = false;
+		}
+		return buffers[front];
+	}
+};
+}
+#endif
@@ -1,4 +1,5 @@
 #include "../mecacell/mecacell.h"
+#include "../mecacell/paddedvector.hpp"
 #define CATCH_CONFIG_MAIN // This tells Catch to provide a main() - only do this in one cpp file
 #include "catch.hpp"
 
@@ -20,4 +21,1561 @@ TEST_CASE("Trigo, vectors & rotations") {
 	REQUIRE(closestDistToTriangleEdge(a, b, c, Vec(-11, -5, 2)) == 1);
 	REQUIRE(doubleEq(closestDistToTriangleEdge(a, b, c, Vec(-7, -6.3, 2)), 1.3));
 	REQUIRE(doubleEq(closestDistToTriangleEdge(a, b, c, Vec(-7, -6.3, 3)), sqrt(1.0 + 1.3 * 1.3)));
+
+	// constant expressions (header-only arithmetic)
+#if MECACELL_INLINE_VEC
+	static_assert(Vec(1, 2, 3).cross(Vec(4, 5, 6)) == Vec(-3, 6, -3), "constexpr cross");
+	static_assert((2.0 * Vec(1, 2, 3) - Vec(1)).sqlength() == 35, "constexpr arithmetic");
+#endif
+	PaddedVec pa(a), pb(b);
+	REQUIRE((pb - pa).toVec() == b - a);
+	REQUIRE((pb - pa).length() == (b - a).length());
+	REQUIRE(pa.dot(pb) == a.dot(b));
+}
+
+class TestCell : public ConnectableCell<TestCell> {
+public:
+	using ConnectableCell<TestCell>::ConnectableCell;
+	double getAdhesionWith(const TestCell *) { return 0.9; }
+	TestCell *updateBehavior(double) { return nullptr; }
+};
+
+template <typename I = Verlet>
+double runTestWorld(size_t nbThreads, int nbFrames = 50, bool soa = false,
+                    bool batched = false, bool incrementalGrid = false, bool fused = false) {
+	BasicWorld<TestCell, I> w;
+	w.setIncrementalGrid(incrementalGrid);
+	w.setFusedPasses(fused);
+	w.setNbThreads(nbThreads);
+	w.setSoAIntegration(soa);
+	w.setBatchedForces(batched);
+	std::default_random_engine rnd(42);
+	std::uniform_real_distribution<double> dist(-150, 150);
+	for (int i = 0; i < 200; ++i) w.addCell(new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd))));
+	for (int f = 0; f < nbFrames; ++f) w.update();
+	double res = 0;
+	for (auto &c : w.cells) res += c->getPosition().sqlength() + c->getVelocity().sqlength();
+	return res;
+}
+
+TEST_CASE("Parallel world update") {
+	double ref = runTestWorld(2);
+	REQUIRE(ref == runTestWorld(3));
+	REQUIRE(ref == runTestWorld(4));
+	REQUIRE(runTestWorld(1) == runTestWorld(1));
+	REQUIRE(ref == runTestWorld(1, 50, false, true)); // same batches, serially
+}
+
+TEST_CASE("Resized thread pool") {
+	ThreadPool pool(2);
+	for (size_t n = 2; n < 12; ++n) {
+		vector<int> count(1000, 0);
+		pool.parallelFor(count.size(), [&](size_t i) { ++count[i]; });
+		pool.resize(n % 5 + 2); // new workers don't run the previous job again
+		pool.parallelFor(count.size(), [&](size_t i) { ++count[i]; });
+		for (auto c : count) REQUIRE(c == 2);
+	}
+	auto run = [](bool resized) {
+		BasicWorld<TestCell, Verlet> w;
+		w.setNbThreads(resized ? 2 : 4);
+		std::default_random_engine rnd(42);
+		std::uniform_real_distribution<double> dist(-150, 150);
+		for (int i = 0; i < 200; ++i)
+			w.addCell(new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd))));
+		w.update();
+		w.setNbThreads(4);
+		for (int f = 0; f < 20; ++f) w.update();
+		double res = 0;
+		for (auto &c : w.cells) res += c->getPosition().sqlength() + c->getNbConnections();
+		return res;
+	};
+	REQUIRE(run(true) == run(false));
+}
+
+TEST_CASE("Incremental cell grid") {
+	REQUIRE(runTestWorld(1, 100) == runTestWorld(1, 100, false, false, true));
+	REQUIRE(runTestWorld(2, 100) == runTestWorld(2, 100, false, false, true));
+}
+
+// Verlet without its batch version
+struct CellVerlet {
+	template <typename C> void operator()(C &c, const double &dt) { Verlet()(c, dt); }
+};
+
+TEST_CASE("SoA integration") {
+	REQUIRE(runTestWorld(1) == runTestWorld(1, 50, true));
+	REQUIRE(runTestWorld(3) == runTestWorld(3, 50, true));
+	REQUIRE(runTestWorld<Euler>(1) == runTestWorld<Euler>(1, 50, true));
+	// not enabled without a batch version
+	BasicWorld<TestCell, CellVerlet> w;
+	w.setSoAIntegration(true);
+	REQUIRE(!w.getSoAIntegration());
+	REQUIRE(runTestWorld<CellVerlet>(1, 50, true) == runTestWorld(1));
+}
+
+// highest cell speed while a compressed cluster relaxes for 20 time units, from steps
+// of dt
+template <typename C, typename I> double relaxationMaxSpeed(BasicWorld<C, I> &w, double dt) {
+	w.setDt(dt);
+	for (int i = 0; i < 27; ++i)
+		w.addCell(new C(Vec(28.0 * (i % 3), 28.0 * (i / 3 % 3), 28.0 * (i / 9))));
+	double v = 0;
+	while (w.getSimulatedTime() < 20.0 - 1e-9) {
+		w.update();
+		for (auto &c : w.cells) v = max(v, c->getVelocity().length());
+	}
+	return v;
+}
+
+TEST_CASE("Multi rate integration") {
+	BasicWorld<TestCell, Verlet> fine, coarse;
+	BasicWorld<TestCell, MultiRate<Verlet>> single, substeps, soaSubsteps;
+	single.getIntegrator().nbSubsteps = 1;
+	soaSubsteps.setSoAIntegration(true);
+	double ref = relaxationMaxSpeed(fine, 0.02);
+	double coarseSpeed = relaxationMaxSpeed(coarse, 0.1);
+	REQUIRE(relaxationMaxSpeed(single, 0.1) == coarseSpeed);
+	// 4 substeps of 0.025 stay close to steps of 0.02, steps of 0.1 blow up
+	double subSpeed = relaxationMaxSpeed(substeps, 0.1);
+	REQUIRE(abs(subSpeed - ref) < 0.1 * ref);
+	REQUIRE(coarseSpeed > 5.0 * ref);
+	REQUIRE(relaxationMaxSpeed(soaSubsteps, 0.1) == subSpeed);
+	// the prevposition is the position before the whole update
+	vector<Vec> before;
+	for (auto &c : substeps.cells) before.push_back(c->getPosition());
+	substeps.setG(Vec(0, -1, 0));
+	substeps.update();
+	for (size_t i = 0; i < before.size(); ++i) {
+		REQUIRE(substeps.cells[i]->getPrevposition() == before[i]);
+		REQUIRE(substeps.cells[i]->getPosition() != before[i]);
+	}
+}
+
+TEST_CASE("Adaptive dt") {
+	// the same relaxation for 20 time units, at a fixed and at an adaptive dt
+	BasicWorld<TestCell, Verlet> fixed, adaptive;
+	BasicWorld<TestCell, MultiRate<Verlet>> adaptiveSubsteps;
+	adaptiveSubsteps.getIntegrator().nbSubsteps = 8;
+	adaptive.setAdaptiveDt(true, 0.001, 1.0);
+	adaptiveSubsteps.setAdaptiveDt(true, 0.001, 1.0);
+	double ref = relaxationMaxSpeed(fixed, 0.02);
+	REQUIRE(abs(relaxationMaxSpeed(adaptive, 0.02) - ref) < 0.1 * ref);
+	REQUIRE(abs(relaxationMaxSpeed(adaptiveSubsteps, 0.02) - ref) < 0.1 * ref);
+	REQUIRE(doubleEq(fixed.getSimulatedTime(), 20.0));
+	REQUIRE(adaptive.getSimulatedTime() >= 20.0);
+	REQUIRE(adaptive.getNbUpdates() < 0.75 * fixed.getNbUpdates());
+	REQUIRE(adaptiveSubsteps.getNbUpdates() < 0.2 * fixed.getNbUpdates());
+	REQUIRE((adaptive.getDt() >= 0.001 && adaptive.getDt() <= 1.0));
+}
+
+TEST_CASE("Compute backend") {
+	BasicWorld<TestCell, Verlet> ref, device, deviceThreads;
+	BasicWorld<TestCell, MultiRate<Verlet>> deviceSubsteps;
+	device.setComputeBackend(new HostBackend());
+	deviceThreads.setComputeBackend(new HostBackend(3));
+	deviceSubsteps.setComputeBackend(new HostBackend());
+	double refSpeed = relaxationMaxSpeed(ref, 0.02);
+	double speed = relaxationMaxSpeed(device, 0.02);
+	REQUIRE(abs(speed - refSpeed) < 0.1 * refSpeed);
+	REQUIRE(relaxationMaxSpeed(deviceThreads, 0.02) == speed);
+	for (size_t i = 0; i < device.cells.size(); ++i)
+		REQUIRE(device.cells[i]->getPosition() == deviceThreads.cells[i]->getPosition());
+	// the substeps run on the backend too
+	REQUIRE(abs(relaxationMaxSpeed(deviceSubsteps, 0.1) - refSpeed) < 0.1 * refSpeed);
+}
+
+// grows and divides 3 times along directions of its own, the mother may then die
+class DividingCell : public ConnectableCell<DividingCell> {
+public:
+	using ConnectableCell<DividingCell>::ConnectableCell;
+	int generation = 0;
+	double getAdhesionWith(const DividingCell *) { return 0.9; }
+	DividingCell *updateBehavior(double) {
+		if (generation >= 3) return nullptr;
+		grow(0.05 + 0.01 * (generation % 3));
+		if (getRelativeVolume() < 2.0) return nullptr;
+		Vec p = getPosition();
+		DividingCell *c = divide(Vec(sin(p.x), cos(p.y), sin(p.z + 1.0)));
+		c->generation = ++generation;
+		if (generation == 3 && static_cast<int>(p.x) % 2 == 0) die();
+		return c;
+	}
+};
+
+// same divisions, but the growth depends on a signal exchanged with the neighbours
+class SignalingCell : public ConnectableCell<SignalingCell> {
+public:
+	using ConnectableCell<SignalingCell>::ConnectableCell;
+	int generation = 0;
+	double signal = 1.0, publishedSignal = 1.0;
+	double getAdhesionWith(const SignalingCell *) { return 0.9; }
+	void publishState() {
+		ConnectableCell<SignalingCell>::publishState();
+		publishedSignal = signal;
+	}
+	SignalingCell *updateBehavior(double) {
+		double s = 0;
+		for (auto &n : getConnectedCells())
+			s += n->publishedSignal * n->getPublishedState().radius / getRadius();
+		signal = 0.5 * signal + 0.1 * s;
+		if (generation >= 3) return nullptr;
+		grow(0.03 + 0.02 * tanh(signal));
+		if (getRelativeVolume() < 2.0) return nullptr;
+		Vec p = getPosition();
+		SignalingCell *c = divide(Vec(sin(p.x), cos(p.y), sin(p.z + 1.0)));
+		c->generation = ++generation;
+		c->signal = 0;
+		return c;
+	}
+};
+
+// grows and divides 3 times at random rates and along random directions
+class RandomCell : public ConnectableCell<RandomCell> {
+public:
+	using ConnectableCell<RandomCell>::ConnectableCell;
+	int generation = 0;
+	double getAdhesionWith(const RandomCell *) { return 0.9; }
+	RandomCell *updateBehavior(double) {
+		if (generation >= 3) return nullptr;
+		grow(getRandomStream().uniform(0.03, 0.07));
+		if (getRelativeVolume() < 2.0) return nullptr;
+		RandomCell *c = divide();
+		c->generation = ++generation;
+		if (generation == 3 && getRandomStream().uniform() < 0.3) die();
+		return c;
+	}
+};
+
+template <typename C = DividingCell>
+double runDividingWorld(size_t nbThreads, bool parallelBehavior, uint64_t seed = 1) {
+	BasicWorld<C, Verlet> w;
+	w.setNbThreads(nbThreads);
+	w.setRandomSeed(seed);
+	w.setBatchedForces(true); // same forces for any nb of threads
+	w.setParallelBehavior(parallelBehavior);
+	for (int i = 0; i < 20; ++i)
+		w.addCell(new C(Vec(60.0 * (i % 4), 60.0 * (i / 4 % 3), 40.0 * (i / 12))));
+	for (int f = 0; f < 100; ++f) w.update();
+	REQUIRE(w.cells.size() > 100);
+	double res = 0;
+	for (auto &c : w.cells) res += c->getPosition().sqlength() + c->getRadius();
+	return res;
+}
+
+TEST_CASE("Parallel behaviours") {
+	double ref = runDividingWorld(1, false);
+	REQUIRE(ref == runDividingWorld(1, true));
+	REQUIRE(ref == runDividingWorld(3, false));
+	REQUIRE(ref == runDividingWorld(3, true));
+	// behaviours reading their neighbours' published state
+	double signaling = runDividingWorld<SignalingCell>(1, true);
+	REQUIRE(signaling == runDividingWorld<SignalingCell>(2, true));
+	REQUIRE(signaling == runDividingWorld<SignalingCell>(4, true));
+}
+
+TEST_CASE("Random streams") {
+	// Random123's known answers
+	auto b = philox4x32({{0, 0, 0, 0}}, {{0, 0}});
+	REQUIRE((b[0] == 0x6627e8d5 && b[1] == 0xe169c58d && b[2] == 0xbc57ac4c &&
+	         b[3] == 0x9b00dbd8));
+	b = philox4x32({{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}},
+	               {{0xffffffff, 0xffffffff}});
+	REQUIRE((b[0] == 0x408f276d && b[1] == 0x41c83b0e && b[2] == 0xa20bc7c6 &&
+	         b[3] == 0x6d5451fd));
+	RandomStream s0(42, 7, 3), s1(42, 7, 3), s2(42, 8, 3);
+	bool allSame = true, allDifferent = true;
+	for (int i = 0; i < 1000; ++i) {
+		double u0 = s0.uniform(), u1 = s1.uniform(), u2 = s2.uniform();
+		REQUIRE((u0 >= 0 && u0 < 1));
+		allSame = allSame && u0 == u1;
+		allDifferent = allDifferent && u0 != u2;
+		REQUIRE(doubleEq(s0.unitVector().length(), 1.0));
+		s1.unitVector();
+	}
+	REQUIRE(allSame);
+	REQUIRE(allDifferent);
+	s0.reset(42, 7, 3);
+	s1.reset(42, 7, 3);
+	REQUIRE(s0.normal() == s1.normal());
+	// random behaviours: the same draws for any nb of threads
+	double ref = runDividingWorld<RandomCell>(1, false);
+	REQUIRE(ref == runDividingWorld<RandomCell>(1, true));
+	REQUIRE(ref == runDividingWorld<RandomCell>(2, true));
+	REQUIRE(ref == runDividingWorld<RandomCell>(4, true));
+	REQUIRE(ref != runDividingWorld<RandomCell>(1, false, 2));
+}
+
+// grows and divides 3 times along directions depending on its position; its
+// generation is saved with its state, as it is sent from one rank to another
+class MigratingCell : public ConnectableCell<MigratingCell> {
+public:
+	using ConnectableCell<MigratingCell>::ConnectableCell;
+	int generation = 0;
+	double getAdhesionWith(const MigratingCell *) { return 0.9; }
+	MigratingCell *updateBehavior(double) {
+		if (generation >= 3) return nullptr;
+		grow(0.04);
+		if (getRelativeVolume() < 2.0) return nullptr;
+		Vec p = getPosition();
+		MigratingCell *c = divide(Vec(0.5 + sin(p.y), cos(p.x), sin(p.z + 1.0)));
+		c->generation = ++generation;
+		return c;
+	}
+	template <typename W> void saveState(W &w) const {
+		ConnectableCell<MigratingCell>::saveState(w);
+		w.put(generation);
+	}
+	template <typename R> void loadState(R &r) {
+		ConnectableCell<MigratingCell>::loadState(r);
+		r.get(generation);
+	}
+};
+
+struct RankResult {
+	vector<uint64_t> ids;
+	double sumX = 0, sumRadius = 0, checksum = 0;
+	size_t nbConnections = 0, nbGhosts = 0, nbMigrations = 0, nbOutOfSlab = 0;
+};
+
+// a row of cells added on rank 0, each rank on its own thread
+vector<RankResult> runDistributedWorld(int nbRanks, int nbFrames) {
+	LocalCommunicatorGroup group(nbRanks);
+	vector<RankResult> res(nbRanks);
+	vector<std::thread> threads;
+	for (int rk = 0; rk < nbRanks; ++rk)
+		threads.emplace_back([&, rk]() {
+			DistributedWorld<MigratingCell, Verlet> w(group.get(rk));
+			w.getLocalWorld().setRandomSeed(1);
+			w.setLoadBalancingPeriod(10);
+			for (int i = 0; rk == 0 && i < 24; ++i)
+				w.addCell(new MigratingCell(Vec(50.0 * i, 30.0 * (i % 2), 30.0 * (i % 3))));
+			for (int f = 0; f < nbFrames; ++f) w.update();
+			RankResult &r = res[rk];
+			for (auto &c : w.getOwnedCells()) {
+				r.ids.push_back(c->getId());
+				r.sumX += c->getPosition().x;
+				r.sumRadius += c->getRadius();
+				r.checksum += c->getPosition().sqlength() + c->getRadius();
+				r.nbConnections += c->getNbConnections();
+				double x = c->getPosition().x;
+				if (x < w.getSlabLow(rk) - DEFAULT_CELL_RADIUS ||
+				    x > w.getSlabHigh(rk) + DEFAULT_CELL_RADIUS)
+					++r.nbOutOfSlab;
+			}
+			r.nbGhosts = w.getNbGhostCells();
+			r.nbMigrations = w.getNbMigrations();
+		});
+	for (auto &t : threads) t.join();
+	return res;
+}
+
+TEST_CASE("Ensemble of worlds") {
+	using W = BasicWorld<RandomCell, Verlet>;
+	const char *path = "ensemble_test_plane.obj";
+	{
+		std::ofstream obj(path);
+		obj << "vn 0 1 0\nv -500 -30 -500\nv 500 -30 -500\nv 500 -30 500\nv -500 -30 500\n"
+		    << "f 1//1 2//1 3//1\nf 1//1 3//1 4//1\n";
+	}
+	// worlds of different viscosities
+	auto populate = [](W &w, size_t i) {
+		w.setBatchedForces(true);
+		w.setViscosityCoef(0.001 * (i + 1));
+		for (int c = 0; c < 20; ++c)
+			w.addCell(new RandomCell(Vec(60.0 * (c % 4), 60.0 * (c / 4 % 3), 40.0 * (c / 12))));
+	};
+	auto checksum = [](W &w) {
+		double res = 0;
+		for (auto &c : w.cells) res += c->getPosition().sqlength() + c->getRadius();
+		return res;
+	};
+	Ensemble<W> serial(1, 9), parallel(3, 9);
+	serial.addModel("plane", path);
+	for (size_t i = 0; i < 6; ++i) {
+		populate(serial.addWorld(), i);
+		populate(parallel.addWorld(), i);
+	}
+	parallel.addModel("plane", path);
+	parallel.setSliceSize(3);
+	// the third world stops at its 20th update
+	auto stop = [](W &w, size_t i) { return i == 2 && w.getNbUpdates() == 20; };
+	serial.setStopCondition(stop);
+	parallel.setStopCondition(stop);
+	serial.run(60);
+	parallel.run(60);
+	for (size_t i = 0; i < 6; ++i) {
+		REQUIRE(serial.getSeed(i) == parallel.getSeed(i));
+		REQUIRE(serial[i].getNbUpdates() == (i == 2 ? 20 : 60));
+		REQUIRE(parallel.isStopped(i) == (i == 2));
+		REQUIRE(checksum(serial[i]) == checksum(parallel[i]));
+		REQUIRE(serial[i].models.at("plane").mesh == parallel[0].models.at("plane").mesh);
+	}
+	REQUIRE(serial.getSeed(0) != serial.getSeed(1));
+	// as if the world ran alone
+	W alone;
+	alone.setRandomSeed(serial.getSeed(4));
+	alone.addModel("plane", path);
+	populate(alone, 4);
+	for (int f = 0; f < 60; ++f) alone.update();
+	REQUIRE(checksum(alone) == checksum(serial[4]));
+	std::remove(path);
+}
+
+TEST_CASE("Distributed world") {
+	// a single rank is the local world
+	BasicWorld<MigratingCell, Verlet> serial;
+	serial.setRandomSeed(1);
+	for (int i = 0; i < 24; ++i)
+		serial.addCell(new MigratingCell(Vec(50.0 * i, 30.0 * (i % 2), 30.0 * (i % 3))));
+	for (int f = 0; f < 150; ++f) serial.update();
+	REQUIRE(serial.cells.size() == 24 * 8);
+	double serialChecksum = 0, serialX = 0;
+	size_t serialConnections = 0;
+	for (auto &c : serial.cells) {
+		serialChecksum += c->getPosition().sqlength() + c->getRadius();
+		serialX += c->getPosition().x;
+		serialConnections += c->getNbConnections();
+	}
+	auto one = runDistributedWorld(1, 150);
+	REQUIRE(one[0].checksum == serialChecksum);
+	REQUIRE(one[0].nbGhosts == 0);
+	for (int nbRanks : {2, 3}) {
+		auto ranks = runDistributedWorld(nbRanks, 150);
+		vector<uint64_t> ids;
+		double sumX = 0;
+		size_t nbConnections = 0, nbMigrations = 0, nbGhosts = 0;
+		for (auto &r : ranks) {
+			REQUIRE(r.nbOutOfSlab == 0);
+			REQUIRE(r.ids.size() > serial.cells.size() / (2 * nbRanks)); // balanced
+			ids.insert(ids.end(), r.ids.begin(), r.ids.end());
+			sumX += r.sumX;
+			nbConnections += r.nbConnections;
+			nbMigrations += r.nbMigrations;
+			nbGhosts += r.nbGhosts;
+		}
+		// every cell divided 3 times, and is owned by a single rank
+		REQUIRE(ids.size() == serial.cells.size());
+		std::sort(ids.begin(), ids.end());
+		REQUIRE(std::unique(ids.begin(), ids.end()) == ids.end());
+		REQUIRE(nbMigrations > 24 * (nbRanks - 1) / nbRanks); // not only the first ones
+		REQUIRE(nbGhosts > 0);
+		// the same tissue as the serial world
+		REQUIRE(abs(sumX - serialX) / ids.size() < 0.25 * DEFAULT_CELL_RADIUS);
+		REQUIRE(abs(static_cast<double>(nbConnections) - serialConnections) <
+		        0.05 * serialConnections);
+	}
+}
+
+struct GridTestObj {
+	Vec p;
+	double r;
+	Vec getPosition() const { return p; }
+	double getRadius() const { return r; }
+};
+
+TEST_CASE("FlatGrid matches Grid") {
+	std::default_random_engine rnd(7);
+	std::uniform_real_distribution<double> dist(-300, 300);
+	std::uniform_real_distribution<double> rdist(5, 60);
+	vector<GridTestObj> objs(300);
+	for (auto &o : objs) o = {Vec(dist(rnd), dist(rnd), dist(rnd)), rdist(rnd)};
+	Grid<GridTestObj *> g(50);
+	FlatGrid<GridTestObj *> fg(50);
+	for (int pass = 0; pass < 2; ++pass) { // second pass reuses the flat grid's buffers
+		g.clear();
+		fg.clear();
+		for (auto &o : objs) {
+			g.insert(&o);
+			fg.insert(&o);
+		}
+		for (auto &o : objs) REQUIRE(g.retrieve(&o) == fg.retrieve(&o));
+		REQUIRE(g.retrieveUnique(Vec::zero(), 120) == fg.retrieveUnique(Vec::zero(), 120));
+		REQUIRE(g.getVolume() == fg.getVolume());
+		REQUIRE(g.computeSurface() == fg.computeSurface());
+		std::map<std::tuple<int, int, int>, size_t> gBuckets, fgBuckets;
+		g.forEachBucket([&](int i, int j, int k, size_t n) {
+			gBuckets[std::make_tuple(i, j, k)] = n;
+		});
+		fg.forEachBucket([&](int i, int j, int k, size_t n) {
+			fgBuckets[std::make_tuple(i, j, k)] = n;
+		});
+		REQUIRE(gBuckets == fgBuckets);
+		REQUIRE(gBuckets.size() == g.getContent().size());
+		for (auto &o : objs) o.p += Vec(10, -5, 3);
+	}
+	// the grids' box iteration visits the grid cells iterateTo visits, in the same order
+	vector<Vec> viaVec, viaSpan;
+	Vec(-2.6, 0.4, 1.5).iterateTo(Vec(1.2, 2.5, 3.49), [&](const Vec &v) { viaVec.push_back(v); });
+	GridSpan(Vec(-2.6, 0.4, 1.5), Vec(1.2, 2.5, 3.49)).forEach([&](int i, int j, int k) {
+		viaSpan.push_back(Vec(i, j, k));
+	});
+	REQUIRE(viaVec.size() == 5 * 3 * 2);
+	REQUIRE(viaVec == viaSpan);
+}
+
+TEST_CASE("Incremental FlatGrid updates") {
+	// a grid whose objects are moved in place matches a grid refilled from scratch,
+	// including the order of the objects in each grid cell
+	std::default_random_engine rnd(11);
+	std::uniform_real_distribution<double> dist(-300, 300);
+	std::uniform_real_distribution<double> rdist(5, 60);
+	std::uniform_real_distribution<double> step(-30, 30);
+	vector<GridTestObj> objs(300);
+	vector<GridSpan> spans(objs.size());
+	for (auto &o : objs) o = {Vec(dist(rnd), dist(rnd), dist(rnd)), rdist(rnd)};
+	FlatGrid<GridTestObj *> incremental(50), refilled(50);
+	for (size_t i = 0; i < objs.size(); ++i) incremental.insert(&objs[i], spans[i]);
+	for (int round = 0; round < 40; ++round) {
+		for (size_t i = 0; i < objs.size(); ++i) {
+			auto &o = objs[i];
+			if (i % 3 == 0) o.p += Vec(step(rnd), step(rnd), step(rnd));
+			if (i % 7 == round % 7) o.r = rdist(rnd); // covers more or fewer grid cells
+			if (round == 20 && i % 2) o.p = Vec(dist(rnd), dist(rnd), dist(rnd)) * 3.0;
+			incremental.update(&o, spans[i]);
+		}
+		refilled.clear();
+		for (auto &o : objs) refilled.insert(&o);
+		REQUIRE(incremental.size() == refilled.size());
+		for (auto &o : objs) REQUIRE(incremental.retrieve(&o) == refilled.retrieve(&o));
+		REQUIRE(incremental.getVolume() == refilled.getVolume());
+		REQUIRE(incremental.computeSurface() == refilled.computeSurface());
+		std::map<std::tuple<int, int, int>, size_t> incBuckets, refBuckets;
+		incremental.forEachBucket([&](int i, int j, int k, size_t n) {
+			incBuckets[std::make_tuple(i, j, k)] = n;
+		});
+		refilled.forEachBucket([&](int i, int j, int k, size_t n) {
+			refBuckets[std::make_tuple(i, j, k)] = n;
+		});
+		REQUIRE(incBuckets == refBuckets);
+		REQUIRE(incremental.getContent() == refilled.getContent());
+	}
+}
+
+TEST_CASE("Grid ray casts find the nearest sphere") {
+	std::default_random_engine rnd(11);
+	std::uniform_real_distribution<double> dist(-300, 300);
+	std::uniform_real_distribution<double> rdist(5, 60);
+	vector<GridTestObj> objs(300);
+	for (auto &o : objs) o = {Vec(dist(rnd), dist(rnd), dist(rnd)), rdist(rnd)};
+	Grid<GridTestObj *> g(50);
+	FlatGrid<GridTestObj *> fg(50);
+	for (auto &o : objs) {
+		g.insert(&o);
+		fg.insert(&o);
+	}
+	auto all = [](GridTestObj *) { return true; };
+	int nbHits = 0;
+	for (int r = 0; r < 200; ++r) {
+		Vec origin(dist(rnd) * 2, dist(rnd) * 2, dist(rnd) * 2);
+		Vec dir = (Vec(dist(rnd), dist(rnd), dist(rnd)) * 0.3 - origin).normalized();
+		GridTestObj *ref = nullptr;
+		double refT = 2000;
+		for (auto &o : objs) {
+			double t;
+			if (raySphere(origin, dir, o.p, o.r, t) && t < refT) {
+				refT = t;
+				ref = &o;
+			}
+		}
+		GridTestObj *hit = nullptr, *flatHit = nullptr;
+		double t, flatT;
+		REQUIRE(g.rayCast(origin, dir, 2000, all, hit, t) == (ref != nullptr));
+		REQUIRE(fg.rayCast(origin, dir, 2000, all, flatHit, flatT) == (ref != nullptr));
+		if (ref) {
+			++nbHits;
+			REQUIRE(hit == ref);
+			REQUIRE(flatHit == ref);
+			REQUIRE(doubleEq(t, refT));
+		}
+	}
+	REQUIRE(nbHits > 50);
+	// rejected objects are skipped
+	GridTestObj *hit = nullptr;
+	double t;
+	REQUIRE(!g.rayCast(Vec(-1000, 0, 0), Vec(1, 0, 0), 2000,
+	                   [](GridTestObj *) { return false; }, hit, t));
+}
+
+TEST_CASE("Sweep and prune finds the overlapping pairs") {
+	std::default_random_engine rnd(5);
+	std::uniform_real_distribution<double> dist(-300, 300);
+	std::uniform_real_distribution<double> rdist(2, 80);
+	std::uniform_real_distribution<double> move(-8, 8);
+	vector<GridTestObj> objs(300);
+	for (auto &o : objs) o = {Vec(dist(rnd), dist(rnd), dist(rnd)), rdist(rnd)};
+	vector<GridTestObj *> ptrs;
+	for (auto &o : objs) ptrs.push_back(&o);
+	auto overlap = [](const GridTestObj &a, const GridTestObj &b) {
+		return fabs(a.p.x - b.p.x) <= a.r + b.r && fabs(a.p.y - b.p.y) <= a.r + b.r &&
+		       fabs(a.p.z - b.p.z) <= a.r + b.r;
+	};
+	auto check = [&](const SweepAndPrune<GridTestObj *> &sap) {
+		std::set<pair<GridTestObj *, GridTestObj *>> found;
+		size_t nbPairs = 0;
+		sap.forEachPair([&](GridTestObj *a, GridTestObj *b) {
+			++nbPairs;
+			found.insert(make_pair(min(a, b), max(a, b)));
+		});
+		REQUIRE(nbPairs == found.size()); // each pair once
+		size_t expected = 0;
+		for (size_t i = 0; i < objs.size(); ++i)
+			for (size_t j = i + 1; j < objs.size(); ++j)
+				if (overlap(objs[i], objs[j])) {
+					++expected;
+					REQUIRE(found.count(make_pair(&objs[i], &objs[j])));
+				}
+		REQUIRE(found.size() == expected);
+		return expected;
+	};
+	SweepAndPrune<GridTestObj *> sap;
+	sap.rebuild(ptrs);
+	REQUIRE(sap.size() == objs.size());
+	REQUIRE(check(sap) > 50);
+	// small moves and growths: the list is sorted again incrementally
+	for (int f = 0; f < 10; ++f) {
+		for (auto &o : objs) {
+			o.p += Vec(move(rnd), move(rnd), move(rnd));
+			o.r *= 1.02;
+		}
+		sap.update();
+		check(sap);
+	}
+	// the cloud flattened along the sweep axis: another axis is chosen
+	const int axis = sap.getAxis();
+	for (auto &o : objs) {
+		double *c[3] = {&o.p.x, &o.p.y, &o.p.z};
+		*c[axis] *= 0.01;
+	}
+	sap.update();
+	REQUIRE(sap.getAxis() != axis);
+	check(sap);
+}
+
+TEST_CASE("Sweep and prune broad phase") {
+	auto run = [](BroadPhase b, size_t nbThreads, bool switchHalfway) {
+		BasicWorld<TestCell, Verlet> w;
+		w.setBroadPhase(b);
+		w.setNbThreads(nbThreads);
+		w.setBatchedForces(true); // same results with any number of threads
+		std::default_random_engine rnd(42);
+		std::uniform_real_distribution<double> dist(-150, 150);
+		std::uniform_real_distribution<double> rdist(5, 60);
+		for (int i = 0; i < 200; ++i) {
+			TestCell *c = new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd)));
+			c->setRadius(rdist(rnd));
+			w.addCell(c);
+		}
+		for (int f = 0; f < 40; ++f) {
+			if (switchHalfway && f == 20)
+				w.setBroadPhase(b == BroadPhase::grid ? BroadPhase::sweepAndPrune
+				                                      : BroadPhase::grid);
+			if (f == 10) w.addCell(new TestCell(Vec(0, 0, 0)));
+			w.update();
+		}
+		double res = 0;
+		for (auto &c : w.cells) res += c->getPosition().sqlength() + c->getNbConnections();
+		return res;
+	};
+	const double ref = run(BroadPhase::sweepAndPrune, 1, false);
+	REQUIRE(ref == run(BroadPhase::sweepAndPrune, 3, false));
+	REQUIRE(run(BroadPhase::grid, 1, true) == run(BroadPhase::grid, 2, true));
+
+	// same interpenetrating pairs as the grid. Each cell overlaps at most one other, so
+	// that no connection can prevent another one (see ConnectableCell::connection),
+	// whatever the order the pairs are found in
+	BasicWorld<TestCell, Verlet> g, s;
+	s.setBroadPhase(BroadPhase::sweepAndPrune);
+	std::default_random_engine rnd(3);
+	std::uniform_real_distribution<double> dist(-300, 300);
+	std::uniform_real_distribution<double> rdist(5, 60);
+	vector<pair<Vec, double>> spheres;
+	vector<int> nbOverlaps;
+	while (spheres.size() < 300) {
+		Vec p(dist(rnd), dist(rnd), dist(rnd));
+		double r = rdist(rnd);
+		vector<size_t> overlapping;
+		for (size_t i = 0; i < spheres.size(); ++i)
+			if ((spheres[i].first - p).length() <= spheres[i].second + r) overlapping.push_back(i);
+		if (overlapping.size() > 1 || (overlapping.size() == 1 && nbOverlaps[overlapping[0]]))
+			continue;
+		for (auto i : overlapping) ++nbOverlaps[i];
+		spheres.push_back(make_pair(p, r));
+		nbOverlaps.push_back(overlapping.size());
+	}
+	for (auto &sp : spheres) {
+		g.addCell(new TestCell(sp.first));
+		g.cells.back()->setRadius(sp.second);
+		s.addCell(new TestCell(sp.first));
+		s.cells.back()->setRadius(sp.second);
+	}
+	g.update();
+	s.update();
+	REQUIRE(s.getCellGrid().size() == 0);
+	REQUIRE(s.getCellSweep().size() == s.cells.size());
+	auto pairs = [](BasicWorld<TestCell, Verlet> &w) {
+		std::map<TestCell *, size_t> index;
+		for (size_t i = 0; i < w.cells.size(); ++i) index[w.cells[i]] = i;
+		std::set<pair<size_t, size_t>> res;
+		for (auto &c : w.connections) {
+			size_t a = index[c->getNode0()], b = index[c->getNode1()];
+			res.insert(make_pair(min(a, b), max(a, b)));
+		}
+		return res;
+	};
+	std::set<pair<size_t, size_t>> expected;
+	for (size_t i = 0; i < s.cells.size(); ++i)
+		for (size_t j = i + 1; j < s.cells.size(); ++j) {
+			double r = s.cells[i]->getRadius() + s.cells[j]->getRadius();
+			if ((s.cells[i]->getPosition() - s.cells[j]->getPosition()).sqlength() <= r * r)
+				expected.insert(make_pair(i, j));
+		}
+	REQUIRE(expected.size() > 20);
+	REQUIRE(pairs(g) == expected);
+	REQUIRE(pairs(s) == expected);
+	// picking works without the grid
+	for (int k = 0; k < 20; ++k) {
+		Vec origin(-500, dist(rnd), dist(rnd));
+		TestCell *hg = nullptr, *hs = nullptr;
+		double tg, ts;
+		auto all = [](TestCell *) { return true; };
+		bool found = g.rayCast(origin, Vec(1, 0, 0), 2000, all, hg, tg);
+		REQUIRE(s.rayCast(origin, Vec(1, 0, 0), 2000, all, hs, ts) == found);
+		if (found) REQUIRE(doubleEq(tg, ts));
+	}
+}
+
+TEST_CASE("ObjectPool reuses freed slots") {
+	ObjectPool<GridTestObj, 4> pool;
+	vector<GridTestObj *> objs;
+	for (int i = 0; i < 6; ++i) objs.push_back(pool.create(GridTestObj{Vec(i, 0, 0), 1.0}));
+	REQUIRE(pool.size() == 6);
+	REQUIRE(pool.capacity() == 8);
+	REQUIRE(objs[5]->p.x == 5);
+	GridTestObj *freed = objs[2];
+	pool.destroy(freed);
+	REQUIRE(pool.size() == 5);
+	REQUIRE(pool.create(GridTestObj{Vec::zero(), 2.0}) == freed);
+	REQUIRE(pool.capacity() == 8);
+}
+
+TEST_CASE("Connection slots stay consistent when cells die") {
+	BasicWorld<TestCell, Verlet> w;
+	std::default_random_engine rnd(3);
+	std::uniform_real_distribution<double> dist(-100, 100);
+	for (int i = 0; i < 200; ++i) w.addCell(new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd))));
+	for (int f = 0; f < 20; ++f) w.update();
+	for (size_t i = 0; i < w.cells.size(); i += 3) w.cells[i]->die();
+	w.update();
+	REQUIRE(w.cells.size() == 133);
+	REQUIRE(w.connectionPool.size() == w.connections.size());
+	for (size_t i = 0; i < w.connections.size(); ++i) {
+		auto *con = w.connections[i];
+		REQUIRE(con->worldSlot == i);
+		REQUIRE(con->getNode0()->getRWConnections()[con->nodeSlots.first] == con);
+		REQUIRE(con->getNode1()->getRWConnections()[con->nodeSlots.second] == con);
+		REQUIRE(con->getNode0()->getConnectedCells()[con->nodeSlots.first] == con->getNode1());
+		REQUIRE(con->getNode0()->isConnectedTo(con->getNode1()));
+	}
+}
+
+TEST_CASE("Cell handles") {
+	BasicWorld<TestCell, Verlet> w;
+	for (int i = 0; i < 10; ++i) w.addCell(new TestCell(Vec(i * 100.0, 0, 0)));
+	auto h = w.getHandle(w.cells[3]);
+	auto h2 = w.getHandle(w.cells[4]);
+	REQUIRE(w.getCell(h) == w.cells[3]);
+	w.cells[3]->die();
+	w.update();
+	REQUIRE(w.getCell(h) == nullptr);
+	REQUIRE(w.getCell(h2) != nullptr);
+	REQUIRE(w.getCell(h2)->getId() == h2.id);
+	w.removeAllCells();
+	REQUIRE(w.getCell(h2) == nullptr);
+}
+
+TEST_CASE("Locality reordering") {
+	std::default_random_engine rnd(5);
+	std::uniform_int_distribution<uint32_t> coord(0, 0x1FFFFF);
+	for (int i = 0; i < 100; ++i) {
+		uint32_t x = coord(rnd), y = coord(rnd), z = coord(rnd);
+		uint64_t ref = 0;
+		for (int b = 0; b < 21; ++b)
+			ref |= uint64_t(x >> b & 1) << (3 * b) | uint64_t(y >> b & 1) << (3 * b + 1) |
+			       uint64_t(z >> b & 1) << (3 * b + 2);
+		REQUIRE(Morton::encode(x, y, z) == ref);
+	}
+	// the same divisions with and without reordering (random streams are per cell)
+	BasicWorld<RandomCell, Verlet> w, reordered;
+	reordered.setLocalityReordering(10, 1.0);
+	for (auto *world : {&w, &reordered}) {
+		world->setRandomSeed(3);
+		for (int i = 0; i < 20; ++i)
+			world->addCell(
+			    new RandomCell(Vec(60.0 * (i % 4), 60.0 * (i / 4 % 3), 40.0 * (i / 12))));
+		for (int f = 0; f < 100; ++f) world->update();
+	}
+	REQUIRE(reordered.cells.size() == w.cells.size());
+	REQUIRE(reordered.meanConnectionIndexGap() < w.meanConnectionIndexGap());
+	double gap = w.meanConnectionIndexGap();
+	w.reorderCells();
+	REQUIRE(w.meanConnectionIndexGap() < 0.8 * gap);
+	for (size_t i = 0; i < w.connections.size(); ++i) {
+		auto *con = w.connections[i];
+		REQUIRE(con->worldSlot == i);
+		REQUIRE(con->getNode0()->getRWConnections()[con->nodeSlots.first] == con);
+		REQUIRE(con->getNode1()->getRWConnections()[con->nodeSlots.second] == con);
+	}
+	for (int f = 0; f < 10; ++f) w.update(); // grid refilled
+	REQUIRE(w.connectionPool.size() == w.connections.size());
+}
+
+TEST_CASE("PointerSet matches std::set") {
+	std::default_random_engine rnd(11);
+	vector<GridTestObj> objs(100);
+	std::uniform_int_distribution<size_t> pick(0, objs.size() - 1);
+	PointerSet<GridTestObj> ps;
+	std::set<GridTestObj *> ref;
+	for (int i = 0; i < 5000; ++i) {
+		GridTestObj *o = &objs[pick(rnd)];
+		if (ref.count(o)) {
+			ps.erase(o);
+			ref.erase(o);
+		} else {
+			ps.insert(o);
+			ref.insert(o);
+		}
+		REQUIRE(ps.size() == ref.size());
+	}
+	for (auto &o : objs) REQUIRE(ps.contains(&o) == (ref.count(&o) > 0));
+}
+
+TEST_CASE("SmallVector matches std::vector") {
+	std::default_random_engine rnd(12);
+	std::uniform_int_distribution<int> pick(0, 99);
+	SmallVector<int, 4> sv;
+	vector<int> ref;
+	for (int i = 0; i < 2000; ++i) {
+		// grows up to ~50 elements then shrinks back below the inline capacity
+		if (pick(rnd) < (i < 1000 ? 60 : 30)) {
+			sv.push_back(i);
+			ref.push_back(i);
+		} else if (!ref.empty()) {
+			size_t k = pick(rnd) % ref.size(); // erased as cells erase their connections
+			sv[k] = sv.back();
+			sv.pop_back();
+			ref[k] = ref.back();
+			ref.pop_back();
+		}
+		REQUIRE(sv.size() == ref.size());
+	}
+	REQUIRE(std::equal(ref.begin(), ref.end(), sv.begin()));
+	SmallVector<int, 4> copy(sv), assigned;
+	assigned = sv;
+	REQUIRE(std::equal(ref.begin(), ref.end(), copy.begin()));
+	REQUIRE(std::equal(ref.begin(), ref.end(), assigned.begin()));
+	sv.assign(3, 7);
+	REQUIRE((sv.size() == 3 && sv[2] == 7));
+}
+
+TEST_CASE("Connected cells lookup past the linear search") {
+	// a big cell connected to more cells than the inline lists and the linear search hold
+	BasicWorld<TestCell, Verlet> w;
+	TestCell *big = new TestCell(Vec::zero());
+	big->setRadius(150);
+	w.addCell(big);
+	std::default_random_engine rnd(4);
+	std::uniform_real_distribution<double> dist(-1, 1);
+	for (int i = 0; i < 60; ++i) {
+		Vec dir(dist(rnd), dist(rnd), dist(rnd));
+		w.addCell(new TestCell(dir.normalized() * 185.0));
+	}
+	w.update();
+	REQUIRE(big->getNbConnections() > 20);
+	for (int k = 0; k < 2; ++k) {
+		for (auto &c : w.cells)
+			REQUIRE(big->isConnectedTo(c) == (c != big && c->isConnectedTo(big)));
+		// back under the linear search limit
+		for (size_t i = 1; i < w.cells.size() && i < 55; ++i) w.cells[i]->die();
+		w.update();
+	}
+	REQUIRE(big->getNbConnections() <= 8);
+}
+
+TEST_CASE("FaceBVH finds all the faces a brute force search finds") {
+	std::default_random_engine rnd(5);
+	std::uniform_real_distribution<double> dist(-500, 500);
+	std::uniform_real_distribution<double> offset(-30, 30);
+	vector<Vec> vertices;
+	vector<Triangle> faces;
+	for (unsigned int i = 0; i < 300; ++i) {
+		Vec p(dist(rnd), dist(rnd), dist(rnd));
+		for (int j = 0; j < 3; ++j)
+			vertices.push_back(p + Vec(offset(rnd), offset(rnd), offset(rnd)));
+		faces.push_back(Triangle(3 * i, 3 * i + 1, 3 * i + 2));
+	}
+	auto bruteForce = [&](const Vec &c, double r) {
+		vector<unsigned int> res;
+		for (unsigned int f = 0; f < faces.size(); ++f) {
+			bool overlap = true;
+			for (int a = 0; a < 3; ++a) {
+				double mn = 1e300, mx = -1e300;
+				for (auto v : faces[f].indices) {
+					double x = a == 0 ? vertices[v].x : a == 1 ? vertices[v].y : vertices[v].z;
+					mn = min(mn, x);
+					mx = max(mx, x);
+				}
+				double cc = a == 0 ? c.x : a == 1 ? c.y : c.z;
+				if (mx < cc - r || mn > cc + r) overlap = false;
+			}
+			if (overlap) res.push_back(f);
+		}
+		return res;
+	};
+	FaceBVH bvh;
+	bvh.build(vertices, faces);
+	for (int pass = 0; pass < 2; ++pass) { // second pass after a refit
+		for (int q = 0; q < 200; ++q) {
+			Vec c(dist(rnd), dist(rnd), dist(rnd));
+			vector<unsigned int> found;
+			bvh.forEachFace(c, 60, [&](unsigned int f) { found.push_back(f); });
+			sort(found.begin(), found.end());
+			REQUIRE(unique(found.begin(), found.end()) == found.end());
+			auto expected = bruteForce(c, 60);
+			REQUIRE(includes(found.begin(), found.end(), expected.begin(), expected.end()));
+		}
+		for (auto &v : vertices) v = Vec(v.z, -v.x, v.y) * 0.8 + Vec(10, 20, 30);
+		bvh.refit(vertices, faces);
+	}
+}
+
+// cells falling on a tilted, scaled and translated plane
+double runModelWorld(bool lazy, bool fused = false) {
+	const char *path = "lazy_test_plane.obj";
+	{
+		std::ofstream obj(path);
+		obj << "vn 0 1 0\n";
+		for (int i = 0; i <= 10; ++i)
+			for (int j = 0; j <= 10; ++j) obj << "v " << i * 20 - 100 << " 0 " << j * 20 - 100 << "\n";
+		for (int i = 0; i < 10; ++i)
+			for (int j = 0; j < 10; ++j) {
+				int a = i * 11 + j + 1, b = a + 11;
+				obj << "f " << a << "//1 " << b << "//1 " << b + 1 << "//1\n";
+				obj << "f " << a << "//1 " << b + 1 << "//1 " << a + 1 << "//1\n";
+			}
+	}
+	BasicWorld<TestCell, Verlet> w;
+	w.setFusedPasses(fused);
+	w.setG(Vec(0, -20, 0));
+	w.addModel("plane", path);
+	Model &m = w.models.at("plane");
+	m.setLazyTransformation(lazy);
+	m.scale(Vec(3, 3, 3));
+	m.rotate(Rotation<Vec>(Vec(1, 0, 0.5).normalized(), 0.2));
+	m.translate(Vec(10, -5, 20));
+	std::default_random_engine rnd(3);
+	std::uniform_real_distribution<double> dist(-250, 250);
+	for (int i = 0; i < 100; ++i)
+		w.addCell(new TestCell(Vec(dist(rnd), 30 + (dist(rnd) + 250) * 0.5, dist(rnd))));
+	double res = 0;
+	for (int f = 0; f < 150; ++f) {
+		w.update();
+		if (f == 75) m.translate(Vec(0, 2, 0)); // the model moves under the cells
+	}
+	for (auto &c : w.cells)
+		res += c->getPosition().sqlength() + c->getRWModelConnections().size();
+	std::remove(path);
+	return res;
+}
+
+TEST_CASE("Lazy model transformations") {
+	REQUIRE(runModelWorld(false) == runModelWorld(true));
+	Matrix4x4 t;
+	t.scale(Vec(2, 0.5, 3));
+	t.rotate(Rotation<Vec>(Vec(0, 1, 1).normalized(), 1.2));
+	t.translate(Vec(4, -7, 2));
+	Vec p(3, 8, -1);
+	Vec q = t.inverted() * (t * p);
+	REQUIRE(doubleEq(p.x, q.x));
+	REQUIRE(doubleEq(p.y, q.y));
+	REQUIRE(doubleEq(p.z, q.z));
+}
+
+TEST_CASE("Cell - model contacts stay consistent") {
+	const char *path = "contacts_test_plane.obj";
+	{
+		std::ofstream obj(path);
+		obj << "vn 0 1 0\nv -500 0 -500\nv 500 0 -500\nv 500 0 500\nv -500 0 500\n"
+		    << "f 1//1 2//1 3//1\nf 1//1 3//1 4//1\n";
+	}
+	BasicWorld<TestCell, Verlet> w;
+	w.setG(Vec(0, -20, 0));
+	w.addModel("plane", path);
+	std::default_random_engine rnd(5);
+	std::uniform_real_distribution<double> dist(-200, 200);
+	for (int i = 0; i < 80; ++i)
+		w.addCell(new TestCell(Vec(dist(rnd), 30 + (dist(rnd) + 200) * 0.3, dist(rnd))));
+	// every contact is listed once by its cell, at its slot
+	auto consistent = [&]() {
+		size_t listed = 0;
+		for (auto &c : w.cells) {
+			listed += c->getRWModelConnections().size();
+			for (size_t s = 0; s < c->getRWModelConnections().size(); ++s) {
+				auto *cmc = c->getRWModelConnections()[s];
+				if (cmc->cellSlot != s || cmc->getCell() != c) return false;
+				if (cmc < &w.cellModelConnections[0] ||
+				    cmc > &w.cellModelConnections[w.cellModelConnections.size() - 1])
+					return false;
+			}
+		}
+		return listed == w.cellModelConnections.size();
+	};
+	for (int f = 0; f < 100; ++f) w.update();
+	REQUIRE(w.cellModelConnections.size() > 0);
+	REQUIRE(consistent());
+	for (size_t i = 0; i < w.cells.size(); i += 4) w.cells[i]->die();
+	w.update();
+	REQUIRE(w.cellModelConnections.size() > 0);
+	REQUIRE(consistent());
+	w.removeModel("plane");
+	REQUIRE(w.cellModelConnections.empty());
+	for (auto &c : w.cells) REQUIRE(c->getRWModelConnections().empty());
+	std::remove(path);
+}
+
+TEST_CASE("Trace events") {
+	REQUIRE(std::string(traceEventName(TraceEvent::potentialCollision)) ==
+	        "potential collision");
+	REQUIRE(std::string(traceEventName(TraceEvent::anchorProjected)) == "anchor projected");
+	REQUIRE(std::string(traceEventName(TraceEvent::modelRemoved)) == "model removed");
+	const char *path = "trace_test_plane.obj";
+	{
+		std::ofstream obj(path);
+		obj << "vn 0 1 0\nv -500 0 -500\nv 500 0 -500\nv 500 0 500\nv -500 0 500\n"
+		    << "f 1//1 2//1 3//1\nf 1//1 3//1 4//1\n";
+	}
+	BasicWorld<TestCell, Verlet> w;
+	w.setG(Vec(0, -20, 0));
+	w.addModel("plane", path);
+	std::default_random_engine rnd(7);
+	std::uniform_real_distribution<double> dist(-200, 200);
+	for (int i = 0; i < 40; ++i)
+		w.addCell(new TestCell(Vec(dist(rnd), 30 + (dist(rnd) + 200) * 0.3, dist(rnd))));
+	for (int f = 0; f < 60; ++f) w.update();
+	const TraceSink &sink = w.getTraceSink();
+#if MECACELL_TRACE
+	// each event is nested in the previous level's one, for the same cell, model and face:
+	// potential collision > collision > connection similarity, then connection updated
+	// (> anchor projected) or new connection. Deletions come after all the collisions
+	auto sameContact = [](const TraceRecord &a, const TraceRecord &b) {
+		return a.cell == b.cell && a.model == b.model && a.face == b.face;
+	};
+	const TraceRecord *potential = nullptr, *collision = nullptr, *prev = nullptr;
+	bool nested = true;
+	for (const auto &r : sink.getRecords()) {
+		switch (r.event) {
+			case TraceEvent::potentialCollision:
+				nested &= r.value == 0 || r.value == 1;
+				potential = &r;
+				collision = nullptr;
+				break;
+			case TraceEvent::collision:
+				nested &= potential && sameContact(*potential, r) && potential->value == 1;
+				collision = &r;
+				break;
+			case TraceEvent::connectionSimilarity:
+			case TraceEvent::connectionUpdated:
+			case TraceEvent::newConnection:
+				nested &= collision && sameContact(*collision, r);
+				nested &= prev->event == TraceEvent::collision ||
+				          prev->event == TraceEvent::connectionSimilarity;
+				break;
+			case TraceEvent::anchorProjected:
+				nested &= prev->event == TraceEvent::connectionUpdated && sameContact(*prev, r);
+				break;
+			default:
+				potential = collision = nullptr;
+		}
+		prev = &r;
+	}
+	REQUIRE(nested);
+	REQUIRE(sink.count(TraceEvent::newConnection) > 0);
+	REQUIRE(sink.count(TraceEvent::connectionUpdated) > 0);
+	// a collision either updates a contact or creates one
+	REQUIRE(sink.count(TraceEvent::collision) ==
+	        sink.count(TraceEvent::connectionUpdated) + sink.count(TraceEvent::newConnection));
+	REQUIRE(sink.count(TraceEvent::newConnection) - sink.count(TraceEvent::connectionDeleted) ==
+	        w.cellModelConnections.size());
+	w.removeModel("plane");
+	REQUIRE(sink.count(TraceEvent::modelRemoved) == 1);
+	REQUIRE(sink.getRecords().back().event == TraceEvent::modelRemoved);
+	w.getTraceSink().clear();
+	REQUIRE(sink.getRecords().empty());
+#else
+	// compiled out
+	REQUIRE(w.cellModelConnections.size() > 0);
+	REQUIRE(sink.getRecords().empty());
+#endif
+	std::remove(path);
+}
+
+TEST_CASE("Fused update passes") {
+	REQUIRE(runTestWorld(1, 100) == runTestWorld(1, 100, false, false, false, true));
+	REQUIRE(runTestWorld(3, 100) == runTestWorld(3, 100, false, false, false, true));
+	REQUIRE(runTestWorld(1, 100, true) == runTestWorld(1, 100, true, false, false, true));
+	REQUIRE(runModelWorld(false) == runModelWorld(false, true)); // with gravity
+}
+
+TEST_CASE("Spring only connections") {
+	using CMC = CellModelConnection<TestCell>;
+	// no joint state in cell - model connections
+	REQUIRE(sizeof(CMC::CMConnection) <
+	        sizeof(Connection<ModelConnectionPoint, TestCell *>) / 4);
+	TestCell c(Vec(0, 3, 0));
+	CMC::CSConnection sOnly({SpaceConnectionPoint(Vec::zero()), &c}, Spring(10, 1, 1));
+	Connection<SpaceConnectionPoint, TestCell *> full({SpaceConnectionPoint(Vec::zero()), &c},
+	                                                  Spring(10, 1, 1));
+	sOnly.computeForces(0.02);
+	full.computeForces(0.02);
+	REQUIRE(sOnly.getSc().length == full.getSc().length);
+	REQUIRE(sOnly.getSc().direction == full.getSc().direction);
+	REQUIRE(sOnly.getSc().prevLength == full.getSc().prevLength);
+	REQUIRE(c.getForce() == Vec(0, -2 * 10 * (3 - 1) / 2.0, 0));
+}
+
+TEST_CASE("Quaternion orientations") {
+	std::default_random_engine rnd(5);
+	std::normal_distribution<double> d(0, 1);
+	auto randomUnit = [&]() { return Vec(d(rnd), d(rnd), d(rnd)).normalized(); };
+	for (int i = 0; i < 100; ++i) {
+		Rotation<Vec> rot(randomUnit(), 0.2 + 0.02 * i);
+		Quaternion q(rot.teta, rot.n);
+		Basis<Vec> o;
+		o.updateWithRotation(rot);
+		// joint frames and directions (see Joint::setFrame & Joint::updateDirection)
+		Vec x = randomUnit();
+		Basis<Vec> b(x, x.ortho());
+		Rotation<Vec> r = rot.inverted() + Vec::getRotation(Basis<Vec>(), b);
+		Quaternion qr =
+		    q.conjugated() * Quaternion::betweenBases(Vec(1, 0, 0), Vec(0, 1, 0), b.X, b.Y);
+		Vec dirR = o.X.rotated(r.rotated(rot));
+		Vec dirQ = (q * qr) * Vec(1, 0, 0);
+		REQUIRE((dirR - b.X).length() < 1e-9);
+		REQUIRE((dirQ - b.X).length() < 1e-9);
+		REQUIRE(((q * qr) * Vec(0, 1, 0) - o.Y.rotated(r.rotated(rot))).length() < 1e-9);
+		// integration steps (see Orientable::addAngularDisplacement)
+		Vec dt = randomUnit() * 0.05;
+		Rotation<Vec> next = rot + dt;
+		Quaternion qNext = (Quaternion(dt.length(), dt / dt.length()) * q).normalized();
+		Basis<Vec> oNext;
+		oNext.updateWithRotation(next);
+		REQUIRE((qNext * Vec(1, 0, 0) - oNext.X).length() < 1e-9);
+		REQUIRE((qNext * Vec(0, 1, 0) - oNext.Y).length() < 1e-9);
+	}
+}
+
+TEST_CASE("OBJ loading and mesh cache") {
+	const char *path = "objmodel_test.obj";
+	const string cache = ObjModel::cachePath(path);
+	std::remove(cache.c_str());
+	{
+		std::ofstream obj(path);
+		obj << "# comment\n\nv 0 0 0\nv 1.5 0 0\r\nv\t0 2 -1e-3\nv 1 1 1\n"
+		    << "vt 0 0\nvt 1 0\nvt 0.5 1\nvn 0 0 1\no object\nusemtl x\n"
+		    << "f 1 2 3\nf 1/1 2/2 3/3\nf 1//1 2//1 3//1\nf 2/1/1 4/2/1 3/3/1\n"
+		    << "f -4/-3/-1 -3/-2/-1 -2/-1/-1\nf 1 2 3 4\nf 1 2\nf 1 a 3\n";
+	}
+	ObjModel m(path, true);
+	REQUIRE(m.vertices.size() == 4);
+	REQUIRE(m.vertices[2] == Vec(0, 2, -1e-3));
+	REQUIRE(m.uv.size() == 3);
+	REQUIRE(m.normals.size() == 1);
+	REQUIRE(m.faces.size() == 5); // non triangular and invalid faces are ignored
+	REQUIRE(!m.faces[0].hasUV);
+	REQUIRE(!m.faces[0].hasNormals);
+	REQUIRE(m.faces[1].hasUV);
+	REQUIRE(!m.faces[1].hasNormals);
+	REQUIRE(!m.faces[2].hasUV);
+	REQUIRE(m.faces[2].hasNormals);
+	REQUIRE(m.faces[3].v.indices == (array<unsigned int, 3>{{1, 3, 2}}));
+	REQUIRE(m.faces[4].v.indices == m.faces[0].v.indices); // relative indices
+	REQUIRE(m.faces[4].t.indices == m.faces[1].t.indices);
+	std::ifstream cached(cache, std::ios::binary);
+	REQUIRE(cached.good());
+	cached.close();
+
+	ObjModel c(path, true); // from the cache
+	REQUIRE(c.vertices == m.vertices);
+	REQUIRE(c.normals == m.normals);
+	REQUIRE(c.uv.size() == m.uv.size());
+	REQUIRE(c.faces.size() == m.faces.size());
+	for (size_t i = 0; i < c.faces.size(); ++i) {
+		REQUIRE(c.faces[i].v.indices == m.faces[i].v.indices);
+		REQUIRE(c.faces[i].n.indices == m.faces[i].n.indices);
+		REQUIRE(c.faces[i].hasUV == m.faces[i].hasUV);
+	}
+	std::remove(path);
+	std::remove(cache.c_str());
+}
+
+TEST_CASE("Shared model meshes") {
+	const char *path = "shared_mesh_test.obj";
+	{
+		std::ofstream obj(path);
+		obj << "vn 0 1 0\nv 0 0 0\nv 1 0 0\nv 0 0 1\nf 1//1 2//1 3//1\n";
+	}
+	using W = BasicWorld<TestCell, Verlet>;
+	{
+		W a, b;
+		a.addModel("m", path);
+		b.addModel("m", path);
+		Model &ma = a.models.at("m"), &mb = b.models.at("m");
+		REQUIRE(ma.mesh == mb.mesh); // parsed once
+		REQUIRE(ma.mesh.use_count() == 2);
+		REQUIRE(ma.mesh->faceNormals.size() == 1);
+		// each instance has its own transformation
+		ma.translate(Vec(0, 5, 0));
+		REQUIRE(ma.getVertex(1) == Vec(1, 5, 0));
+		REQUIRE(mb.getVertex(1) == Vec(1, 0, 0));
+		REQUIRE(ma.mesh->vertices[1] == Vec(1, 0, 0));
+		// lazy instances keep no geometry of their own
+		mb.setLazyTransformation(true);
+		mb.translate(Vec(0, 5, 0));
+		REQUIRE(mb.vertices.empty());
+		REQUIRE(mb.bvh.empty());
+		REQUIRE(mb.getVertex(1) == ma.getVertex(1));
+		// a mesh is loaded again once its file changed
+		{
+			std::ofstream obj(path);
+			obj << "v 0 0 0\nv 2 0 0\nv 0 0 2\nv 2 0 2\nf 1 2 3\nf 2 4 3\n";
+		}
+		Model mc(path);
+		REQUIRE(mc.mesh != ma.mesh);
+		REQUIRE(mc.getFaces().size() == 2);
+		REQUIRE(mc.mesh->faceNormals.empty());
+		REQUIRE(Mesh::load(path) == mc.mesh);
+	}
+	// no model left: the registry doesn't keep meshes alive
+	std::weak_ptr<const Mesh> w = Mesh::load(path);
+	REQUIRE(w.expired());
+	std::remove(path);
+}
+
+TEST_CASE("Mesh face adjacency") {
+	const char *path = "adjacency_test.obj";
+	{
+		// a 6x4 grid of quads, each split in 2 triangles
+		std::ofstream obj(path);
+		for (int i = 0; i <= 6; ++i)
+			for (int j = 0; j <= 4; ++j) obj << "v " << i << " 0 " << j << "\n";
+		for (int i = 0; i < 6; ++i)
+			for (int j = 0; j < 4; ++j) {
+				int a = i * 5 + j + 1, b = a + 5;
+				obj << "f " << a << " " << b << " " << b + 1 << "\nf " << a << " " << b + 1 << " "
+				    << a + 1 << "\n";
+			}
+	}
+	auto mesh = Mesh::load(path);
+	std::remove(path);
+	const auto &faces = mesh->faces;
+	REQUIRE(faces.size() == 48);
+	REQUIRE(mesh->vertexFaces.size() == mesh->vertices.size());
+	REQUIRE(mesh->faceNeighbours.size() == faces.size());
+	for (size_t v = 0; v < mesh->vertices.size(); ++v)
+		mesh->vertexFaces.forEach(v, [&](uint32_t f) {
+			const auto &id = faces[f].indices;
+			REQUIRE((id[0] == v || id[1] == v || id[2] == v));
+		});
+	// same as comparing every pair of faces
+	for (size_t i = 0; i < faces.size(); ++i) {
+		vector<uint32_t> expected;
+		for (size_t j = 0; j < faces.size(); ++j) {
+			if (i == j) continue;
+			bool shared = false;
+			for (auto a : faces[i].indices)
+				for (auto b : faces[j].indices) shared = shared || a == b;
+			if (shared) expected.push_back(j);
+		}
+		REQUIRE(vector<uint32_t>(mesh->faceNeighbours.rowBegin(i),
+		                         mesh->faceNeighbours.rowEnd(i)) == expected);
+		if (!expected.empty()) REQUIRE(mesh->faceNeighbours.contains(i, expected.back()));
+		REQUIRE(!mesh->faceNeighbours.contains(i, i));
+	}
+	// an inner vertex of the grid is used by 6 faces, an inner face touches 12 others
+	REQUIRE(mesh->vertexFaces.rowSize(6) == 6);
+	REQUIRE(mesh->faceNeighbours.rowSize(10) == 12);
+}
+
+template <typename W> double worldChecksum(W &w) {
+	double res = 0;
+	for (auto &c : w.cells)
+		res += c->getPosition().sqlength() + c->getVelocity().sqlength() +
+		       c->getNbConnections() + c->getRWModelConnections().size();
+	return res;
+}
+
+// records its force when its behaviour is updated (after the integration)
+class ForceProbeCell : public ConnectableCell<ForceProbeCell> {
+public:
+	Vec behaviorForce;
+	using ConnectableCell<ForceProbeCell>::ConnectableCell;
+	double getAdhesionWith(const ForceProbeCell *) { return 0.9; }
+	ForceProbeCell *updateBehavior(double) {
+		behaviorForce = getForce();
+		return nullptr;
+	}
+};
+
+TEST_CASE("Sleeping cells") {
+	BasicWorld<TestCell, Verlet> awake, sleeping, sleepingThreads, sleepingSoa;
+	sleeping.setSleeping(true);
+	sleepingThreads.setSleeping(true);
+	sleepingThreads.setNbThreads(3);
+	sleepingThreads.setBatchedForces(true);
+	sleeping.setBatchedForces(true);
+	sleepingSoa.setSleeping(true);
+	sleepingSoa.setBatchedForces(true);
+	sleepingSoa.setSoAIntegration(true); // only the awake cells are integrated
+	double ref = relaxationMaxSpeed(awake, 0.02);
+	REQUIRE(relaxationMaxSpeed(sleeping, 0.02) == ref); // falls asleep once at rest
+	relaxationMaxSpeed(sleepingThreads, 0.02);
+	REQUIRE(relaxationMaxSpeed(sleepingSoa, 0.02) == ref);
+	REQUIRE(sleeping.getNbSleepingCells() == sleeping.cells.size());
+	REQUIRE(worldChecksum(sleepingThreads) == worldChecksum(sleeping));
+	REQUIRE(worldChecksum(sleepingSoa) == worldChecksum(sleeping));
+	for (size_t i = 0; i < awake.cells.size(); ++i)
+		REQUIRE((awake.cells[i]->getPosition() - sleeping.cells[i]->getPosition()).length() <
+		        0.01 * DEFAULT_CELL_RADIUS);
+	// a sleeping cluster stays still
+	Vec p0 = sleeping.cells[0]->getPosition();
+	for (int f = 0; f < 10; ++f) sleeping.update();
+	REQUIRE(sleeping.cells[0]->getPosition() == p0);
+	// a kicked cell wakes its neighbours up
+	TestCell *kicked = sleeping.cells[13];
+	TestCell *neighbour = kicked->getConnectedCells()[0];
+	Vec n0 = neighbour->getPosition();
+	kicked->wakeUp();
+	kicked->setVelocity(Vec(20, 0, 0));
+	sleeping.update();
+	REQUIRE(!kicked->isAsleep());
+	for (auto &n : kicked->getConnectedCells()) REQUIRE(!n->isAsleep());
+	sleeping.update();
+	REQUIRE(neighbour->getPosition() != n0);
+	// new cells and disabled sleeping
+	sleeping.addCell(new TestCell(Vec(300, 0, 0)));
+	REQUIRE(!sleeping.cells.back()->isAsleep());
+	sleeping.setSleeping(false);
+	REQUIRE(sleeping.getNbSleepingCells() == 0);
+
+	// with fused passes, the forces are still there when the sleep is decided: a falling
+	// cell (slower than the speed threshold) doesn't fall asleep
+	auto fall = [](bool fused) {
+		BasicWorld<TestCell, Verlet> w;
+		w.setFusedPasses(fused);
+		w.setG(Vec(0, -1, 0));
+		w.setSleepThresholds(1e9, 1e9, 1e-6);
+		w.setSleeping(true, 5);
+		w.addCell(new TestCell(Vec(0, 0, 0)));
+		for (int f = 0; f < 20; ++f) w.update();
+		REQUIRE(!w.cells[0]->isAsleep());
+		return w.cells[0]->getPosition();
+	};
+	REQUIRE(fall(true) == fall(false));
+	// a relaxing cluster falls asleep at the same frames
+	{
+		BasicWorld<TestCell, Verlet> fused;
+		fused.setFusedPasses(true);
+		fused.setSleeping(true);
+		fused.setBatchedForces(true);
+		REQUIRE(relaxationMaxSpeed(fused, 0.02) == ref);
+		REQUIRE(fused.getNbSleepingCells() == fused.cells.size());
+	}
+	// sleeping cells get the same forces with and without SoA integration
+	{
+		BasicWorld<ForceProbeCell, Verlet> scalar, soa;
+		for (auto *w : {&scalar, &soa}) {
+			w->setFusedPasses(true);
+			w->setSleeping(true);
+			w->setBatchedForces(true);
+			w->setG(Vec(0, -0.01, 0));
+		}
+		soa.setSoAIntegration(true);
+		relaxationMaxSpeed(scalar, 0.02);
+		relaxationMaxSpeed(soa, 0.02);
+		REQUIRE(soa.getNbSleepingCells() > 0);
+		REQUIRE(soa.getNbSleepingCells() == scalar.getNbSleepingCells());
+		for (size_t i = 0; i < soa.cells.size(); ++i) {
+			REQUIRE(soa.cells[i]->behaviorForce == scalar.cells[i]->behaviorForce);
+			REQUIRE(soa.cells[i]->getPosition() == scalar.cells[i]->getPosition());
+		}
+	}
+}
+
+TEST_CASE("Checkpoint and restart") {
+	const char *path = "checkpoint_test.mcc";
+	// cells only, with a few deaths
+	auto populate = [](BasicWorld<TestCell, Verlet> &w) {
+		std::default_random_engine rnd(7);
+		std::uniform_real_distribution<double> dist(-150, 150);
+		for (int i = 0; i < 200; ++i)
+			w.addCell(new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd))));
+	};
+	BasicWorld<TestCell, Verlet> ref;
+	populate(ref);
+	for (int f = 0; f < 30; ++f) ref.update();
+	for (size_t i = 0; i < ref.cells.size(); i += 17) ref.cells[i]->die();
+	ref.update();
+	REQUIRE(ref.saveCheckpoint(path));
+	for (int f = 0; f < 30; ++f) ref.update();
+
+	BasicWorld<TestCell, Verlet> restarted;
+	populate(restarted); // replaced by the checkpoint's cells
+	REQUIRE(restarted.loadCheckpoint(path));
+	REQUIRE(restarted.getNbUpdates() == 31);
+	for (int f = 0; f < 30; ++f) restarted.update();
+	REQUIRE(restarted.cells.size() == ref.cells.size());
+	REQUIRE(restarted.connections.size() == ref.connections.size());
+	REQUIRE(worldChecksum(restarted) == worldChecksum(ref));
+
+	// asynchronous write, then a restart with models
+	const char *objPath = "checkpoint_test_plane.obj";
+	{
+		std::ofstream obj(objPath);
+		obj << "vn 0 1 0\nv -500 0 -500\nv 500 0 -500\nv 500 0 500\nv -500 0 500\n"
+		    << "f 1//1 2//1 3//1\nf 1//1 3//1 4//1\n";
+	}
+	auto withModel = [&](BasicWorld<TestCell, Verlet> &w) {
+		w.setG(Vec(0, -20, 0));
+		w.addModel("plane", objPath);
+	};
+	BasicWorld<TestCell, Verlet> refModel;
+	withModel(refModel);
+	std::default_random_engine rnd(3);
+	std::uniform_real_distribution<double> dist(-200, 200);
+	for (int i = 0; i < 60; ++i)
+		refModel.addCell(new TestCell(Vec(dist(rnd), 30 + (dist(rnd) + 200) * 0.3, dist(rnd))));
+	for (int f = 0; f < 100; ++f) refModel.update();
+	refModel.models.at("plane").translate(Vec(0, 1, 0));
+	REQUIRE(refModel.saveCheckpoint(path, true));
+	for (int f = 0; f < 50; ++f) refModel.update();
+	REQUIRE(refModel.waitForCheckpoint());
+	size_t nbModelConnections = 0;
+	for (auto &c : refModel.cells) nbModelConnections += c->getRWModelConnections().size();
+	REQUIRE(nbModelConnections > 0);
+
+	BasicWorld<TestCell, Verlet> restartedModel;
+	REQUIRE(!restartedModel.loadCheckpoint(path)); // no plane
+	withModel(restartedModel);
+	REQUIRE(restartedModel.loadCheckpoint(path));
+	for (int f = 0; f < 50; ++f) restartedModel.update();
+	REQUIRE(worldChecksum(restartedModel) == worldChecksum(refModel));
+
+	// truncated files are rejected
+	vector<char> data;
+	REQUIRE(readFile(path, data));
+	data.resize(data.size() / 2);
+	REQUIRE(writeFileAtomically(path, data));
+	REQUIRE(!restartedModel.loadCheckpoint(path));
+	REQUIRE(restartedModel.cells.empty());
+	std::remove(path);
+	std::remove(objPath);
+}
+
+TEST_CASE("Trajectory output") {
+	for (int compress = 0; compress < 2; ++compress) {
+		const char *path = "trajectory_test.mct";
+		BasicWorld<TestCell, Verlet> w;
+		std::default_random_engine rnd(11);
+		std::uniform_real_distribution<double> dist(-150, 150);
+		for (int i = 0; i < 200; ++i) w.addCell(new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd))));
+		vector<TrajectoryFrame> expected;
+		{
+			TrajectoryWriter out(path, 5, compress, 2);
+			REQUIRE(out.isOpen());
+			REQUIRE(out.isCompressed() == (compress && compressionAvailable()));
+			out.attach(w);
+			// what the writer should see at each recorded frame
+			w.addUpdateHook([&](BasicWorld<TestCell, Verlet> &world) {
+				if (world.getNbUpdates() % 5) return;
+				TrajectoryFrame f;
+				f.frame = world.getNbUpdates();
+				for (auto &c : world.cells) {
+					f.x.push_back(c->getPosition().x);
+					f.y.push_back(c->getPosition().y);
+					f.z.push_back(c->getPosition().z);
+					f.radius.push_back(c->getRadius());
+					f.pressure.push_back(c->getPressure());
+				}
+				for (auto &con : world.connections) {
+					auto c0 = find(world.cells.begin(), world.cells.end(), con->getNode0());
+					auto c1 = find(world.cells.begin(), world.cells.end(), con->getNode1());
+					f.node0.push_back(c0 - world.cells.begin());
+					f.node1.push_back(c1 - world.cells.begin());
+				}
+				expected.push_back(f);
+			});
+			for (int f = 0; f < 52; ++f) w.update();
+			REQUIRE(out.flush());
+			REQUIRE(out.getNbFramesWritten() == 10);
+		}
+		TrajectoryReader in(path);
+		REQUIRE(in.isValid());
+		TrajectoryFrame f;
+		size_t nbFrames = 0;
+		while (in.next(f)) {
+			REQUIRE(nbFrames < expected.size());
+			const auto &e = expected[nbFrames++];
+			REQUIRE(f.frame == e.frame);
+			REQUIRE(f.x == e.x);
+			REQUIRE(f.y == e.y);
+			REQUIRE(f.z == e.z);
+			REQUIRE(f.radius == e.radius);
+			REQUIRE(f.pressure == e.pressure);
+			REQUIRE(f.node0 == e.node0);
+			REQUIRE(f.node1 == e.node1);
+		}
+		REQUIRE(nbFrames == 10);
+		REQUIRE(expected.back().nbConnections() > 0);
+		std::remove(path);
+	}
+}
+
+TEST_CASE("Profiling stats") {
+	BasicWorld<TestCell, Verlet> w;
+	std::default_random_engine rnd(12);
+	std::uniform_real_distribution<double> dist(-150, 150);
+	for (int i = 0; i < 200; ++i) w.addCell(new TestCell(Vec(dist(rnd), dist(rnd), dist(rnd))));
+	for (int f = 0; f < 20; ++f) w.update();
+	const auto &p = w.getProfileStats();
+#if MECACELL_PROFILING
+	REQUIRE(p.nbUpdates == 20);
+	// every phase runs at each update
+	for (size_t i = 0; i < ProfileStats::NB_PHASES; ++i) REQUIRE(p.seconds[i] > 0);
+	REQUIRE(p.getTotalSeconds() > 0);
+	REQUIRE(p.getCount(ProfileCounter::gridInserts) == 20 * 200); // refilled at each update
+	REQUIRE(p.getCount(ProfileCounter::connectionsCreated) >= w.connections.size());
+	REQUIRE(p.getCount(ProfileCounter::connectionsCreated) -
+	            p.getCount(ProfileCounter::connectionsDeleted) ==
+	        w.connections.size());
+	REQUIRE(p.getCount(ProfileCounter::cellModelContacts) == 0);
+	REQUIRE(p.getCount(ProfileCounter::sleepingCells) == 0);
+	// summed over the updates
+	BasicWorld<TestCell, Verlet> sleeping;
+	sleeping.setSleeping(true);
+	uint64_t nbSleeping = 0;
+	sleeping.addUpdateHook(
+	    [&](BasicWorld<TestCell, Verlet> &s) { nbSleeping += s.getNbSleepingCells(); });
+	relaxationMaxSpeed(sleeping, 0.02);
+	REQUIRE(nbSleeping > 0);
+	REQUIRE(sleeping.getProfileStats().getCount(ProfileCounter::sleepingCells) == nbSleeping);
+	REQUIRE(sleeping.getProfileStats().nbUpdates ==
+	        static_cast<uint64_t>(sleeping.getNbUpdates()));
+#else
+	// compiled out
+	REQUIRE(p.nbUpdates == 0);
+	REQUIRE(p.getTotalSeconds() == 0);
+	for (size_t i = 0; i < ProfileStats::NB_COUNTERS; ++i) REQUIRE(p.counters[i] == 0);
+#endif
+	w.resetProfileStats();
+	REQUIRE(w.getProfileStats().nbUpdates == 0);
+	REQUIRE(w.getProfileStats().getCount(ProfileCounter::gridInserts) == 0);
 }